@@ -540,28 +540,36 @@ void MapViewerWind::on_button_load_maps_clicked() {
   std::list<std::pair<QString, std::string>> error_list;
   std::mutex lock;
 
-#pragma omp parallel for schedule(static)
-  for (int idx = 0; idx < filenames.size(); idx++) {
+#pragma omp parallel
+  {
+    // reused by all files processed by this thread
+    std::vector<uint8_t> inflate_buffer;
     std::string error_info;
-    if (!process_map_file(filenames[idx].toLocal8Bit().data(),
-                          (this->maps[idx].map_content).get(), &error_info)) {
-      lock.lock();
-
-      error_list.emplace_back(filenames[idx], error_info);
-
-      this->maps[idx].filename = "";
-
-      lock.unlock();
-    } else {
-      const int last_idx_of_reverse_slash = filenames[idx].lastIndexOf('\\');
-      const int last_idx_of_slash = filenames[idx].lastIndexOf('/');
-      const int last_idx_of_seperator =
-          std::max(last_idx_of_reverse_slash, last_idx_of_slash);
-
-      const int basename_length =
-          filenames[idx].length() - last_idx_of_seperator - 1;
-
-      this->maps[idx].filename = filenames[idx].last(basename_length);
+#pragma omp for schedule(dynamic, 16)
+    for (int idx = 0; idx < filenames.size(); idx++) {
+      error_info.clear();
+      if (!process_map_file(filenames[idx].toLocal8Bit().data(),
+                            (this->maps[idx].map_content).get(), &error_info,
+                            &inflate_buffer)) {
+        lock.lock();
+
+        error_list.emplace_back(filenames[idx], error_info);
+
+        this->maps[idx].filename = "";
+
+        lock.unlock();
+      } else {
+        const int last_idx_of_reverse_slash =
+            filenames[idx].lastIndexOf('\\');
+        const int last_idx_of_slash = filenames[idx].lastIndexOf('/');
+        const int last_idx_of_seperator =
+            std::max(last_idx_of_reverse_slash, last_idx_of_slash);
+
+        const int basename_length =
+            filenames[idx].length() - last_idx_of_seperator - 1;
+
+        this->maps[idx].filename = filenames[idx].last(basename_length);
+      }
     }
   }
 
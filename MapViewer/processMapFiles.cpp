@@ -22,14 +22,16 @@ This file is part of SlopeCraft.
 
 #include "processMapFiles.h"
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
-#include <fstream>
+#include <functional>
+#include <span>
+#include <string_view>
 #include <vector>
 #include <zlib.h>
 
-#include <iostream>
-
-using std::cout, std::endl;
+constexpr size_t map_color_bytes = 128 * 128 * sizeof(uint8_t);
 
 bool uncompress_map_file(const char *filename, std::vector<uint8_t> *const dest,
                          std::string *const error_info);
@@ -39,11 +41,6 @@ const uint8_t *find_color_begin(const std::vector<uint8_t> &inflated,
 
 bool uncompress_map_file(const char *filename, std::vector<uint8_t> *const dest,
                          std::string *const error_info) {
-  dest->clear();
-
-  const size_t source_size = std::filesystem::file_size(filename);
-  dest->reserve(4 * source_size);
-
   gzFile gz_file = ::gzopen(filename, "rb");
 
   if (gz_file == nullptr) {
@@ -56,24 +53,215 @@ bool uncompress_map_file(const char *filename, std::vector<uint8_t> *const dest,
     }
     return false;
   }
+  ::gzbuffer(gz_file, 64 * 1024);
+
+  // The buffer may be reused across files, so its capacity is kept. A map file
+  // inflates to a little more than 128*128 bytes.
+  std::error_code ec;
+  const size_t source_size = std::filesystem::file_size(filename, ec);
+  size_t inflated_size = 0;
+  dest->resize(std::max<size_t>({dest->capacity(), 4 * source_size,
+                                 2 * map_color_bytes}));
 
   while (true) {
-    dest->emplace_back();
-    if (::gzfread(&dest->back(), 1, 1, gz_file) <= 0) {
-      dest->pop_back();
+    if (inflated_size >= dest->size()) {
+      dest->resize(2 * dest->size());
+    }
+    const size_t free_bytes =
+        std::min<size_t>(dest->size() - inflated_size, INT32_MAX);
+    const int bytes = ::gzread(gz_file, dest->data() + inflated_size,
+                               static_cast<unsigned>(free_bytes));
+    if (bytes < 0) {
+      int errnum = 0;
+      const char *msg = ::gzerror(gz_file, &errnum);
+      if (error_info != nullptr) {
+        *error_info = "Failed to inflate map data file ";
+        *error_info += filename;
+        *error_info += ": ";
+        *error_info += msg;
+      }
+      ::gzclose(gz_file);
+      dest->clear();
+      return false;
+    }
+    if (bytes == 0) {
       break;
     }
+    inflated_size += bytes;
   }
 
   ::gzclose(gz_file);
-  dest->shrink_to_fit();
+  dest->resize(inflated_size);
 
   return true;
 }
 
+namespace {
+// Walks the NBT tree without building it, looking for the byte array named
+// "colors" that holds 128*128 bytes.
+class nbt_color_finder {
+ public:
+  explicit nbt_color_finder(std::span<const uint8_t> data) : data_{data} {}
+
+  const uint8_t *find() noexcept {
+    uint8_t root_type = 0;
+    if (!this->read(&root_type) || root_type != tag_compound) {
+      return nullptr;
+    }
+    if (!this->skip_string()) {
+      return nullptr;
+    }
+    this->walk_compound(0);
+    return this->found_;
+  }
+
+ private:
+  static constexpr uint8_t tag_end = 0;
+  static constexpr uint8_t tag_byte_array = 7;
+  static constexpr uint8_t tag_string = 8;
+  static constexpr uint8_t tag_list = 9;
+  static constexpr uint8_t tag_compound = 10;
+  static constexpr uint8_t tag_int_array = 11;
+  static constexpr uint8_t tag_long_array = 12;
+  static constexpr int max_depth = 512;
+
+  std::span<const uint8_t> data_;
+  size_t pos_{0};
+  const uint8_t *found_{nullptr};
+
+  size_t remaining() const noexcept { return this->data_.size() - this->pos_; }
+
+  template <typename int_t>
+  bool read(int_t *val) noexcept {
+    if (this->remaining() < sizeof(int_t)) {
+      return false;
+    }
+    // NBT is big endian
+    std::make_unsigned_t<int_t> v = 0;
+    for (size_t i = 0; i < sizeof(int_t); i++) {
+      v = (v << 8) | this->data_[this->pos_ + i];
+    }
+    *val = static_cast<int_t>(v);
+    this->pos_ += sizeof(int_t);
+    return true;
+  }
+
+  bool skip(size_t bytes) noexcept {
+    if (this->remaining() < bytes) {
+      return false;
+    }
+    this->pos_ += bytes;
+    return true;
+  }
+
+  bool skip_string() noexcept {
+    uint16_t length = 0;
+    return this->read(&length) && this->skip(length);
+  }
+
+  bool skip_array(size_t element_bytes) noexcept {
+    int32_t length = 0;
+    if (!this->read(&length) || length < 0) {
+      return false;
+    }
+    return this->skip(size_t(length) * element_bytes);
+  }
+
+  static int fixed_payload_bytes(uint8_t type) noexcept {
+    constexpr int bytes[] = {0, 1, 2, 4, 8, 4, 8};
+    if (type < sizeof(bytes) / sizeof(int)) {
+      return bytes[type];
+    }
+    return -1;
+  }
+
+  // Returns false if the data is broken or the colors are found.
+  bool walk_compound(int depth) noexcept {
+    while (true) {
+      uint8_t type = 0;
+      if (!this->read(&type)) {
+        return false;
+      }
+      if (type == tag_end) {
+        return true;
+      }
+      uint16_t name_length = 0;
+      if (!this->read(&name_length) || this->remaining() < name_length) {
+        return false;
+      }
+      const std::string_view name{
+          reinterpret_cast<const char *>(this->data_.data() + this->pos_),
+          name_length};
+      this->pos_ += name_length;
+
+      if (type == tag_byte_array && name == "colors") {
+        int32_t length = 0;
+        if (!this->read(&length) || length < 0) {
+          return false;
+        }
+        if (size_t(length) == map_color_bytes &&
+            this->remaining() >= map_color_bytes) {
+          this->found_ = this->data_.data() + this->pos_;
+          return false;
+        }
+        if (!this->skip(length)) {
+          return false;
+        }
+        continue;
+      }
+
+      if (!this->walk_payload(type, depth + 1)) {
+        return false;
+      }
+    }
+  }
+
+  bool walk_payload(uint8_t type, int depth) noexcept {
+    if (depth > max_depth) {
+      return false;
+    }
+    const int fixed_bytes = fixed_payload_bytes(type);
+    if (fixed_bytes >= 0) {
+      return this->skip(fixed_bytes);
+    }
+    switch (type) {
+      case tag_byte_array:
+        return this->skip_array(1);
+      case tag_string:
+        return this->skip_string();
+      case tag_int_array:
+        return this->skip_array(4);
+      case tag_long_array:
+        return this->skip_array(8);
+      case tag_compound:
+        return this->walk_compound(depth);
+      case tag_list: {
+        uint8_t element_type = 0;
+        int32_t length = 0;
+        if (!this->read(&element_type) || !this->read(&length) || length < 0) {
+          return false;
+        }
+        const int element_bytes = fixed_payload_bytes(element_type);
+        if (element_bytes >= 0) {
+          return this->skip(size_t(length) * element_bytes);
+        }
+        for (int32_t i = 0; i < length; i++) {
+          if (!this->walk_payload(element_type, depth + 1)) {
+            return false;
+          }
+        }
+        return true;
+      }
+      default:
+        return false;
+    }
+  }
+};
+}  // namespace
+
 const uint8_t *find_color_begin(const std::vector<uint8_t> &inflated,
                                 std::string *const error_info) {
-  if (inflated.size() <= 128 * 128 * sizeof(char)) {
+  if (inflated.size() <= map_color_bytes) {
     if (error_info != nullptr) {
       *error_info =
           "The inflated file content is invalid. The file size is " +
@@ -83,30 +271,29 @@ const uint8_t *find_color_begin(const std::vector<uint8_t> &inflated,
     return nullptr;
   }
 
-  // std::vector<const uint8_t *> possiblePtrs;
+  {
+    const uint8_t *colors = nbt_color_finder{inflated}.find();
+    if (colors != nullptr) {
+      return colors;
+    }
+  }
 
+  // The nbt may be broken somewhere else, so fall back to searching the tag
+  // header of colors directly.
   constexpr uint8_t feature[] = {0x07, 0x00, 0x06, 0x63, 0x6F, 0x6C, 0x6F,
                                  0x72, 0x73, 0x00, 0x00, 0x40, 0x00};
-  constexpr size_t feature_length = sizeof(feature) / sizeof(uint8_t);
-  for (const uint8_t *ptr = inflated.data();
-       ptr != inflated.data() + inflated.size(); ptr++) {
-    if (ptr[0] != feature[0]) {
-      continue;
-    }
-    // cout<<"found the header of feature"<<endl;
-    bool same = true;
-    for (size_t idx = 1; idx < feature_length; idx++) {
-      same = same && (ptr[idx] == feature[idx]);
-    }
-
-    if (same) {
-      const size_t left_bytes =
-          inflated.data() + inflated.size() - (ptr + feature_length);
-      if (left_bytes >= 128 * 128 * sizeof(uint8_t)) {
-        // cout<<"found feature, but left bytes are too few"<<endl;
-        return ptr + feature_length;
-      }
+  const std::boyer_moore_horspool_searcher searcher{std::begin(feature),
+                                                    std::end(feature)};
+  for (auto it = inflated.begin(); it != inflated.end();) {
+    it = std::search(it, inflated.end(), searcher);
+    if (it == inflated.end()) {
+      break;
+    }
+    const size_t offset = (it - inflated.begin()) + sizeof(feature);
+    if (inflated.size() - offset >= map_color_bytes) {
+      return inflated.data() + offset;
     }
+    ++it;
   }
 
   if (error_info != nullptr) {
@@ -114,15 +301,13 @@ const uint8_t *find_color_begin(const std::vector<uint8_t> &inflated,
                   "file may be invalid.";
   }
 
-  // cout<<"failed to find feature"<<endl;
-
   return nullptr;
 }
 
 bool process_map_file(
     const char *filename,
     Eigen::Array<uint8_t, 128, 128, Eigen::RowMajor> *const dest,
-    std::string *const error_info) {
+    std::string *const error_info, std::vector<uint8_t> *inflate_buffer) {
 
   if (filename == nullptr || strlen(filename) <= 0) {
     if (error_info != nullptr)
@@ -136,15 +321,19 @@ bool process_map_file(
     return false;
   }
 
-  if ((!std::filesystem::exists(filename)) ||
-      (!std::filesystem::is_regular_file(filename))) {
-    if (error_info != nullptr)
-      *error_info = std::string("File ") + filename +
-                    " doesn't exist, otherwise it is not a regular file.";
-    return false;
+  {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(filename, ec)) {
+      if (error_info != nullptr)
+        *error_info = std::string("File ") + filename +
+                      " doesn't exist, otherwise it is not a regular file.";
+      return false;
+    }
   }
 
-  std::vector<uint8_t> inflated;
+  std::vector<uint8_t> local_buffer;
+  std::vector<uint8_t> &inflated =
+      (inflate_buffer != nullptr) ? *inflate_buffer : local_buffer;
 
   if (!uncompress_map_file(filename, &inflated, error_info)) {
     return false;
@@ -156,7 +345,7 @@ bool process_map_file(
     return false;
   }
 
-  memcpy(dest->data(), color_ptr, 128 * 128 * sizeof(uint8_t));
+  memcpy(dest->data(), color_ptr, map_color_bytes);
 
   return true;
 }
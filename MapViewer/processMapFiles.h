@@ -33,9 +33,12 @@ This file is part of SlopeCraft.
 
 // const uint8_t * find_color_begin(const std::vector<uint8_t>&inflated);
 
+// inflate_buffer is optional. Pass the same buffer when loading many files to
+// avoid reallocating for each file.
 bool process_map_file(
     const char *filename,
     Eigen::Array<uint8_t, 128, 128, Eigen::RowMajor> *const dest,
-    std::string *const error_info);
+    std::string *const error_info,
+    std::vector<uint8_t> *inflate_buffer = nullptr);
 
 #endif // PROCESSMAPFILES_H
@@ -6,6 +6,10 @@
 #include <QTableWidget>
 #include <magic_enum/magic_enum.hpp>
 #include <QDesktopServices>
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QThread>
+#include <string>
 
 const QString SCWind::update_url{
     "https://api.github.com/repos/SlopeCraft/SlopeCraft/releases"};
@@ -202,8 +206,10 @@ SCWind::SCWind(QWidget *parent) : QMainWindow(parent), ui(new Ui::SCWind) {
 SCWind::~SCWind() {
   delete this->ui;
   {
-    QDir cache_dir{this->cache_root_dir()};
+    const QString cache_dir_name = this->cache_root_dir();
+    QDir cache_dir{cache_dir_name};
     if (cache_dir.exists()) {
+      SCL_forget_caches(cache_dir_name.toLocal8Bit().data());
       cache_dir.removeRecursively();
     }
   }
@@ -710,7 +716,7 @@ SCWind::convert_image(int idx) noexcept {
 }
 
 std::unique_ptr<SlopeCraft::converted_image, SlopeCraft::deleter>
-SCWind::convert_image(const cvt_task &task) noexcept {
+SCWind::convert_image(const cvt_task &task, bool in_background) noexcept {
   auto ctable = this->current_color_table();
   if (ctable == nullptr) {
     QMessageBox::critical(
@@ -742,13 +748,124 @@ SCWind::convert_image(const cvt_task &task) noexcept {
         .rows = static_cast<size_t>(raw.height()),
         .cols = static_cast<size_t>(raw.width()),
     };
-    auto cvted_img = ctable->convert_image(img, this->current_convert_option());
+    const auto option = this->current_convert_option();
+    // Colors matched with another block list are reused, so that changing a
+    // few blocks doesn't match every color again.
+    const SlopeCraft::converted_image *previous{nullptr};
+    for (const auto &[input, result] : task.converted_images) {
+      if (input.table != ctable && input.option.algo == option.algo &&
+          result.converted_image != nullptr) {
+        previous = result.converted_image.get();
+        break;
+      }
+    }
+    auto convert = [ctable, img, previous](
+                       const SlopeCraft::convert_option &opt) {
+      return (previous == nullptr)
+                 ? ctable->convert_image(img, opt)
+                 : ctable->convert_image_incremental(img, opt, *previous);
+    };
+    auto cvted_img = in_background
+                         ? this->convert_in_background(option, raw.size(),
+                                                       convert)
+                         : convert(option);
 
     return std::unique_ptr<SlopeCraft::converted_image, SlopeCraft::deleter>{
         cvted_img};
   }
 }
 
+SlopeCraft::converted_image *SCWind::convert_in_background(
+    SlopeCraft::convert_option option, QSize raw_size,
+    const std::function<SlopeCraft::converted_image *(
+        const SlopeCraft::convert_option &)> &convert) noexcept {
+  // Callbacks are called in the worker thread, so they post to the gui
+  // thread.
+  option.progress.cb_set_range = [](void *widget, int min, int max, int val) {
+    QMetaObject::invokeMethod(
+        reinterpret_cast<QProgressBar *>(widget),
+        [=]() {
+          progress_callback(reinterpret_cast<QProgressBar *>(widget))
+              .set_range(min, max, val);
+        },
+        Qt::QueuedConnection);
+  };
+  option.progress.cb_add = [](void *widget, int delta) {
+    QMetaObject::invokeMethod(
+        reinterpret_cast<QProgressBar *>(widget),
+        [=]() {
+          progress_callback(reinterpret_cast<QProgressBar *>(widget))
+              .add(delta);
+        },
+        Qt::QueuedConnection);
+  };
+  option.ui.cb_keep_awake = nullptr;
+  option.ui.cb_report_error = [](void *wind, SCL_errorFlag ef,
+                                 const char *msg) {
+    // the user cancelled it
+    if (ef == SCL_errorFlag::TASK_CANCELLED) {
+      return;
+    }
+    SCWind *self = reinterpret_cast<SCWind *>(wind);
+    QMetaObject::invokeMethod(
+        self,
+        [self, ef, msg = std::string{msg}]() {
+          self->report_error(ef, msg.c_str());
+        },
+        Qt::QueuedConnection);
+  };
+  option.ui.cb_report_working_status = [](void *wind, SCL_workStatus ws) {
+    SCWind *self = reinterpret_cast<SCWind *>(wind);
+    QMetaObject::invokeMethod(
+        self, [self, ws]() { self->ui_callbacks().report_working_status(ws); },
+        Qt::QueuedConnection);
+  };
+
+  struct preview_target {
+    SCWind *wind;
+    QSize size;
+  } target{this, raw_size};
+  option.preview.wind = &target;
+  option.preview.cb_preview = [](void *p, const uint32_t *argb, size_t rows,
+                                 size_t cols) {
+    const auto *target = reinterpret_cast<const preview_target *>(p);
+    const QImage preview =
+        QImage{reinterpret_cast<const uchar *>(argb), static_cast<int>(cols),
+               static_cast<int>(rows), QImage::Format::Format_ARGB32}
+            .scaled(target->size, Qt::IgnoreAspectRatio,
+                    Qt::FastTransformation);
+    SCWind *self = target->wind;
+    QMetaObject::invokeMethod(
+        self,
+        [self, preview]() {
+          self->ui->lb_cvted_image->setPixmap(QPixmap::fromImage(preview));
+          self->ui->tw_cvt_image->setCurrentIndex(1);
+        },
+        Qt::QueuedConnection);
+  };
+
+  SlopeCraft::cancel_token token;
+  option.ui.cancel = &token;
+
+  // Window modal, so the task and color table can't change during the
+  // conversion, while the window still paints the preview and progress.
+  QProgressDialog dialog{tr("正在转化图像……"), tr("取消"), 0, 0, this};
+  dialog.setWindowModality(Qt::WindowModal);
+  dialog.setMinimumDuration(0);
+  connect(&dialog, &QProgressDialog::canceled, [&token]() { token.cancel(); });
+
+  SlopeCraft::converted_image *result{nullptr};
+  QThread *worker = QThread::create([&]() { result = convert(option); });
+  QEventLoop loop;
+  connect(worker, &QThread::finished, &loop, &QEventLoop::quit);
+  worker->start();
+  dialog.show();
+  loop.exec();
+  worker->wait();
+  delete worker;
+  return result;
+}
+
 const SlopeCraft::converted_image &SCWind::convert_if_need(
     cvt_task &task) noexcept {
   const auto table = this->current_color_table();
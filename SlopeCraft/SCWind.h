@@ -3,6 +3,7 @@
 
 #include <tuple>
 #include <vector>
+#include <functional>
 #include <memory>
 #include <QMainWindow>
 #include <QRadioButton>
@@ -259,9 +260,16 @@ class SCWind : public QMainWindow {
                                 SlopeCraft::deleter>
   convert_image(int idx) noexcept;
 
+  // If in_background, converts in a worker thread with a cancellable progress
+  // dialog, and shows a low resolution preview before the full conversion
+  // finishes. Returns nullptr if it fails or is cancelled.
   [[nodiscard]] std::unique_ptr<SlopeCraft::converted_image,
                                 SlopeCraft::deleter>
-  convert_image(const cvt_task&) noexcept;
+  convert_image(const cvt_task&, bool in_background = false) noexcept;
+  [[nodiscard]] SlopeCraft::converted_image* convert_in_background(
+      SlopeCraft::convert_option option, QSize raw_size,
+      const std::function<SlopeCraft::converted_image*(
+          const SlopeCraft::convert_option&)>& convert) noexcept;
 
   [[nodiscard]] const SlopeCraft::converted_image& convert_if_need(
       cvt_task&) noexcept;
@@ -296,8 +296,10 @@ void SCWind::on_pb_cvt_current_clicked() noexcept {
   }
 
   {
-    auto cvted = this->convert_image(sel.value());
+    auto cvted = this->convert_image(this->tasks[sel.value()], true);
     if (!cvted) {
+      // drop the preview
+      this->refresh_current_cvt_display(sel.value());
       return;
     }
     this->tasks[sel.value()].set_converted(this->current_color_table(),
@@ -805,6 +807,7 @@ void SCWind::on_ac_clear_cache_triggered() noexcept {
   }
 
   emit this->image_changed();
+  SCL_forget_caches(cache_dir_name.toLocal8Bit().data());
 
   const auto entries = cache_dir.entryList();
 
@@ -31,9 +31,11 @@ This file is part of SlopeCraft.
 
 #define EIGEN_NO_DEBUG
 #include <Eigen/Dense>
+#include <functional>
 #include <iostream>
 #include <ColorManip/newColorSet.hpp>
 #include <ColorManip/newTokiColor.hpp>
+#include <uiPack/uiPack.h>
 
 #include "SlopeCraftL.h"
 
@@ -62,6 +64,26 @@ namespace SlopeCraft {
 extern const float RGBBasicSource[256 * 3];
 extern const std::unique_ptr<const colorset_basic_t> basic_colorset;
 
+// Let utilities stop when the cancel_token of ui is cancelled
+inline void set_cancel_checker(uiPack &pack, const ui_callbacks &ui) noexcept {
+  pack._cancelPtr = ui.cancel;
+  if (ui.cancel == nullptr) {
+    pack.cancelRequested = nullptr;
+    return;
+  }
+  pack.cancelRequested = [](const void *token) {
+    return static_cast<const cancel_token *>(token)->is_cancelled();
+  };
+}
+
+inline std::function<bool()> cancel_checker_of(
+    const ui_callbacks &ui) noexcept {
+  if (ui.cancel == nullptr) {
+    return {};
+  }
+  return [token = ui.cancel]() { return token->is_cancelled(); };
+}
+
 }  // namespace SlopeCraft
 
 #define SC_HASH_ADD_DATA(hasher, obj) hasher.process_bytes(&obj, sizeof(obj));
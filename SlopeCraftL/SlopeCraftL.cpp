@@ -31,6 +31,7 @@ This file is part of SlopeCraft.
 #include "blocklist.h"
 #include "string_deliver.h"
 #include "color_table.h"
+#include "cache_manager.h"
 
 using namespace SlopeCraft;
 
@@ -182,6 +183,19 @@ SCL_EXPORT void SCL_get_base_color_ARGB32(uint32_t dest[64]) {
   }
 }
 
+SCL_EXPORT void SCL_set_cache_budget(const char *cache_root_dir,
+                                     uint64_t max_bytes) {
+  cache_manager::of(cache_root_dir).set_budget(max_bytes);
+}
+
+SCL_EXPORT uint64_t SCL_get_cache_size(const char *cache_root_dir) {
+  return cache_manager::of(cache_root_dir).total_bytes();
+}
+
+SCL_EXPORT void SCL_forget_caches(const char *cache_root_dir) {
+  cache_manager::of(cache_root_dir).forget_all();
+}
+
 // SCL_EXPORT int SCL_getBlockPalette(const mc_block_interface **blkpp,
 //                                    size_t capacity) {
 //   return TokiSlopeCraft::getBlockPalette(blkpp, capacity);
@@ -22,6 +22,8 @@ This file is part of SlopeCraft.
 
 #ifndef KERNEL_H
 #define KERNEL_H
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
 #include <cstring>
@@ -220,11 +222,44 @@ struct progress_callbacks {
   }
 };
 
+// added in v5.4
+// Shared by the caller and running tasks. Tasks check it at coarse granularity
+// and fail with TASK_CANCELLED after cancel(), or TASK_TIMED_OUT after the
+// deadline.
+struct cancel_token {
+  std::atomic<bool> cancelled{false};
+  // steady_clock time since epoch in nanoseconds, 0 means no deadline
+  std::atomic<int64_t> deadline_ns{0};
+
+  inline void cancel() noexcept { this->cancelled = true; }
+
+  inline static int64_t now_ns() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+  // The deadline is counted from now
+  inline void set_timeout(std::chrono::nanoseconds timeout) noexcept {
+    this->deadline_ns = now_ns() + timeout.count();
+  }
+
+  [[nodiscard]] inline bool is_timed_out() const noexcept {
+    const int64_t ddl = this->deadline_ns.load(std::memory_order_relaxed);
+    return ddl > 0 && now_ns() >= ddl;
+  }
+  [[nodiscard]] inline bool is_cancelled() const noexcept {
+    return this->cancelled.load(std::memory_order_relaxed) ||
+           this->is_timed_out();
+  }
+};
+
 struct ui_callbacks {
   void *wind{nullptr};
   void (*cb_keep_awake)(void *){nullptr};
   void (*cb_report_error)(void *, errorFlag, const char *){nullptr};
   void (*cb_report_working_status)(void *, workStatus){nullptr};
+  // added in v5.4
+  const cancel_token *cancel{nullptr};
 
   inline void keep_awake() const {
     if (this->cb_keep_awake) {
@@ -242,6 +277,34 @@ struct ui_callbacks {
       this->cb_report_working_status(this->wind, ws);
     }
   }
+
+  [[nodiscard]] inline bool is_cancelled() const {
+    return this->cancel != nullptr && this->cancel->is_cancelled();
+  }
+  // Reports TASK_CANCELLED or TASK_TIMED_OUT if cancelled
+  inline bool report_if_cancelled() const {
+    if (not this->is_cancelled()) {
+      return false;
+    }
+    if (this->cancel->is_timed_out()) {
+      this->report_error(errorFlag::TASK_TIMED_OUT, "The deadline is reached");
+    } else {
+      this->report_error(errorFlag::TASK_CANCELLED, "The task is cancelled");
+    }
+    return true;
+  }
+};
+
+// added in v5.4
+struct convert_preview_callback {
+  void *wind{nullptr};
+  // Called by convert_image before the full conversion with a downsampled
+  // copy converted without dithering. argb is row-major. Colors matched for
+  // the preview are reused by the full conversion.
+  void (*cb_preview)(void *wind, const uint32_t *argb, size_t rows,
+                     size_t cols){nullptr};
+  // The longer side of the preview is at most max_side
+  size_t max_side{256};
 };
 
 struct convert_option {
@@ -251,6 +314,8 @@ struct convert_option {
   GA_converter_option ai_cvter_opt{};
   progress_callbacks progress{};
   ui_callbacks ui{};
+  // added in v5.4
+  convert_preview_callback preview{};
 };
 
 struct map_data_file_options {
@@ -305,6 +370,10 @@ struct litematic_options {
   const char *region_name_utf8 = "by SlopeCraft";
   ui_callbacks ui;
   progress_callbacks progressbar;
+  // added in v5.4. Split the structure into region_count_x * region_count_z
+  // regions, each region has its own palette.
+  uint32_t region_count_x{1};
+  uint32_t region_count_z{1};
 };
 struct vanilla_structure_options {
   uint64_t caller_api_version{SC_VERSION_U64};
@@ -418,6 +487,15 @@ class color_table {
   [[nodiscard]] virtual bool generate_test_schematic(
       const char *filename,
       const test_blocklist_options &option) const noexcept = 0;
+
+  // added in v5.4. Same as convert_image, but colors already matched in
+  // previous are reused, even if previous is converted by another color table.
+  // Only colors affected by the difference of allowed colors are matched
+  // again, so converting the same image after changing a few blocks is much
+  // faster.
+  [[nodiscard]] virtual converted_image *convert_image_incremental(
+      const_image_reference original_img, const convert_option &option,
+      const converted_image &previous) const noexcept = 0;
 };
 
 class converted_image {
@@ -539,6 +617,19 @@ SCL_EXPORT uint8_t SCL_maxBaseColor();
 SCL_EXPORT SCL_gameVersion SCL_basecolor_version(uint8_t basecolor);
 SCL_EXPORT void SCL_get_base_color_ARGB32(uint32_t dest[64]);
 
+// added in v5.4
+// Limit total size of caches in cache_root_dir. Least recently used caches are
+// removed when exceeded. 0 means no limit. The default limit is 8 GiB.
+SCL_EXPORT void SCL_set_cache_budget(const char *cache_root_dir,
+                                     uint64_t max_bytes);
+// added in v5.4
+[[nodiscard]] SCL_EXPORT uint64_t
+SCL_get_cache_size(const char *cache_root_dir);
+// added in v5.4
+// Forget all caches in cache_root_dir. Call it before removing caches or the
+// whole dir without SlopeCraftL, so that the cache size doesn't count them.
+SCL_EXPORT void SCL_forget_caches(const char *cache_root_dir);
+
 // SCL_EXPORT SCL_gameVersion SCL_basecolor_version(uint8_t basecolor);
 
 // SCL_EXPORT uint64_t SCL_mcVersion2VersionNumber(::SCL_gameVersion);
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <fmt/format.h>
+#include <json.hpp>
+
+#include "cache_manager.h"
+
+namespace {
+constexpr const char *manifest_filename = "SlopeCraftL_cache_manifest.json";
+constexpr const char *tmp_extension = ".tmp";
+constexpr int manifest_version = 1;
+
+int64_t now_seconds() noexcept {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+int64_t to_seconds(std::filesystem::file_time_type ft) noexcept {
+  // std::chrono::clock_cast is not available on all compilers
+  const auto age = std::filesystem::file_time_type::clock::now() - ft;
+  return now_seconds() -
+         std::chrono::duration_cast<std::chrono::seconds>(age).count();
+}
+
+using manifest_entries_t =
+    std::unordered_map<std::string, std::pair<uint64_t, int64_t>>;
+
+/// Returns nullopt if the manifest is missing, broken or of another version.
+std::optional<manifest_entries_t> read_manifest(
+    const std::filesystem::path &file) noexcept {
+  std::ifstream ifs{file, std::ios::binary};
+  if (not ifs) {
+    return std::nullopt;
+  }
+  try {
+    const auto jo = nlohmann::json::parse(ifs, nullptr, true, true);
+    if (jo.at("version").get<int>() != manifest_version) {
+      return std::nullopt;
+    }
+    manifest_entries_t ret;
+    for (const auto &[key, val] : jo.at("entries").items()) {
+      ret.emplace(key, std::pair{val.at(0).get<uint64_t>(),
+                                 val.at(1).get<int64_t>()});
+    }
+    return ret;
+  } catch (...) {
+    return std::nullopt;
+  }
+}
+
+std::filesystem::path unique_tmp_path(const std::filesystem::path &file) {
+  static std::atomic<uint64_t> counter{0};
+  const uint64_t thread_hash =
+      std::hash<std::thread::id>{}(std::this_thread::get_id());
+  std::filesystem::path tmp = file;
+  tmp += fmt::format(".{:x}-{:x}{}", thread_hash, counter++, tmp_extension);
+  return tmp;
+}
+}  // namespace
+
+cache_manager &cache_manager::of(const std::filesystem::path &root) noexcept {
+  static std::mutex registry_lock;
+  static std::unordered_map<std::string, std::unique_ptr<cache_manager>>
+      registry;
+
+  const auto normalized = root.lexically_normal();
+  std::lock_guard<std::mutex> lk{registry_lock};
+  auto &mgr = registry[normalized.generic_string()];
+  if (mgr == nullptr) {
+    mgr.reset(new cache_manager{normalized});
+  }
+  return *mgr;
+}
+
+cache_manager::cache_manager(const std::filesystem::path &root) noexcept
+    : root_{root} {
+  std::lock_guard<std::mutex> lk{this->lock_};
+  this->load_manifest_no_lock();
+}
+
+cache_manager::~cache_manager() {
+  std::lock_guard<std::mutex> lk{this->lock_};
+  if (this->manifest_dirty_) {
+    this->save_manifest_no_lock();
+  }
+}
+
+std::string cache_manager::key_of(
+    const std::filesystem::path &file) const noexcept {
+  return file.lexically_normal()
+      .lexically_relative(this->root_)
+      .generic_string();
+}
+
+std::filesystem::path cache_manager::manifest_file() const noexcept {
+  return this->root_ / manifest_filename;
+}
+
+cache_manager::entry *cache_manager::find_or_adopt_no_lock(
+    const std::string &key) noexcept {
+  auto it = this->entries_.find(key);
+  if (it != this->entries_.end()) {
+    return &it->second;
+  }
+  // the cache may be written by another process after the manifest is loaded
+  std::error_code ec;
+  const auto path = this->root_ / key;
+  if (not std::filesystem::is_regular_file(path, ec)) {
+    return nullptr;
+  }
+  const uint64_t bytes = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return nullptr;
+  }
+  const auto write_time = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return nullptr;
+  }
+  const entry ent{.bytes = bytes, .last_access = to_seconds(write_time)};
+  this->erased_.erase(key);
+  this->total_bytes_ += ent.bytes;
+  this->manifest_dirty_ = true;
+  return &this->entries_.emplace(key, ent).first->second;
+}
+
+bool cache_manager::contains(const std::filesystem::path &file) noexcept {
+  const auto key = this->key_of(file);
+  std::lock_guard<std::mutex> lk{this->lock_};
+  return this->find_or_adopt_no_lock(key) != nullptr;
+}
+
+void cache_manager::touch(const std::filesystem::path &file) noexcept {
+  const auto key = this->key_of(file);
+  std::lock_guard<std::mutex> lk{this->lock_};
+  entry *ent = this->find_or_adopt_no_lock(key);
+  if (ent == nullptr) {
+    return;
+  }
+  ent->last_access = now_seconds();
+  // access time is written with the next commit or on exit
+  this->manifest_dirty_ = true;
+}
+
+void cache_manager::erase(const std::filesystem::path &file) noexcept {
+  const auto key = this->key_of(file);
+  std::lock_guard<std::mutex> lk{this->lock_};
+  this->erase_no_lock(key);
+  this->save_manifest_no_lock();
+}
+
+void cache_manager::forget_all() noexcept {
+  std::lock_guard<std::mutex> lk{this->lock_};
+  this->entries_.clear();
+  this->erased_.clear();
+  this->total_bytes_ = 0;
+  this->manifest_dirty_ = false;
+}
+
+std::string cache_manager::commit(
+    const std::filesystem::path &file,
+    const std::function<std::string(const std::filesystem::path &tmp)>
+        &writer) noexcept {
+  std::error_code ec;
+  std::filesystem::create_directories(file.parent_path(), ec);
+  if (ec) {
+    return fmt::format("Failed to create directory {}: {}",
+                       file.parent_path().string(), ec.message());
+  }
+
+  const auto tmp = unique_tmp_path(file);
+  {
+    auto err = writer(tmp);
+    if (not err.empty()) {
+      std::filesystem::remove(tmp, ec);
+      return err;
+    }
+  }
+  std::filesystem::rename(tmp, file, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return fmt::format("Failed to rename {} to {}: {}", tmp.string(),
+                       file.string(), ec.message());
+  }
+  const uint64_t bytes = std::filesystem::file_size(file, ec);
+
+  const auto key = this->key_of(file);
+  std::lock_guard<std::mutex> lk{this->lock_};
+  this->erased_.erase(key);
+  auto &ent = this->entries_[key];
+  this->total_bytes_ -= ent.bytes;
+  ent = entry{.bytes = bytes, .last_access = now_seconds()};
+  this->total_bytes_ += bytes;
+  this->manifest_dirty_ = true;
+
+  this->evict_no_lock(key);
+  this->save_manifest_no_lock();
+  return {};
+}
+
+void cache_manager::set_budget(uint64_t bytes) noexcept {
+  std::lock_guard<std::mutex> lk{this->lock_};
+  this->budget_ = bytes;
+  this->evict_no_lock({});
+  if (this->manifest_dirty_) {
+    this->save_manifest_no_lock();
+  }
+}
+
+uint64_t cache_manager::budget() const noexcept {
+  std::lock_guard<std::mutex> lk{this->lock_};
+  return this->budget_;
+}
+
+uint64_t cache_manager::total_bytes() const noexcept {
+  std::lock_guard<std::mutex> lk{this->lock_};
+  return this->total_bytes_;
+}
+
+void cache_manager::erase_no_lock(const std::string &key) noexcept {
+  auto it = this->entries_.find(key);
+  if (it == this->entries_.end()) {
+    return;
+  }
+  std::error_code ec;
+  std::filesystem::remove(this->root_ / key, ec);
+  this->total_bytes_ -= it->second.bytes;
+  this->entries_.erase(it);
+  this->erased_.emplace(key);
+  this->manifest_dirty_ = true;
+}
+
+void cache_manager::evict_no_lock(const std::string &keep) noexcept {
+  std::vector<std::pair<int64_t, std::string>> candidates;
+  candidates.reserve(this->entries_.size());
+  for (const auto &[key, ent] : this->entries_) {
+    if (key != keep) {
+      candidates.emplace_back(ent.last_access, key);
+    }
+  }
+  // least recently used first
+  std::sort(candidates.begin(), candidates.end());
+
+  const int64_t now = now_seconds();
+  for (const auto &[last_access, key] : candidates) {
+    const bool is_idle = this->max_idle_.count() > 0 &&
+                         now - last_access > this->max_idle_.count();
+    const bool is_over_budget =
+        this->budget_ > 0 && this->total_bytes_ > this->budget_;
+    if (not is_idle and not is_over_budget) {
+      // the rest are used more recently
+      break;
+    }
+    this->erase_no_lock(key);
+  }
+}
+
+void cache_manager::load_manifest_no_lock() noexcept {
+  auto on_disk = read_manifest(this->manifest_file());
+  if (not on_disk) {
+    // missing or broken manifest
+    this->rebuild_manifest_no_lock();
+    return;
+  }
+  this->entries_.clear();
+  this->total_bytes_ = 0;
+  for (const auto &[key, val] : *on_disk) {
+    const entry ent{.bytes = val.first, .last_access = val.second};
+    this->entries_.emplace(key, ent);
+    this->total_bytes_ += ent.bytes;
+  }
+}
+
+void cache_manager::merge_manifest_no_lock() noexcept {
+  auto on_disk = read_manifest(this->manifest_file());
+  if (not on_disk) {
+    return;
+  }
+  for (const auto &[key, val] : *on_disk) {
+    if (this->erased_.contains(key)) {
+      continue;
+    }
+    const entry ent{.bytes = val.first, .last_access = val.second};
+    auto [it, inserted] = this->entries_.try_emplace(key, ent);
+    if (inserted) {
+      this->total_bytes_ += ent.bytes;
+    } else if (ent.last_access > it->second.last_access) {
+      // rewritten or used more recently by another process
+      this->total_bytes_ += ent.bytes - it->second.bytes;
+      it->second = ent;
+    }
+  }
+  // caches removed by other processes
+  std::error_code ec;
+  for (auto it = this->entries_.begin(); it != this->entries_.end();) {
+    if (on_disk->contains(it->first) or
+        std::filesystem::exists(this->root_ / it->first, ec)) {
+      ++it;
+      continue;
+    }
+    this->total_bytes_ -= it->second.bytes;
+    it = this->entries_.erase(it);
+  }
+}
+
+void cache_manager::rebuild_manifest_no_lock() noexcept {
+  this->entries_.clear();
+  this->total_bytes_ = 0;
+  std::error_code ec;
+  const auto manifest = this->manifest_file();
+  for (auto it = std::filesystem::recursive_directory_iterator{
+           this->root_,
+           std::filesystem::directory_options::skip_permission_denied, ec};
+       it != std::filesystem::recursive_directory_iterator{};
+       it.increment(ec)) {
+    if (ec) {
+      break;
+    }
+    if (not it->is_regular_file(ec)) {
+      continue;
+    }
+    const auto &path = it->path();
+    if (path == manifest) {
+      continue;
+    }
+    if (path.extension() == tmp_extension) {
+      // left by an interrupted commit
+      std::filesystem::remove(path, ec);
+      continue;
+    }
+    const entry ent{.bytes = it->file_size(ec),
+                    .last_access = to_seconds(it->last_write_time(ec))};
+    this->entries_.emplace(this->key_of(path), ent);
+    this->total_bytes_ += ent.bytes;
+  }
+  this->manifest_dirty_ = true;
+}
+
+void cache_manager::save_manifest_no_lock() noexcept {
+  // Other processes may have saved the manifest since it was loaded. The
+  // window between merging and renaming is small, and a lost entry is
+  // recovered by find_or_adopt_no_lock anyway.
+  this->merge_manifest_no_lock();
+
+  nlohmann::json entries = nlohmann::json::object();
+  for (const auto &[key, ent] : this->entries_) {
+    entries[key] = {ent.bytes, ent.last_access};
+  }
+  nlohmann::json jo;
+  jo["version"] = manifest_version;
+  jo["entries"] = std::move(entries);
+
+  std::error_code ec;
+  if (not std::filesystem::is_directory(this->root_, ec)) {
+    // the whole cache dir is removed, don't bring it back
+    return;
+  }
+  const auto manifest = this->manifest_file();
+  const auto tmp = unique_tmp_path(manifest);
+  {
+    std::ofstream ofs{tmp, std::ios::binary};
+    if (not ofs) {
+      return;
+    }
+    ofs << jo.dump();
+    ofs.close();
+    if (not ofs) {
+      std::filesystem::remove(tmp, ec);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp, manifest, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return;
+  }
+  this->erased_.clear();
+  this->manifest_dirty_ = false;
+}
@@ -0,0 +1,103 @@
+#ifndef SLOPECRAFT_CACHE_MANAGER_H
+#define SLOPECRAFT_CACHE_MANAGER_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/// Manages all cache files in a cache root dir. Every cache file is recorded
+/// in a manifest with its size and last access time, so looking up a cache
+/// doesn't touch the file system. When the total size exceeds the budget, the
+/// least recently used caches are removed.
+///
+/// Several processes may share a cache root dir. The manifest on disk is
+/// re-read and merged before it's saved, and a cache missing from the manifest
+/// is looked up in the file system, so caches written by others are not lost.
+class cache_manager {
+ public:
+  static constexpr uint64_t default_budget_bytes{uint64_t(8) << 30};
+  static constexpr std::chrono::seconds default_max_idle{
+      std::chrono::days{30}};
+
+  /// Get the manager of a cache root dir. It's created on first use, and the
+  /// manifest is loaded (or rebuilt by scanning the dir if missing).
+  [[nodiscard]] static cache_manager &of(
+      const std::filesystem::path &root) noexcept;
+
+  cache_manager(const cache_manager &) = delete;
+  cache_manager(cache_manager &&) = delete;
+  ~cache_manager();
+
+  /// Falls back to the file system if the manifest has no entry of file.
+  [[nodiscard]] bool contains(const std::filesystem::path &file) noexcept;
+
+  /// Mark file as recently used.
+  void touch(const std::filesystem::path &file) noexcept;
+
+  /// Remove file from disk and manifest, for example when it's broken.
+  void erase(const std::filesystem::path &file) noexcept;
+
+  /// Forget all caches without touching the disk. Call it before removing
+  /// caches by other means, so that the total size and the manifest saved later
+  /// don't keep them.
+  void forget_all() noexcept;
+
+  /// Write a cache file atomically. writer should write the whole cache to the
+  /// temporary path it receives and return an error message on failure. On
+  /// success the temporary file is renamed to file, so readers never see a
+  /// partially written cache.
+  [[nodiscard]] std::string commit(
+      const std::filesystem::path &file,
+      const std::function<std::string(const std::filesystem::path &tmp)>
+          &writer) noexcept;
+
+  /// 0 means no limit. Caches are evicted immediately if needed.
+  void set_budget(uint64_t bytes) noexcept;
+  [[nodiscard]] uint64_t budget() const noexcept;
+
+  [[nodiscard]] uint64_t total_bytes() const noexcept;
+
+ private:
+  explicit cache_manager(const std::filesystem::path &root) noexcept;
+
+  struct entry {
+    uint64_t bytes{0};
+    /// seconds since epoch
+    int64_t last_access{0};
+  };
+
+  std::filesystem::path root_;
+  mutable std::mutex lock_;
+  std::unordered_map<std::string, entry> entries_;
+  /// Keys erased since the manifest was last saved, so that merging with the
+  /// manifest on disk doesn't bring them back.
+  std::unordered_set<std::string> erased_;
+  uint64_t total_bytes_{0};
+  uint64_t budget_{default_budget_bytes};
+  std::chrono::seconds max_idle_{default_max_idle};
+  bool manifest_dirty_{false};
+
+  [[nodiscard]] std::string key_of(
+      const std::filesystem::path &file) const noexcept;
+  [[nodiscard]] std::filesystem::path manifest_file() const noexcept;
+
+  /// Find the entry of key, or record it if the file exists on disk.
+  [[nodiscard]] entry *find_or_adopt_no_lock(const std::string &key) noexcept;
+
+  void load_manifest_no_lock() noexcept;
+  void rebuild_manifest_no_lock() noexcept;
+  /// Merge the manifest written by other processes into entries_.
+  void merge_manifest_no_lock() noexcept;
+  void save_manifest_no_lock() noexcept;
+  void erase_no_lock(const std::string &key) noexcept;
+  /// Remove caches idle for too long, then remove least recently used ones
+  /// until total size fits in budget. keep is never removed.
+  void evict_no_lock(const std::string &keep) noexcept;
+};
+
+#endif  // SLOPECRAFT_CACHE_MANAGER_H
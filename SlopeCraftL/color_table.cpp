@@ -8,6 +8,7 @@
 #include "color_table.h"
 #include "water_item.h"
 #include "structure_3D.h"
+#include "cache_manager.h"
 #include "utilities/ProcessBlockId/process_block_id.h"
 #include "utilities/Schem/mushroom.h"
 
@@ -228,8 +229,9 @@ std::filesystem::path color_table_impl::convert_task_cache_filename(
     const char *cache_root_dir) const noexcept {
   auto self_cache_dir = this->self_cache_dir(cache_root_dir);
   self_cache_dir.append("convert");
-  self_cache_dir.append(fmt::format(
-      "{:x}", converted_image_impl::convert_task_hash(original_img, option)));
+  self_cache_dir.append(
+      fmt::format("{:x}", converted_image_impl::convert_task_hash(
+                              original_img, option, this->hash())));
   return self_cache_dir;
 }
 
@@ -238,7 +240,7 @@ bool color_table_impl::has_convert_cache(
     const char *cache_root_dir) const noexcept {
   auto path =
       this->convert_task_cache_filename(original_img, option, cache_root_dir);
-  return std::filesystem::is_regular_file(path);
+  return cache_manager::of(cache_root_dir).contains(path);
 }
 
 std::string color_table_impl::save_convert_cache(
@@ -247,10 +249,11 @@ std::string color_table_impl::save_convert_cache(
   try {
     auto filename =
         this->convert_task_cache_filename(original_img, option, cache_root_dir);
-    std::filesystem::create_directories(filename.parent_path());
 
-    auto err =
-        dynamic_cast<const converted_image_impl &>(cvted).save_cache(filename);
+    auto writer = [&cvted](const std::filesystem::path &tmp) {
+      return dynamic_cast<const converted_image_impl &>(cvted).save_cache(tmp);
+    };
+    auto err = cache_manager::of(cache_root_dir).commit(filename, writer);
     if (!err.empty()) {
       return fmt::format("Failed to save cache to file \"{}\": {}",
                          filename.string(), err);
@@ -266,9 +269,18 @@ std::string color_table_impl::save_convert_cache(
 color_table_impl::load_convert_cache(
     const_image_reference original_img, const convert_option &option,
     const char *cache_root_dir) const noexcept {
-  return converted_image_impl::load_cache(
-      *this,
-      this->convert_task_cache_filename(original_img, option, cache_root_dir));
+  const auto filename =
+      this->convert_task_cache_filename(original_img, option, cache_root_dir);
+  auto &mgr = cache_manager::of(cache_root_dir);
+  auto ret =
+      converted_image_impl::load_cache(*this, filename, original_img, option);
+  if (ret) {
+    mgr.touch(filename);
+  } else {
+    // the cache is missing, broken or belongs to another image
+    mgr.erase(filename);
+  }
+  return ret;
 }
 
 std::filesystem::path color_table_impl::build_task_cache_filename(
@@ -307,8 +319,10 @@ bool color_table_impl::save_build_cache(const converted_image &cvted,
                                         string_deliver *error) const noexcept {
   const auto filename =
       this->build_task_cache_filename(cvted, option, cache_root_dir);
-  auto err_msg =
-      dynamic_cast<const structure_3D_impl &>(structure).save_cache(filename);
+  auto writer = [&structure](const std::filesystem::path &tmp) {
+    return dynamic_cast<const structure_3D_impl &>(structure).save_cache(tmp);
+  };
+  auto err_msg = cache_manager::of(cache_root_dir).commit(filename, writer);
   write_to_sd(error, err_msg);
 
   return err_msg.empty();
@@ -320,7 +334,7 @@ bool color_table_impl::has_build_cache(
     const char *cache_root_dir) const noexcept {
   const auto filename =
       this->build_task_cache_filename(cvted, option, cache_root_dir);
-  return std::filesystem::is_regular_file(filename);
+  return cache_manager::of(cache_root_dir).contains(filename);
 }
 
 structure_3D *color_table_impl::load_build_cache(
@@ -329,11 +343,14 @@ structure_3D *color_table_impl::load_build_cache(
     SlopeCraft::string_deliver *error) const noexcept {
   const auto filename =
       this->build_task_cache_filename(cvted, option, cache_root_dir);
+  auto &mgr = cache_manager::of(cache_root_dir);
   auto res = structure_3D_impl::load_cache(filename);
   if (res) {
+    mgr.touch(filename);
     write_to_sd(error, "");
     return new structure_3D_impl{std::move(res.value())};
   }
+  mgr.erase(filename);
   write_to_sd(error, res.error());
   return nullptr;
 }
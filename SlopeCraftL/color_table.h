@@ -46,7 +46,22 @@ class color_table_impl : public SlopeCraft::color_table {
 
   [[nodiscard]] converted_image *convert_image(
       const_image_reference original_img,
-      const convert_option &option) const noexcept final;
+      const convert_option &option) const noexcept final {
+    return this->convert_image(original_img, option, nullptr);
+  }
+
+  [[nodiscard]] converted_image *convert_image_incremental(
+      const_image_reference original_img, const convert_option &option,
+      const converted_image &previous) const noexcept final {
+    return this->convert_image(
+        original_img, option,
+        &dynamic_cast<const converted_image_impl &>(previous));
+  }
+
+  /// Colors matched in previous are reused if it's not nullptr.
+  [[nodiscard]] converted_image_impl *convert_image(
+      const_image_reference original_img, const convert_option &option,
+      const converted_image_impl *previous) const noexcept;
 
   [[nodiscard]] static std::optional<color_table_impl> create(
       const color_table_create_info &args) noexcept;
@@ -18,16 +18,28 @@ converted_image_impl::converted_image_impl(const color_table_impl &table)
       game_version{table.mc_version()},
       colorset{table.allowed} {}
 
-converted_image *color_table_impl::convert_image(
-    const_image_reference original_img,
-    const convert_option &option) const noexcept {
+converted_image_impl *color_table_impl::convert_image(
+    const_image_reference original_img, const convert_option &option,
+    const converted_image_impl *previous) const noexcept {
   converted_image_impl cvted{*this};
+  if (previous != nullptr) {
+    cvted.converter.reuse_matched_colors(previous->converter);
+  }
 
   const auto algo = (option.algo == convertAlgo::gaCvter)
                         ? convertAlgo::RGB_Better
                         : option.algo;
   cvted.converter.set_raw_image(original_img.data, original_img.rows,
                                 original_img.cols, false);
+  set_cancel_checker(cvted.converter.ui, option.ui);
+  if (option.preview.cb_preview != nullptr) {
+    // matched by the same converter, so the full conversion reuses colors
+    const Eigen::Array<uint32_t, Eigen::Dynamic, Eigen::Dynamic,
+                       Eigen::RowMajor>
+        preview = cvted.converter.preview(algo, option.preview.max_side);
+    option.preview.cb_preview(option.preview.wind, preview.data(),
+                              preview.rows(), preview.cols());
+  }
   {
     heu::GAOption opt;
     opt.crossoverProb = option.ai_cvter_opt.crossoverProb;
@@ -36,7 +48,14 @@ converted_image *color_table_impl::convert_image(
     opt.maxFailTimes = option.ai_cvter_opt.maxFailTimes;
     opt.populationSize = option.ai_cvter_opt.popSize;
 
-    cvted.converter.convert_image(algo, option.dither, &opt);
+    const bool ok = cvted.converter.convert_image(algo, option.dither, &opt);
+    // the token may not outlive the returned image
+    SlopeCraft::set_cancel_checker(cvted.converter.ui, {});
+    if (!ok) {
+      option.ui.report_if_cancelled();
+      option.ui.report_working_status(workStatus::none);
+      return nullptr;
+    }
   }
 
   option.progress.set_range(0, 4 * cvted.size(), 4 * cvted.size());
@@ -85,6 +104,11 @@ bool converted_image_impl::export_map_data(
   int fail_count = 0;
   for (int c = 0; c < cols; c++) {
     for (int r = 0; r < rows; r++) {
+      // files already written are complete maps, so they are kept
+      if (option.ui.report_if_cancelled()) {
+        option.ui.report_working_status(workStatus::none);
+        return false;
+      }
       const std::array<int, 2> offset = {r * 128, c * 128};
       std::filesystem::path current_filename = dir;
       current_filename.append(fmt::format("map_{}.dat", currentIndex));
@@ -250,6 +274,9 @@ converted_image_impl::height_info(const build_options &option) const noexcept {
       compressor.setSource(HL.getBase(), ptr);
       bool success = compressor.compress(option.max_allowed_height,
                                          allow_lossless_compress);
+      if (option.ui.report_if_cancelled()) {
+        return std::nullopt;
+      }
       Eigen::ArrayXi temp;
       HL.make(&ptr[0], compressor.getResult(), allow_lossless_compress, &temp);
       if (!success) {
@@ -286,9 +313,13 @@ converted_image_impl::height_info(const build_options &option) const noexcept {
 }
 
 uint64_t converted_image_impl::convert_task_hash(
-    const_image_reference original_img, const convert_option &option) noexcept {
-  boost::uuids::detail::md5 hash;
+    const_image_reference original_img, const convert_option &option,
+    uint64_t color_table_hash) noexcept {
+  using hasher_t = boost::uuids::detail::md5;
+  using digest_bytes_t = std::array<uint8_t, sizeof(hasher_t::digest_type)>;
+  hasher_t hash;
 
+  SC_HASH_ADD_DATA(hash, color_table_hash)
   SC_HASH_ADD_DATA(hash, option.algo)
   SC_HASH_ADD_DATA(hash, option.dither)
   if (option.algo == SCL_convertAlgo::gaCvter) {
@@ -298,19 +329,43 @@ uint64_t converted_image_impl::convert_task_hash(
     SC_HASH_ADD_DATA(hash, option.ai_cvter_opt.crossoverProb)
     SC_HASH_ADD_DATA(hash, option.ai_cvter_opt.mutationProb)
   }
+  SC_HASH_ADD_DATA(hash, original_img.rows)
+  SC_HASH_ADD_DATA(hash, original_img.cols)
+
+  // Pixels are hashed in fixed-size blocks in parallel, and then the digests
+  // of blocks are hashed in order. The result doesn't depend on thread count.
+  constexpr size_t pixels_per_block{size_t(1) << 18};
+  const size_t num_pixels = original_img.rows * original_img.cols;
+  const size_t num_blocks =
+      (num_pixels + pixels_per_block - 1) / pixels_per_block;
+  std::vector<digest_bytes_t> block_digests;
+  block_digests.resize(num_blocks);
+#pragma omp parallel for schedule(static) if (num_blocks > 1)
+  for (int64_t blk = 0; blk < int64_t(num_blocks); blk++) {
+    const size_t begin = blk * pixels_per_block;
+    const size_t end = std::min(begin + pixels_per_block, num_pixels);
+    hasher_t block_hash;
+    block_hash.process_bytes(original_img.data + begin,
+                             (end - begin) * sizeof(uint32_t));
+    hasher_t::digest_type dig;
+    block_hash.get_digest(dig);
+    memcpy(block_digests[blk].data(), dig, sizeof(dig));
+  }
+  for (const auto &dig : block_digests) {
+    hash.process_bytes(dig.data(), dig.size());
+  }
 
-  hash.process_bytes(original_img.data, original_img.rows * original_img.cols);
-
-  decltype(hash)::digest_type dig;
+  hasher_t::digest_type dig;
   hash.get_digest(dig);
   std::array<uint64_t, 2> temp;
+  static_assert(sizeof(temp) == sizeof(dig));
   memcpy(temp.data(), dig, sizeof(temp));
   return temp[0] ^ temp[1];
 }
 
 std::string converted_image_impl::save_cache(
     const std::filesystem::path &file) const noexcept {
-  if (this->converter.save_cache(file.string().c_str())) {
+  if (not this->converter.save_cache(file.string().c_str())) {
     return "Failed to open file.";
   }
   return {};
@@ -318,7 +373,9 @@ std::string converted_image_impl::save_cache(
 
 tl::expected<converted_image_impl, std::string>
 converted_image_impl::load_cache(const color_table_impl &table,
-                                 const std::filesystem::path &file) noexcept {
+                                 const std::filesystem::path &file,
+                                 const_image_reference original_img,
+                                 const convert_option &option) noexcept {
   converted_image_impl ret{table};
   if (!std::filesystem::is_regular_file(file)) {
     return tl::make_unexpected("No such file");
@@ -326,6 +383,27 @@ converted_image_impl::load_cache(const color_table_impl &table,
   if (!ret.converter.load_cache(file.string().c_str())) {
     return tl::make_unexpected("Failed to load cache, the cache is incorrect");
   }
+  // The file name is only a hash, so compare the content to reject collisions.
+  if (ret.rows() != original_img.rows || ret.cols() != original_img.cols) {
+    return tl::make_unexpected(
+        "The cache is converted from another image with different size");
+  }
+  Eigen::Map<const eimg_row_major> original{
+      original_img.data, static_cast<int64_t>(original_img.rows),
+      static_cast<int64_t>(original_img.cols)};
+  if ((original != ret.converter.raw_image()).any()) {
+    return tl::make_unexpected(
+        "The cache is converted from another image with same hash");
+  }
+  // GA converter stores its result as RGB_Better
+  const SCL_convertAlgo expected_algo =
+      (option.algo == SCL_convertAlgo::gaCvter) ? SCL_convertAlgo::RGB_Better
+                                                : option.algo;
+  if (ret.converter.convert_algo() != expected_algo ||
+      ret.converter.is_dither() != option.dither) {
+    return tl::make_unexpected(
+        "The cache is converted with another algorithm or dither option");
+  }
   return ret;
 }
 
@@ -715,10 +793,15 @@ bool converted_image_impl::export_assembled_maps_litematic(
   libSchem::litematic_info info{};
   info.litename_utf8 = export_opt.litename_utf8;
   info.regionname_utf8 = export_opt.region_name_utf8;
+  info.region_count_x = export_opt.region_count_x;
+  info.region_count_z = export_opt.region_count_z;
 
-  auto err = schem.export_litematic(filename, info);
+  auto err = schem.export_litematic(filename, info,
+                                    cancel_checker_of(export_opt.ui));
   if (not err) {
-    export_opt.ui.report_error(err.error().first, err.error().second.c_str());
+    if (not export_opt.ui.report_if_cancelled()) {
+      export_opt.ui.report_error(err.error().first, err.error().second.c_str());
+    }
     return false;
   }
   return true;
@@ -728,9 +811,12 @@ bool converted_image_impl::export_assembled_maps_vanilla_structure(
     const char *filename, const SlopeCraft::assembled_maps_options &map_opt,
     const SlopeCraft::vanilla_structure_options &export_opt) const noexcept {
   auto schem = this->assembled_maps(map_opt);
-  auto err = schem.export_structure(filename, export_opt.is_air_structure_void);
+  auto err = schem.export_structure(filename, export_opt.is_air_structure_void,
+                                    cancel_checker_of(export_opt.ui));
   if (not err) {
-    export_opt.ui.report_error(err.error().first, err.error().second.c_str());
+    if (not export_opt.ui.report_if_cancelled()) {
+      export_opt.ui.report_error(err.error().first, err.error().second.c_str());
+    }
     return false;
   }
   return true;
@@ -67,14 +67,16 @@ class converted_image_impl : public converted_image {
       const build_options &option) const noexcept;
 
   [[nodiscard]] static uint64_t convert_task_hash(
-      const_image_reference original_img,
-      const convert_option &option) noexcept;
+      const_image_reference original_img, const convert_option &option,
+      uint64_t color_table_hash) noexcept;
 
   std::string save_cache(const std::filesystem::path &file) const noexcept;
 
+  /// Load cache and check that it was converted from original_img with option.
   [[nodiscard]] static tl::expected<converted_image_impl, std::string>
-  load_cache(const color_table_impl &table,
-             const std::filesystem::path &file) noexcept;
+  load_cache(const color_table_impl &table, const std::filesystem::path &file,
+             const_image_reference original_img,
+             const convert_option &option) noexcept;
 
   bool is_converted_from(const color_table &table_) const noexcept final;
 
@@ -30,8 +30,8 @@ This file is part of SlopeCraft.
 const double initializeNonZeroRatio = 0.05;
 
 constexpr uint16_t popSize = 50;
-uint16_t maxFailTimes = 30;
-uint16_t lossy_compressor::maxGeneration = 600;
+constexpr uint16_t initialMaxFailTimes = 30;
+constexpr uint16_t initialMaxGeneration = 200;
 constexpr double crossoverProb = 0.9;
 constexpr double mutateProb = 0.01;
 constexpr uint32_t reportRate = 50;
@@ -91,9 +91,15 @@ class solver_t
       if (curClock - prevClock >= CLOCKS_PER_SEC / 2) {
         prevClock = curClock;
         this->_args.ptr->progress_bar.set_range(
-            0, lossy_compressor::maxGeneration, this->generation());
+            0, this->option().maxGenerations, this->generation());
       }
     }
+    // the run ends after this generation
+    if (this->_args.ptr->ui.is_cancelled()) {
+      heu::GAOption opt = this->option();
+      opt.maxGenerations = 0;
+      this->setOption(opt);
+    }
   }
 };
 
@@ -118,7 +124,9 @@ void lossy_compressor::setSource(const Eigen::ArrayXi &_base,
 }
 
 void lossy_compressor::runGenetic(uint16_t maxHeight,
-                                  bool allowNaturalCompress) {
+                                  bool allowNaturalCompress,
+                                  uint16_t maxGeneration,
+                                  uint16_t maxFailTimes) {
   {
     heu::GAOption opt;
     opt.crossoverProb = crossoverProb;
@@ -144,17 +152,22 @@ void lossy_compressor::runGenetic(uint16_t maxHeight,
 }
 
 bool lossy_compressor::compress(uint16_t maxHeight, bool allowNaturalCompress) {
+  uint16_t maxFailTimes = initialMaxFailTimes;
+  uint16_t maxGeneration = initialMaxGeneration;
   this->progress_bar.set_range(0, maxGeneration, 0);
 
   // std::cerr<<"Genetic algorithm started\n";
   uint16_t tryTimes = 0;
-  maxFailTimes = 30;
-  maxGeneration = 200;
   while (tryTimes < 3) {
-    this->runGenetic(maxHeight, allowNaturalCompress);
+    this->runGenetic(maxHeight, allowNaturalCompress, maxGeneration,
+                     maxFailTimes);
+    if (this->ui.is_cancelled()) {
+      return false;
+    }
     if (this->resultFitness() <= 0) {
       tryTimes++;
-      maxFailTimes = -1;
+      // retry longer, and never stop early
+      maxFailTimes = UINT16_MAX;
       maxGeneration *= 2;
     } else
       break;
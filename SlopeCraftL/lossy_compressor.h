@@ -44,6 +44,7 @@ class lossy_compressor {
   lossy_compressor();
   ~lossy_compressor();
   void setSource(const Eigen::ArrayXi &, std::span<const TokiColor *>);
+  // Returns false if failed or cancelled by ui
   bool compress(uint16_t maxHeight, bool allowNaturalCompress);
   const Eigen::ArrayX<uint8_t> &getResult() const;
   double resultFitness() const;
@@ -56,9 +57,9 @@ class lossy_compressor {
   std::unique_ptr<solver_t> solver;
   std::vector<const TokiColor *> source;
 
-  static uint16_t maxGeneration;
-
-  void runGenetic(uint16_t maxHeight, bool allowNaturalCompress);
+  // GA limits are per call, since compressors may run in parallel
+  void runGenetic(uint16_t maxHeight, bool allowNaturalCompress,
+                  uint16_t maxGeneration, uint16_t maxFailTimes);
 };
 
 double randD();
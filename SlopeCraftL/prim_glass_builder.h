@@ -90,6 +90,7 @@ class prim_glass_builder {
   static const uint32_t unitL = 32;
   static const uint32_t reportRate = 50;
   enum blockType { air = 0, glass = 1, target = 127 };
+  // Returns an empty map if cancelled by ui
   glassMap makeBridge(const TokiMap &_targetMap,
                       walkableMap *walkable = nullptr);
 
@@ -5,10 +5,16 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/device/file.hpp>
 #include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <zstd.h>
 #include <cereal/cereal.hpp>
 #include <cereal/archives/binary.hpp>
 #include <magic_enum/magic_enum.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <span>
 
 #include "structure_3D.h"
 #include "color_table.h"
@@ -42,6 +48,9 @@ std::optional<structure_3D_impl> structure_3D_impl::create(
     fixed_opt.compress_method = compressSettings::noCompress;
     fixed_opt.glass_method = glassBridgeSettings::noBridge;
   }
+  if (option.ui.report_if_cancelled()) {
+    return std::nullopt;
+  }
   fixed_opt.ui.report_working_status(workStatus::buidingHeighMap);
   fixed_opt.main_progressbar.set_range(0, 10 * cvted.size(), 0);
   {
@@ -197,6 +206,10 @@ std::optional<structure_3D_impl> structure_3D_impl::create(
         glassMap glass;
         // cerr << "Construct glass bridge at y=" << y << endl;
         glass = glass_builder.makeBridge(targetMap);
+        if (fixed_opt.ui.report_if_cancelled()) {
+          fixed_opt.ui.report_working_status(workStatus::none);
+          return std::nullopt;
+        }
         for (int r = 0; r < glass.rows(); r++)
           for (int c = 0; c < glass.cols(); c++)
             if (ret.schem(r, y, c) == prim_glass_builder::air &&
@@ -238,12 +251,18 @@ bool structure_3D_impl::export_litematica(
   libSchem::litematic_info info{};
   info.litename_utf8 = option.litename_utf8;
   info.regionname_utf8 = option.region_name_utf8;
+  info.region_count_x = option.region_count_x;
+  info.region_count_z = option.region_count_z;
 
   {
-    auto res = this->schem.export_litematic(filename, info);
+    auto res = this->schem.export_litematic(filename, info,
+                                            cancel_checker_of(option.ui));
 
     if (not res) {
-      option.ui.report_error(res.error().first, res.error().second.c_str());
+      if (not option.ui.report_if_cancelled()) {
+        option.ui.report_error(res.error().first, res.error().second.c_str());
+      }
+      option.ui.report_working_status(workStatus::none);
       return false;
     }
   }
@@ -258,9 +277,13 @@ bool structure_3D_impl::export_vanilla_structure(
   option.ui.report_working_status(workStatus::writingMetaInfo);
   option.progressbar.set_range(0, 100 + schem.size(), 0);
 
-  auto res = schem.export_structure(filename, option.is_air_structure_void);
+  auto res = schem.export_structure(filename, option.is_air_structure_void,
+                                    cancel_checker_of(option.ui));
   if (not res) {
-    option.ui.report_error(res.error().first, res.error().second.c_str());
+    if (not option.ui.report_if_cancelled()) {
+      option.ui.report_error(res.error().first, res.error().second.c_str());
+    }
+    option.ui.report_working_status(workStatus::none);
     return false;
   }
 
@@ -288,9 +311,11 @@ bool structure_3D_impl::export_WE_schem(
 
   option.progressbar.set_range(0, 100, 5);
 
-  auto res = schem.export_WESchem(filename, info);
+  auto res = schem.export_WESchem(filename, info, cancel_checker_of(option.ui));
   if (not res) {
-    option.ui.report_error(res.error().first, res.error().second.c_str());
+    if (not option.ui.report_if_cancelled()) {
+      option.ui.report_error(res.error().first, res.error().second.c_str());
+    }
     return false;
   }
 
@@ -359,13 +384,14 @@ bool structure_3D_impl::export_flat_diagram(
                                int64_t c) -> libFlatDiagram::block_img_ref_t {
     if (r < 0 || c < 0 || r >= this->schem.z_range() ||
         c >= this->schem.x_range()) {
-      return libFlatDiagram::block_img_ref_t{img_list_rmj.at(0).data()};
+      return libFlatDiagram::block_img_ref_t{img_list_rmj.at(0).data(), 16, 16};
     }
 
     const int ele = this->schem(c, 0, r);
     assert(ele >= 0 and ele < ptrdiff_t(this->schem.palette_size()));
 
-    return libFlatDiagram::block_img_ref_t{img_list_rmj.at(ele).data()};
+    return libFlatDiagram::block_img_ref_t{img_list_rmj.at(ele).data(), 16,
+                                           16};
   };
 
   std::array<std::pair<std::string, std::string>, 4> txt{
@@ -413,30 +439,187 @@ void load(archive &ar, Eigen::ArrayXX<uint8_t> &mat) {
 }
 }  // namespace cereal
 
+namespace {
+// Cache format v2: a small header, the block palette, a chunk table and raw
+// data chunks that are zstd-compressed one by one. The file is loaded by
+// memory mapping, and chunks are decompressed in parallel straight into the
+// destination buffers.
+constexpr std::array<char, 8> structure_cache_magic{'S', 'C', 'L', '3',
+                                                    'D', 'C', 'C', 'H'};
+constexpr uint32_t structure_cache_version{2};
+constexpr size_t structure_cache_chunk_bytes{size_t(4) << 20};
+
+struct structure_cache_header {
+  std::array<char, 8> magic;
+  uint32_t version;
+  int32_t mc_major_version;
+  int32_t mc_data_version;
+  uint32_t palette_size;
+  std::array<int64_t, 3> shape_xyz;
+  std::array<int64_t, 2> map_color_shape;
+  uint64_t block_count;
+  uint64_t chunk_count;
+};
+static_assert(std::is_trivially_copyable_v<structure_cache_header>);
+
+enum class cache_chunk_target : uint32_t { schem = 0, map_color = 1 };
+
+struct structure_cache_chunk {
+  cache_chunk_target target;
+  uint32_t reserved{0};
+  uint64_t raw_offset;  // offset in destination buffer
+  uint64_t raw_bytes;
+  uint64_t file_offset;  // offset of compressed data in file
+  uint64_t compressed_bytes;
+};
+static_assert(std::is_trivially_copyable_v<structure_cache_chunk>);
+
+class mapped_reader {
+ private:
+  std::span<const uint8_t> data_;
+  size_t pos_{0};
+
+ public:
+  explicit mapped_reader(std::span<const uint8_t> d) : data_{d} {}
+
+  std::span<const uint8_t> read_bytes(size_t bytes) {
+    if (bytes > this->data_.size() - this->pos_) {
+      throw std::runtime_error{
+          fmt::format("Cache file is truncated, expected {} bytes at offset "
+                      "{}, but the file has only {} bytes",
+                      bytes, this->pos_, this->data_.size())};
+    }
+    auto ret = this->data_.subspan(this->pos_, bytes);
+    this->pos_ += bytes;
+    return ret;
+  }
+
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  T read() {
+    T ret;
+    memcpy(&ret, this->read_bytes(sizeof(T)).data(), sizeof(T));
+    return ret;
+  }
+};
+
+template <class T>
+  requires std::is_trivially_copyable_v<T>
+void write_pod(std::ostream &os, const T &val) {
+  os.write(reinterpret_cast<const char *>(&val), sizeof(T));
+}
+
+int zstd_level() noexcept {
+  // ZSTD_defaultCLevel() doesn't exist below zstd 1.5
+#if ZSTD_VERSION_MINOR >= 5
+  return ZSTD_defaultCLevel();
+#else
+  return ZSTD_CLEVEL_DEFAULT;
+#endif
+}
+
+void split_into_chunks(cache_chunk_target target, size_t total_bytes,
+                       std::vector<structure_cache_chunk> &dest) noexcept {
+  for (size_t offset = 0; offset < total_bytes;
+       offset += structure_cache_chunk_bytes) {
+    dest.emplace_back(structure_cache_chunk{
+        .target = target,
+        .raw_offset = offset,
+        .raw_bytes =
+            std::min(structure_cache_chunk_bytes, total_bytes - offset),
+        .file_offset = 0,
+        .compressed_bytes = 0,
+    });
+  }
+}
+}  // namespace
+
 std::string structure_3D_impl::save_cache(
     const std::filesystem::path &filename) const noexcept {
   try {
     std::filesystem::create_directories(filename.parent_path());
-    boost::iostreams::filtering_ostream ofs{};
-    ofs.set_auto_close(true);
-    {
-      boost::iostreams::zstd_params params;
-      // ZSTD_defaultCLevel() doesn't exist below zstd 1.5
-#if ZSTD_VERSION_MINOR >= 5
-      params.level = uint32_t(ZSTD_defaultCLevel());
-#else
-      params.level = uint32_t(ZSTD_CLEVEL_DEFAULT);
-#endif
-      ofs.push(boost::iostreams::zstd_compressor{params});
-      ofs.push(
-          boost::iostreams::file_sink{filename.string(), std::ios::binary});
+
+    std::vector<structure_cache_chunk> chunks;
+    split_into_chunks(cache_chunk_target::schem,
+                      this->schem.size() * sizeof(libSchem::Schem::ele_t),
+                      chunks);
+    split_into_chunks(cache_chunk_target::map_color,
+                      this->map_color.size() * sizeof(uint8_t), chunks);
+
+    std::vector<std::vector<uint8_t>> compressed;
+    compressed.resize(chunks.size());
+    std::atomic<bool> compress_failed{false};
+    const int level = zstd_level();
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t idx = 0; idx < int64_t(chunks.size()); idx++) {
+      const auto &chunk = chunks[idx];
+      const auto *src =
+          (chunk.target == cache_chunk_target::schem)
+              ? reinterpret_cast<const uint8_t *>(this->schem.data())
+              : this->map_color.data();
+      auto &dst = compressed[idx];
+      dst.resize(ZSTD_compressBound(chunk.raw_bytes));
+      const size_t ret = ZSTD_compress(dst.data(), dst.size(),
+                                       src + chunk.raw_offset, chunk.raw_bytes,
+                                       level);
+      if (ZSTD_isError(ret)) {
+        compress_failed = true;
+        continue;
+      }
+      dst.resize(ret);
+    }
+    if (compress_failed) {
+      return "Failed to compress cache with zstd";
     }
 
-    {
-      cereal::BinaryOutputArchive boa{ofs};
-      boa(*this);
+    std::vector<uint8_t> palette_bytes;
+    for (const auto &id : this->schem.palette()) {
+      const uint32_t len = id.size();
+      const auto *len_p = reinterpret_cast<const uint8_t *>(&len);
+      palette_bytes.insert(palette_bytes.end(), len_p, len_p + sizeof(len));
+      palette_bytes.insert(palette_bytes.end(), id.begin(), id.end());
+    }
+
+    uint64_t file_offset = sizeof(structure_cache_header) +
+                           sizeof(uint64_t) + palette_bytes.size() +
+                           chunks.size() * sizeof(structure_cache_chunk);
+    for (size_t idx = 0; idx < chunks.size(); idx++) {
+      chunks[idx].file_offset = file_offset;
+      chunks[idx].compressed_bytes = compressed[idx].size();
+      file_offset += compressed[idx].size();
     }
 
+    const structure_cache_header header{
+        .magic = structure_cache_magic,
+        .version = structure_cache_version,
+        .mc_major_version = int32_t(this->schem.MC_major_version_number()),
+        .mc_data_version = int32_t(this->schem.MC_version_number()),
+        .palette_size = uint32_t(this->schem.palette_size()),
+        .shape_xyz = {this->schem.x_range(), this->schem.y_range(),
+                      this->schem.z_range()},
+        .map_color_shape = {this->map_color.rows(), this->map_color.cols()},
+        .block_count = this->block_count(),
+        .chunk_count = chunks.size(),
+    };
+
+    std::ofstream ofs{filename, std::ios::binary};
+    if (not ofs) {
+      return fmt::format("Failed to open {}", filename.string());
+    }
+    write_pod(ofs, header);
+    write_pod(ofs, uint64_t(palette_bytes.size()));
+    ofs.write(reinterpret_cast<const char *>(palette_bytes.data()),
+              palette_bytes.size());
+    for (const auto &chunk : chunks) {
+      write_pod(ofs, chunk);
+    }
+    for (const auto &data : compressed) {
+      ofs.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+    ofs.close();
+    if (not ofs) {
+      return fmt::format("Failed to write {}", filename.string());
+    }
   } catch (const std::exception &e) {
     return fmt::format("Caught exception: {}", e.what());
   }
@@ -444,8 +627,142 @@ std::string structure_3D_impl::save_cache(
   return {};
 }
 
+tl::expected<structure_3D_impl, std::string>
+structure_3D_impl::load_cache_mapped(std::span<const uint8_t> file) noexcept {
+  structure_3D_impl ret;
+  try {
+    mapped_reader reader{file};
+    const auto header = reader.read<structure_cache_header>();
+    if (header.magic != structure_cache_magic) {
+      return tl::make_unexpected("Not a structure cache file");
+    }
+    if (header.version != structure_cache_version) {
+      return tl::make_unexpected(
+          fmt::format("Unsupported structure cache version {}, expected {}",
+                      header.version, structure_cache_version));
+    }
+    {
+      std::string err = libSchem::Schem::check_size(
+          header.shape_xyz[0], header.shape_xyz[1], header.shape_xyz[2]);
+      if (not err.empty()) {
+        return tl::make_unexpected(std::move(err));
+      }
+      if (header.map_color_shape[0] < 0 || header.map_color_shape[1] < 0) {
+        return tl::make_unexpected("Found negative shape of map color");
+      }
+    }
+
+    ret.schem.set_MC_major_version_number(
+        SCL_gameVersion(header.mc_major_version));
+    ret.schem.set_MC_version_number(
+        MCDataVersion::MCDataVersion_t(header.mc_data_version));
+    {
+      mapped_reader palette_reader{
+          reader.read_bytes(reader.read<uint64_t>())};
+      std::vector<std::string_view> palette;
+      palette.reserve(header.palette_size);
+      for (uint32_t i = 0; i < header.palette_size; i++) {
+        auto bytes = palette_reader.read_bytes(palette_reader.read<uint32_t>());
+        palette.emplace_back(reinterpret_cast<const char *>(bytes.data()),
+                             bytes.size());
+      }
+      ret.schem.set_block_id(palette);
+    }
+    ret.schem.resize(header.shape_xyz[0], header.shape_xyz[1],
+                     header.shape_xyz[2]);
+    ret.map_color.resize(header.map_color_shape[0], header.map_color_shape[1]);
+    ret.block_count_ = header.block_count;
+
+    std::vector<structure_cache_chunk> chunks;
+    chunks.reserve(header.chunk_count);
+    for (uint64_t i = 0; i < header.chunk_count; i++) {
+      chunks.emplace_back(reader.read<structure_cache_chunk>());
+    }
+    // validate the chunk table before decompressing anything
+    const std::array<size_t, 2> dst_bytes{
+        ret.schem.size() * sizeof(libSchem::Schem::ele_t),
+        ret.map_color.size() * sizeof(uint8_t)};
+    for (const auto &chunk : chunks) {
+      if (chunk.target != cache_chunk_target::schem &&
+          chunk.target != cache_chunk_target::map_color) {
+        return tl::make_unexpected(
+            fmt::format("Unknown chunk target {} in cache",
+                        static_cast<uint32_t>(chunk.target)));
+      }
+      const size_t dst = dst_bytes[static_cast<uint32_t>(chunk.target)];
+      if (chunk.raw_offset > dst || chunk.raw_bytes > dst - chunk.raw_offset ||
+          chunk.file_offset > file.size() ||
+          chunk.compressed_bytes > file.size() - chunk.file_offset) {
+        return tl::make_unexpected("The chunk table of cache is broken");
+      }
+    }
+    // Chunks of each target must cover it exactly, without gaps or overlaps,
+    // otherwise some bytes are left uninitialized.
+    {
+      std::vector<const structure_cache_chunk *> sorted;
+      sorted.reserve(chunks.size());
+      for (const auto &chunk : chunks) {
+        sorted.emplace_back(&chunk);
+      }
+      std::ranges::sort(sorted, [](const auto *a, const auto *b) {
+        return std::pair{a->target, a->raw_offset} <
+               std::pair{b->target, b->raw_offset};
+      });
+      std::array<size_t, 2> covered{0, 0};
+      for (const auto *chunk : sorted) {
+        size_t &end = covered[static_cast<uint32_t>(chunk->target)];
+        if (chunk->raw_offset != end) {
+          return tl::make_unexpected(
+              "Chunks of cache have gaps or overlaps, it is broken");
+        }
+        end += chunk->raw_bytes;
+      }
+      if (covered != dst_bytes) {
+        return tl::make_unexpected(
+            "Chunks of cache don't cover the whole structure");
+      }
+    }
+
+    std::atomic<bool> decompress_failed{false};
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t idx = 0; idx < int64_t(chunks.size()); idx++) {
+      const auto &chunk = chunks[idx];
+      auto *dst = (chunk.target == cache_chunk_target::schem)
+                      ? reinterpret_cast<uint8_t *>(ret.schem.data())
+                      : ret.map_color.data();
+      const size_t ret_bytes =
+          ZSTD_decompress(dst + chunk.raw_offset, chunk.raw_bytes,
+                          file.data() + chunk.file_offset,
+                          chunk.compressed_bytes);
+      if (ZSTD_isError(ret_bytes) || ret_bytes != chunk.raw_bytes) {
+        decompress_failed = true;
+      }
+    }
+    if (decompress_failed) {
+      return tl::make_unexpected("Failed to decompress cache, it is broken");
+    }
+  } catch (const std::exception &e) {
+    return tl::make_unexpected(fmt::format("Caught exception: {}", e.what()));
+  }
+  return ret;
+}
+
 tl::expected<structure_3D_impl, std::string> structure_3D_impl::load_cache(
     const std::filesystem::path &filename) noexcept {
+  try {
+    boost::iostreams::mapped_file_source file{filename.string()};
+    std::span<const uint8_t> data{
+        reinterpret_cast<const uint8_t *>(file.data()), file.size()};
+    if (data.size() >= structure_cache_magic.size() &&
+        std::equal(structure_cache_magic.begin(), structure_cache_magic.end(),
+                   data.begin())) {
+      return load_cache_mapped(data);
+    }
+  } catch (const std::exception &e) {
+    return tl::make_unexpected(fmt::format("Caught exception: {}", e.what()));
+  }
+
+  // fall back to cache written by older versions
   structure_3D_impl ret;
   try {
     boost::iostreams::filtering_istream ifs;
@@ -465,6 +782,9 @@ tl::expected<structure_3D_impl, std::string> structure_3D_impl::load_cache(
 }
 
 uint64_t structure_3D_impl::block_count() const noexcept {
+  if (this->block_count_.has_value()) {
+    return this->block_count_.value();
+  }
   std::vector<uint8_t> LUT_is_air;
   LUT_is_air.reserve(this->schem.palette_size());
   for (auto &id : this->schem.palette()) {
@@ -17,6 +17,11 @@ class structure_3D_impl : public structure_3D {
   Eigen::ArrayXX<uint8_t>
       map_color;  // map color may be modified by lossy
                   // compression,so we store the modified one
+ private:
+  // stored in cache header, so loading a cache doesn't need to count blocks
+  std::optional<uint64_t> block_count_{std::nullopt};
+
+ public:
 
   size_t shape_x() const noexcept final { return this->schem.x_range(); }
   size_t shape_y() const noexcept final { return this->schem.y_range(); }
@@ -52,6 +57,12 @@ class structure_3D_impl : public structure_3D {
   [[nodiscard]] static tl::expected<structure_3D_impl, std::string> load_cache(
       const std::filesystem::path &file) noexcept;
 
+ private:
+  [[nodiscard]] static tl::expected<structure_3D_impl, std::string>
+  load_cache_mapped(std::span<const uint8_t> file) noexcept;
+
+ public:
+
   uint64_t block_count() const noexcept final;
 
   template <class archive>
@@ -257,6 +257,26 @@ bool VCL_block_state_list::add(std::string_view filename) noexcept {
   return true;
 }
 
+VCL_block_state_list::VCL_block_state_list(const VCL_block_state_list &src)
+    : states{src.states} {
+  this->rebind_full_ids();
+}
+
+VCL_block_state_list &VCL_block_state_list::operator=(
+    const VCL_block_state_list &src) {
+  if (this != &src) {
+    this->states = src.states;
+    this->rebind_full_ids();
+  }
+  return *this;
+}
+
+void VCL_block_state_list::rebind_full_ids() noexcept {
+  for (auto &[id, blk] : this->states) {
+    blk.full_id_p = &id;
+  }
+}
+
 void VCL_block_state_list::available_block_states(
     SCL_gameVersion v, VCL_face_t f,
     std::vector<VCL_block *> *const str_list) noexcept {
@@ -164,7 +164,18 @@ class VCL_block_state_list {
  private:
   std::unordered_map<std::string, VCL_block> states;
 
+  // make full_id_p of each block point to its key in this->states
+  void rebind_full_ids() noexcept;
+
  public:
+  VCL_block_state_list() = default;
+  // Copies rebind full_id_p to their own keys. Moving keeps the nodes of
+  // states, so full_id_p stays valid.
+  VCL_block_state_list(const VCL_block_state_list &src);
+  VCL_block_state_list(VCL_block_state_list &&) noexcept = default;
+  VCL_block_state_list &operator=(const VCL_block_state_list &src);
+  VCL_block_state_list &operator=(VCL_block_state_list &&) noexcept = default;
+
   using is_allowed_callback_t = std::function<bool(const VCL_block *)>;
   bool add(std::string_view filename) noexcept;
 
@@ -190,6 +201,15 @@ class VCL_block_state_list {
     return &it->second;
   }
 
+  // whether blk is an element of this list, not a copy of it
+  inline bool contains(const VCL_block *blk) const noexcept {
+    if (blk == nullptr || blk->full_id_ptr() == nullptr) {
+      return false;
+    }
+    auto it = this->states.find(*blk->full_id_ptr());
+    return it != this->states.end() && &it->second == blk;
+  }
+
   void update_foliages(bool is_foliage_transparent) noexcept;
 };
 
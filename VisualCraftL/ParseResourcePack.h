@@ -61,6 +61,13 @@ resize_image_nearest(
                        .block(0, 0, 1, 1)) src_block,
     int rows, int cols) noexcept;
 
+/// Downsample by averaging each factor*factor box of pixels, like a level of
+/// mipmap. Rows and cols of src must be multiples of factor.
+Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+downsample_image_box(const Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic,
+                                        Eigen::RowMajor> &src,
+                     int factor) noexcept;
+
 Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
 process_dynamic_texture(const Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic,
                                            Eigen::RowMajor> &src) noexcept;
@@ -392,6 +399,10 @@ class element {
            (point <= this->xyz_maxpos()).all();
   }
 
+  /// uv in range [0,1] of a point on face f, rotated by the face.
+  std::array<float, 2> face_uv(face_idx f,
+                               const Eigen::Array3f &coordinate) const noexcept;
+
   void intersect_points(
       const face_idx f, const ray_t &ray,
       std::vector<intersect_point> *const dest) const noexcept;
@@ -418,10 +429,24 @@ class model {
     }
   }
 
-  EImgRowMajor_t projection_image(face_idx fidx) const noexcept;
+  /// Render the model seen from face fidx. Each face is projected as a
+  /// rectangle and composed front to back, so the image can be of any
+  /// resolution.
+  EImgRowMajor_t projection_image(face_idx fidx,
+                                  int resolution = 16) const noexcept;
 
-  void projection_image(face_idx idx,
-                        EImgRowMajor_t *const dest) const noexcept;
+  void projection_image(face_idx idx, EImgRowMajor_t *const dest,
+                        int resolution = 16) const noexcept;
+
+  /// Like projection_image, but if textures are larger than resolution, the
+  /// model is rendered at texture resolution into full_res_buffer, then
+  /// downsampled by box filter.
+  void projection_image_downsampled(
+      face_idx fidx, EImgRowMajor_t *const dest, int resolution,
+      EImgRowMajor_t *const full_res_buffer) const noexcept;
+
+  /// The largest size of textures on visible faces, or 0 if none.
+  int texture_resolution() const noexcept;
 
   void merge_back(const model &md, face_rot x_rot, face_rot y_rot) noexcept;
 };
@@ -610,6 +635,10 @@ class VCL_resource_pack {
 
   inline void set_is_MC12(bool val) noexcept { this->is_MC12 = val; }
 
+  // Whether the file in resource pack is read by add_* functions. Other files
+  // needn't to be loaded.
+  static bool is_file_used(std::string_view path_in_zip) noexcept;
+
   bool add_colormaps(const zipped_folder &resource_pack_root) noexcept;
 
   bool add_textures(const zipped_folder &resourece_pack_root,
@@ -664,6 +693,8 @@ class VCL_resource_pack {
     std::string pure_id;
     // std::vector<std::pair<std::string, std::string>> traits;
     resource_json::state_list state_list;
+    // projection rendered at texture resolution before downsampling
+    block_model::EImgRowMajor_t full_res_projection;
   };
 
   std::variant<model_with_rotation, block_model::model> find_model(
@@ -675,10 +706,13 @@ class VCL_resource_pack {
   std::variant<model_with_rotation, block_model::model> find_model(
       const std::string &block_state_str, buffer_t &) const noexcept;
 
+  /// Compute the projection image of a block in resolution*resolution. Every
+  /// texture pixel counts in the result, see
+  /// model::projection_image_downsampled.
   bool compute_projection(const std::string &block_state_str,
                           VCL_face_t face_exposed,
-                          block_model::EImgRowMajor_t *const img,
-                          buffer_t &) const noexcept;
+                          block_model::EImgRowMajor_t *const img, buffer_t &,
+                          int resolution = 16) const noexcept;
 
   inline const auto &get_colormap(bool is_foliage) const noexcept {
     return (is_foliage) ? (this->colormap_foliage) : (this->colormap_grass);
@@ -22,6 +22,7 @@ This file is part of SlopeCraft.
 
 #include "ParseResourcePack.h"
 #include "VCL_internal.h"
+#include <algorithm>
 
 using namespace block_model;
 using Array3f = ::Eigen::Array3f;
@@ -123,283 +124,287 @@ Array3f crossover_point(const plane_t &plane, const ray_t &ray) noexcept {
   return result;
 }
 
-void element::intersect_points(
-    const face_idx f, const ray_t &ray,
-    std::vector<intersect_point> *const dest) const noexcept {
-  if (dest == nullptr)
-    return;
-
-  // const Array3f &start_point = ray.x0y0z0;
-  /*  switch (f) {
-    case face_x_pos:
-      start_point = {128, 0, 0};
-      break;
+namespace {
+// faces with (almost) zero area are never hit
+bool is_face_visible(const element &ele, face_idx f) noexcept {
+  if (ele.face(f).is_hidden) {
+    return false;
+  }
+  switch (f) {
     case face_x_neg:
-      start_point = {-128, 0, 0};
-      break;
-
-    case face_y_pos:
-      start_point = {0, 128, 0};
-      break;
+    case face_x_pos:
+      return ele.y_range_abs() * ele.z_range_abs() >= 1e-4f;
     case face_y_neg:
-      start_point = {0, -128, 0};
-      break;
-
-    case face_z_pos:
-      start_point = {0, 0, 128};
-      break;
+    case face_y_pos:
+      return ele.x_range_abs() * ele.z_range_abs() >= 1e-4f;
     case face_z_neg:
-      start_point = {0, 0, -128};
-      break;
-    }
-  */
-
-  if (this->face(f).is_hidden)
-    return;
-
-  switch (f) {
-  case face_x_neg:
-  case face_x_pos:
-    if (this->y_range_abs() * this->z_range_abs() < 1e-4f) {
-      // VCL_report(VCL_report_type_t::information, "yz range skip");
-      return;
-    }
-    break;
-  case face_y_neg:
-  case face_y_pos:
-    if (this->x_range_abs() * this->z_range_abs() < 1e-4f) {
-      // VCL_report(VCL_report_type_t::information, "xz range skip");
-      return;
-    }
-    break;
-  case face_z_neg:
-  case face_z_pos:
-    if (this->x_range_abs() * this->y_range_abs() < 1e-4f) {
-      // VCL_report(VCL_report_type_t::information, "xy range skip");
-      return;
-    }
-    break;
+    case face_z_pos:
+      return ele.x_range_abs() * ele.y_range_abs() >= 1e-4f;
   }
+  return false;
+}
+}  // namespace
 
-  intersect_point intersect{1e9f, {0, 0}, nullptr};
-  Array3f coordinate;
-  coordinate = crossover_point(this->plane(f), ray);
-  // printf("\nelement::intersect_points : coordinate = [%f, %f,
-  // %f]",coordinate[0], coordinate[1], coordinate[2]);
-  if (!this->is_not_outside(coordinate))
-    return;
-
-  intersect.face_ptr = &this->face(f);
-
+std::array<float, 2> element::face_uv(
+    face_idx f, const Array3f &coordinate) const noexcept {
   const Array3f min_pos = this->xyz_minpos();
   const Array3f max_pos = this->xyz_maxpos();
-  /*
-  printf("\nelement::intersect_points : ");
-  printf("min_pos = [%f, %f, %f]; ", min_pos[0], min_pos[1], min_pos[2]);
-  printf("max_pos = [%f, %f, %f]; ", max_pos[0], max_pos[1], max_pos[2]);
-
-  */
 
   // u is col and v is row
-  Array3f uv_start;
-  // #warning compute uv here
-
+  std::array<float, 2> uv;
   switch (f) {
-  case face_idx::face_up:
-    uv_start = {min_pos[0], max_pos[1], min_pos[2]};
-    // uv_end=max_pos;
-
-    // here u <-> x+
-    intersect.uv[0] = (coordinate[0] - uv_start[0]) / this->x_range_abs();
-    // here v<-> z+
-    intersect.uv[1] = (coordinate[2] - uv_start[2]) / this->z_range_abs();
-    /*
-    printf("\nelement::intersect_points : face = up, uv_start = [%f, %f, %f],
-    " "uv = [%f, %f] ", uv_start[0], uv_start[1], uv_start[2],
-    intersect.uv[0], intersect.uv[1]);
-
-           */
-
-    break;
-
-  case face_idx::face_down:
-    uv_start = {max_pos[0], min_pos[1], max_pos[2]};
-    {
-      Array3f uv_end = {min_pos[0], min_pos[1], min_pos[2]};
-      //   here u <-> x+
-      intersect.uv[0] = (coordinate[0] - uv_end[0]) / this->x_range_abs();
-      // here v <-> z-
-      intersect.uv[1] = (uv_start[2] - coordinate[2]) / this->z_range_abs();
-    }
-    break;
+    case face_idx::face_up:
+      // here u <-> x+, v <-> z+
+      uv[0] = (coordinate[0] - min_pos[0]) / this->x_range_abs();
+      uv[1] = (coordinate[2] - min_pos[2]) / this->z_range_abs();
+      break;
+    case face_idx::face_down:
+      // here u <-> x+, v <-> z-
+      uv[0] = (coordinate[0] - min_pos[0]) / this->x_range_abs();
+      uv[1] = (max_pos[2] - coordinate[2]) / this->z_range_abs();
+      break;
+    case face_idx::face_east:
+      // here u <-> z-, v <-> y-
+      uv[0] = (max_pos[2] - coordinate[2]) / this->z_range_abs();
+      uv[1] = (max_pos[1] - coordinate[1]) / this->y_range_abs();
+      break;
+    case face_idx::face_west:
+      // here u <-> z+, v <-> y-
+      uv[0] = (coordinate[2] - min_pos[2]) / this->z_range_abs();
+      uv[1] = (max_pos[1] - coordinate[1]) / this->y_range_abs();
+      break;
+    case face_idx::face_south:
+      // here u <-> x+, v <-> y-
+      uv[0] = (coordinate[0] - min_pos[0]) / this->x_range_abs();
+      uv[1] = (max_pos[1] - coordinate[1]) / this->y_range_abs();
+      break;
+    case face_idx::face_north:
+      // here u <-> x-, v <-> y-
+      uv[0] = (max_pos[0] - coordinate[0]) / this->x_range_abs();
+      uv[1] = (max_pos[1] - coordinate[1]) / this->y_range_abs();
+      break;
+  }
 
-  case face_idx::face_east:
-    // uv_start=max_pos;
-    uv_start = {max_pos[0], max_pos[1], max_pos[2]};
-    // uv_end = {max_pos[0], min_pos[1], min_pos[2]};
-    //  here u <-> z-
-    intersect.uv[0] = (uv_start[2] - coordinate[2]) / this->z_range_abs();
-    // here v <-> y-
-    intersect.uv[1] = (uv_start[1] - coordinate[1]) / this->y_range_abs();
-    break;
+  for (auto &val : uv) {
+    val = std::max<float>(std::min<float>(val, 1), 0);
+  }
 
-  case face_idx::face_west:
-    uv_start = {min_pos[0], max_pos[1], min_pos[2]};
-    // uv_end = {min_pos[0], min_pos[1], max_pos[2]};
+  switch (this->face(f).rot) {
+    case face_rot::face_rot_0:
+      break;
+    case face_rot::face_rot_90: {
+      const float temp_u = uv[0];
+      uv[0] = uv[1];
+      uv[1] = 1 - temp_u;
+    } break;
+    case face_rot::face_rot_180:
+      uv[0] = 1 - uv[0];
+      uv[1] = 1 - uv[1];
+      break;
+    case face_rot::face_rot_270: {
+      const float temp_u = uv[0];
+      uv[0] = 1 - uv[1];
+      uv[1] = temp_u;
+    } break;
+  }
+  return uv;
+}
 
-    // here u <-> z+
-    intersect.uv[0] = (coordinate[2] - uv_start[2]) / this->z_range_abs();
-    // here v <-> y-
-    intersect.uv[1] = (uv_start[1] - coordinate[1]) / this->y_range_abs();
-    break;
+void element::intersect_points(
+    const face_idx f, const ray_t &ray,
+    std::vector<intersect_point> *const dest) const noexcept {
+  if (dest == nullptr) return;
 
-  case face_idx::face_south:
-    uv_start = {min_pos[0], max_pos[1], max_pos[2]};
-    // uv_end = {max_pos[0], min_pos[1], max_pos[2]};
+  if (!is_face_visible(*this, f)) return;
 
-    // here u <-> x+
-    intersect.uv[0] = (coordinate[0] - uv_start[0]) / this->x_range_abs();
-    // here v <-> y-
-    intersect.uv[1] = (uv_start[1] - coordinate[1]) / this->y_range_abs();
-    break;
+  const Array3f coordinate = crossover_point(this->plane(f), ray);
+  if (!this->is_not_outside(coordinate)) return;
 
-  case face_idx::face_north:
-    uv_start = {max_pos[0], max_pos[0], min_pos[0]};
-    // uv_end = min_pos;
+  intersect_point intersect;
+  intersect.face_ptr = &this->face(f);
+  intersect.uv = this->face_uv(f, coordinate);
+  intersect.distance = (coordinate - ray.x0y0z0).square().sum();
 
-    // here u <-> x-
-    intersect.uv[0] = (uv_start[0] - coordinate[0]) / this->x_range_abs();
-    // here v <-> y-
-    intersect.uv[1] = (uv_start[1] - coordinate[1]) / this->y_range_abs();
-    break;
-  }
+  dest->emplace_back(intersect);
+}
 
-  for (auto &uv : intersect.uv) {
-    uv = std::max<float>(std::min<float>(uv, 16), 0);
+namespace {
+// How pixels of a projection image map to model coordinates. Rays are
+// parallel to depth_axis, so every face seen is a rectangle of constant depth.
+struct projection_layout {
+  int col_axis;
+  bool col_increasing;
+  int row_axis;
+  bool row_increasing;
+  int depth_axis;
+  // where rays start on depth_axis
+  float origin;
+};
+
+constexpr projection_layout layout_of(face_idx fidx) noexcept {
+  switch (fidx) {
+    case face_idx::face_up:
+      return {x_idx, true, z_idx, true, y_idx, 128.0f};
+    case face_idx::face_down:
+      return {x_idx, true, z_idx, false, y_idx, -128.0f};
+    case face_idx::face_east:
+      return {z_idx, false, y_idx, false, x_idx, 128.0f};
+    case face_idx::face_west:
+      return {z_idx, true, y_idx, false, x_idx, -128.0f};
+    case face_idx::face_south:
+      return {x_idx, true, y_idx, false, z_idx, 128.0f};
+    case face_idx::face_north:
+      return {x_idx, false, y_idx, false, z_idx, -128.0f};
   }
+  return {x_idx, true, z_idx, true, y_idx, 128.0f};
+}
 
-  switch (intersect.face_ptr->rot) {
-  case face_rot::face_rot_0:
-    break;
-  case face_rot::face_rot_90: {
-    float temp_u = intersect.uv[0];
-    intersect.uv[0] = intersect.uv[1];
-    intersect.uv[1] = 1 - temp_u;
-  } break;
-
-  case face_rot::face_rot_180:
-    intersect.uv[0] = 1 - intersect.uv[0];
-    intersect.uv[1] = 1 - intersect.uv[1];
-    break;
+// Coordinate of the center of pixel idx. For resolution 16 it's exactly
+// idx + 0.5 or 15.5 - idx.
+inline float pixel_center(int idx, bool increasing, float pixel_size) noexcept {
+  const float pos = (idx + 0.5f) * pixel_size;
+  return increasing ? pos : 16.0f - pos;
+}
 
-  case face_rot::face_rot_270: {
-    float temp_u = intersect.uv[0];
-    intersect.uv[0] = 1 - intersect.uv[1];
-    intersect.uv[1] = temp_u;
-    break;
-  }
+// Range [first, last] of pixels whose centers are in [min, max]. last < first
+// if there is none.
+std::pair<int, int> covered_pixels(float min, float max, bool increasing,
+                                   float pixel_size, int resolution) noexcept {
+  int first = resolution, last = -1;
+  for (int idx = 0; idx < resolution; idx++) {
+    const float pos = pixel_center(idx, increasing, pixel_size);
+    if (pos >= min && pos <= max) {
+      first = std::min(first, idx);
+      last = std::max(last, idx);
+    }
   }
-
-  intersect.distance = (coordinate - ray.x0y0z0).square().sum();
-
-  dest->emplace_back(intersect);
+  return {first, last};
 }
 
-inline bool intersect_compare_fun(const intersect_point &a,
-                                  const intersect_point &b) noexcept {
-  return a.distance < b.distance;
+// position of face f on the depth axis
+inline float face_depth(const element &ele, face_idx f,
+                        const projection_layout &layout) noexcept {
+  const bool is_max_side = (f == face_x_pos || f == face_y_pos ||
+                            f == face_z_pos);
+  return is_max_side ? ele.xyz_maxpos()[layout.depth_axis]
+                     : ele.xyz_minpos()[layout.depth_axis];
 }
 
-void model::projection_image(face_idx fidx,
-                             EImgRowMajor_t *const dest) const noexcept {
-  dest->resize(16, 16);
-  dest->fill(0x00000000);
+struct projected_face {
+  const element *ele;
+  face_idx face;
+  float distance;
+};
+}  // namespace
+
+void model::projection_image(face_idx fidx, EImgRowMajor_t *const dest,
+                             int resolution) const noexcept {
+  resolution = std::max(resolution, 1);
+  dest->resize(resolution, resolution);
   dest->fill(0x00000000);
 
-  std::vector<intersect_point> intersects;
-  intersects.reserve(this->elements.size() * 2);
-
-  ray_t ray(fidx);
-  for (int r = 0; r < 16; r++) {
-    for (int c = 0; c < 16; c++) {
-      // printf("\nr = %i, c = %i, : ", r, c);
-
-      intersects.clear();
-
-      // set the origin point of a ray
-      switch (fidx) {
-      case face_idx::face_up:
-        ray.x0y0z0 = {c + 0.5f, 128.0f, r + 0.5f};
-        break;
-      case face_idx::face_down:
-        ray.x0y0z0 = {c + 0.5f, -128.0f, 15.5f - r};
-        break;
-
-      case face_idx::face_east:
-        // r->y-, c->z-,x=128
-        ray.x0y0z0 = {128.0f, 15.5f - r, 15.5f - c};
-        break;
-      case face_idx::face_west:
-        // r->y-, c->z+, x=-128
-        ray.x0y0z0 = {-128.0f, 15.5f - r, c + 0.5f};
-        break;
-      case face_idx::face_south:
-        // r->y-, c->x+, z=128
-        ray.x0y0z0 = {c + 0.5f, 15.5f - r, 128.0f};
-        break;
-      case face_idx::face_north:
-        // r->y-, c->x-, z=-128
-        ray.x0y0z0 = {15.5f - c, 15.5f - r, -128.0f};
-        break;
+  const projection_layout layout = layout_of(fidx);
+  const float pixel_size = 16.0f / resolution;
+
+  // The face facing the ray is seen if visible, otherwise the one behind it.
+  // Both cover the same rectangle.
+  std::vector<projected_face> faces;
+  faces.reserve(this->elements.size());
+  for (const element &ele : this->elements) {
+    face_idx f = fidx;
+    if (!is_face_visible(ele, f)) {
+      f = inverse_face(fidx);
+      if (!is_face_visible(ele, f)) {
+        continue;
       }
-
-      for (const element &ele : this->elements) {
-        const size_t n_cur = intersects.size();
-        ele.intersect_points(fidx, ray, &intersects);
-        if (intersects.size() > n_cur) {
-          // skip the reverse face if there is already a intersect
+    }
+    const float diff = face_depth(ele, f, layout) - layout.origin;
+    faces.emplace_back(projected_face{&ele, f, diff * diff});
+  }
+  // front to back
+  std::stable_sort(faces.begin(), faces.end(),
+                   [](const projected_face &a, const projected_face &b) {
+                     return a.distance < b.distance;
+                   });
+
+  int opaque_pixels = 0;
+  const int total_pixels = resolution * resolution;
+  Array3f coordinate;
+  for (const projected_face &pf : faces) {
+    const element &ele = *pf.ele;
+    const Array3f min_pos = ele.xyz_minpos();
+    const Array3f max_pos = ele.xyz_maxpos();
+
+    const auto [c_first, c_last] = covered_pixels(
+        min_pos[layout.col_axis], max_pos[layout.col_axis],
+        layout.col_increasing, pixel_size, resolution);
+    const auto [r_first, r_last] = covered_pixels(
+        min_pos[layout.row_axis], max_pos[layout.row_axis],
+        layout.row_increasing, pixel_size, resolution);
+
+    intersect_point ip;
+    ip.face_ptr = &ele.face(pf.face);
+    ip.distance = pf.distance;
+    coordinate[layout.depth_axis] = face_depth(ele, pf.face, layout);
+
+    for (int r = r_first; r <= r_last; r++) {
+      coordinate[layout.row_axis] =
+          pixel_center(r, layout.row_increasing, pixel_size);
+      for (int c = c_first; c <= c_last; c++) {
+        ARGB &color = dest->operator()(r, c);
+        if (getA(color) >= 255) {
           continue;
         }
-        ele.intersect_points(inverse_face(fidx), ray, &intersects);
-      }
-      if constexpr (false) {
-        std::string msg =
-            fmt::format("num of intersects : {}", intersects.size());
-        VCL_report(VCL_report_type_t::information, msg.c_str());
+        coordinate[layout.col_axis] =
+            pixel_center(c, layout.col_increasing, pixel_size);
+        ip.uv = ele.face_uv(pf.face, coordinate);
+        color = ComposeColor_background_half_transparent(color, ip.color());
+        if (getA(color) >= 255) {
+          opaque_pixels++;
+        }
       }
+    }
+    if (opaque_pixels >= total_pixels) {
+      break;
+    }
+  }
+}
 
-      // printf("\n");
-
-      std::sort(intersects.begin(), intersects.end(), intersect_compare_fun);
+void model::projection_image_downsampled(
+    face_idx fidx, EImgRowMajor_t *const dest, int resolution,
+    EImgRowMajor_t *const full_res_buffer) const noexcept {
+  resolution = std::max(resolution, 1);
+  // smallest multiple of resolution that keeps all texture pixels
+  const int factor =
+      std::max(1, (this->texture_resolution() + resolution - 1) / resolution);
+  if (factor <= 1) {
+    this->projection_image(fidx, dest, resolution);
+    return;
+  }
 
-      // printf("\nmodel::projection_image : r = %i, c = %i; ", r, c);
-      /*printf("intersects distance = [ ");
-      for (auto i : intersects) {
-        printf("%f, ", i.distance);
-      }
-      printf("];");
-      */
+  this->projection_image(fidx, full_res_buffer, resolution * factor);
+  *dest = downsample_image_box(*full_res_buffer, factor);
+}
 
-      ARGB color = 0x00000000;
-      // printf("\n color : ");
-      for (intersect_point &ip : intersects) {
-        // printf("\n0x%08X + 0x%08X -> ", color, ip.color());
-        color = ComposeColor_background_half_transparent(color, ip.color());
-        // printf("0x%08X; ", color);
-        if (getA(color) >= 255)
-          break;
+int model::texture_resolution() const noexcept {
+  int result = 0;
+  for (const element &ele : this->elements) {
+    for (const face_t &f : ele.faces) {
+      if (f.is_hidden || f.texture == nullptr) {
+        continue;
       }
-      // printf(";");
-
-      dest->operator()(r, c) = color;
+      result = std::max<int>(result, f.texture->rows());
+      result = std::max<int>(result, f.texture->cols());
     }
   }
+  return result;
 }
 
-EImgRowMajor_t model::projection_image(face_idx fidx) const noexcept {
-  EImgRowMajor_t result(16, 16);
+EImgRowMajor_t model::projection_image(face_idx fidx,
+                                       int resolution) const noexcept {
+  EImgRowMajor_t result(resolution, resolution);
 
-  this->projection_image(fidx, &result);
+  this->projection_image(fidx, &result, resolution);
 
   return result;
 }
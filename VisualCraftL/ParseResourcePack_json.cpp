@@ -948,15 +948,15 @@ void dereference_model(block_model_json_temp &model) {
   // finished current element
 }
 
+// parent.is_inherited must be set by caller, so that children of the same
+// parent can inherit concurrently.
 bool model_json_inherit_new(block_model_json_temp &child,
-                            block_model_json_temp &parent, const bool) {
+                            const block_model_json_temp &parent, const bool) {
   if (child.parent.empty()) {
     ::VCL_report(VCL_report_type_t::error, "child has no parent.");
     return false;
   }
 
-  parent.is_inherited = true;
-
   // child.textures.reserve(child.textures.size() + parent.textures.size());
   // merge textures
   for (const auto &pt : parent.textures) {
@@ -980,52 +980,71 @@ bool model_json_inherit_new(block_model_json_temp &child,
   return true;
 }
 
-bool inherit_recrusively(std::string_view childname,
-                         block_model_json_temp &child,
-                         std::unordered_map<std::string, block_model_json_temp>
-                             &temp_models) noexcept {
-  if (child.parent.empty()) return true;
-
-  // #warning This function is not finished yet. I hope to inherit from the
-  // root, which measn to find the root and inherit from root to leaf
-
-  // find parent till the root
-  auto it = temp_models.find(child.parent);
+namespace {
+// Both must be less than -1, which is the depth before a root model.
+constexpr int inherit_depth_invalid = -2;
+constexpr int inherit_depth_visiting = -3;
+
+// Number of ancestors of each model. Models with a missing ancestor or an
+// inheritance loop get inherit_depth_invalid.
+std::unordered_map<std::string_view, int> compute_inherit_depth(
+    const std::unordered_map<std::string, block_model_json_temp>
+        &temp_models) noexcept {
+  std::unordered_map<std::string_view, int> depth;
+  depth.reserve(temp_models.size());
+  std::vector<std::string_view> chain;
+
+  for (const auto &model : temp_models) {
+    chain.clear();
+    // depth of the last model in chain minus 1
+    int d = 0;
+    const auto *cur = &model;
+    while (true) {
+      auto known = depth.find(cur->first);
+      if (known != depth.end()) {
+        d = known->second;
+        if (d == inherit_depth_visiting) {
+          std::string msg = fmt::format(
+              "Failed to inherit. Model {} inherits from itself.", cur->first);
+          ::VCL_report(VCL_report_type_t::error, msg.c_str());
+          d = inherit_depth_invalid;
+        }
+        break;
+      }
 
-  if (it == temp_models.end()) {
-    std::string msg = fmt::format(
-        "Failed to inherit. Undefined reference to model {}, "
-        "required by {}.",
-        child.parent.data(), childname.data());
-    ::VCL_report(VCL_report_type_t::error, msg.c_str());
-    return false;
-  }
+      chain.emplace_back(cur->first);
+      depth.emplace(cur->first, inherit_depth_visiting);
+      if (cur->second.parent.empty()) {
+        // so that the root gets depth 0
+        d = -1;
+        break;
+      }
 
-  if (!it->second.parent.empty()) {
-    // find root
-    const bool success =
-        inherit_recrusively(it->first, it->second, temp_models);
-    if (!success) {
-      return false;
+      auto parent = temp_models.find(cur->second.parent);
+      if (parent == temp_models.end()) {
+        std::string msg = fmt::format(
+            "Failed to inherit. Undefined reference to model {}, "
+            "required by {}.",
+            cur->second.parent, cur->first);
+        ::VCL_report(VCL_report_type_t::error, msg.c_str());
+        d = inherit_depth_invalid;
+        break;
+      }
+      cur = &*parent;
     }
-  }
-  /*
-  printf("\ninhering : parent : %s, child : %s,\n", child.parent.data(),
-         childname.data());
-         */
-  const bool success = model_json_inherit_new(child, it->second, false);
 
-  // dereference_texture_name(child.textures);
-
-  if (!success) {
-    std::string msg = fmt::format("Failed to inherit. Child : {}, parent : {}.",
-                                  childname.data(), child.parent.data());
-    ::VCL_report(VCL_report_type_t::error, msg.c_str());
-    return false;
+    // the back of chain is the nearest to root
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      if (d != inherit_depth_invalid) {
+        d++;
+      }
+      depth[*it] = d;
+    }
   }
 
-  return true;
+  return depth;
 }
+}  // namespace
 
 bool resource_pack::add_block_models(
     const zipped_folder &resource_pack_root,
@@ -1045,88 +1064,121 @@ bool resource_pack::add_block_models(
     files = &temp->files;
   }
 
-  // the name of model is : block/<model-name>
-  std::unordered_map<std::string, block_model_json_temp> temp_models;
-
-  temp_models.reserve(files->size());
-
-  std::array<char, 1024> buffer;
-
+  // parse all jsons in parallel
+  std::vector<const std::pair<const std::string, zipped_file> *> json_files;
+  json_files.reserve(files->size());
   for (const auto &file : *files) {
-    if (!file.first.ends_with(".json")) continue;
-    buffer.fill('\0');
-    std::strcpy(buffer.data(), "block/");
-    {
-      const int end = file.first.find_last_of('.');
-      char *const dest = buffer.data() + std::strlen(buffer.data());
-      for (int idx = 0; idx < end; idx++) {
-        dest[idx] = file.first[idx];
-      }
+    if (file.first.ends_with(".json")) {
+      json_files.emplace_back(&file);
     }
+  }
 
-    block_model_json_temp bmjt;
-
-    const bool ok = parse_single_model_json(
-        (const char *)file.second.data(),
-        (const char *)file.second.data() + file.second.file_size(), &bmjt);
+  std::vector<block_model_json_temp> parsed_models(json_files.size());
+  // std::vector<bool> can't be written concurrently
+  std::vector<uint8_t> parse_ok(json_files.size(), false);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t idx = 0; idx < int64_t(json_files.size()); idx++) {
+    const zipped_file &file = json_files[idx]->second;
+    parse_ok[idx] = parse_single_model_json(
+        (const char *)file.data(), (const char *)file.data() + file.file_size(),
+        &parsed_models[idx]);
+  }
 
-    if (!ok) {
+  // the name of model is : block/<model-name>
+  std::unordered_map<std::string, block_model_json_temp> temp_models;
+  temp_models.reserve(json_files.size());
+  for (size_t idx = 0; idx < json_files.size(); idx++) {
+    const std::string &filename = json_files[idx]->first;
+    if (!parse_ok[idx]) {
       std::string msg = fmt::format(
-          "Failed to parse assets/minecraft/models/block/{}.", file.first);
+          "Failed to parse assets/minecraft/models/block/{}.", filename);
       ::VCL_report(VCL_report_type_t::error, msg.c_str());
       return false;
     }
-
-    temp_models.emplace(buffer.data(), bmjt);
-  }
-  // parsed all jsons
-  /*
-  printf("Loaded %i model jsons.\n", int(temp_models.size()));
-
-  for (const auto &file : temp_models) {
-    printf("%s, ", file.first.data());
+    temp_models.emplace(
+        fmt::format("block/{}",
+                    std::string_view{filename}.substr(
+                        0, filename.find_last_of('.'))),
+        std::move(parsed_models[idx]));
+  }
+  parsed_models.clear();
+
+  // inherit level by level. Parents are always inherited before their children,
+  // and models of the same level are independent.
+  using model_ptr_t = std::pair<const std::string, block_model_json_temp> *;
+  auto depth = compute_inherit_depth(temp_models);
+  std::vector<std::vector<model_ptr_t>> levels;
+  for (auto &model : temp_models) {
+    const int d = depth.at(model.first);
+    if (d == inherit_depth_invalid) {
+      continue;
+    }
+    if (d > 0) {
+      temp_models.at(model.second.parent).is_inherited = true;
+    }
+    if (int(levels.size()) <= d) {
+      levels.resize(d + 1);
+    }
+    levels[d].emplace_back(&model);
+  }
+
+  for (size_t level = 1; level < levels.size(); level++) {
+    const auto &models = levels[level];
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t idx = 0; idx < int64_t(models.size()); idx++) {
+      auto &child = *models[idx];
+      const std::string parent_name = child.second.parent;
+      const auto &parent = temp_models.find(parent_name)->second;
+
+      // the parent failed to inherit
+      bool ok = (depth.find(parent_name)->second != inherit_depth_invalid);
+      if (ok) {
+        ok = model_json_inherit_new(child.second, parent, false);
+        if (!ok) {
+          std::string msg =
+              fmt::format("Failed to inherit. Child : {}, parent : {}.",
+                          child.first, parent_name);
+          ::VCL_report(VCL_report_type_t::error, msg.c_str());
+        }
+      }
+      if (!ok) {
+        depth.find(child.first)->second = inherit_depth_invalid;
+      }
+    }
   }
-  printf("\n\n");
-
-  */
 
-  // inherit
+  std::vector<model_ptr_t> valid_models;
+  valid_models.reserve(temp_models.size());
   for (auto &model : temp_models) {
-    const bool ok = inherit_recrusively(model.first, model.second, temp_models);
-    if (!ok) {
-      model.second.parent = "INVALID";
+    if (depth.at(model.first) == inherit_depth_invalid) {
       std::string msg = fmt::format(
           "Failed to inherit model {}. This model will be "
           "skipped, but it may cause further errors.",
           model.first);
       ::VCL_report(VCL_report_type_t::warning, msg.c_str());
-      // #warning following line should be commented.
-      // return false;
       continue;
     }
-
-    dereference_texture_name(model.second.textures);
-    dereference_model(model.second);
-  }
-  // remove invalid
-  for (auto it = temp_models.begin(); it != temp_models.end();) {
-    if (it->second.parent == "INVALID") {
-      it = temp_models.erase(it);
+    if (this->block_models.contains(model.first) && !on_conflict_replace_old) {
       continue;
     }
-
-    ++it;
+    valid_models.emplace_back(&model);
   }
 
   // convert temp models to block_models
-  this->block_models.reserve(this->block_models.size() + temp_models.size());
-  for (auto &tmodel : temp_models) {
-    if (this->block_models.contains(tmodel.first) && !on_conflict_replace_old) {
-      continue;
-    }
-
+  struct convert_result {
     block_model::model md;
-    bool skip_this_model = false;
+    bool skip_this_model{false};
+    std::string error;
+  };
+  std::vector<convert_result> results(valid_models.size());
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t idx = 0; idx < int64_t(valid_models.size()); idx++) {
+    auto &tmodel = *valid_models[idx];
+    dereference_texture_name(tmodel.second.textures);
+    dereference_model(tmodel.second);
+
+    block_model::model &md = results[idx].md;
+    bool &skip_this_model = results[idx].skip_this_model;
 
     md.elements.reserve(tmodel.second.elements.size());
     for (auto &tele : tmodel.second.elements) {
@@ -1134,9 +1186,9 @@ bool resource_pack::add_block_models(
       block_model::element ele;
 
       // ele._from = tele.from;
-      for (int idx = 0; idx < 3; idx++) {
-        ele._from[idx] = tele.from[idx];
-        ele._to[idx] = tele.to[idx];
+      for (int dim = 0; dim < 3; dim++) {
+        ele._from[dim] = tele.from[dim];
+        ele._to[dim] = tele.to[dim];
       }
 
       for (uint8_t faceidx = 0; faceidx < 6; faceidx++) {
@@ -1162,12 +1214,13 @@ bool resource_pack::add_block_models(
         }
 
         if (imgptr == nullptr) {
+          skip_this_model = true;
           if (tface.texture.starts_with('#') && tmodel.second.is_inherited) {
             // This model is considered to be abstract
-            skip_this_model = true;
             continue;
           }
-          std::string msg = fmt::format(
+          std::string &msg = results[idx].error;
+          msg = fmt::format(
               "Undefined reference to texture \"{}\", required by "
               "model {} but no such image.\nThe textures are : \n",
               tface.texture, tmodel.first);
@@ -1178,8 +1231,7 @@ bool resource_pack::add_block_models(
             msg.append(temp);
             msg.push_back('}');
           }
-          ::VCL_report(VCL_report_type_t::error, msg.c_str());
-          return false;
+          continue;
 
           // if managed to find, go on
         }
@@ -1190,8 +1242,17 @@ bool resource_pack::add_block_models(
       md.elements.emplace_back(ele);
     }
     // finished current model
-    if (!skip_this_model) {
-      this->block_models.emplace(tmodel.first, std::move(md));
+  }
+
+  this->block_models.reserve(this->block_models.size() + valid_models.size());
+  for (size_t idx = 0; idx < valid_models.size(); idx++) {
+    if (!results[idx].error.empty()) {
+      ::VCL_report(VCL_report_type_t::error, results[idx].error.c_str());
+      return false;
+    }
+    if (!results[idx].skip_this_model) {
+      this->block_models.emplace(valid_models[idx]->first,
+                                 std::move(results[idx].md));
     }
   }
 
@@ -1233,35 +1294,54 @@ bool resource_pack::add_block_states(
     files = &temp->files;
   }
 
-  this->block_states.reserve(this->block_states.size() + files->size());
+  struct parse_task {
+    const std::pair<const std::string, zipped_file> *file;
+    std::variant<resource_json::block_states_variant,
+                 resource_json::block_state_multipart>
+        bs{};
+    bool success{false};
+  };
 
+  std::vector<parse_task> tasks;
+  tasks.reserve(files->size());
   for (const auto &file : *files) {
-    if (this->block_states.contains(file.first) && !on_conflict_replace_old) {
+    const std::string_view block_id = std::string_view{file.first}.substr(
+        0, file.first.find_last_of('.'));
+    if (this->block_states.contains(std::string{block_id}) &&
+        !on_conflict_replace_old) {
       continue;
     }
-    std::variant<resource_json::block_states_variant,
-                 resource_json::block_state_multipart>
-        bs;
+    tasks.emplace_back(parse_task{.file = &file});
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t idx = 0; idx < int64_t(tasks.size()); idx++) {
+    parse_task &task = tasks[idx];
+    const zipped_file &file = task.file->second;
     bool is_dest_variant;
+    task.success = parse_block_state(
+        (const char *)file.data(), (const char *)file.data() + file.file_size(),
+        &task.bs, &is_dest_variant);
+  }
 
-    const bool success = parse_block_state(
-        (const char *)file.second.data(),
-        (const char *)file.second.data() + file.second.file_size(), &bs,
-        &is_dest_variant);
+  this->block_states.reserve(this->block_states.size() + tasks.size());
 
-    if (!success) {
+  for (parse_task &task : tasks) {
+    const std::string &filename = task.file->first;
+    if (!task.success) {
       std::string msg = fmt::format(
           "Failed to parse block state json file "
           "assets/minecraft/blockstates/{}. This will be "
           "skipped but may cause further errors.\n",
-          file.first);
+          filename);
 
       ::VCL_report(VCL_report_type_t::warning, msg.c_str());
       continue;
     }
 
-    const int substrlen = file.first.find_last_of('.');
-    this->block_states.emplace(file.first.substr(0, substrlen), std::move(bs));
+    const int substrlen = filename.find_last_of('.');
+    this->block_states.emplace(filename.substr(0, substrlen),
+                               std::move(task.bs));
   }
 
   return true;
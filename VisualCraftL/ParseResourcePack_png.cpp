@@ -24,6 +24,7 @@ This file is part of SlopeCraft.
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "ParseResourcePack.h"
 #include "Resource_tree.h"
@@ -303,76 +304,127 @@ bool resource_pack::add_textures(const zipped_folder &rpr,
 bool resource_pack::add_textures_direct(
     const std::unordered_map<std::string, zipped_file> &pngs,
     std::string_view namespace_name, const bool conflict_conver_old) noexcept {
-  this->textures_original.reserve(this->textures_original.size() + pngs.size());
-  constexpr int buffer_size = 1024;
-  std::array<char, buffer_size> buffer;
-
+  struct decode_task {
+    std::string key;
+    const std::string *filename;
+    const zipped_file *png;
+    bool is_dynamic;
+    block_model::EImgRowMajor_t img{};
+    std::string warning{};
+  };
+
+  std::vector<decode_task> tasks;
+  tasks.reserve(pngs.size());
   for (const auto &file : pngs) {
     if (!file.first.ends_with(".png")) continue;
 
-    const bool is_dynamic = pngs.contains(file.first + ".mcmeta");
-
-    buffer.fill('\0');
-    std::strcpy(buffer.data(), namespace_name.data());
-    if (this->is_MC12) {
-      std::strcat(buffer.data(), ":blocks/");
-    } else {
-      std::strcat(buffer.data(), ":block/");
-    }
-
-    // write in filename without extension name
-    {
-      char *dest = buffer.data() + std::strlen(buffer.data());
-
-      const char *src_begin = file.first.data();
-      const char *const src_end =
-          file.first.data() + file.first.find_last_of(".");
-
-      for (; src_begin < src_end; src_begin++) {
-        *dest = *src_begin;
-        dest++;
-      }
-    }
-    // key finished
+    // filename without extension name
+    const std::string_view stem =
+        std::string_view{file.first}.substr(0, file.first.find_last_of('.'));
+    std::string key = fmt::format("{}:{}{}", namespace_name,
+                                  (this->is_MC12) ? "blocks/" : "block/", stem);
 
-    if (this->textures_original.contains(buffer.data()) &&
-        !conflict_conver_old) {
+    if (this->textures_original.contains(key) && !conflict_conver_old) {
       continue;
     }
 
-    block_model::EImgRowMajor_t img;
+    tasks.emplace_back(decode_task{
+        .key = std::move(key),
+        .filename = &file.first,
+        .png = &file.second,
+        .is_dynamic = pngs.contains(file.first + ".mcmeta"),
+    });
+  }
 
+  // Pngs are independent, so they are decompressed and decoded in parallel.
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t idx = 0; idx < int64_t(tasks.size()); idx++) {
+    decode_task &task = tasks[idx];
     const bool success =
-        parse_png(file.second.data(), file.second.file_size(), &img);
-    if (!success || img.size() <= 0) {
-      std::string msg = fmt::format(
+        parse_png(task.png->data(), task.png->file_size(), &task.img);
+    if (!success || task.img.size() <= 0) {
+      task.warning = fmt::format(
           "Failed to parse png file {} in {}. Png parsing will "
           "continue but this warning may cause further errors.",
-          file.first, buffer.data());
-      ::VCL_report(VCL_report_type_t::warning, msg.c_str());
+          *task.filename, task.key);
       continue;
     }
 
-    if (is_dynamic) {
-      if (img.rows() % img.cols() != 0) {
-        std::string msg = fmt::format(
+    if (task.is_dynamic) {
+      if (task.img.rows() % task.img.cols() != 0) {
+        task.warning = fmt::format(
             "Failed to process dynamic png file {} in {}. Image "
             "has {} rows and {} cols, which is not of integer ratio. Png "
             "parsing will continue but this warning may cause further "
             "errors.",
-            file.first.data(), buffer.data(), img.rows(), img.rows());
-        ::VCL_report(VCL_report_type_t::warning, msg.c_str());
+            *task.filename, task.key, task.img.rows(), task.img.cols());
         continue;
       }
 
-      img = process_dynamic_texture(img);
+      task.img = process_dynamic_texture(task.img);
     }
+  }
 
-    this->textures_original.emplace(std::string(buffer.data()), std::move(img));
+  this->textures_original.reserve(this->textures_original.size() +
+                                  tasks.size());
+  for (decode_task &task : tasks) {
+    if (!task.warning.empty()) {
+      ::VCL_report(VCL_report_type_t::warning, task.warning.c_str());
+      continue;
+    }
+    this->textures_original.emplace(std::move(task.key), std::move(task.img));
   }
   return true;
 }
 
+Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+downsample_image_box(const Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic,
+                                        Eigen::RowMajor> &src,
+                     int factor) noexcept {
+  if (factor <= 1) {
+    return src;
+  }
+  Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> result(0,
+                                                                             0);
+  if (src.rows() % factor != 0 || src.cols() % factor != 0) {
+    return result;
+  }
+  result.resize(src.rows() / factor, src.cols() / factor);
+
+  // Colors are weighted by alpha, so that composing the result over a
+  // background gives the mean of composing each source pixel.
+  const uint32_t area = factor * factor;
+  for (int r = 0; r < result.rows(); r++) {
+    for (int c = 0; c < result.cols(); c++) {
+      uint32_t sum_alpha = 0;
+      std::array<uint32_t, 3> sum_weighted{0, 0, 0};
+      std::array<uint32_t, 3> sum{0, 0, 0};
+      for (int sr = r * factor; sr < (r + 1) * factor; sr++) {
+        for (int sc = c * factor; sc < (c + 1) * factor; sc++) {
+          const ARGB argb = src(sr, sc);
+          const std::array<uint32_t, 3> rgb{getR(argb), getG(argb),
+                                            getB(argb)};
+          sum_alpha += getA(argb);
+          for (int ch = 0; ch < 3; ch++) {
+            sum_weighted[ch] += rgb[ch] * getA(argb);
+            sum[ch] += rgb[ch];
+          }
+        }
+      }
+      std::array<uint32_t, 3> rgb;
+      for (int ch = 0; ch < 3; ch++) {
+        // rounded to nearest
+        rgb[ch] = (sum_alpha > 0)
+                      ? (sum_weighted[ch] + sum_alpha / 2) / sum_alpha
+                      : (sum[ch] + area / 2) / area;
+      }
+      const uint32_t alpha = (sum_alpha + area / 2) / area;
+      result(r, c) = ARGB32(rgb[0], rgb[1], rgb[2], alpha);
+    }
+  }
+  return result;
+}
+
 Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
 process_dynamic_texture(const Eigen::Array<ARGB, Eigen::Dynamic, Eigen::Dynamic,
                                            Eigen::RowMajor> &src) noexcept {
@@ -522,10 +574,12 @@ bool compose_image_background_half_transparent(
     return false;
   }
 
-  for (int i = 0; i < front_and_dest.size(); i++) {
-    front_and_dest(i) =
-        ComposeColor_background_half_transparent(back(i), front_and_dest(i));
-  }
+  const size_t size = front_and_dest.size();
+  // equals to calling ComposeColor_background_half_transparent(back(i),
+  // front_and_dest(i)) for each pixel
+  ComposeColor_background_half_transparent_batch(
+      {back.data(), size}, {front_and_dest.data(), size},
+      {front_and_dest.data(), size});
   return true;
 }
 
@@ -542,15 +596,9 @@ std::array<uint8_t, 3> compose_image_and_mean(
     return {};
   }
 
-  std::array<uint64_t, 3> val{0, 0, 0};
-
-  for (int i = 0; i < front.size(); i++) {
-    const ARGB composed = ComposeColor(front(i), back(i));
-
-    val[0] += getR(composed);
-    val[1] += getG(composed);
-    val[2] += getB(composed);
-  }
+  const size_t size = front.size();
+  std::array<uint64_t, 3> val =
+      ComposeColor_sum_batch({front.data(), size}, {back.data(), size});
 
   std::array<uint8_t, 3> ret;
 
@@ -25,6 +25,32 @@ This file is part of SlopeCraft.
 #include "VCL_internal.h"
 #include <ColorManip/ColorManip.h>
 
+bool VCL_resource_pack::is_file_used(std::string_view path) noexcept {
+  constexpr std::string_view assets{"assets/"};
+  if (!path.starts_with(assets)) {
+    return false;
+  }
+  path.remove_prefix(assets.size());
+
+  const size_t slash = path.find('/');
+  if (slash == std::string_view::npos) {
+    return false;
+  }
+  const std::string_view namespace_name = path.substr(0, slash);
+  path.remove_prefix(slash + 1);
+
+  // textures of all namespaces are loaded, "blocks" is for 1.12
+  if (path.starts_with("textures/block/") ||
+      path.starts_with("textures/blocks/")) {
+    return true;
+  }
+  if (namespace_name != "minecraft") {
+    return false;
+  }
+  return path.starts_with("textures/colormap/") ||
+         path.starts_with("models/block/") || path.starts_with("blockstates/");
+}
+
 bool VCL_resource_pack::copy(const VCL_resource_pack &src) noexcept {
   this->textures_original = src.textures_original;
   this->textures_override = src.textures_override;
@@ -360,10 +386,12 @@ VCL_resource_pack::find_model(const std::string &block_state_str,
 
 bool VCL_resource_pack::compute_projection(
     const std::string &block_state_str, VCL_face_t face_exposed,
-    block_model::EImgRowMajor_t *const img, buffer_t &buffer) const noexcept {
+    block_model::EImgRowMajor_t *const img, buffer_t &buffer,
+    int resolution) const noexcept {
   std::variant<model_with_rotation, block_model::model> ret =
       this->find_model(block_state_str, buffer);
 
+  const block_model::model *md = nullptr;
   if (ret.index() == 0) {
     auto model = std::get<0>(ret);
     if (model.model_ptr == nullptr) {
@@ -374,15 +402,15 @@ bool VCL_resource_pack::compute_projection(
       VCL_report(VCL_report_type_t::error, msg.c_str());
       return false;
     }
-
-    model.model_ptr->projection_image(
-        block_model::invrotate(face_exposed, model.x_rot, model.y_rot), img);
-    return true;
+    md = model.model_ptr;
+    face_exposed =
+        block_model::invrotate(face_exposed, model.x_rot, model.y_rot);
+  } else {
+    md = &std::get<1>(ret);
   }
 
-  block_model::model &md = std::get<1>(ret);
-
-  md.projection_image(face_exposed, img);
+  md->projection_image_downsampled(face_exposed, img, resolution,
+                                   &buffer.full_res_projection);
   return true;
 }
 
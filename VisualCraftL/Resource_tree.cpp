@@ -26,6 +26,7 @@ This file is part of SlopeCraft.
 #include <fmt/format.h>
 #include <filesystem>
 #include <cassert>
+#include <mutex>
 
 #include "VCL_internal.h"
 
@@ -50,87 +51,210 @@ auto split_by_slash(std::string_view str) noexcept {
   return result;
 }
 
-std::optional<zipped_folder> zipped_folder::from_zip(std::string_view zipname,
-                                                     zip_t *zip) noexcept {
-  zipped_folder result;
-  if (zip == nullptr) {
-    return std::nullopt;
+// Everything needed to reopen a zip. A libzip archive can't be used by multiple
+// threads at the same time, so each thread borrows a handle from the pool.
+class zip_archive_source {
+ public:
+  // If buffer is empty, zipname is opened as a file.
+  zip_archive_source(std::string_view zipname,
+                     std::span<const uint8_t> buffer) noexcept
+      : zipname_{zipname}, buffer_{buffer} {}
+
+  zip_archive_source(const zip_archive_source &) = delete;
+
+  ~zip_archive_source() noexcept {
+    for (zip_t *archive : this->idle_) {
+      zip_close(archive);
+    }
   }
 
-  const int64_t entry_num = zip_get_num_entries(zip, ZIP_FL_UNCHANGED);
+  const std::string &zipname() const noexcept { return this->zipname_; }
 
-  for (int64_t entry_idx = 0; entry_idx < entry_num; entry_idx++) {
-    auto splited =
-        split_by_slash(::zip_get_name(zip, entry_idx, ZIP_FL_ENC_GUESS));
+  zip_t *acquire() noexcept {
+    {
+      std::lock_guard<std::mutex> lk{this->lock_};
+      if (!this->idle_.empty()) {
+        zip_t *archive = this->idle_.back();
+        this->idle_.pop_back();
+        return archive;
+      }
+    }
+    return this->open();
+  }
 
-    zipped_folder *curfolder = &result;
-    zipped_file *destfile = nullptr;
-    for (size_t idx = 0; idx + 1 < splited.size(); idx++) {
-      if (idx + 1 < splited.size()) {
-        // is folder name
-        curfolder = &curfolder->subfolders[std::string(splited.at(idx))];
+  void release(zip_t *archive) noexcept {
+    std::lock_guard<std::mutex> lk{this->lock_};
+    this->idle_.emplace_back(archive);
+  }
+
+ private:
+  std::string zipname_;
+  std::span<const uint8_t> buffer_;
+  std::mutex lock_;
+  std::vector<zip_t *> idle_;
+
+  zip_t *open() noexcept {
+    if (this->buffer_.empty()) {
+      int errorcode;
+      zip_t *const archive =
+          zip_open(this->zipname_.c_str(), ZIP_RDONLY, &errorcode);
+      if (archive == nullptr) {
+        std::string msg =
+            fmt::format("Failed to open zip file : {}, error code = {}",
+                        this->zipname_, errorcode);
+        ::VCL_report(VCL_report_type_t::error, msg.c_str());
       }
+      return archive;
     }
 
-    if (std::string_view(::zip_get_name(zip, entry_idx, ZIP_FL_ENC_GUESS))
-            .back() != '/') {
-      auto ret = curfolder->files.emplace(splited.back(), zipped_file());
-      destfile = &ret.first->second;
+    zip_error_t err;
+    zip_error_init(&err);
+    zip_source_t *source = zip_source_buffer_create(
+        this->buffer_.data(), this->buffer_.size_bytes(), 0, &err);
+    if (source == nullptr) {
+      ::VCL_report(VCL_report_type_t::error,
+                   fmt::format("{} may be a broken zip: {}", this->zipname_,
+                               zip_error_strerror(&err))
+                       .c_str());
+      zip_error_fini(&err);
+      return nullptr;
     }
 
-    if (destfile == nullptr) {
-      continue;
+    zip_t *archive = zip_open_from_source(source, ZIP_RDONLY, &err);
+    if (archive == nullptr) {
+      ::VCL_report(VCL_report_type_t::error,
+                   fmt::format("{} may be a broken zip: {}", this->zipname_,
+                               zip_error_strerror(&err))
+                       .c_str());
+      zip_source_free(source);
+    }
+    zip_error_fini(&err);
+    return archive;
+  }
+};
+
+struct zipped_file::lazy_content {
+  std::shared_ptr<zip_archive_source> archive;
+  int64_t index{-1};
+  std::once_flag once;
+  std::vector<uint8_t> data;
+
+  void decompress() noexcept {
+    zip_t *const zip = this->archive->acquire();
+    if (zip == nullptr) {
+      this->archive.reset();
+      return;
     }
 
     zip_stat_t stat;
-    zip_stat_index(zip, entry_idx, ZIP_FL_UNCHANGED, &stat);
+    zip_stat_init(&stat);
+    zip_file_t *zfile = nullptr;
+    if (zip_stat_index(zip, this->index, ZIP_FL_UNCHANGED, &stat) == 0) {
+      zfile = zip_fopen_index(zip, this->index, ZIP_FL_UNCHANGED);
+    }
 
-    destfile->__data.resize(stat.size);
-    zip_file_t *const zfile = zip_fopen_index(zip, entry_idx, ZIP_FL_UNCHANGED);
-    if (zfile == NULL) {
+    if (zfile == nullptr) {
       std::string msg = fmt::format(
-          "Failed to open file in zip. index : {}, file name : {}\n", entry_idx,
-          ::zip_get_name(zip, entry_idx, ZIP_FL_ENC_GUESS));
+          "Failed to open file in zip {}. index : {}, file name : {}\n",
+          this->archive->zipname(), this->index,
+          ::zip_get_name(zip, this->index, ZIP_FL_ENC_GUESS));
       ::VCL_report(VCL_report_type_t::error, msg.c_str());
-      continue;
+    } else {
+      this->data.resize(stat.size);
+      const int64_t bytes = zip_fread(zfile, this->data.data(), stat.size);
+      zip_fclose(zfile);
+      if (bytes != int64_t(stat.size)) {
+        std::string msg = fmt::format(
+            "Failed to decompress file in zip {}. index : {}, file name : {}\n",
+            this->archive->zipname(), this->index,
+            ::zip_get_name(zip, this->index, ZIP_FL_ENC_GUESS));
+        ::VCL_report(VCL_report_type_t::error, msg.c_str());
+        this->data.clear();
+      }
     }
 
-    zip_fread(zfile, destfile->__data.data(), stat.size);
+    this->archive->release(zip);
+    // the zip is closed when all files in it are decompressed
+    this->archive.reset();
   }
+};
 
-  return result;
+const std::vector<uint8_t> &zipped_file::content() const noexcept {
+  static const std::vector<uint8_t> empty;
+  if (this->__content == nullptr) {
+    return empty;
+  }
+  lazy_content &c = *this->__content;
+  std::call_once(c.once, [&c]() { c.decompress(); });
+  return c.data;
 }
 
-std::optional<zipped_folder> zipped_folder::from_zip(
-    std::string_view zipname,
-    const std::span<const uint8_t> zip_content) noexcept {
-  zip_error_t err;
-  zip_source_t *source = zip_source_buffer_create(
-      zip_content.data(), zip_content.size_bytes(), 0, &err);
-  if (source == nullptr) {
-    ::VCL_report(VCL_report_type_t::error,
-                 fmt::format("{} may be a broken zip: {}", zipname,
-                             zip_error_strerror(&err))
-                     .c_str());
+int64_t zipped_file::file_size() const noexcept {
+  return this->content().size();
+}
+
+const uint8_t *zipped_file::data() const noexcept {
+  return this->content().data();
+}
+
+std::optional<zipped_folder> zipped_folder::from_archive(
+    const std::shared_ptr<zip_archive_source> &archive,
+    const path_filter_t &filter) noexcept {
+  zip_t *const zip = archive->acquire();
+  if (zip == nullptr) {
     return std::nullopt;
   }
 
-  zip_t *archive = zip_open_from_source(source, ZIP_RDONLY, &err);
-  if (archive == nullptr) {
+  zipped_folder result;
+  const int64_t entry_num = zip_get_num_entries(zip, ZIP_FL_UNCHANGED);
+
+  for (int64_t entry_idx = 0; entry_idx < entry_num; entry_idx++) {
+    const char *const name = ::zip_get_name(zip, entry_idx, ZIP_FL_ENC_GUESS);
+    if (name == nullptr) {
+      continue;
+    }
+    const std::string_view path{name};
+    if (path.empty() || path.back() == '/') {
+      // folders are created by files in them
+      continue;
+    }
+    if (filter && !filter(path)) {
+      continue;
+    }
+
+    auto splited = split_by_slash(path);
+
+    zipped_folder *curfolder = &result;
+    for (size_t idx = 0; idx + 1 < splited.size(); idx++) {
+      // is folder name
+      curfolder = &curfolder->subfolders[std::string(splited.at(idx))];
+    }
+
+    zipped_file file;
+    file.__content = std::make_shared<zipped_file::lazy_content>();
+    file.__content->archive = archive;
+    file.__content->index = entry_idx;
+    curfolder->files.emplace(splited.back(), std::move(file));
+  }
+
+  archive->release(zip);
+  return result;
+}
+
+std::optional<zipped_folder> zipped_folder::from_zip(
+    std::string_view zipname, const std::span<const uint8_t> zip_content,
+    const path_filter_t &filter) noexcept {
+  if (zip_content.empty()) {
     ::VCL_report(VCL_report_type_t::error,
-                 fmt::format("{} may be a broken zip: {}", zipname,
-                             zip_error_strerror(&err))
-                     .c_str());
-    zip_source_free(source);
+                 fmt::format("{} is empty.", zipname).c_str());
     return std::nullopt;
   }
-  auto content = from_zip(zipname, archive);
-  zip_close(archive);
-  return std::move(content);
+  return from_archive(
+      std::make_shared<zip_archive_source>(zipname, zip_content), filter);
 }
 
 std::optional<zipped_folder> zipped_folder::from_zip(
-    std::string_view zipname) noexcept {
+    std::string_view zipname, const path_filter_t &filter) noexcept {
   if (true) {
     std::filesystem::path path = (const char8_t *)(zipname).data();
     if (zipname.empty()) {
@@ -154,19 +278,10 @@ std::optional<zipped_folder> zipped_folder::from_zip(
       return std::nullopt;
     }
   }
-  int errorcode;
-  zip_t *const zip = zip_open(zipname.data(), ZIP_RDONLY, &errorcode);
-
-  if (zip == NULL) {
-    std::string msg = fmt::format(
-        "Failed to open zip file : {}, error code = {}", zipname, errorcode);
-    ::VCL_report(VCL_report_type_t::error, msg.c_str());
-    return std::nullopt;
-  }
 
-  auto content = from_zip(zipname, zip);
-  zip_close(zip);
-  return std::move(content);
+  return from_archive(std::make_shared<zip_archive_source>(
+                          zipname, std::span<const uint8_t>{}),
+                      filter);
 }
 
 void zipped_folder::merge_from_base(const zipped_folder &source_base) noexcept {
@@ -203,4 +318,21 @@ void zipped_folder::merge_from_base(zipped_folder &&source_base) noexcept {
       find->second.merge_from_base(std::move(it.second));
     }
   }
+}
+
+// Earlier resource packs override later ones by path, so the vanilla pack goes
+// last. Files are moved or shared between packs, never copied.
+std::optional<zipped_folder> overlay_resource_packs(
+    std::vector<std::optional<zipped_folder>> &packs) noexcept {
+  for (const auto &pack : packs) {
+    if (not pack) {
+      return std::nullopt;
+    }
+  }
+
+  zipped_folder result = std::move(packs.front().value());
+  for (size_t idx = 1; idx < packs.size(); idx++) {
+    result.merge_from_base(std::move(packs[idx].value()));
+  }
+  return result;
 }
\ No newline at end of file
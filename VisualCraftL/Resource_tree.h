@@ -30,25 +30,27 @@ This file is part of SlopeCraft.
 #include <optional>
 #include <span>
 #include <cstdint>
-// forward declaration for zip and zip_t defined in zip.h
-struct zip;
+#include <functional>
+#include <memory>
 
+class zip_archive_source;
 class zipped_file;
 class zipped_folder;
 
+// A file in zip. It's decompressed when its content is accessed for the first
+// time. Copies share the same content.
 class zipped_file {
  private:
-  std::vector<uint8_t> __data;
+  struct lazy_content;
+  std::shared_ptr<lazy_content> __content;
+
+  const std::vector<uint8_t> &content() const noexcept;
 
  public:
   friend class zipped_folder;
-  inline int64_t file_size() const noexcept { return __data.size(); }
-
-  inline uint8_t *data() noexcept { return __data.data(); }
+  int64_t file_size() const noexcept;
 
-  inline const uint8_t *data() const noexcept { return __data.data(); }
-
-  inline void append_0_for_c_str() noexcept { this->__data.push_back(0); }
+  const uint8_t *data() const noexcept;
 };
 
 class zipped_folder {
@@ -56,6 +58,11 @@ class zipped_folder {
   std::unordered_map<std::string, zipped_folder> subfolders;
   std::unordered_map<std::string, zipped_file> files;
 
+  // Decides whether a file in zip is indexed by its full path, like
+  // "assets/minecraft/models/block/stone.json". Folders without any indexed
+  // file are not created.
+  using path_filter_t = std::function<bool(std::string_view path_in_zip)>;
+
   inline zipped_folder *folder_at(const char *const str) noexcept {
     auto it = subfolders.find(str);
     if (it != subfolders.end()) {
@@ -89,15 +96,26 @@ class zipped_folder {
 
   void merge_from_base(zipped_folder &&source_base) noexcept;
 
-  static std::optional<zipped_folder> from_zip(std::string_view zipname,
-                                               zip *archive) noexcept;
-
+  // Only the directory of zip is read here, files are decompressed on demand.
+  // The zip stays open until all files in it are destroyed.
   static std::optional<zipped_folder> from_zip(
-      std::string_view zipname) noexcept;
+      std::string_view zipname, const path_filter_t &filter = {}) noexcept;
 
+  // zip_content must be alive until all files in the result are decompressed
+  // or destroyed.
   static std::optional<zipped_folder> from_zip(
-      std::string_view zipname,
-      const std::span<const uint8_t> zip_content) noexcept;
+      std::string_view zipname, const std::span<const uint8_t> zip_content,
+      const path_filter_t &filter = {}) noexcept;
+
+ private:
+  static std::optional<zipped_folder> from_archive(
+      const std::shared_ptr<zip_archive_source> &archive,
+      const path_filter_t &filter) noexcept;
 };
 
+// Merges packs into one, where files in earlier packs override those with the
+// same path in later packs. Returns nullopt if any pack is missing.
+std::optional<zipped_folder> overlay_resource_packs(
+    std::vector<std::optional<zipped_folder>> &packs) noexcept;
+
 #endif  // SLOPECRAFT_VISUALCRAFTL_RESOURCE_TREE_H
\ No newline at end of file
@@ -23,41 +23,31 @@ This file is part of SlopeCraft.
 #include "TokiVC.h"
 
 #include "VCL_internal.h"
+#include <algorithm>
+#include <cstring>
 #include <set>
 #include <shared_mutex>
+#include <string_view>
 #include <unordered_map>
 #include <variant>
 
-libImageCvt::template ImageCvter<false>::basic_colorset_t
-    TokiVC::colorset_basic;
-libImageCvt::template ImageCvter<false>::allowed_colorset_t
-    TokiVC::colorset_allowed;
-
-// global variables that VCL uses
-VCL_resource_pack TokiVC::pack;
-VCL_block_state_list TokiVC::bsl;
-SCL_gameVersion TokiVC::version = SCL_gameVersion::MC19;
-VCL_face_t TokiVC::exposed_face = VCL_face_t::face_down;
-int TokiVC::max_block_layers = 3;
-bool TokiVC::is_render_quality_fast{true};
-VCL_biome_t TokiVC::biome{VCL_biome_t::the_void};
-
-std::vector<std::variant<const VCL_block *, std::vector<const VCL_block *>>>
-    TokiVC::LUT_basic_color_idx_to_blocks;
-
-std::unordered_map<const VCL_block *, uint16_t> TokiVC::blocks_allowed;
-
 namespace TokiVC_internal {
 std::shared_mutex global_lock;
-bool is_basic_color_set_ready = false;
-bool is_allowed_color_set_ready = false;
+const std::shared_ptr<TokiVC_resource> global_resource{
+    std::make_shared<TokiVC_resource>()};
+const std::shared_ptr<TokiVC_context> global_context{
+    std::make_shared<TokiVC_context>(global_resource)};
 
+// kernels using the global context
 std::set<TokiVC *> TokiVC_register;
 }  // namespace TokiVC_internal
 
-TokiVC::TokiVC() : img_cvter{colorset_basic, colorset_allowed} {
+TokiVC::TokiVC()
+    : context_{TokiVC_internal::global_context},
+      img_cvter{context_->resource->colorset_basic,
+                context_->colorset_allowed} {
   TokiVC_internal::global_lock.lock();
-  if (TokiVC_internal::is_basic_color_set_ready) {
+  if (this->context_->resource->is_basic_color_set_ready) {
     this->_step = VCL_Kernel_step::VCL_wait_for_image;
   } else {
     this->_step = VCL_Kernel_step::VCL_wait_for_resource;
@@ -68,7 +58,18 @@ TokiVC::TokiVC() : img_cvter{colorset_basic, colorset_allowed} {
   TokiVC_internal::global_lock.unlock();
 }
 
+TokiVC::TokiVC(std::shared_ptr<const TokiVC_context> context)
+    : context_{std::move(context)},
+      img_cvter{context_->resource->colorset_basic,
+                context_->colorset_allowed} {
+  assert(this->context_->is_allowed_color_set_ready);
+  this->_step = VCL_Kernel_step::VCL_wait_for_image;
+}
+
 TokiVC::~TokiVC() {
+  if (this->context_ != TokiVC_internal::global_context) {
+    return;
+  }
   TokiVC_internal::global_lock.lock();
 
   auto it = TokiVC_internal::TokiVC_register.find(this);
@@ -80,6 +81,13 @@ TokiVC::~TokiVC() {
   TokiVC_internal::global_lock.unlock();
 }
 
+std::shared_lock<std::shared_mutex> TokiVC::lock_context() const noexcept {
+  if (this->context_ == TokiVC_internal::global_context) {
+    return std::shared_lock<std::shared_mutex>{TokiVC_internal::global_lock};
+  }
+  return {};
+}
+
 void TokiVC::show_gpu_name() const noexcept {
   std::string msg = this->img_cvter.gpu_resource()->device_vendor_v();
   VCL_report(VCL_report_type_t::information, msg.c_str());
@@ -92,13 +100,14 @@ void TokiVC::set_ui(void *uiptr,
 }
 
 VCL_Kernel_step TokiVC::step() const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   return this->_step;
 }
 
-bool add_projection_image_for_bsl(const std::vector<VCL_block *> &bs_list,
-                                  resource_pack::buffer_t &buff) noexcept {
+bool add_projection_image_for_bsl(
+    const VCL_resource_pack &pack, VCL_face_t exposed_face,
+    const std::vector<VCL_block *> &bs_list) noexcept {
   for (VCL_block *blkp : bs_list) {
     if (blkp->full_id_ptr() == nullptr) {
       std::string msg = fmt::format(
@@ -108,20 +117,29 @@ bool add_projection_image_for_bsl(const std::vector<VCL_block *> &bs_list,
       VCL_report(VCL_report_type_t::error, msg.c_str());
       return false;
     }
+  }
 
-    //    {
-    //      std::string msg =
-    //          fmt::format("Computing projection image for full id \"{}\"\n",
-    //                      blkp->full_id_ptr()->c_str());
-    //      VCL_report(VCL_report_type_t::information, msg.c_str());
-    //    }
-
-    block_model::EImgRowMajor_t *img = &blkp->project_image_on_exposed_face;
+  // every block writes to its own image, so they are computed in parallel
+  std::vector<uint8_t> ok(bs_list.size(), true);
+#pragma omp parallel
+  {
+    resource_pack::buffer_t buff;
+    buff.pure_id.reserve(256);
+    buff.state_list.reserve(16);
+
+#pragma omp for schedule(dynamic, 64)
+    for (int64_t idx = 0; idx < int64_t(bs_list.size()); idx++) {
+      VCL_block *blkp = bs_list[idx];
+      ok[idx] = pack.compute_projection(*blkp->full_id_ptr(), exposed_face,
+                                        &blkp->project_image_on_exposed_face,
+                                        buff);
+    }
+  }
 
-    if (!TokiVC::pack.compute_projection(*blkp->full_id_ptr(),
-                                         TokiVC::exposed_face, img, buff)) {
+  for (size_t idx = 0; idx < bs_list.size(); idx++) {
+    if (!ok[idx]) {
       std::string msg = fmt::format("failed to compute projection for {}.\n",
-                                    blkp->full_id_ptr()->c_str());
+                                    bs_list[idx]->full_id_ptr()->c_str());
       VCL_report(VCL_report_type_t::error, msg.c_str());
       return false;
     }
@@ -151,141 +169,6 @@ bool add_color_non_transparent(
   return true;
 }
 
-bool add_color_trans_to_nontrans(
-    const block_model::EImgRowMajor_t &front,
-    const std::vector<VCL_block *> &bs_nontransparent,
-    const std::vector<const VCL_block *> &accumulate_blocks,
-    mutlihash_color_blocks &map_color_blocks) noexcept {
-  if (front.size() <= 0) {
-    return false;
-  }
-
-  for (VCL_block *blkp : bs_nontransparent) {
-    if (!blkp->is_background()) {
-      continue;
-    }
-    bool ok = true;
-
-    std::array<uint8_t, 3> ret =
-        compose_image_and_mean(front, blkp->project_image_on_exposed_face, &ok);
-
-    if (!ok) {
-      return false;
-    }
-    std::vector<const VCL_block *> blocks(accumulate_blocks);
-    blocks.emplace_back(blkp);
-
-    map_color_blocks.emplace(ARGB32(ret[0], ret[1], ret[2]), blocks);
-
-    // temp_rgb_rowmajor.emplace_back(ret);
-    // LUT_bcitb.emplace_back(std::move(blocks));
-  }
-
-  return true;
-}
-
-bool add_color_trans_to_trans_recurs(
-    const int allowed_depth, const block_model::EImgRowMajor_t &front,
-    const std::vector<VCL_block *> &bs_transparent,
-    const std::vector<VCL_block *> &bs_nontransparent,
-    const std::vector<const VCL_block *> &accumulate_blocks,
-    mutlihash_color_blocks &map_color_blocks) noexcept {
-  if (allowed_depth <= 0) {
-    std::string msg =
-        fmt::format("Invalid value for allowed_depth : {}\n", allowed_depth);
-    VCL_report(VCL_report_type_t::error, msg.c_str());
-    return false;
-  }
-
-  if (allowed_depth == 1) {
-    return add_color_trans_to_nontrans(front, bs_nontransparent,
-                                       accumulate_blocks, map_color_blocks);
-  }
-  block_model::EImgRowMajor_t img(front);
-
-  {
-    uint8_t min_alpha = 255;
-    for (int i = 0; i < front.size(); i++) {
-      min_alpha = std::min(min_alpha, getA(front(i)));
-    }
-
-    // if multiple transparent block composed a non-transparent image, then the
-    // recursion terminate.
-    if (min_alpha >= 255) {
-      auto mean_opt = compute_mean_color(front);
-
-      if (not mean_opt) {
-        VCL_report(VCL_report_type_t::error,
-                   "Function add_color_trans_to_trans_recurs failed to "
-                   "compute mean color.\n");
-        return false;
-      }
-      auto &mean = mean_opt.value();
-      map_color_blocks.emplace(ARGB32(mean[0], mean[1], mean[2]),
-                               accumulate_blocks);
-      // LUT_bcitb.emplace_back(accumulate_blocks);
-      // temp_rgb_rowmajor.emplace_back(mean);
-      return true;
-    }
-  }
-
-  for (const VCL_block *cblkp : bs_transparent) {
-    if (cblkp == accumulate_blocks.back()) {
-      continue;
-    }
-
-    memcpy(img.data(), front.data(), front.size() * sizeof(uint32_t));
-    std::vector<const VCL_block *> blocks(accumulate_blocks);
-    blocks.emplace_back(cblkp);
-
-    if (!compose_image_background_half_transparent(
-            img, cblkp->project_image_on_exposed_face)) {
-      VCL_report(VCL_report_type_t::error,
-                 "Function add_color_trans_to_trans_recurs failed "
-                 "because failed to compose image. This is possible caused by "
-                 "images have different sizes.\n");
-      return false;
-    }
-
-    if (!add_color_trans_to_trans_recurs(allowed_depth - 1, img, bs_transparent,
-                                         bs_nontransparent, blocks,
-                                         map_color_blocks)) {
-      VCL_report(VCL_report_type_t::error,
-                 "Function add_color_trans_to_trans_recurs failed "
-                 "because deeper recursion failed.\n");
-      return false;
-    }
-  }
-
-  return true;
-}
-
-bool add_color_trans_to_trans_start_recurse(
-    const int max_allowed_depth, const std::vector<VCL_block *> &bs_transparent,
-    const std::vector<VCL_block *> &bs_nontransparent,
-    mutlihash_color_blocks &map_color_blocks) noexcept {
-  if (max_allowed_depth <= 0) {
-    return false;
-  }
-
-  std::vector<const VCL_block *> accum({nullptr});
-
-  for (const VCL_block *cblkp : bs_transparent) {
-    accum[0] = cblkp;
-    if (!add_color_trans_to_trans_recurs(
-            max_allowed_depth - 1, cblkp->project_image_on_exposed_face,
-            bs_transparent, bs_nontransparent, accum, map_color_blocks)) {
-      VCL_report(
-          VCL_report_type_t::error,
-          "Function add_color_trans_to_trans_start_recurse failed "
-          "due to function call to add_color_trans_to_trans_recurs failed.\n");
-      return false;
-    }
-  }
-
-  return true;
-}
-
 size_t blocks_count(
     const std::variant<const VCL_block *, std::vector<const VCL_block *>>
         &variant) noexcept {
@@ -331,6 +214,233 @@ bool compare_blocks_variant(
   return compare_blocks_multi(std::get<1>(a), std::get<1>(b));
 }
 
+namespace {
+/// A stack of transparent blocks, from front to back, and its composed image.
+struct transparent_stack {
+  std::vector<const VCL_block *> blocks;
+  block_model::EImgRowMajor_t img;
+};
+
+using color_blocks_list = std::vector<std::pair<
+    uint32_t, std::variant<const VCL_block *, std::vector<const VCL_block *>>>>;
+
+bool is_image_opaque(const block_model::EImgRowMajor_t &img) noexcept {
+  for (int i = 0; i < img.size(); i++) {
+    if (getA(img(i)) < 255) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t hash_image(const block_model::EImgRowMajor_t &img) noexcept {
+  return std::hash<std::string_view>{}(
+      std::string_view{reinterpret_cast<const char *>(img.data()),
+                       img.size() * sizeof(uint32_t)});
+}
+
+bool is_image_same(const block_model::EImgRowMajor_t &a,
+                   const block_model::EImgRowMajor_t &b) noexcept {
+  return a.rows() == b.rows() && a.cols() == b.cols() &&
+         memcmp(a.data(), b.data(), a.size() * sizeof(uint32_t)) == 0;
+}
+
+// Stacks with the same composed image give the same colors whatever is put
+// behind them, so only the cheapest one of them is kept and expanded. The
+// others are dropped with all their block combinations, and never reach
+// map_color_blocks. This loses no color, and no cheapest combination of a
+// color since a cheaper prefix stays cheaper with the same blocks behind, but
+// map_color_blocks doesn't list every combination giving a color.
+void remove_duplicated_stacks(std::vector<transparent_stack> &stacks) noexcept {
+  std::vector<size_t> hashes(stacks.size());
+  std::vector<size_t> order(stacks.size());
+  for (size_t i = 0; i < stacks.size(); i++) {
+    hashes[i] = hash_image(stacks[i].img);
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (hashes[a] != hashes[b]) {
+      return hashes[a] < hashes[b];
+    }
+    return compare_blocks_multi(stacks[a].blocks, stacks[b].blocks);
+  });
+
+  std::vector<transparent_stack> unique;
+  unique.reserve(stacks.size());
+  size_t group_begin = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    const size_t idx = order[i];
+    if (i > 0 && hashes[idx] != hashes[order[i - 1]]) {
+      group_begin = unique.size();
+    }
+    bool is_duplicated = false;
+    for (size_t j = group_begin; j < unique.size(); j++) {
+      if (is_image_same(unique[j].img, stacks[idx].img)) {
+        is_duplicated = true;
+        break;
+      }
+    }
+    if (!is_duplicated) {
+      unique.emplace_back(std::move(stacks[idx]));
+    }
+  }
+  stacks = std::move(unique);
+}
+
+// Compute colors that start with stack. If the stack is not opaque and
+// can_grow is true, stacks with one more transparent block are appended to
+// children.
+bool expand_transparent_stack(
+    const transparent_stack &stack, const bool can_grow,
+    const std::vector<VCL_block *> &bs_transparent,
+    const std::vector<VCL_block *> &bs_nontransparent,
+    color_blocks_list &colors,
+    std::vector<transparent_stack> &children) noexcept {
+  if (stack.img.size() <= 0) {
+    return false;
+  }
+
+  // if multiple transparent block composed a non-transparent image, nothing
+  // behind them is visible.
+  if (is_image_opaque(stack.img)) {
+    auto mean = compute_mean_color(stack.img);
+    if (not mean) {
+      return false;
+    }
+    colors.emplace_back(ARGB32(mean->at(0), mean->at(1), mean->at(2)),
+                        stack.blocks);
+    return true;
+  }
+
+  for (VCL_block *blkp : bs_nontransparent) {
+    if (!blkp->is_background()) {
+      continue;
+    }
+    bool ok = true;
+    std::array<uint8_t, 3> ret = compose_image_and_mean(
+        stack.img, blkp->project_image_on_exposed_face, &ok);
+    if (!ok) {
+      return false;
+    }
+    std::vector<const VCL_block *> blocks;
+    blocks.reserve(stack.blocks.size() + 1);
+    blocks = stack.blocks;
+    blocks.emplace_back(blkp);
+    colors.emplace_back(ARGB32(ret[0], ret[1], ret[2]), std::move(blocks));
+  }
+
+  if (!can_grow) {
+    return true;
+  }
+
+  for (const VCL_block *cblkp : bs_transparent) {
+    if (cblkp == stack.blocks.back()) {
+      continue;
+    }
+    transparent_stack child{.blocks = {}, .img = stack.img};
+    if (!compose_image_background_half_transparent(
+            child.img, cblkp->project_image_on_exposed_face)) {
+      return false;
+    }
+    child.blocks.reserve(stack.blocks.size() + 1);
+    child.blocks = stack.blocks;
+    child.blocks.emplace_back(cblkp);
+    children.emplace_back(std::move(child));
+  }
+  return true;
+}
+}  // namespace
+
+// The number of stacks grows as |transparent|^layers, and each of them holds a
+// composed image. Colors are limited by count and stacks by the bytes of their
+// images, deeper layers are skipped when either is reached.
+constexpr size_t max_composed_entries{size_t(1) << 21};
+constexpr size_t max_composed_stack_bytes{size_t(1) << 30};
+
+// Stacks are expanded layer by layer, so the composed image of each prefix is
+// computed only once for all layer counts, and stacks of the same layer are
+// expanded in parallel.
+bool add_color_transparent_stacks(
+    const int max_layers, const std::vector<VCL_block *> &bs_transparent,
+    const std::vector<VCL_block *> &bs_nontransparent,
+    mutlihash_color_blocks &map_color_blocks) noexcept {
+  std::vector<transparent_stack> stacks;
+  stacks.reserve(bs_transparent.size());
+  for (const VCL_block *blkp : bs_transparent) {
+    stacks.emplace_back(transparent_stack{
+        .blocks = {blkp}, .img = blkp->project_image_on_exposed_face});
+  }
+  remove_duplicated_stacks(stacks);
+
+  const size_t num_backgrounds =
+      std::ranges::count_if(bs_nontransparent, [](const VCL_block *blkp) {
+        return blkp->is_background();
+      });
+  auto report_layers_limited = [max_layers](int used_layers) {
+    std::string msg = fmt::format(
+        "Too many combinations of transparent blocks, only {} layers are "
+        "used instead of {}.\n",
+        used_layers, max_layers);
+    VCL_report(VCL_report_type_t::warning, msg.c_str());
+  };
+
+  for (int layers = 1; layers < max_layers && !stacks.empty(); layers++) {
+    bool can_grow = layers + 1 < max_layers;
+    // upper bounds, opaque stacks emit fewer
+    const size_t new_colors = stacks.size() * num_backgrounds;
+    const size_t new_stacks = can_grow ? stacks.size() * bs_transparent.size()
+                                       : size_t(0);
+    // all images have the same size, and parents live until children are made
+    const size_t stack_bytes = stacks.front().img.size() * sizeof(uint32_t);
+    if (map_color_blocks.size() + new_colors > max_composed_entries) {
+      report_layers_limited(layers);
+      break;
+    }
+    if (can_grow &&
+        (stacks.size() + new_stacks) * stack_bytes > max_composed_stack_bytes) {
+      report_layers_limited(layers + 1);
+      can_grow = false;
+    }
+    std::vector<color_blocks_list> colors(stacks.size());
+    std::vector<std::vector<transparent_stack>> children(stacks.size());
+    std::vector<uint8_t> ok(stacks.size(), true);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t idx = 0; idx < int64_t(stacks.size()); idx++) {
+      ok[idx] = expand_transparent_stack(stacks[idx], can_grow, bs_transparent,
+                                         bs_nontransparent, colors[idx],
+                                         children[idx]);
+    }
+
+    size_t num_children = 0;
+    for (size_t idx = 0; idx < stacks.size(); idx++) {
+      if (!ok[idx]) {
+        std::string msg = fmt::format(
+            "Failed to compose images for {} layers of blocks. This is "
+            "possible caused by images have different sizes.\n",
+            layers + 1);
+        VCL_report(VCL_report_type_t::error, msg.c_str());
+        return false;
+      }
+      for (auto &[color, blocks] : colors[idx]) {
+        map_color_blocks.emplace(color, std::move(blocks));
+      }
+      num_children += children[idx].size();
+    }
+
+    stacks.clear();
+    stacks.reserve(num_children);
+    for (auto &vec : children) {
+      for (auto &child : vec) {
+        stacks.emplace_back(std::move(child));
+      }
+    }
+    remove_duplicated_stacks(stacks);
+  }
+
+  return true;
+}
+
 void convert_blocks_and_colors_from_hash_vector(
     mutlihash_color_blocks &src,
     std::vector<std::array<uint8_t, 3>> &colors_temp,
@@ -380,12 +490,14 @@ void convert_blocks_and_colors_from_hash_vector(
   }
 }
 
-bool TokiVC::set_resource_no_lock() noexcept {
-  switch (TokiVC::version) {
+bool TokiVC_resource::resolve() noexcept {
+  this->is_basic_color_set_ready = false;
+
+  switch (this->version) {
     case SCL_gameVersion::ANCIENT:
     case SCL_gameVersion::FUTURE: {
       std::string msg =
-          fmt::format("Invalid MC version : {}\n", int(TokiVC::version));
+          fmt::format("Invalid MC version : {}\n", int(this->version));
       VCL_report(VCL_report_type_t::error, msg.c_str());
       return false;
     }
@@ -393,50 +505,43 @@ bool TokiVC::set_resource_no_lock() noexcept {
       break;
   }
 
-  TokiVC::pack.set_is_MC12(TokiVC::version == SCL_gameVersion::MC12);
+  this->pack.set_is_MC12(this->version == SCL_gameVersion::MC12);
 
   {
     std::vector<VCL_block *> blks;
 
-    TokiVC::bsl.available_block_states(TokiVC::version, TokiVC::exposed_face,
-                                       &blks);
+    this->bsl.available_block_states(this->version, this->exposed_face,
+                                     &blks);
 
-    const bool ok = TokiVC::pack.override_required_textures(
-        TokiVC::biome, TokiVC::is_render_quality_fast, blks.data(),
-        blks.size());
+    const bool ok = this->pack.override_required_textures(
+        this->biome, this->is_render_quality_fast, blks.data(), blks.size());
     if (!ok) {
       VCL_report(VCL_report_type_t::error, "Failed to override textures.");
       return false;
     }
   }
-  // TokiVC::pack.override_textures(TokiVC::biome,
-  // TokiVC::is_render_quality_fast);
+  // this->pack.override_textures(this->biome,
+  // this->is_render_quality_fast);
 
-  TokiVC::bsl.update_foliages(!TokiVC::is_render_quality_fast);
+  this->bsl.update_foliages(!this->is_render_quality_fast);
 
   std::vector<VCL_block *> bs_transparent, bs_nontransparent;
 
-  bs_nontransparent.reserve(TokiVC::bsl.block_states().size() * 2 / 3);
+  bs_nontransparent.reserve(this->bsl.block_states().size() * 2 / 3);
 
-  TokiVC::bsl.avaliable_block_states_by_transparency(
-      TokiVC::version, TokiVC::exposed_face, &bs_nontransparent,
-      &bs_transparent);
+  this->bsl.avaliable_block_states_by_transparency(
+      this->version, this->exposed_face, &bs_nontransparent, &bs_transparent);
 
   {
-    resource_pack::buffer_t buff;
-    {
-      buff.pure_id.reserve(256);
-      buff.state_list.reserve(16);
-      // buff.traits.reserve(16);
-    }
-
-    if (!add_projection_image_for_bsl(bs_nontransparent, buff)) {
+    if (!add_projection_image_for_bsl(this->pack, this->exposed_face,
+                                      bs_nontransparent)) {
       VCL_report(VCL_report_type_t::error,
                  "Failed to go through bs_nontransparent\n");
       return false;
     }
 
-    if (!add_projection_image_for_bsl(bs_transparent, buff)) {
+    if (!add_projection_image_for_bsl(this->pack, this->exposed_face,
+                                      bs_transparent)) {
       VCL_report(VCL_report_type_t::error,
                  "Failed to go through bs_transparent\n");
       return false;
@@ -457,13 +562,11 @@ bool TokiVC::set_resource_no_lock() noexcept {
     //      VCL_report(VCL_report_type_t::information, msg.c_str());
     //    }
 
-    for (int layers = 2; layers <= max_block_layers; layers++) {
-      if (!add_color_trans_to_trans_start_recurse(
-              layers, bs_transparent, bs_nontransparent, map_color_blocks)) {
-        VCL_report(VCL_report_type_t::error,
-                   "failed to compute colors for composed blocks.\n");
-        return false;
-      }
+    if (!add_color_transparent_stacks(this->max_block_layers, bs_transparent,
+                                      bs_nontransparent, map_color_blocks)) {
+      VCL_report(VCL_report_type_t::error,
+                 "failed to compute colors for composed blocks.\n");
+      return false;
     }
 
     //    {
@@ -473,17 +576,17 @@ bool TokiVC::set_resource_no_lock() noexcept {
     //    }
 
     std::vector<std::array<uint8_t, 3>> colors_temp;
-    TokiVC::LUT_basic_color_idx_to_blocks.clear();
+    this->LUT_basic_color_idx_to_blocks.clear();
 
     convert_blocks_and_colors_from_hash_vector(
-        map_color_blocks, colors_temp, TokiVC::LUT_basic_color_idx_to_blocks);
+        map_color_blocks, colors_temp, this->LUT_basic_color_idx_to_blocks);
 
-    if (colors_temp.size() != TokiVC::LUT_basic_color_idx_to_blocks.size()) {
+    if (colors_temp.size() != this->LUT_basic_color_idx_to_blocks.size()) {
       std::string msg = fmt::format(
           "\nImpossible error : "
           "colors_temp.size() (aka {}) "
-          "!=TokiVC::LUT_basic_color_idx_to_blocks.size() (aka {})\n",
-          colors_temp.size(), TokiVC::LUT_basic_color_idx_to_blocks.size());
+          "!=LUT_basic_color_idx_to_blocks.size() (aka {})\n",
+          colors_temp.size(), this->LUT_basic_color_idx_to_blocks.size());
       VCL_report(VCL_report_type_t::error, msg.c_str());
       return false;
     }
@@ -507,24 +610,53 @@ bool TokiVC::set_resource_no_lock() noexcept {
           arrX3f(r, c) = colors_temp[r][c] / 255.0f;
         }
       }
-      TokiVC::colorset_basic.set_colors(arrX3f.data(), arrX3f.rows());
+      this->colorset_basic.set_colors(arrX3f.data(), arrX3f.rows());
     }
   }
 
+  this->is_basic_color_set_ready = true;
+  return true;
+}
+
+void TokiVC_resource::set_option(
+    const VCL_set_resource_option &option) noexcept {
+  this->version = option.version;
+  this->exposed_face = option.exposed_face;
+  this->max_block_layers = option.max_block_layers;
+  this->biome = option.biome;
+  this->is_render_quality_fast = option.is_render_quality_fast;
+}
+
+bool TokiVC::set_resource_no_lock() noexcept {
+  TokiVC_internal::global_context->discard_allowed();
+  if (!TokiVC_internal::global_resource->resolve()) {
+    return false;
+  }
+  TokiVC::on_basic_colorset_ready_no_lock();
+  return true;
+}
+
+bool TokiVC::load_snapshot_no_lock(
+    const char *filename,
+    const TokiVC_resource::snapshot_key_t &key) noexcept {
+  TokiVC_internal::global_context->discard_allowed();
+  if (!TokiVC_internal::global_resource->load_snapshot(filename, key)) {
+    return false;
+  }
+  TokiVC::on_basic_colorset_ready_no_lock();
+  return true;
+}
+
+void TokiVC::on_basic_colorset_ready_no_lock() noexcept {
   // update steps
   for (auto ptr : TokiVC_internal::TokiVC_register) {
     ptr->_step = VCL_Kernel_step::VCL_wait_for_allowed_list;
     ptr->img_cvter.on_color_set_changed();
   }
-
-  TokiVC_internal::is_basic_color_set_ready = true;
-
-  return true;
 }
 
 bool is_color_allowed(
-    const std::variant<const VCL_block *, std::vector<const VCL_block *>>
-        &variant,
+    const TokiVC_resource::blocks_of_color_t &variant,
     const std::unordered_map<const VCL_block *, uint16_t>
         &blks_allowed) noexcept {
   if (variant.index() == 0) {
@@ -541,17 +673,25 @@ bool is_color_allowed(
   }
 }
 
-bool TokiVC::set_allowed_no_lock(
+void TokiVC_context::discard_allowed() noexcept {
+  this->is_allowed_color_set_ready = false;
+  // block ids are rebuilt when allowed blocks are set
+  this->LUT_color_block_offset.clear();
+  this->LUT_color_block_ids.clear();
+}
+
+bool TokiVC_context::set_allowed(
     std::span<const VCL_block *const> blocks_ptr_allowed) noexcept {
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  this->discard_allowed();
+  if (!this->resource->is_basic_color_set_ready) {
     VCL_report(VCL_report_type_t::error,
                "You can not set the allowed blocks before basic color set is "
                "ready.");
     return false;
   }
 
-  TokiVC::blocks_allowed.clear();
-  TokiVC::blocks_allowed.reserve(blocks_ptr_allowed.size());
+  this->blocks_allowed.clear();
+  this->blocks_allowed.reserve(blocks_ptr_allowed.size());
 
   for (size_t i = 0; i < blocks_ptr_allowed.size(); i++) {
     if (blocks_ptr_allowed[i] == nullptr ||
@@ -560,13 +700,13 @@ bool TokiVC::set_allowed_no_lock(
       return false;
     }
 
-    TokiVC::blocks_allowed.emplace(blocks_ptr_allowed[i], 0xFFFF);
+    this->blocks_allowed.emplace(blocks_ptr_allowed[i], 0xFFFF);
   }
 
   {
     uint16_t counter = 1;
     size_t counter_air = 0;
-    for (auto &pair : TokiVC::blocks_allowed) {
+    for (auto &pair : this->blocks_allowed) {
       if (pair.first->is_air()) {
         pair.second = 0;
         counter_air++;
@@ -585,42 +725,57 @@ bool TokiVC::set_allowed_no_lock(
     }
   }
 
+  const auto &LUT_bcitb = this->resource->LUT_basic_color_idx_to_blocks;
   std::vector<uint8_t> allowed_list;
-  allowed_list.resize(TokiVC::LUT_basic_color_idx_to_blocks.size());
+  allowed_list.resize(LUT_bcitb.size());
   std::fill(allowed_list.begin(), allowed_list.end(), 0);
 
-  //  {
-  //    std::string msg = fmt::format("TokiVC::colorset_basic.color_count() =
-  //                                  {}
-  //                                      .",
-  //                                  TokiVC::colorset_basic.color_count());
-  //    VCL_report(VCL_report_type_t::information, msg.c_str());
-  //  }
-
-  for (size_t idx = 0; idx < TokiVC::LUT_basic_color_idx_to_blocks.size();
-       idx++) {
-    const auto &variant = LUT_basic_color_idx_to_blocks[idx];
-    if (is_color_allowed(variant, TokiVC::blocks_allowed)) {
+  this->LUT_color_block_offset.reserve(LUT_bcitb.size() + 1);
+  this->LUT_color_block_offset.emplace_back(0);
+
+  for (size_t idx = 0; idx < LUT_bcitb.size(); idx++) {
+    const auto &variant = LUT_bcitb[idx];
+    if (is_color_allowed(variant, this->blocks_allowed)) {
       allowed_list[idx] = 1;
+      if (variant.index() == 0) {
+        this->LUT_color_block_ids.emplace_back(
+            this->blocks_allowed.at(std::get<0>(variant)));
+      } else {
+        for (const VCL_block *blkp : std::get<1>(variant)) {
+          this->LUT_color_block_ids.emplace_back(
+              this->blocks_allowed.at(blkp));
+        }
+      }
     }
+    this->LUT_color_block_offset.emplace_back(
+        this->LUT_color_block_ids.size());
   }
 
-  if (!TokiVC::colorset_allowed.apply_allowed(
-          TokiVC::colorset_basic,
+  if (!this->colorset_allowed.apply_allowed(
+          this->resource->colorset_basic,
           reinterpret_cast<const bool *>(allowed_list.data()))) {
     VCL_report(VCL_report_type_t::error,
-               "Function \"TokiVC::colorset_allowed.apply_allowed\" failed.");
+               "Function \"colorset_allowed.apply_allowed\" failed.");
+    this->discard_allowed();
     return false;
   }
 
-  TokiVC_internal::is_allowed_color_set_ready = true;
+  this->is_allowed_color_set_ready = true;
+  return true;
+}
+
+bool TokiVC::set_allowed_no_lock(
+    std::span<const VCL_block *const> blocks_ptr_allowed) noexcept {
+  const bool ok =
+      TokiVC_internal::global_context->set_allowed(blocks_ptr_allowed);
 
   for (TokiVC *tkvcp : TokiVC_internal::TokiVC_register) {
-    tkvcp->_step = VCL_Kernel_step::VCL_wait_for_image;
+    tkvcp->_step = ok ? VCL_Kernel_step::VCL_wait_for_image
+                      : VCL_Kernel_step::VCL_wait_for_allowed_list;
     tkvcp->img_cvter.on_color_set_changed();
   }
 
-  return true;
+  return ok;
 }
 
 bool TokiVC::set_image(const int64_t rows, const int64_t cols,
@@ -630,7 +785,7 @@ bool TokiVC::set_image(const int64_t rows, const int64_t cols,
     return false;
   }
 
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   if (this->_step < VCL_Kernel_step::VCL_wait_for_image) {
     VCL_report(VCL_report_type_t::error, "Trying to skip steps.");
@@ -645,7 +800,7 @@ bool TokiVC::set_image(const int64_t rows, const int64_t cols,
 }
 
 int64_t TokiVC::rows() const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
   if (this->_step < VCL_Kernel_step::VCL_wait_for_conversion) {
     return 0;
   }
@@ -653,7 +808,7 @@ int64_t TokiVC::rows() const noexcept {
   return this->img_cvter.rows();
 }
 int64_t TokiVC::cols() const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
   if (this->_step < VCL_Kernel_step::VCL_wait_for_conversion) {
     return 0;
   }
@@ -663,7 +818,7 @@ int64_t TokiVC::cols() const noexcept {
 
 const uint32_t *TokiVC::raw_image(int64_t *const __rows, int64_t *const __cols,
                                   bool *const is_row_major) const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
   if (this->_step < VCL_Kernel_step::VCL_wait_for_conversion) {
     return nullptr;
   }
@@ -684,7 +839,7 @@ const uint32_t *TokiVC::raw_image(int64_t *const __rows, int64_t *const __cols,
 }
 
 bool TokiVC::convert(::SCL_convertAlgo algo, bool dither) noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
   if (this->_step < VCL_Kernel_step::VCL_wait_for_conversion) {
     return false;
   }
@@ -703,7 +858,7 @@ bool TokiVC::convert(::SCL_convertAlgo algo, bool dither) noexcept {
 
 void TokiVC::converted_image(uint32_t *dest, int64_t *rows, int64_t *cols,
                              bool write_dest_row_major) const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
   if (this->_step < VCL_Kernel_step::VCL_wait_for_build) {
     return;
   }
@@ -28,7 +28,11 @@ This file is part of SlopeCraft.
 #include "VisualCraftL.h"
 
 #include "DirectionHandler.hpp"
+#include <array>
+#include <memory>
+#include <optional>
 #include <shared_mutex>
+#include <span>
 #include <unordered_map>
 #include <utilities/ColorManip/colorset_optical.hpp>
 #include <utilities/ColorManip/imageConvert.hpp>
@@ -48,9 +52,90 @@ class VCL_GPU_Device {
   gpu_wrapper::device_wrapper *dw{nullptr};
 };
 
+// Resource pack, block states and the basic colorset computed from them.
+// After it's resolved, it's only read, so contexts with different allowed
+// blocks can share it.
+class TokiVC_resource {
+ public:
+  using basic_colorset_t =
+      libImageCvt::template ImageCvter<false>::basic_colorset_t;
+  using blocks_of_color_t =
+      std::variant<const VCL_block *, std::vector<const VCL_block *>>;
+
+  basic_colorset_t colorset_basic;
+  VCL_resource_pack pack;
+  VCL_block_state_list bsl;
+  SCL_gameVersion version{SCL_gameVersion::MC19};
+  VCL_face_t exposed_face{VCL_face_t::face_down};
+  int max_block_layers{3};
+  bool is_render_quality_fast{true};
+  VCL_biome_t biome{VCL_biome_t::the_void};
+
+  std::vector<blocks_of_color_t> LUT_basic_color_idx_to_blocks;
+
+  bool is_basic_color_set_ready{false};
+  // false if the resource is loaded from snapshot
+  bool is_resource_pack_loaded{false};
+
+  void set_option(const VCL_set_resource_option &option) noexcept;
+
+  // Compute projection images and the basic colorset from pack and bsl.
+  bool resolve() noexcept;
+
+  // A snapshot stores the resolved resource: projection images, the basic
+  // colorset and the blocks of each color. Loading it doesn't need the
+  // resource pack.
+  using snapshot_key_t = std::array<uint8_t, 20>;
+  static std::optional<snapshot_key_t> snapshot_key(
+      std::span<const char *const> zip_filenames,
+      std::span<const char *const> json_filenames,
+      const VCL_set_resource_option &option) noexcept;
+  bool save_snapshot(const char *filename,
+                     const snapshot_key_t &key) const noexcept;
+  // The options and block state list must be set before loading.
+  bool load_snapshot(const char *filename, const snapshot_key_t &key) noexcept;
+};
+
+// A resolved resource with a set of allowed blocks, everything a kernel needs
+// to convert and build.
+class TokiVC_context {
+ public:
+  using allowed_colorset_t =
+      libImageCvt::template ImageCvter<false>::allowed_colorset_t;
+
+  explicit TokiVC_context(std::shared_ptr<const TokiVC_resource> res)
+      : resource{std::move(res)} {}
+
+  const std::shared_ptr<const TokiVC_resource> resource;
+
+  allowed_colorset_t colorset_allowed;
+  // block -> block id in schem
+  std::unordered_map<const VCL_block *, uint16_t> blocks_allowed;
+
+  // Schem block ids of each basic color, flattened. Blocks of color i are
+  // LUT_color_block_ids[LUT_color_block_offset[i]] to
+  // LUT_color_block_ids[LUT_color_block_offset[i + 1] - 1], from the first
+  // layer to the last. Colors that are not allowed have no blocks. Built by
+  // set_allowed so that build doesn't need to look up blocks.
+  std::vector<uint32_t> LUT_color_block_offset;
+  std::vector<uint16_t> LUT_color_block_ids;
+
+  bool is_allowed_color_set_ready{false};
+
+  bool set_allowed(
+      std::span<const VCL_block *const> blocks_ptr_allowed) noexcept;
+  void discard_allowed() noexcept;
+
+  void fill_schem_blocklist(libSchem::Schem &schem) const noexcept;
+  bool export_test_litematic(const char *filename) const noexcept;
+};
+
 class TokiVC : public VCL_Kernel {
  public:
+  // uses the global context
   TokiVC();
+  // context must have allowed blocks
+  explicit TokiVC(std::shared_ptr<const TokiVC_context> context);
   virtual ~TokiVC();
   void set_ui(void *uiptr, void (*progressRangeSet)(void *, int, int, int),
               void (*progressAdd)(void *, int)) noexcept override;
@@ -130,54 +215,61 @@ class TokiVC : public VCL_Kernel {
                       const int requiredModsCount = 0) const noexcept override;
 
  public:
-  static libImageCvt::template ImageCvter<false>::basic_colorset_t
-      colorset_basic;
-  static libImageCvt::template ImageCvter<false>::allowed_colorset_t
-      colorset_allowed;
-
-  static VCL_resource_pack pack;
-  static VCL_block_state_list bsl;
-  static SCL_gameVersion version;
-  static VCL_face_t exposed_face;
-  static int max_block_layers;
-  static bool is_render_quality_fast;
-  static VCL_biome_t biome;
-
+  // Functions below work on the global resource and allowed blocks, and
+  // update the kernels that use them.
   static bool set_resource_no_lock() noexcept;
   static bool set_allowed_no_lock(
       std::span<const VCL_block *const> blocks_ptr_allowed) noexcept;
-
-  static bool export_test_litematic_no_lock(const char *filename) noexcept;
-
-  static const auto &LUT_bcitb() noexcept {
-    return TokiVC::LUT_basic_color_idx_to_blocks;
-  }
+  // The options and block state list must be set before loading.
+  static bool load_snapshot_no_lock(
+      const char *filename,
+      const TokiVC_resource::snapshot_key_t &key) noexcept;
 
  private:
-  static std::vector<
-      std::variant<const VCL_block *, std::vector<const VCL_block *>>>
-      LUT_basic_color_idx_to_blocks;
+  static void on_basic_colorset_ready_no_lock() noexcept;
 
-  static std::unordered_map<const VCL_block *, uint16_t> blocks_allowed;
+  // Only kernels using the global context need locking, other contexts are
+  // never modified.
+  [[nodiscard]] std::shared_lock<std::shared_mutex> lock_context()
+      const noexcept;
 
  private:
   VCL_Kernel_step _step{VCL_Kernel_step::VCL_wait_for_resource};
   bool imgcvter_prefer_gpu{false};
 
+  // keeps the colorsets referenced by img_cvter alive
+  const std::shared_ptr<const TokiVC_context> context_;
   libImageCvt::ImageCvter<false> img_cvter;
   libSchem::Schem schem;
 
-  void fill_schem_blocklist_no_lock() noexcept;
+  using block_images_t =
+      std::unordered_map<const VCL_block *, block_model::EImgRowMajor_t>;
+
+  const VCL_block *block_at(int64_t r, int64_t c,
+                            int layer_idx) const noexcept;
+  /// Images of blocks in rows [row_start,row_end) at the resolution of opt.
+  /// Empty if it's 16, then projection images are used directly.
+  block_images_t block_images_for_flag_diagram(const flag_diagram_option &,
+                                               int layer_idx) const noexcept;
 
   void draw_flag_diagram_to_memory(uint32_t *image_u8c3_rowmajor,
-                                   const flag_diagram_option &,
-                                   int layer_idx) const noexcept;
+                                   const flag_diagram_option &, int layer_idx,
+                                   const block_images_t &) const noexcept;
+};
+
+// Handle of a context given to API users. Kernels created with it hold their
+// own reference, so destroying the handle doesn't affect them.
+class VCL_resource_context {
+ public:
+  std::shared_ptr<const TokiVC_context> context;
 };
 
 namespace TokiVC_internal {
+// Guards the global resource and context, which are set by
+// VCL_set_resource_* and VCL_set_allowed_blocks and modified in place.
 extern std::shared_mutex global_lock;
-extern bool is_basic_color_set_ready;
-extern bool is_allowed_color_set_ready;
+extern const std::shared_ptr<TokiVC_resource> global_resource;
+extern const std::shared_ptr<TokiVC_context> global_context;
 }  // namespace TokiVC_internal
 
 #endif  // SLOPECRAFT_VISUALCRAFTL_TOKIVC_H
\ No newline at end of file
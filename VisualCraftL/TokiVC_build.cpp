@@ -27,21 +27,22 @@ This file is part of SlopeCraft.
 #include <chrono>
 #include <vector>
 
-void TokiVC::fill_schem_blocklist_no_lock() noexcept {
+void TokiVC_context::fill_schem_blocklist(
+    libSchem::Schem &schem) const noexcept {
   std::vector<const char *> blk_ids;
   // fill with nullptr
-  blk_ids.resize(TokiVC::blocks_allowed.size());
+  blk_ids.resize(this->blocks_allowed.size());
   for (auto &p : blk_ids) {
     p = nullptr;
   }
-  for (const auto &pair : TokiVC::blocks_allowed) {
+  for (const auto &pair : this->blocks_allowed) {
     blk_ids[pair.second] = pair.first->full_id_ptr()->c_str();
   }
-  this->schem.set_block_id(blk_ids.data(), blk_ids.size());
+  schem.set_block_id(blk_ids.data(), blk_ids.size());
 }
 
 int64_t TokiVC::xyz_size(int64_t *x, int64_t *y, int64_t *z) const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   if (this->_step < VCL_Kernel_step::VCL_built) {
     VCL_report(VCL_report_type_t::error,
@@ -56,7 +57,7 @@ int64_t TokiVC::xyz_size(int64_t *x, int64_t *y, int64_t *z) const noexcept {
 }
 
 bool TokiVC::build() noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   if (this->_step < VCL_Kernel_step::VCL_wait_for_build) {
     VCL_report(VCL_report_type_t::error,
@@ -64,86 +65,70 @@ bool TokiVC::build() noexcept {
     return false;
   }
 
-  dir_handler<int64_t> dirh(TokiVC::exposed_face, this->img_cvter.rows(),
-                            this->img_cvter.cols(), TokiVC::max_block_layers);
+  const TokiVC_context &ctx = *this->context_;
+  const TokiVC_resource &res = *ctx.resource;
+
+  dir_handler<int64_t> dirh(res.exposed_face, this->img_cvter.rows(),
+                            this->img_cvter.cols(), res.max_block_layers);
 
   this->schem.resize(dirh.range_xyz()[0], dirh.range_xyz()[1],
                      dirh.range_xyz()[2]);
 
-  this->fill_schem_blocklist_no_lock();
+  ctx.fill_schem_blocklist(this->schem);
 
   this->schem.fill(0);
 
-  std::atomic_bool ret = true;
+  const auto &offset = ctx.LUT_color_block_offset;
+  const uint16_t *const block_ids = ctx.LUT_color_block_ids.data();
+  if (offset.size() != res.LUT_basic_color_idx_to_blocks.size() + 1) {
+    VCL_report(VCL_report_type_t::error,
+               "Block ids of colors are not ready. This is an internal "
+               "error.");
+    return false;
+  }
+  const uint16_t color_count = uint16_t(offset.size() - 1);
+
+  // coordinates are linear in depth, so every voxel of a pixel is at a fixed
+  // stride from the first one in the xzy tensor.
+  const auto linear_index = [this](const std::array<int64_t, 3> &coord) {
+    return coord[0] + this->schem.x_range() *
+                          (coord[2] + this->schem.z_range() * coord[1]);
+  };
+  const int64_t depth_stride = linear_index(dirh.coordinate_of(0, 0, 1)) -
+                               linear_index(dirh.coordinate_of(0, 0, 0));
+  uint16_t *const dest = this->schem.data();
 
   const Eigen::ArrayXX<uint16_t> color_id_mat = this->img_cvter.color_id();
-  // #warning resume omp here
 #pragma omp parallel for schedule(static)
   for (int64_t r = 0; r < this->img_cvter.rows(); r++) {
     for (int64_t c = 0; c < this->img_cvter.cols(); c++) {
-      auto color_id = color_id_mat(r, c);
-      if (color_id >= 0xFFFF)
-        continue;  // full transparent pixels, use air instead
-
-      const auto &variant = TokiVC::LUT_basic_color_idx_to_blocks[color_id];
-
-      const VCL_block *const *blockpp = nullptr;
-      size_t depth_current = 0;
-
-      if (variant.index() == 0) {
-        blockpp = &std::get<0>(variant);
-        depth_current = 1;
-      } else {
-        const std::vector<const VCL_block *> &vec = std::get<1>(variant);
-        blockpp = vec.data();
-        depth_current = vec.size();
-      }
-
-      for (size_t depth = 0; depth < depth_current; depth++) {
-        const auto coord = dirh.coordinate_of(r, c, depth);
-        const int64_t range[3] = {this->schem.x_range(), this->schem.y_range(),
-                                  this->schem.z_range()};
-        for (size_t di = 0; di < 3; di++) {
-          if (coord[di] < 0 || coord[di] >= range[di]) {
-            std::string msg =
-                fmt::format("coordinate out of range : {}, {}, {}.\n", coord[0],
-                            coord[1], coord[2]);
-            VCL_report(VCL_report_type_t::error, msg.c_str());
-          }
-        }
-
-        const VCL_block *const blkp = blockpp[depth];
-
-        auto it = TokiVC::blocks_allowed.find(blkp);
-        if (it == TokiVC::blocks_allowed.end()) {
-          std::string msg = fmt::format(
-              "Failed to find VCL_block at address {} named {} in "
-              "allowed blocks. This is an internal error.",
-              (const void *)blkp, blkp->full_id_ptr()->c_str());
-          VCL_report(VCL_report_type_t::error, msg.c_str());
-          ret = false;
-        }
-
-        const uint16_t blk_id = it->second;
-
-        this->schem(coord[0], coord[1], coord[2]) = blk_id;
+      const uint16_t color_id = color_id_mat(r, c);
+      // full transparent pixels, use air instead
+      if (color_id >= color_count) continue;
+
+      const uint32_t beg = offset[color_id];
+      const uint32_t end = offset[color_id + 1];
+      int64_t idx = linear_index(dirh.coordinate_of(r, c, 0));
+      for (uint32_t i = beg; i < end; i++) {
+        dest[idx] = block_ids[i];
+        idx += depth_stride;
       }
     }
   }
 
-  this->schem.set_MC_major_version_number(TokiVC::version);
+  this->schem.set_MC_major_version_number(res.version);
   this->schem.set_MC_version_number(
-      MCDataVersion::suggested_version(TokiVC::version));
+      MCDataVersion::suggested_version(res.version));
 
   this->_step = VCL_Kernel_step::VCL_built;
 
-  return ret;
+  return true;
 }
 
 bool TokiVC::export_litematic(const char *localEncoding_filename,
                               const char *utf8_litename,
                               const char *utf8_regionname) const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   if (this->_step < VCL_Kernel_step::VCL_built) {
     VCL_report(VCL_report_type_t::error,
@@ -182,7 +167,7 @@ bool TokiVC::export_litematic(const char *localEncoding_filename,
 
 bool TokiVC::export_structure(const char *localEncoding_TargetName,
                               bool is_air_structure_void) const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   if (this->_step < VCL_Kernel_step::VCL_built) {
     VCL_report(VCL_report_type_t::error,
@@ -211,7 +196,7 @@ bool TokiVC::export_WESchem(const char *localEncoding_fileName,
                             const char *utf8_Name,
                             const char *const *const utf8_requiredMods,
                             const int requiredModsCount) const noexcept {
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
   if (this->_step < VCL_Kernel_step::VCL_built) {
     VCL_report(VCL_report_type_t::error,
                "Trying to export structure without built.");
@@ -45,9 +45,10 @@ const VCL_block *find_first_mark_block(
   return p;
 }
 
-bool TokiVC::export_test_litematic_no_lock(const char *filename) noexcept {
-  if (!TokiVC_internal::is_basic_color_set_ready ||
-      !TokiVC_internal::is_allowed_color_set_ready) {
+bool TokiVC_context::export_test_litematic(
+    const char *filename) const noexcept {
+  if (!this->resource->is_basic_color_set_ready ||
+      !this->is_allowed_color_set_ready) {
     VCL_report(
         VCL_report_type_t::error,
         "Trying to export testing litematic before allowed blocks are set.");
@@ -55,39 +56,38 @@ bool TokiVC::export_test_litematic_no_lock(const char *filename) noexcept {
   }
 
   libSchem::Schem schem;
-  schem.set_MC_major_version_number(TokiVC::version);
+  schem.set_MC_major_version_number(this->resource->version);
   schem.set_MC_version_number(
-      MCDataVersion::suggested_version(TokiVC::version));
+      MCDataVersion::suggested_version(this->resource->version));
 
   // setup block id
   {
-    std::vector<const char *> blk_id(TokiVC::blocks_allowed.size());
+    std::vector<const char *> blk_id(this->blocks_allowed.size());
 
     for (auto &charp : blk_id) {
       charp = nullptr;
     }
 
-    for (const auto &pair : TokiVC::blocks_allowed) {
-      blk_id[pair.second] = pair.first->id_for_schem(TokiVC::version).c_str();
+    for (const auto &pair : this->blocks_allowed) {
+      blk_id[pair.second] =
+          pair.first->id_for_schem(this->resource->version).c_str();
     }
 
     schem.set_block_id(blk_id.data(), blk_id.size());
   }
 
   // divide blocks by class
-  std::map<
-      VCL_block_class_t,
-      std::vector<typename decltype(TokiVC::blocks_allowed)::const_iterator>>
-      blk_class;
+  using iterator_t = decltype(this->blocks_allowed)::const_iterator;
+  std::map<VCL_block_class_t, std::vector<iterator_t>> blk_class;
 
   for (auto cls : magic_enum::enum_values<VCL_block_class_t>()) {
     blk_class[cls] = {};
-    blk_class[cls].reserve(TokiVC::blocks_allowed.size() /
+    blk_class[cls].reserve(this->blocks_allowed.size() /
                            magic_enum::enum_values<VCL_block_class_t>().size());
   }
 
-  for (auto it = TokiVC::blocks_allowed.begin();
-       it != TokiVC::blocks_allowed.end(); ++it) {
+  for (auto it = this->blocks_allowed.begin();
+       it != this->blocks_allowed.end(); ++it) {
     blk_class.at(it->first->block_class).emplace_back(it);
   }
 
@@ -95,9 +95,9 @@ bool TokiVC::export_test_litematic_no_lock(const char *filename) noexcept {
 
   for (auto &pair : blk_class) {
     std::sort(pair.second.begin(), pair.second.end(),
-              [](typename decltype(TokiVC::blocks_allowed)::const_iterator A,
-                 typename decltype(TokiVC::blocks_allowed)::const_iterator B)
-                  -> bool { return A->second < B->second; });
+              [](iterator_t A, iterator_t B) -> bool {
+                return A->second < B->second;
+              });
     max_cols = std::max(max_cols, pair.second.size());
   }
   max_cols++;
@@ -114,7 +114,7 @@ bool TokiVC::export_test_litematic_no_lock(const char *filename) noexcept {
   schem.resize(x_range, y_range, z_range);
   schem.fill(0);
 
-  const VCL_block *const marker = find_first_mark_block(TokiVC::blocks_allowed);
+  const VCL_block *const marker = find_first_mark_block(this->blocks_allowed);
 
   for (size_t idx_class = 0; idx_class < block_class_arr.size(); idx_class++) {
     const auto &vec = blk_class.at(block_class_arr[idx_class]);
@@ -127,7 +127,7 @@ bool TokiVC::export_test_litematic_no_lock(const char *filename) noexcept {
     }
 
     if (marker != nullptr) {
-      schem(vec.size(), 1, z_pos) = TokiVC::blocks_allowed.at(marker);
+      schem(vec.size(), 1, z_pos) = this->blocks_allowed.at(marker);
     }
   }
 
@@ -137,7 +137,7 @@ bool TokiVC::export_test_litematic_no_lock(const char *filename) noexcept {
   {
     libSchem::litematic_info info;
     info.litename_utf8 =
-        fmt::format("Testing litematic for 1.{}", int(TokiVC::version));
+        fmt::format("Testing litematic for 1.{}", int(this->resource->version));
     info.author_utf8 = "VisualCraftL";
     info.destricption_utf8 = "This litematic is generated by VisualCraft.";
 
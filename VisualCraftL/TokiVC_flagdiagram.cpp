@@ -57,66 +57,125 @@ void ARGB_to_AGBR(uint32_t *ptr, size_t num_pixels) noexcept {
   }
 }
 
-void TokiVC::draw_flag_diagram_to_memory(uint32_t *image_u8c3_rowmajor,
-                                         const flag_diagram_option &opt,
-                                         int layer_idx) const noexcept {
+namespace {
+// flag_diagram_option::block_resolution is added in v5.4, options from older
+// callers don't have this field.
+constexpr uint64_t block_resolution_since{SC_MAKE_VERSION_U64(5, 4, 0, 0)};
+
+int flag_diagram_resolution(
+    const VCL_Kernel::flag_diagram_option &opt) noexcept {
+  if (opt.lib_version < block_resolution_since) {
+    return 16;
+  }
+  return std::clamp(opt.block_resolution, 1, 1024);
+}
+}  // namespace
+
+const VCL_block *TokiVC::block_at(int64_t r, int64_t c,
+                                  int layer_idx) const noexcept {
+  const uint16_t current_color_idx = this->img_cvter.color_id(r, c);
+
+  const auto &LUT_bcitb =
+      this->context_->resource->LUT_basic_color_idx_to_blocks;
+  const auto &variant = LUT_bcitb[current_color_idx];
+  if (variant.index() == 0) {
+    return (layer_idx == 0) ? std::get<0>(variant) : nullptr;
+  }
+  const auto &vec = std::get<1>(variant);
+  return (layer_idx < (int)vec.size()) ? vec[layer_idx] : nullptr;
+}
+
+TokiVC::block_images_t TokiVC::block_images_for_flag_diagram(
+    const flag_diagram_option &opt, int layer_idx) const noexcept {
+  const int res = flag_diagram_resolution(opt);
+  block_images_t images;
+  if (res == 16) {
+    return images;
+  }
+
+  // only blocks that are drawn, other blocks never get a image of this size
+  for (int64_t r = opt.row_start; r < opt.row_end; r++) {
+    for (int64_t c = 0; c < this->img_cvter.cols(); c++) {
+      const VCL_block *blkp = this->block_at(r, c, layer_idx);
+      if (blkp != nullptr) {
+        images.emplace(blkp, block_model::EImgRowMajor_t{});
+      }
+    }
+  }
+
+  const TokiVC_resource &resource = *this->context_->resource;
+  resource_pack::buffer_t buffer;
+  size_t num_resized = 0;
+  for (auto &[blkp, img] : images) {
+    const auto &img_16 = blkp->project_image_on_exposed_face;
+    if (res < 16 && 16 % res == 0) {
+      // a lower level of mipmap
+      img = downsample_image_box(img_16, 16 / res);
+      continue;
+    }
+    // Resource pack is unavailable if resource is loaded from snapshot
+    if (res > 16 && resource.is_resource_pack_loaded &&
+        blkp->full_id_ptr() != nullptr &&
+        resource.pack.compute_projection(*blkp->full_id_ptr(),
+                                         resource.exposed_face, &img, buffer,
+                                         res)) {
+      continue;
+    }
+    img = resize_image_nearest(img_16, res, res);
+    num_resized++;
+  }
+  if (res > 16 && num_resized > 0) {
+    std::string msg = fmt::format(
+        "{} of {} blocks in flag diagram are enlarged from 16x16 by nearest "
+        "neighbour instead of rendered at {}x{}, because {}.\n",
+        num_resized, images.size(), res, res,
+        resource.is_resource_pack_loaded
+            ? "their projections failed"
+            : "resource is loaded from a snapshot without resource packs");
+    VCL_report(VCL_report_type_t::warning, msg.c_str());
+  }
+  return images;
+}
+
+void TokiVC::draw_flag_diagram_to_memory(
+    uint32_t *image_u8c3_rowmajor, const flag_diagram_option &opt,
+    int layer_idx, const block_images_t &images) const noexcept {
+  const int res = flag_diagram_resolution(opt);
   Eigen::Map<block_model::EImgRowMajor_t> map(
-      image_u8c3_rowmajor, (opt.row_end - opt.row_start) * 16,
-      this->cols() * 16);
+      image_u8c3_rowmajor, (opt.row_end - opt.row_start) * res,
+      this->cols() * res);
 
   memset(image_u8c3_rowmajor, 0,
-         (opt.row_end - opt.row_start) * 16 * this->img_cvter.cols() * 16 *
+         (opt.row_end - opt.row_start) * res * this->img_cvter.cols() * res *
              sizeof(uint32_t));
 
-  /*s  constexpr int size_of_u32_per_vec = 32 / sizeof(uint32_t);
-
-  const bool is_dst_aligned =
-      (reinterpret_cast<size_t>(image_u8c3_rowmajor) % 32) == 0;
-
-      */
   // copy block images
   for (int64_t r = opt.row_start; r < opt.row_end; r++) {
-    const int r_pixel_beg = (r - opt.row_start) * 16;
+    const int r_pixel_beg = (r - opt.row_start) * res;
     for (int64_t c = 0; c < this->cols(); c++) {
-      const int c_pixel_beg = c * 16;
-      const uint16_t current_color_idx = this->img_cvter.color_id(r, c);
-
-      const auto &variant =
-          TokiVC::LUT_basic_color_idx_to_blocks[current_color_idx];
-      const VCL_block *blkp = nullptr;
-      if (variant.index() == 0) {
-        if (layer_idx == 0) {
-          blkp = std::get<0>(variant);
-        }
-      } else {
-        const auto &vec = std::get<1>(variant);
-
-        if (layer_idx < (int)vec.size()) {
-          blkp = vec[layer_idx];
-        }
-      }
+      const int c_pixel_beg = c * res;
+      const VCL_block *blkp = this->block_at(r, c, layer_idx);
 
       if (blkp == nullptr) {
-        map.block<16, 16>(r_pixel_beg, c_pixel_beg).fill(0x00'FF'FF'FF);
+        map.block(r_pixel_beg, c_pixel_beg, res, res).fill(0x00'FF'FF'FF);
         continue;
       }
-      /*
-      const bool is_src_aligned =
-          (reinterpret_cast<size_t>(
-               blkp->project_image_on_exposed_face.data()) %
-           32) == 0;
-      const bool is_aligned = is_dst_aligned && is_src_aligned;
-      */
-
-      map.block<16, 16>(r_pixel_beg, c_pixel_beg) =
-          blkp->project_image_on_exposed_face;
+
+      if (res == 16) {
+        map.block<16, 16>(r_pixel_beg, c_pixel_beg) =
+            blkp->project_image_on_exposed_face;
+        continue;
+      }
+      auto it = images.find(blkp);
+      assert(it != images.end());
+      map.block(r_pixel_beg, c_pixel_beg, res, res) = it->second;
     }
   }
 
   for (int64_t br = opt.row_start; br < opt.row_end; br++) {
     if ((opt.split_line_row_margin > 0) &&
         (br % opt.split_line_row_margin == 0)) {
-      const int64_t pr = (br - opt.row_start) * 16;
+      const int64_t pr = (br - opt.row_start) * res;
 
       reverse_color(&map(pr, 0), map.cols());
     }
@@ -125,7 +184,7 @@ void TokiVC::draw_flag_diagram_to_memory(uint32_t *image_u8c3_rowmajor,
   for (int64_t bc = 0; bc < this->img_cvter.cols(); bc++) {
     if ((opt.split_line_col_margin > 0) &&
         (bc % opt.split_line_col_margin == 0)) {
-      const int64_t pc = bc * 16;
+      const int64_t pc = bc * res;
 
       for (int64_t pr = 0; pr < map.rows(); pr++) {
         map(pr, pc) = reverse_color(map(pr, pc));
@@ -144,21 +203,24 @@ void TokiVC::flag_diagram(uint32_t *image_u8c3_rowmajor,
     return;
   }
 
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
+  const int res = flag_diagram_resolution(opt);
   if (rows_required_dest != nullptr) {
-    *rows_required_dest = (opt.row_end - opt.row_start) * 16;
+    *rows_required_dest = (opt.row_end - opt.row_start) * res;
   }
 
   if (cols_required_dest != nullptr) {
-    *cols_required_dest = this->img_cvter.cols() * 16;
+    *cols_required_dest = this->img_cvter.cols() * res;
   }
 
   if (image_u8c3_rowmajor == nullptr) {
     return;
   }
 
-  this->draw_flag_diagram_to_memory(image_u8c3_rowmajor, opt, layer_idx);
+  this->draw_flag_diagram_to_memory(
+      image_u8c3_rowmajor, opt, layer_idx,
+      this->block_images_for_flag_diagram(opt, layer_idx));
 }
 
 #include <png.h>
@@ -173,14 +235,16 @@ bool TokiVC::export_flag_diagram(const char *png_filename,
     return false;
   }
 
-  std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  auto lkgd = this->lock_context();
 
   this->img_cvter.ui.rangeSet(0, this->img_cvter.rows(), 0);
 
-  const int64_t rows_capacity_by_blocks = 64;
+  const int res = flag_diagram_resolution(opt);
+  // keep the buffer about the same size at any resolution
+  const int64_t rows_capacity_by_blocks = std::max(1, 64 * 16 / res);
 
-  block_model::EImgRowMajor_t buffer(rows_capacity_by_blocks * 16,
-                                     this->img_cvter.cols() * 16);
+  block_model::EImgRowMajor_t buffer(rows_capacity_by_blocks * res,
+                                     this->img_cvter.cols() * res);
 
   FILE *fp = fopen(png_filename, "wb");
 
@@ -220,8 +284,8 @@ bool TokiVC::export_flag_diagram(const char *png_filename,
 
   // png_set_text_compression_level(png, 8);
 
-  png_set_IHDR(png, png_info, this->img_cvter.cols() * 16,
-               16 * (opt.row_end - opt.row_start), 8, PNG_COLOR_TYPE_RGB_ALPHA,
+  png_set_IHDR(png, png_info, this->img_cvter.cols() * res,
+               res * (opt.row_end - opt.row_start), 8, PNG_COLOR_TYPE_RGB_ALPHA,
                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
                PNG_FILTER_TYPE_DEFAULT);
   png_write_info(png, png_info);
@@ -253,21 +317,25 @@ bool TokiVC::export_flag_diagram(const char *png_filename,
     png_set_text(png, png_info, png_txts.data(), png_txts.size());
   }
 
+  // images are computed once for all rows
+  const block_images_t images =
+      this->block_images_for_flag_diagram(opt, layer_idx);
+
   for (int64_t ridx = opt.row_start; ridx < opt.row_end;
        ridx += rows_capacity_by_blocks) {
     const int64_t rows_this_time =
         std::min(opt.row_end - ridx, rows_capacity_by_blocks);
     memset(buffer.data(), 0xFF, buffer.size() * sizeof(uint32_t));
-    this->draw_flag_diagram_to_memory(
-        buffer.data(),
-        {opt.lib_version, ridx, ridx + rows_this_time,
-         opt.split_line_row_margin, opt.split_line_col_margin},
-        layer_idx);
+    flag_diagram_option opt_temp = opt;
+    opt_temp.row_start = ridx;
+    opt_temp.row_end = ridx + rows_this_time;
+    this->draw_flag_diagram_to_memory(buffer.data(), opt_temp, layer_idx,
+                                      images);
 
     ARGB_to_AGBR(buffer.data(),
-                 rows_this_time * 16 * this->img_cvter.cols() * 16);
+                 rows_this_time * res * this->img_cvter.cols() * res);
 
-    for (int64_t pix_r = 0; pix_r < rows_this_time * 16; pix_r++) {
+    for (int64_t pix_r = 0; pix_r < rows_this_time * res; pix_r++) {
       png_write_row(png, reinterpret_cast<const uint8_t *>(&buffer(pix_r, 0)));
     }
 
@@ -0,0 +1,396 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "TokiVC.h"
+#include "VCL_internal.h"
+
+#include <zip.h>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/uuid/detail/sha1.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+
+/*
+Layout of a snapshot file. All integers are in native byte order, every
+section starts at a multiple of 4 bytes.
+
+snapshot_header
+block_count blocks:
+  uint32_t id_length, char id[id_length], padding to 4 bytes
+  uint32_t rows, uint32_t cols, uint32_t pixels[rows*cols]
+color_count colors:
+  uint32_t is_multi_block, uint32_t block_count,
+  uint32_t block_index[block_count]
+float rgb[3][color_count]
+*/
+
+namespace {
+constexpr char snapshot_magic[8] = {'V', 'C', 'L', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t snapshot_format_version = 1;
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t format_version;
+  uint32_t reserved;
+  TokiVC_resource::snapshot_key_t key;
+  uint32_t block_count;
+  uint32_t color_count;
+};
+static_assert(sizeof(snapshot_header) % 4 == 0);
+
+void append_bytes(std::vector<uint8_t> &dest, const void *src, size_t bytes) {
+  const auto *p = reinterpret_cast<const uint8_t *>(src);
+  dest.insert(dest.end(), p, p + bytes);
+}
+
+void append_u32(std::vector<uint8_t> &dest, uint32_t val) {
+  append_bytes(dest, &val, sizeof(val));
+}
+
+class snapshot_reader {
+ public:
+  explicit snapshot_reader(std::span<const uint8_t> data) : data_{data} {}
+
+  bool read(void *dest, size_t bytes) noexcept {
+    if (this->data_.size() - this->pos_ < bytes) {
+      return false;
+    }
+    memcpy(dest, this->data_.data() + this->pos_, bytes);
+    this->pos_ += bytes;
+    return true;
+  }
+
+  bool read_u32(uint32_t *dest) noexcept { return this->read(dest, 4); }
+
+  bool skip_padding() noexcept {
+    const size_t padded = (this->pos_ + 3) / 4 * 4;
+    if (padded > this->data_.size()) {
+      return false;
+    }
+    this->pos_ = padded;
+    return true;
+  }
+
+  bool at_end() const noexcept { return this->pos_ == this->data_.size(); }
+
+ private:
+  std::span<const uint8_t> data_;
+  size_t pos_{0};
+};
+
+bool add_zip_to_key(boost::uuids::detail::sha1 &hash,
+                    const char *zip_filename) noexcept {
+  int errorcode;
+  zip_t *const archive = zip_open(zip_filename, ZIP_RDONLY, &errorcode);
+  if (archive == nullptr) {
+    std::string msg = fmt::format(
+        "Failed to open zip file : {}, error code = {}", zip_filename,
+        errorcode);
+    VCL_report(VCL_report_type_t::error, msg.c_str());
+    return false;
+  }
+
+  // Only the directory is read. The crc of each file is a digest of its
+  // content, and files not used by the resource pack are ignored.
+  const int64_t entry_num = zip_get_num_entries(archive, ZIP_FL_UNCHANGED);
+  hash.process_bytes(&entry_num, sizeof(entry_num));
+  for (int64_t idx = 0; idx < entry_num; idx++) {
+    zip_stat_t stat;
+    zip_stat_init(&stat);
+    if (zip_stat_index(archive, idx, ZIP_FL_UNCHANGED, &stat) != 0 ||
+        stat.name == nullptr) {
+      continue;
+    }
+    if (!VCL_resource_pack::is_file_used(stat.name)) {
+      continue;
+    }
+    hash.process_bytes(stat.name, strlen(stat.name) + 1);
+    hash.process_bytes(&stat.size, sizeof(stat.size));
+    hash.process_bytes(&stat.crc, sizeof(stat.crc));
+  }
+  zip_close(archive);
+  return true;
+}
+
+bool add_file_to_key(boost::uuids::detail::sha1 &hash,
+                     const char *filename) noexcept {
+  std::ifstream ifs{filename, std::ios::binary};
+  if (!ifs) {
+    std::string msg = fmt::format("Failed to open {}", filename);
+    VCL_report(VCL_report_type_t::error, msg.c_str());
+    return false;
+  }
+  std::vector<char> content{std::istreambuf_iterator<char>{ifs},
+                            std::istreambuf_iterator<char>{}};
+  const uint64_t size = content.size();
+  hash.process_bytes(&size, sizeof(size));
+  hash.process_bytes(content.data(), content.size());
+  return true;
+}
+}  // namespace
+
+std::optional<TokiVC_resource::snapshot_key_t> TokiVC_resource::snapshot_key(
+    std::span<const char *const> zip_filenames,
+    std::span<const char *const> json_filenames,
+    const VCL_set_resource_option &option) noexcept {
+  boost::uuids::detail::sha1 hash;
+  hash.process_bytes(snapshot_magic, sizeof(snapshot_magic));
+  hash.process_bytes(&snapshot_format_version,
+                     sizeof(snapshot_format_version));
+  hash.process_bytes(&SC_VERSION_U64, sizeof(SC_VERSION_U64));
+
+  hash.process_bytes(&option.version, sizeof(option.version));
+  hash.process_bytes(&option.max_block_layers, sizeof(option.max_block_layers));
+  hash.process_bytes(&option.biome, sizeof(option.biome));
+  hash.process_bytes(&option.exposed_face, sizeof(option.exposed_face));
+  hash.process_bytes(&option.is_render_quality_fast,
+                     sizeof(option.is_render_quality_fast));
+
+  const uint64_t zip_count = zip_filenames.size();
+  hash.process_bytes(&zip_count, sizeof(zip_count));
+  for (const char *zip : zip_filenames) {
+    if (!add_zip_to_key(hash, zip)) {
+      return std::nullopt;
+    }
+  }
+
+  const uint64_t json_count = json_filenames.size();
+  hash.process_bytes(&json_count, sizeof(json_count));
+  for (const char *json : json_filenames) {
+    if (!add_file_to_key(hash, json)) {
+      return std::nullopt;
+    }
+  }
+
+  boost::uuids::detail::sha1::digest_type dig;
+  hash.get_digest(dig);
+  snapshot_key_t key;
+  static_assert(sizeof(dig) == sizeof(key));
+  memcpy(key.data(), dig, sizeof(key));
+  return key;
+}
+
+bool TokiVC_resource::save_snapshot(const char *filename,
+                                    const snapshot_key_t &key) const noexcept {
+  if (!this->is_basic_color_set_ready) {
+    VCL_report(VCL_report_type_t::error,
+               "Can not save snapshot before resource is set.");
+    return false;
+  }
+
+  std::vector<uint8_t> content;
+  std::unordered_map<const VCL_block *, uint32_t> block_index;
+  std::vector<uint8_t> blocks_section;
+  for (const auto &[id, blk] : this->bsl.block_states()) {
+    const auto &img = blk.project_image_on_exposed_face;
+    if (img.size() <= 0) {
+      continue;
+    }
+    block_index.emplace(&blk, uint32_t(block_index.size()));
+
+    append_u32(blocks_section, id.size());
+    append_bytes(blocks_section, id.data(), id.size());
+    blocks_section.resize((blocks_section.size() + 3) / 4 * 4, 0);
+    append_u32(blocks_section, img.rows());
+    append_u32(blocks_section, img.cols());
+    append_bytes(blocks_section, img.data(), img.size() * sizeof(uint32_t));
+  }
+
+  snapshot_header header;
+  memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+  header.format_version = snapshot_format_version;
+  header.reserved = 0;
+  header.key = key;
+  header.block_count = block_index.size();
+  header.color_count = this->LUT_basic_color_idx_to_blocks.size();
+  append_bytes(content, &header, sizeof(header));
+  content.insert(content.end(), blocks_section.begin(), blocks_section.end());
+
+  for (const auto &variant : this->LUT_basic_color_idx_to_blocks) {
+    std::span<const VCL_block *const> blocks;
+    if (variant.index() == 0) {
+      blocks = {&std::get<0>(variant), 1};
+    } else {
+      blocks = std::get<1>(variant);
+    }
+    append_u32(content, variant.index());
+    append_u32(content, blocks.size());
+    for (const VCL_block *blkp : blocks) {
+      auto it = block_index.find(blkp);
+      if (it == block_index.end()) {
+        VCL_report(VCL_report_type_t::error,
+                   "Failed to save snapshot: a block of basic color has no "
+                   "projection image.");
+        return false;
+      }
+      append_u32(content, it->second);
+    }
+  }
+
+  if (this->colorset_basic.color_count() != int(header.color_count)) {
+    VCL_report(VCL_report_type_t::error,
+               "Failed to save snapshot: size of basic colorset mismatch.");
+    return false;
+  }
+  for (int c = 0; c < 3; c++) {
+    append_bytes(content, this->colorset_basic.rgb_data(c),
+                 header.color_count * sizeof(float));
+  }
+
+  // write to a temporary file first, so a broken snapshot is never loaded
+  std::filesystem::path path{filename};
+  std::filesystem::path tmp{path};
+  tmp += ".tmp";
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  {
+    std::ofstream ofs{tmp, std::ios::binary};
+    ofs.write(reinterpret_cast<const char *>(content.data()), content.size());
+    ofs.close();
+    if (!ofs) {
+      std::string msg = fmt::format("Failed to write snapshot {}", filename);
+      VCL_report(VCL_report_type_t::error, msg.c_str());
+      std::filesystem::remove(tmp, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::string msg =
+        fmt::format("Failed to write snapshot {}: {}", filename, ec.message());
+    VCL_report(VCL_report_type_t::error, msg.c_str());
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+bool TokiVC_resource::load_snapshot(const char *filename,
+                                    const snapshot_key_t &key) noexcept {
+  this->is_basic_color_set_ready = false;
+  this->is_resource_pack_loaded = false;
+
+  // The snapshot is mapped instead of read, every section is copied to its
+  // destination directly from the mapping.
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(filename, ec) ||
+      std::filesystem::file_size(filename, ec) < sizeof(snapshot_header) ||
+      ec) {
+    return false;
+  }
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(filename);
+  } catch (const std::exception &e) {
+    std::string msg =
+        fmt::format("Failed to map snapshot {}: {}", filename, e.what());
+    VCL_report(VCL_report_type_t::warning, msg.c_str());
+    return false;
+  }
+  if (!file.is_open()) {
+    return false;
+  }
+  const std::span<const uint8_t> content{
+      reinterpret_cast<const uint8_t *>(file.data()), file.size()};
+
+  snapshot_reader reader{content};
+  snapshot_header header;
+  if (!reader.read(&header, sizeof(header)) ||
+      memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+      header.format_version != snapshot_format_version || header.key != key) {
+    std::string msg = fmt::format("{} is not a valid snapshot.", filename);
+    VCL_report(VCL_report_type_t::warning, msg.c_str());
+    return false;
+  }
+
+  this->bsl.update_foliages(!this->is_render_quality_fast);
+
+  auto report_broken = [filename]() {
+    std::string msg = fmt::format("Snapshot {} is broken.", filename);
+    VCL_report(VCL_report_type_t::warning, msg.c_str());
+    return false;
+  };
+
+  std::vector<VCL_block *> blocks(header.block_count, nullptr);
+  std::string id;
+  for (auto &blkp : blocks) {
+    uint32_t id_length = 0;
+    if (!reader.read_u32(&id_length) || id_length > content.size()) {
+      return report_broken();
+    }
+    id.resize(id_length);
+    if (!reader.read(id.data(), id_length) || !reader.skip_padding()) {
+      return report_broken();
+    }
+    blkp = this->bsl.block_at(id);
+    if (blkp == nullptr) {
+      return report_broken();
+    }
+
+    uint32_t rows = 0, cols = 0;
+    if (!reader.read_u32(&rows) || !reader.read_u32(&cols) ||
+        uint64_t(rows) * cols > content.size()) {
+      return report_broken();
+    }
+    auto &img = blkp->project_image_on_exposed_face;
+    img.resize(rows, cols);
+    if (!reader.read(img.data(), img.size() * sizeof(uint32_t))) {
+      return report_broken();
+    }
+  }
+
+  decltype(this->LUT_basic_color_idx_to_blocks) LUT;
+  LUT.reserve(header.color_count);
+  for (uint32_t cidx = 0; cidx < header.color_count; cidx++) {
+    uint32_t is_multi_block = 0, block_count = 0;
+    if (!reader.read_u32(&is_multi_block) || !reader.read_u32(&block_count) ||
+        block_count <= 0 || block_count > blocks.size()) {
+      return report_broken();
+    }
+    std::vector<const VCL_block *> color_blocks(block_count);
+    for (auto &blkp : color_blocks) {
+      uint32_t bidx = 0;
+      if (!reader.read_u32(&bidx) || bidx >= blocks.size()) {
+        return report_broken();
+      }
+      blkp = blocks[bidx];
+    }
+    if (is_multi_block) {
+      LUT.emplace_back(std::move(color_blocks));
+    } else {
+      LUT.emplace_back(color_blocks.front());
+    }
+  }
+
+  std::vector<float> rgb(3 * size_t(header.color_count));
+  if (!reader.read(rgb.data(), rgb.size() * sizeof(float)) ||
+      !reader.at_end()) {
+    return report_broken();
+  }
+
+  this->LUT_basic_color_idx_to_blocks = std::move(LUT);
+  this->colorset_basic.set_colors(rgb.data(), header.color_count);
+  this->is_basic_color_set_ready = true;
+  return true;
+}
@@ -24,6 +24,7 @@ This file is part of SlopeCraft.
 
 #include <stddef.h>
 
+#include <filesystem>
 #include <mutex>
 #include <sstream>
 #include <span>
@@ -34,6 +35,17 @@ This file is part of SlopeCraft.
 #include "TokiVC.h"
 #include "VCL_internal.h"
 
+namespace {
+// the resource and context set by VCL_set_resource_* and
+// VCL_set_allowed_blocks, guarded by TokiVC_internal::global_lock
+TokiVC_resource &global_resource() noexcept {
+  return *TokiVC_internal::global_resource;
+}
+TokiVC_context &global_context() noexcept {
+  return *TokiVC_internal::global_context;
+}
+}  // namespace
+
 VCL_EXPORT_FUN VCL_Kernel *VCL_create_kernel() {
   return static_cast<VCL_Kernel *>(new TokiVC);
 }
@@ -44,6 +56,78 @@ VCL_EXPORT_FUN void VCL_destroy_kernel(VCL_Kernel *const ptr) {
   }
 }
 
+VCL_EXPORT_FUN VCL_resource_context *VCL_create_resource_context(
+    const VCL_resource_pack *rp, const VCL_block_state_list *bsl,
+    const VCL_set_resource_option &option) {
+  if (rp == nullptr || bsl == nullptr || option.max_block_layers <= 0) {
+    return nullptr;
+  }
+
+  auto res = std::make_shared<TokiVC_resource>();
+  res->pack = *rp;
+  res->is_resource_pack_loaded = true;
+  res->bsl = *bsl;
+  res->set_option(option);
+  const bool ok = res->resolve();
+  VCL_report(VCL_report_type_t::warning, nullptr, true);
+  if (!ok) {
+    return nullptr;
+  }
+
+  return new VCL_resource_context{
+      std::make_shared<const TokiVC_context>(std::move(res))};
+}
+
+VCL_EXPORT_FUN VCL_resource_context *
+VCL_create_resource_context_with_allowed_blocks(
+    const VCL_resource_context *base,
+    const VCL_block *const *const blocks_allowed, size_t num_block_allowed) {
+  if (base == nullptr) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < num_block_allowed; i++) {
+    if (!base->context->resource->bsl.contains(blocks_allowed[i])) {
+      VCL_report(VCL_report_type_t::error,
+                 "An allowed block doesn't belong to the resource context.");
+      return nullptr;
+    }
+  }
+
+  auto ctx = std::make_shared<TokiVC_context>(base->context->resource);
+  if (!ctx->set_allowed({blocks_allowed, num_block_allowed})) {
+    return nullptr;
+  }
+  return new VCL_resource_context{std::move(ctx)};
+}
+
+VCL_EXPORT_FUN void VCL_destroy_resource_context(VCL_resource_context *ptr) {
+  delete ptr;
+}
+
+VCL_EXPORT_FUN const VCL_block_state_list *
+VCL_resource_context_block_state_list(const VCL_resource_context *ctx) {
+  if (ctx == nullptr) {
+    return nullptr;
+  }
+  return &ctx->context->resource->bsl;
+}
+
+VCL_EXPORT_FUN bool VCL_resource_context_is_allowed_colorset_ok(
+    const VCL_resource_context *ctx) {
+  return ctx != nullptr && ctx->context->is_allowed_color_set_ready;
+}
+
+VCL_EXPORT_FUN VCL_Kernel *VCL_create_kernel_with_context(
+    const VCL_resource_context *ctx) {
+  if (ctx == nullptr || !ctx->context->is_allowed_color_set_ready) {
+    VCL_report(VCL_report_type_t::error,
+               "Creating kernel with a resource context without allowed "
+               "blocks.");
+    return nullptr;
+  }
+  return static_cast<VCL_Kernel *>(new TokiVC{ctx->context});
+}
+
 VCL_resource_pack *zip_folder_to_resource_pack(
     const zipped_folder &zf) noexcept {
   VCL_resource_pack *const rp = new VCL_resource_pack;
@@ -95,36 +179,26 @@ VCL_EXPORT_FUN VCL_resource_pack *VCL_create_resource_pack(
   if (zip_file_count <= 0) {
     return nullptr;
   }
-  auto parse_zip = [](const char *filename) noexcept {
-    std::optional<zipped_folder> zf_opt = zipped_folder::from_zip(filename);
 
-    if (not zf_opt) {
+  std::vector<std::optional<zipped_folder>> packs(zip_file_count);
+  // only the directory of each zip is read, so opening all at once is cheap
+#pragma omp parallel for schedule(dynamic)
+  for (int zfidx = 0; zfidx < zip_file_count; zfidx++) {
+    const char *const filename = zip_file_names[zfidx];
+    packs[zfidx] =
+        zipped_folder::from_zip(filename, VCL_resource_pack::is_file_used);
+
+    if (not packs[zfidx]) {
       std::string msg = fmt::format("Failed to parse {}\n", filename);
       VCL_report(VCL_report_type_t::error, msg.c_str(), true);
     }
-    return zf_opt;
-  };
-
-  zipped_folder zf;
-  {
-    std::optional<zipped_folder> zf_opt = parse_zip(zip_file_names[0]);
-
-    if (not zf_opt) {
-      return nullptr;
-    }
-    zf = std::move(zf_opt.value());
   }
 
-  for (int zfidx = 1; zfidx < zip_file_count; zfidx++) {
-    std::optional<zipped_folder> zf_opt = parse_zip(zip_file_names[0]);
-    if (not zf_opt) {
-      return nullptr;
-    }
-
-    zf.merge_from_base(std::move(zf_opt.value()));
+  auto zf = overlay_resource_packs(packs);
+  if (not zf) {
+    return nullptr;
   }
-
-  return zip_folder_to_resource_pack(zf);
+  return zip_folder_to_resource_pack(zf.value());
 }
 
 [[nodiscard]] VCL_EXPORT_FUN VCL_resource_pack *
@@ -134,36 +208,28 @@ VCL_create_resource_pack_from_buffers(const size_t zip_count,
   if (zip_count <= 0) {
     return nullptr;
   }
-  zipped_folder zf;
-  {
-    auto zf_opt = zipped_folder::from_zip(
-        zip_file_names[0],
-        {reinterpret_cast<const uint8_t *>(file_contents[0].data),
-         file_contents[0].size});
-    if (not zf_opt) {
-      VCL_report(VCL_report_type_t::error,
-                 fmt::format("Failed to parse {}\n", zip_file_names[0]).c_str(),
-                 true);
-      return nullptr;
-    }
-    zf = std::move(zf_opt.value());
-  }
-  for (size_t idx = 1; idx < zip_count; idx++) {
-    auto zf_opt = zipped_folder::from_zip(
+
+  std::vector<std::optional<zipped_folder>> packs(zip_count);
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t idx = 0; idx < int64_t(zip_count); idx++) {
+    packs[idx] = zipped_folder::from_zip(
         zip_file_names[idx],
         {reinterpret_cast<const uint8_t *>(file_contents[idx].data),
-         file_contents[idx].size});
-    if (not zf_opt) {
+         file_contents[idx].size},
+        VCL_resource_pack::is_file_used);
+    if (not packs[idx]) {
       VCL_report(
           VCL_report_type_t::error,
           fmt::format("Failed to parse {}\n", zip_file_names[idx]).c_str(),
           true);
-      return nullptr;
     }
-    zf.merge_from_base(std::move(zf_opt.value()));
   }
 
-  return zip_folder_to_resource_pack(zf);
+  auto zf = overlay_resource_packs(packs);
+  if (not zf) {
+    return nullptr;
+  }
+  return zip_folder_to_resource_pack(zf.value());
 }
 
 VCL_EXPORT_FUN void VCL_destroy_resource_pack(VCL_resource_pack *const ptr) {
@@ -396,16 +462,13 @@ VCL_EXPORT_FUN bool VCL_set_resource_copy(
   }
 
   std::unique_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  TokiVC_resource &res = global_resource();
 
-  TokiVC_internal::is_basic_color_set_ready = false;
-  TokiVC::pack = *rp;
-  TokiVC::bsl = *bsl;
-
-  TokiVC::version = option.version;
-  TokiVC::exposed_face = option.exposed_face;
-  TokiVC::max_block_layers = option.max_block_layers;
-  TokiVC::biome = option.biome;
-  TokiVC::is_render_quality_fast = option.is_render_quality_fast;
+  res.is_basic_color_set_ready = false;
+  res.pack = *rp;
+  res.is_resource_pack_loaded = true;
+  res.bsl = *bsl;
+  res.set_option(option);
 
   const bool ret = TokiVC::set_resource_no_lock();
   VCL_report(VCL_report_type_t::warning, nullptr, true);
@@ -429,22 +492,20 @@ VCL_EXPORT_FUN bool VCL_set_resource_move(
 
   bool ret = true;
   std::unique_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+  TokiVC_resource &res = global_resource();
 
-  TokiVC_internal::is_basic_color_set_ready = false;
+  res.is_basic_color_set_ready = false;
 
-  TokiVC::pack = std::move(**rp_ptr);
+  res.pack = std::move(**rp_ptr);
+  res.is_resource_pack_loaded = true;
   VCL_destroy_resource_pack(*rp_ptr);
   *rp_ptr = nullptr;
 
-  TokiVC::bsl = std::move(**bsl_ptr);
+  res.bsl = std::move(**bsl_ptr);
   VCL_destroy_block_state_list(*bsl_ptr);
   *bsl_ptr = nullptr;
 
-  TokiVC::version = option.version;
-  TokiVC::exposed_face = option.exposed_face;
-  TokiVC::max_block_layers = option.max_block_layers;
-  TokiVC::biome = option.biome;
-  TokiVC::is_render_quality_fast = option.is_render_quality_fast;
+  res.set_option(option);
 
   if (!TokiVC::set_resource_no_lock()) {
     ret = false;
@@ -455,65 +516,138 @@ VCL_EXPORT_FUN bool VCL_set_resource_move(
   return ret;
 }
 
+VCL_EXPORT_FUN bool VCL_set_resource_with_snapshot(
+    const int zip_file_count, const char *const *const zip_file_names,
+    const int json_file_count, const char *const *const json_file_names,
+    const VCL_set_resource_option &option, const char *snapshot_dir) {
+  if (zip_file_count <= 0 || json_file_count <= 0 || snapshot_dir == nullptr) {
+    return false;
+  }
+  if (option.max_block_layers <= 0) {
+    return false;
+  }
+
+  const auto key = TokiVC_resource::snapshot_key(
+      {zip_file_names, size_t(zip_file_count)},
+      {json_file_names, size_t(json_file_count)}, option);
+  if (not key) {
+    return false;
+  }
+  std::string key_hex;
+  for (uint8_t byte : key.value()) {
+    key_hex += fmt::format("{:02x}", byte);
+  }
+  const std::string snapshot_file =
+      (std::filesystem::path{snapshot_dir} / (key_hex + ".vclsnapshot"))
+          .string();
+
+  VCL_block_state_list *bsl =
+      VCL_create_block_state_list(json_file_count, json_file_names);
+  if (bsl == nullptr) {
+    return false;
+  }
+
+  if (std::filesystem::is_regular_file(snapshot_file)) {
+    std::unique_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+    TokiVC_resource &res = global_resource();
+    res.is_basic_color_set_ready = false;
+    res.pack = VCL_resource_pack{};
+    res.is_resource_pack_loaded = false;
+    res.bsl = std::move(*bsl);
+    res.set_option(option);
+
+    if (TokiVC::load_snapshot_no_lock(snapshot_file.c_str(), key.value())) {
+      VCL_destroy_block_state_list(bsl);
+      VCL_report(VCL_report_type_t::warning, nullptr, true);
+      return true;
+    }
+    // the block states were moved, load them again
+    VCL_destroy_block_state_list(bsl);
+    bsl = VCL_create_block_state_list(json_file_count, json_file_names);
+  }
+
+  VCL_resource_pack *rp =
+      VCL_create_resource_pack(zip_file_count, zip_file_names);
+  if (rp == nullptr) {
+    VCL_destroy_block_state_list(bsl);
+    return false;
+  }
+
+  if (!VCL_set_resource_move(&rp, &bsl, option)) {
+    VCL_destroy_resource_pack(rp);
+    VCL_destroy_block_state_list(bsl);
+    return false;
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
+    // failing to save the snapshot is not fatal
+    global_resource().save_snapshot(snapshot_file.c_str(), key.value());
+  }
+  VCL_report(VCL_report_type_t::warning, nullptr, true);
+  return true;
+}
+
 VCL_EXPORT_FUN void VCL_discard_resource() {
   std::unique_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
-  TokiVC_internal::is_basic_color_set_ready = false;
-  TokiVC_internal::is_allowed_color_set_ready = false;
+  global_resource().is_basic_color_set_ready = false;
+  global_context().discard_allowed();
 }
 
 VCL_EXPORT_FUN int VCL_get_max_block_layers() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready) {
     return 0;
   }
 
-  return TokiVC::max_block_layers;
+  return global_resource().max_block_layers;
 }
 
 VCL_EXPORT_FUN bool VCL_is_basic_colorset_ok() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  return TokiVC_internal::is_basic_color_set_ready;
+  return global_resource().is_basic_color_set_ready;
 }
 
 VCL_EXPORT_FUN VCL_resource_pack *VCL_get_resource_pack() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready ||
+      !global_resource().is_resource_pack_loaded) {
     return nullptr;
   }
 
-  return &TokiVC::pack;
+  return &global_resource().pack;
 }
 
 VCL_EXPORT_FUN VCL_block_state_list *VCL_get_block_state_list() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready) {
     return nullptr;
   }
-  return &TokiVC::bsl;
+  return &global_resource().bsl;
 }
 
 VCL_EXPORT_FUN SCL_gameVersion VCL_get_game_version() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready) {
     return SCL_gameVersion::ANCIENT;
   }
-  return TokiVC::version;
+  return global_resource().version;
 }
 
 VCL_EXPORT_FUN VCL_face_t VCL_get_exposed_face() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready) {
     return {};
   }
 
-  return TokiVC::exposed_face;
+  return global_resource().exposed_face;
 }
 
 VCL_EXPORT_FUN size_t VCL_num_basic_colors() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  return TokiVC::LUT_bcitb().size();
+  return global_resource().LUT_basic_color_idx_to_blocks.size();
 }
 
 VCL_EXPORT_FUN int VCL_get_basic_color_composition(
@@ -521,22 +655,23 @@ VCL_EXPORT_FUN int VCL_get_basic_color_composition(
     uint32_t *const color) {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready) {
     return -1;
   }
 
-  if (color_idx >= TokiVC::LUT_bcitb().size()) {
+  const TokiVC_resource &res = global_resource();
+  if (color_idx >= res.LUT_basic_color_idx_to_blocks.size()) {
     return false;
   }
 
   if (color != nullptr) {
-    const uint16_t color_id = TokiVC::colorset_basic.color_id(color_idx);
-    *color = ARGB32(TokiVC::colorset_basic.RGB(color_id, 0) * 255,
-                    TokiVC::colorset_basic.RGB(color_id, 1) * 255,
-                    TokiVC::colorset_basic.RGB(color_id, 2) * 255);
+    const uint16_t color_id = res.colorset_basic.color_id(color_idx);
+    *color = ARGB32(res.colorset_basic.RGB(color_id, 0) * 255,
+                    res.colorset_basic.RGB(color_id, 1) * 255,
+                    res.colorset_basic.RGB(color_id, 2) * 255);
   }
 
-  const auto &variant = TokiVC::LUT_bcitb()[color_idx];
+  const auto &variant = res.LUT_basic_color_idx_to_blocks[color_idx];
   const VCL_block *const *srcp = nullptr;
   size_t num_blocks = 0;
   if (variant.index() == 0) {
@@ -565,65 +700,67 @@ VCL_EXPORT_FUN bool VCL_set_allowed_blocks(
 }
 VCL_EXPORT_FUN void VCL_discard_allowed_blocks() {
   std::unique_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
-  TokiVC_internal::is_allowed_color_set_ready = false;
+  global_context().discard_allowed();
 }
 
 VCL_EXPORT_FUN bool VCL_is_allowed_colorset_ok() {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
-  if (!TokiVC_internal::is_basic_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready) {
     return false;
   }
-  return TokiVC_internal::is_allowed_color_set_ready;
+  return global_context().is_allowed_color_set_ready;
 }
 
 VCL_EXPORT_FUN bool VCL_export_test_litematic(const char *filename) {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
-  return TokiVC::export_test_litematic_no_lock(filename);
+  return global_context().export_test_litematic(filename);
 }
 
 VCL_EXPORT_FUN int VCL_get_allowed_colors(uint32_t *dest,
                                           size_t dest_capacity) {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
+  const auto &colorset_allowed = global_context().colorset_allowed;
   size_t num_written = 0;
 
   if (dest == nullptr || dest_capacity <= 0) {
-    return TokiVC::colorset_allowed.color_count();
+    return colorset_allowed.color_count();
   }
 
-  for (int idx = 0; idx < TokiVC::colorset_allowed.color_count(); idx++) {
+  for (int idx = 0; idx < colorset_allowed.color_count(); idx++) {
     if (num_written >= dest_capacity) {
       break;
     }
-    Eigen::Array3i ret = (TokiVC::colorset_allowed.rgb(idx) * 255).cast<int>();
+    Eigen::Array3i ret = (colorset_allowed.rgb(idx) * 255).cast<int>();
     dest[num_written] = ARGB32(ret[0], ret[1], ret[2]);
     num_written++;
   }
 
-  return TokiVC::colorset_allowed.color_count();
+  return colorset_allowed.color_count();
 }
 
 VCL_EXPORT_FUN size_t VCL_get_allowed_color_id(
     uint16_t *const dest, size_t dest_capacity_in_elements) {
   std::shared_lock<std::shared_mutex> lkgd(TokiVC_internal::global_lock);
 
-  if (!TokiVC_internal::is_basic_color_set_ready ||
-      !TokiVC_internal::is_allowed_color_set_ready) {
+  if (!global_resource().is_basic_color_set_ready ||
+      !global_context().is_allowed_color_set_ready) {
     return 0;
   }
 
+  const auto &colorset_allowed = global_context().colorset_allowed;
   if (dest != nullptr) {
     for (size_t cidx = 0;
          cidx < std::min<size_t>(dest_capacity_in_elements,
-                                 TokiVC::colorset_allowed.color_count());
+                                 colorset_allowed.color_count());
          cidx++) {
-      dest[cidx] = TokiVC::colorset_allowed.color_id(cidx);
+      dest[cidx] = colorset_allowed.color_id(cidx);
     }
   }
 
-  return TokiVC::colorset_allowed.color_count();
+  return colorset_allowed.color_count();
 }
 
 VCL_EXPORT_FUN size_t VCL_get_blocks_from_block_state_list(
@@ -911,7 +1048,8 @@ VCL_EXPORT_FUN bool VCL_compute_projection_image(const VCL_model *md,
     return false;
   }
 
-  [[maybe_unused]] auto img = mdptr->projection_image(face);
+  block_model::EImgRowMajor_t img, full_res_img;
+  mdptr->projection_image_downsampled(face, &img, 16, &full_res_img);
 
   Eigen::Map<block_model::EImgRowMajor_t> map(img_buffer_argb32, 16, 16);
 
@@ -1003,11 +1141,19 @@ VCL_EXPORT_FUN void VCL_set_report_callback(VCL_report_callback_t cb) {
 }
 
 void VCL_report(VCL_report_type_t t, const char *msg, bool flush) noexcept {
+  // resource packs are parsed by multiple threads, while the callback may not
+  // be thread-safe
+  static std::mutex lock;
+  std::lock_guard<std::mutex> lk{lock};
   VCL_report_fun(t, msg, flush);
 }
 
 VCL_EXPORT_FUN bool VCL_have_gpu_api() { return ::gpu_wrapper::have_api; }
 
+VCL_EXPORT_FUN bool VCL_have_cpu_backend() {
+  return ::gpu_wrapper::is_cpu_backend;
+}
+
 VCL_EXPORT_FUN const char *VCL_get_GPU_api_name() {
   return ::gpu_wrapper::api_name();
 }
@@ -192,6 +192,7 @@ class VCL_Kernel;
 class VCL_resource_pack;
 class VCL_block_state_list;
 class VCL_block;
+class VCL_resource_context;
 class VCL_model;
 
 class VCL_GPU_Platform;
@@ -248,6 +249,9 @@ class VCL_Kernel {
     int32_t split_line_col_margin;  // 0 or negative number means no split lines
     int png_compress_level{9};
     int png_compress_memory_level{8};
+    // added in v5.4. Size of each block in pixels. Smaller sizes are
+    // downsampled from 16, larger ones are rendered from the resource pack.
+    int block_resolution{16};
   };
 
   virtual void flag_diagram(uint32_t *image_u8c3_rowmajor,
@@ -299,7 +303,8 @@ extern "C" {
 [[nodiscard]] VCL_EXPORT_FUN VCL_Kernel *VCL_create_kernel();
 VCL_EXPORT_FUN void VCL_destroy_kernel(VCL_Kernel *const ptr);
 
-// create and destroy resource pack
+// create and destroy resource pack. Files in earlier zips override files with
+// the same path in later zips.
 [[nodiscard]] VCL_EXPORT_FUN VCL_resource_pack *VCL_create_resource_pack(
     const int zip_file_count, const char *const *const zip_file_names);
 [[nodiscard]] VCL_EXPORT_FUN VCL_resource_pack *
@@ -338,6 +343,17 @@ VCL_EXPORT_FUN bool VCL_set_resource_move(
     VCL_resource_pack **rp_ptr, VCL_block_state_list **bsl_ptr,
     const VCL_set_resource_option &option);
 
+// added in v5.4
+// Create resource pack and block state list from files, then set resource. The
+// resolved resource is saved as a snapshot in snapshot_dir, and later calls
+// with the same zips, jsons and option load the snapshot instead of parsing
+// the resource packs. When loaded from a snapshot, VCL_get_resource_pack
+// returns nullptr.
+VCL_EXPORT_FUN bool VCL_set_resource_with_snapshot(
+    int zip_file_count, const char *const *zip_file_names, int json_file_count,
+    const char *const *json_file_names, const VCL_set_resource_option &option,
+    const char *snapshot_dir);
+
 VCL_EXPORT_FUN void VCL_discard_resource();
 
 // functions to check the resource
@@ -369,6 +385,32 @@ VCL_EXPORT_FUN size_t VCL_get_allowed_color_id(
 
 VCL_EXPORT_FUN bool VCL_export_test_litematic(const char *filename);
 
+// added in v5.4
+// A resource context is a resolved resource with a set of allowed blocks.
+// Functions above work on one global resource, and changing it blocks every
+// kernel. Contexts are independent and never changed after creation, so
+// kernels of different contexts convert in parallel without locking.
+//
+// Create a context with resource only. rp and bsl are copied.
+[[nodiscard]] VCL_EXPORT_FUN VCL_resource_context *VCL_create_resource_context(
+    const VCL_resource_pack *rp, const VCL_block_state_list *bsl,
+    const VCL_set_resource_option &option);
+// Create a context sharing the resource of base, with different allowed
+// blocks. The blocks must come from the block state list of base.
+[[nodiscard]] VCL_EXPORT_FUN VCL_resource_context *
+VCL_create_resource_context_with_allowed_blocks(
+    const VCL_resource_context *base, const VCL_block *const *blocks_allowed,
+    size_t num_block_allowed);
+// Kernels created from the context keep it alive after it's destroyed.
+VCL_EXPORT_FUN void VCL_destroy_resource_context(VCL_resource_context *);
+VCL_EXPORT_FUN const VCL_block_state_list *
+VCL_resource_context_block_state_list(const VCL_resource_context *);
+VCL_EXPORT_FUN bool VCL_resource_context_is_allowed_colorset_ok(
+    const VCL_resource_context *);
+// The context must have allowed blocks.
+[[nodiscard]] VCL_EXPORT_FUN VCL_Kernel *VCL_create_kernel_with_context(
+    const VCL_resource_context *);
+
 // functions about resource pack
 VCL_EXPORT_FUN void VCL_display_resource_pack(const VCL_resource_pack *,
                                               bool textures = true,
@@ -483,6 +525,9 @@ VCL_EXPORT_FUN bool VCL_is_version_ok(
     uint64_t version_at_caller_s_build_time = SC_VERSION_U64);
 
 VCL_EXPORT_FUN bool VCL_have_gpu_api();
+// added in v5.4. Without a gpu api, the only platform and device are a CPU
+// backend that matches colors in batches on CPU threads.
+VCL_EXPORT_FUN bool VCL_have_cpu_backend();
 VCL_EXPORT_FUN const char *VCL_get_GPU_api_name();
 
 [[nodiscard]] VCL_EXPORT_FUN size_t VCL_platform_num();
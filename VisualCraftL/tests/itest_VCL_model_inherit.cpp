@@ -0,0 +1,106 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "ParseResourcePack.h"
+#include "Resource_tree.h"
+
+#include <zip.h>
+
+#include <array>
+#include <iostream>
+#include <string_view>
+#include <utility>
+
+using std::cout, std::endl;
+
+// Models in block/ of the generated resource pack, and whether each one
+// should be parsed.
+constexpr std::array<std::pair<std::string_view, std::string_view>, 6>
+    model_jsons{{
+        {"cube", R"({})"},
+        {"cube_all", R"({"parent":"block/cube"})"},
+        {"stone", R"({"parent":"minecraft:block/cube_all"})"},
+        {"orphan", R"({"parent":"block/no_such_model"})"},
+        {"orphan_child", R"({"parent":"block/orphan"})"},
+        {"self_loop", R"({"parent":"block/self_loop"})"},
+    }};
+constexpr std::array<bool, 6> expect_parsed{true,  true,  true,
+                                            false, false, false};
+
+bool write_zip(const char *filename) noexcept {
+  int err{0};
+  zip_t *zip = zip_open(filename, ZIP_CREATE | ZIP_TRUNCATE, &err);
+  if (zip == nullptr) {
+    cout << "Failed to create " << filename << ", error code : " << err
+         << endl;
+    return false;
+  }
+  for (const auto &[name, json] : model_jsons) {
+    const std::string path =
+        std::string{"assets/minecraft/models/block/"}.append(name).append(
+            ".json");
+    zip_source_t *src = zip_source_buffer(zip, json.data(), json.size(), 0);
+    if (src == nullptr ||
+        zip_file_add(zip, path.c_str(), src, ZIP_FL_ENC_UTF_8) < 0) {
+      zip_source_free(src);
+      zip_discard(zip);
+      cout << "Failed to add " << path << " to zip." << endl;
+      return false;
+    }
+  }
+  return zip_close(zip) == 0;
+}
+
+int main(int, char **) {
+  constexpr const char *filename = "itest_VCL_model_inherit.zip";
+  if (!write_zip(filename)) {
+    return 1;
+  }
+
+  auto folder = zipped_folder::from_zip(filename);
+  if (!folder) {
+    cout << "Failed to open " << filename << endl;
+    return 1;
+  }
+
+  VCL_resource_pack rp;
+  rp.add_block_models(folder.value());
+
+  int failed = 0;
+  for (size_t i = 0; i < model_jsons.size(); i++) {
+    const std::string name =
+        std::string{"block/"}.append(model_jsons[i].first);
+    const bool parsed = rp.get_models().contains(name);
+    if (parsed != expect_parsed[i]) {
+      cout << name << (parsed ? " is parsed but it shouldn't be."
+                              : " is expected to be parsed but it isn't.")
+           << endl;
+      failed++;
+    }
+  }
+  if (failed > 0) {
+    cout << "Failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
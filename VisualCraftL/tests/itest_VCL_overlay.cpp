@@ -0,0 +1,132 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+// Resource packs are given with user packs first and the vanilla pack last, so
+// files in earlier packs must override those in later packs.
+
+#include "Resource_tree.h"
+
+#include <zip.h>
+
+#include <array>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using std::cout, std::endl;
+
+using file_list_t =
+    std::array<std::pair<std::string_view, std::string_view>, 2>;
+
+// stone.png is in both packs
+constexpr file_list_t user_pack{{
+    {"assets/minecraft/textures/block/stone.png", "user"},
+    {"assets/minecraft/textures/block/dirt.png", "user"},
+}};
+constexpr file_list_t vanilla_pack{{
+    {"assets/minecraft/textures/block/stone.png", "vanilla"},
+    {"assets/minecraft/textures/block/sand.png", "vanilla"},
+}};
+
+bool write_zip(const char *filename, const file_list_t &files) noexcept {
+  int err{0};
+  zip_t *zip = zip_open(filename, ZIP_CREATE | ZIP_TRUNCATE, &err);
+  if (zip == nullptr) {
+    cout << "Failed to create " << filename << ", error code : " << err
+         << endl;
+    return false;
+  }
+  for (const auto &[path, content] : files) {
+    zip_source_t *src =
+        zip_source_buffer(zip, content.data(), content.size(), 0);
+    if (src == nullptr ||
+        zip_file_add(zip, std::string{path}.c_str(), src, ZIP_FL_ENC_UTF_8) <
+            0) {
+      zip_source_free(src);
+      zip_discard(zip);
+      cout << "Failed to add " << path << " to zip." << endl;
+      return false;
+    }
+  }
+  return zip_close(zip) == 0;
+}
+
+// Content of a file in folder, or an empty string if it's not found.
+std::string_view content_of(const zipped_folder &folder,
+                            std::string_view filename) noexcept {
+  const zipped_folder *dir = &folder;
+  for (std::string_view name : {"assets", "minecraft", "textures", "block"}) {
+    dir = dir->subfolder(name);
+    if (dir == nullptr) {
+      return {};
+    }
+  }
+  auto it = dir->files.find(std::string{filename});
+  if (it == dir->files.end()) {
+    return {};
+  }
+  return {reinterpret_cast<const char *>(it->second.data()),
+          size_t(it->second.file_size())};
+}
+
+int main(int, char **) {
+  constexpr const char *user_zip = "itest_VCL_overlay_user.zip";
+  constexpr const char *vanilla_zip = "itest_VCL_overlay_vanilla.zip";
+  if (!write_zip(user_zip, user_pack) ||
+      !write_zip(vanilla_zip, vanilla_pack)) {
+    return 1;
+  }
+
+  std::vector<std::optional<zipped_folder>> packs;
+  packs.emplace_back(zipped_folder::from_zip(user_zip));
+  packs.emplace_back(zipped_folder::from_zip(vanilla_zip));
+  auto overlaid = overlay_resource_packs(packs);
+  if (!overlaid) {
+    cout << "Failed to open or overlay zips." << endl;
+    return 1;
+  }
+
+  constexpr std::array<std::pair<std::string_view, std::string_view>, 3>
+      expected{{
+          {"stone.png", "user"},
+          {"dirt.png", "user"},
+          {"sand.png", "vanilla"},
+      }};
+  int failed = 0;
+  for (const auto &[filename, content] : expected) {
+    const std::string_view found = content_of(overlaid.value(), filename);
+    if (found != content) {
+      cout << filename << " is \"" << found << "\", expected \"" << content
+           << "\"" << endl;
+      failed++;
+    }
+  }
+  if (failed > 0) {
+    cout << "Failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
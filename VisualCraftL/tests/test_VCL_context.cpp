@@ -0,0 +1,115 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+// A resource context copies the resource pack and block state list, so it must
+// keep working after both sources are destroyed.
+
+#include <VisualCraftL.h>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout, std::endl;
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cout << "Usage : test_VCL_context <block list json> <resource pack zip>"
+         << endl;
+    return 1;
+  }
+  const char *const json_file = argv[1];
+  const char *const zip_file = argv[2];
+
+  VCL_set_resource_option option;
+  option.version = SCL_gameVersion::MC20;
+  option.max_block_layers = 2;
+  option.biome = VCL_biome_t::the_void;
+  option.exposed_face = VCL_face_t::face_up;
+  option.is_render_quality_fast = false;
+
+  VCL_resource_context *ctx = nullptr;
+  {
+    VCL_block_state_list *bsl = VCL_create_block_state_list(1, &json_file);
+    VCL_resource_pack *rp = VCL_create_resource_pack(1, &zip_file);
+    if (bsl == nullptr || rp == nullptr) {
+      cout << "Failed to load resource." << endl;
+      return 1;
+    }
+    ctx = VCL_create_resource_context(rp, bsl, option);
+    // the context must not refer to them anymore
+    VCL_destroy_block_state_list(bsl);
+    VCL_destroy_resource_pack(rp);
+  }
+  if (ctx == nullptr) {
+    cout << "Failed to create resource context." << endl;
+    return 1;
+  }
+
+  const VCL_block_state_list *ctx_bsl =
+      VCL_resource_context_block_state_list(ctx);
+  std::vector<const VCL_block *> blocks;
+  blocks.resize(VCL_get_blocks_from_block_state_list_match_const(
+      ctx_bsl, option.version, option.exposed_face, nullptr, 0));
+  VCL_get_blocks_from_block_state_list_match_const(
+      ctx_bsl, option.version, option.exposed_face, blocks.data(),
+      blocks.size());
+
+  // checking that blocks come from the context reads their ids
+  VCL_resource_context *allowed_ctx =
+      VCL_create_resource_context_with_allowed_blocks(ctx, blocks.data(),
+                                                      blocks.size());
+  VCL_destroy_resource_context(ctx);
+  if (allowed_ctx == nullptr) {
+    cout << "Failed to create resource context with allowed blocks." << endl;
+    return 1;
+  }
+
+  VCL_Kernel *kernel = VCL_create_kernel_with_context(allowed_ctx);
+  VCL_destroy_resource_context(allowed_ctx);
+  if (kernel == nullptr) {
+    cout << "Failed to create kernel." << endl;
+    return 1;
+  }
+
+  constexpr int64_t rows = 32, cols = 48;
+  std::vector<uint32_t> img(rows * cols);
+  std::mt19937 rng{42};
+  for (auto &argb : img) {
+    argb = rng() | 0xFF000000;
+  }
+
+  bool ok = kernel->set_image(rows, cols, img.data(), true) &&
+            kernel->convert(SCL_convertAlgo::RGB_Better) && kernel->build();
+  if (ok) {
+    int64_t out_rows = 0, out_cols = 0;
+    kernel->converted_image(nullptr, &out_rows, &out_cols, true);
+    ok = (out_rows == rows && out_cols == cols);
+  }
+  VCL_destroy_kernel(kernel);
+
+  if (!ok) {
+    cout << "Failed to convert with the context." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
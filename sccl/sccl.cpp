@@ -0,0 +1,108 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include <CLI11.hpp>
+#include <thread>
+
+#include "sccl_internal.h"
+#include <QCoreApplication>
+
+#include <SC_version_buildtime.h>
+#include <fmt/format.h>
+
+int main(int argc, char **argv) {
+  inputs input;
+  CLI::App app{"Convert images to map arts in batch. See job.md for the "
+               "format of job files."};
+
+  app.set_version_flag("--version,-v", SC_VERSION_STR);
+  app.add_option("job", input.job_file, "Job file in json")
+      ->check(CLI::ExistingFile);
+  app.add_option("--prefix", input.prefix,
+                 "Filename prefix of outputs, overrides the one in job file");
+  app.add_flag("--no-cache", input.disable_cache,
+               "Don't use the convert cache in job file")
+      ->default_val(false);
+
+  // compute
+  app.add_option("--threads,-j", input.num_threads,
+                 "CPU threads used to convert and build")
+      ->check(CLI::PositiveNumber)
+      ->default_val(std::thread::hardware_concurrency());
+  app.add_option("--workers,-w", input.num_workers,
+                 "Number of tasks processed at the same time. 0 means "
+                 "decided automatically.")
+      ->check(CLI::NonNegativeNumber)
+      ->default_val(0);
+
+  // daemon
+  auto daemon_opt =
+      app.add_option("--daemon", input.daemon_name,
+                     "Keep running and serve jobs on this local socket, so "
+                     "that block lists and color tables are loaded only once");
+  app.add_option("--connect", input.connect_name,
+                 "Send the job to the daemon on this local socket")
+      ->excludes(daemon_opt);
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    // --help and --version exit with 0
+    if (app.exit(e) == 0) {
+      return 0;
+    }
+    return int(sccl_exit_code::invalid_arguments);
+  }
+  if (input.daemon_name.empty() && input.job_file.empty()) {
+    fmt::print(stderr, "No job file.\n");
+    return int(sccl_exit_code::invalid_arguments);
+  }
+
+  QCoreApplication qapp(argc, argv);
+  if (!input.daemon_name.empty()) {
+    return int(run_daemon(input));
+  }
+  if (!input.connect_name.empty()) {
+    return int(run_client(input));
+  }
+
+  auto j = load_job(input.job_file);
+  if (!j) {
+    fmt::print(stderr, "{}\n", j.error());
+    return int(sccl_exit_code::invalid_job);
+  }
+  if (!input.prefix.empty()) {
+    j->prefix = input.prefix;
+  }
+  if (input.disable_cache) {
+    j->cache_dir.clear();
+  }
+
+  resource_cache cache;
+  const sccl_exit_code ret =
+      run_job(j.value(), input, cache, [](std::string_view line) {
+        fmt::print("{}\n", line);
+        std::fflush(stdout);
+      });
+  qapp.quit();
+  return int(ret);
+}
@@ -0,0 +1,161 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "sccl_internal.h"
+#include <LocalDaemon.h>
+#include <QCoreApplication>
+#include <filesystem>
+#include <fmt/format.h>
+#include <json.hpp>
+#include <mutex>
+
+namespace {
+using njson = nlohmann::json;
+
+std::string error_response(sccl_exit_code code, std::string_view what) {
+  njson jo;
+  jo["success"] = false;
+  jo["exit_code"] = int(code);
+  jo["error"] = what;
+  return jo.dump();
+}
+
+std::string run_request(const njson &req, const inputs &input,
+                        resource_cache &cache) noexcept(false) {
+  tl::expected<job, std::string> j;
+  if (req.contains("job_file")) {
+    j = load_job(req.at("job_file").get<std::string>());
+  } else {
+    j = load_job_from_string(req.at("job").dump(),
+                             req.value("base_dir", std::string{"."}));
+  }
+  if (!j) {
+    return error_response(sccl_exit_code::invalid_job, j.error());
+  }
+  if (req.contains("prefix")) {
+    j->prefix = req.at("prefix");
+  }
+  if (input.disable_cache || req.value("no_cache", false)) {
+    j->cache_dir.clear();
+  }
+  inputs in = input;
+  in.num_workers = req.value("workers", input.num_workers);
+
+  njson results = njson::array();
+  const sccl_exit_code ret =
+      run_job(j.value(), in, cache, [&results](std::string_view line) {
+        results.emplace_back(njson::parse(line));
+      });
+
+  njson jo;
+  jo["success"] = (ret == sccl_exit_code::success);
+  jo["exit_code"] = int(ret);
+  jo["results"] = std::move(results);
+  return jo.dump();
+}
+
+// Runs and clear_cache modify the cache and use tables in it, so they are
+// serialized by run_lock. Status and ping don't wait for them.
+std::string handle_request(std::string_view request, const inputs &input,
+                           resource_cache &cache, std::mutex &run_lock,
+                           bool &stop) noexcept {
+  try {
+    const njson req = njson::parse(request);
+    const std::string type = req.at("type");
+    if (type == "run") {
+      std::lock_guard<std::mutex> lk{run_lock};
+      return run_request(req, input, cache);
+    }
+
+    njson jo;
+    jo["success"] = true;
+    jo["exit_code"] = int(sccl_exit_code::success);
+    if (type == "status") {
+      jo["block_lists"] = cache.num_block_lists();
+      jo["color_tables"] = cache.num_color_tables();
+    } else if (type == "clear_cache") {
+      std::lock_guard<std::mutex> lk{run_lock};
+      cache.clear();
+    } else if (type == "shutdown") {
+      stop = true;
+    } else if (type != "ping") {
+      return error_response(sccl_exit_code::invalid_arguments,
+                            fmt::format("Unknown request type \"{}\"", type));
+    }
+    return jo.dump();
+  } catch (const std::exception &e) {
+    return error_response(sccl_exit_code::invalid_arguments,
+                          fmt::format("Invalid request: {}", e.what()));
+  }
+}
+}  // namespace
+
+sccl_exit_code run_daemon(const inputs &input) noexcept {
+  resource_cache cache;
+  std::mutex run_lock;
+  local_daemon::server server{
+      [&input, &cache, &run_lock](std::string_view request, bool &stop) {
+        return handle_request(request, input, cache, run_lock, stop);
+      }};
+  if (auto ret = server.listen(input.daemon_name); !ret) {
+    fmt::print(stderr, "{}\n", ret.error());
+    return sccl_exit_code::daemon_error;
+  }
+  fmt::print(stderr, "sccl daemon is serving on \"{}\"\n", input.daemon_name);
+  QCoreApplication::exec();
+  return sccl_exit_code::success;
+}
+
+sccl_exit_code run_client(const inputs &input) noexcept {
+  njson req;
+  req["type"] = "run";
+  // the daemon may work in another directory
+  req["job_file"] = std::filesystem::absolute(input.job_file).string();
+  if (!input.prefix.empty()) {
+    req["prefix"] = std::filesystem::absolute(input.prefix).string();
+  }
+  if (input.num_workers > 0) {
+    req["workers"] = input.num_workers;
+  }
+  req["no_cache"] = input.disable_cache;
+
+  auto response = local_daemon::send_request(input.connect_name, req.dump());
+  if (!response) {
+    fmt::print(stderr, "{}\n", response.error());
+    return sccl_exit_code::daemon_error;
+  }
+  try {
+    const njson jo = njson::parse(response.value());
+    if (jo.contains("error")) {
+      fmt::print(stderr, "{}\n", jo.at("error").get<std::string>());
+    }
+    if (jo.contains("results")) {
+      for (const njson &line : jo.at("results")) {
+        fmt::print("{}\n", line.dump());
+      }
+    }
+    return sccl_exit_code(jo.at("exit_code").get<int>());
+  } catch (const std::exception &e) {
+    fmt::print(stderr, "Invalid response from daemon: {}\n", e.what());
+    return sccl_exit_code::daemon_error;
+  }
+}
@@ -0,0 +1,178 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#ifndef SLOPECRAFT_SCCL_INTERNAL_H
+#define SLOPECRAFT_SCCL_INTERNAL_H
+
+#include <SlopeCraftL.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+#include <utility>
+#include <vector>
+
+// Exit codes of sccl, stable for scripts and services that run it.
+enum class sccl_exit_code : int {
+  success = 0,
+  invalid_arguments = 1,
+  // the job file can't be read or parsed
+  invalid_job = 2,
+  // block lists or color tables can't be created
+  resource_error = 3,
+  // some tasks failed, others are finished
+  task_failed = 4,
+  // failed to listen, or the daemon is not reachable
+  daemon_error = 5,
+};
+
+struct export_formats {
+  bool converted_image{false};
+  bool map_data{false};
+  bool litematic{false};
+  bool structure{false};
+  bool schem{false};
+  bool flat_diagram{false};
+
+  [[nodiscard]] bool need_build() const noexcept {
+    return this->litematic || this->structure || this->schem ||
+           this->flat_diagram;
+  }
+};
+
+struct color_table_info {
+  std::string name;
+  SCL_mapTypes map_type{SCL_mapTypes::Slope};
+  SCL_gameVersion mc_version{SCL_gameVersion::MC19};
+  // enabled and block id of each base color, the same as presets of SlopeCraft
+  std::vector<std::pair<bool, std::string>> preset;
+};
+
+struct task_info {
+  std::string name;
+  std::string image;
+  // index in job::color_tables
+  size_t color_table{0};
+  SlopeCraft::convert_option convert{};
+  SlopeCraft::build_options build{};
+  export_formats exports{};
+  int map_begin_index{0};
+  // seconds, 0 means no limit
+  double timeout{0};
+};
+
+struct job {
+  std::vector<std::string> block_lists;
+  std::vector<color_table_info> color_tables;
+  std::vector<task_info> tasks;
+  std::string prefix{"./"};
+  // empty means no convert cache
+  std::string cache_dir;
+  int flat_diagram_split_line{16};
+};
+
+struct inputs {
+  std::string job_file;
+  // overrides the prefix in job file if not empty
+  std::string prefix;
+  int num_threads{1};
+  // 0 means decided by the number of tasks and threads
+  int num_workers{0};
+  bool disable_cache{false};
+
+  // serve jobs on this local socket if not empty
+  std::string daemon_name;
+  // send the job to the daemon on this local socket if not empty
+  std::string connect_name;
+};
+
+// Block lists and color tables created for jobs. The daemon keeps it between
+// jobs, so they are created only once.
+// Not thread-safe, except num_block_lists and num_color_tables. Returned
+// color tables are valid until the next call of color_tables_of or clear.
+class resource_cache {
+ public:
+  // Least recently used color tables beyond this number are destroyed.
+  static constexpr size_t max_color_tables = 16;
+
+  [[nodiscard]] tl::expected<std::vector<const SlopeCraft::color_table *>,
+                             std::string>
+  color_tables_of(const job &) noexcept;
+
+  [[nodiscard]] size_t num_block_lists() const noexcept {
+    return this->num_block_lists_;
+  }
+  [[nodiscard]] size_t num_color_tables() const noexcept {
+    return this->num_color_tables_;
+  }
+  void clear() noexcept {
+    this->color_tables_.clear();
+    this->block_lists_.clear();
+    this->update_sizes();
+  }
+
+ private:
+  template <class T>
+  using unique_ptr_t = std::unique_ptr<T, SlopeCraft::deleter>;
+  struct cached_table {
+    unique_ptr_t<SlopeCraft::color_table> table;
+    uint64_t last_used{0};
+  };
+  // Keys contain filename and last modified time of block lists, so
+  // modified files are loaded again.
+  std::map<std::string, unique_ptr_t<SlopeCraft::block_list_interface>>
+      block_lists_;
+  // Keys contain keys of block lists
+  std::map<std::string, cached_table> color_tables_;
+  uint64_t clock_{0};
+  std::atomic<size_t> num_block_lists_{0};
+  std::atomic<size_t> num_color_tables_{0};
+
+  void update_sizes() noexcept {
+    this->num_block_lists_ = this->block_lists_.size();
+    this->num_color_tables_ = this->color_tables_.size();
+  }
+};
+
+// Relative paths in the job file are relative to the directory of it.
+[[nodiscard]] tl::expected<job, std::string> load_job(
+    const std::string &filename) noexcept;
+// Relative paths are relative to base_dir.
+[[nodiscard]] tl::expected<job, std::string> load_job_from_string(
+    std::string_view json, const std::string &base_dir) noexcept;
+
+// Runs all tasks of the job and reports a json line for each finished task,
+// then a summary line. Tasks that convert the same image with the same color
+// table and convert option share the conversion.
+[[nodiscard]] sccl_exit_code run_job(
+    const job &, const inputs &, resource_cache &,
+    const std::function<void(std::string_view json_line)> &report) noexcept;
+
+// Serves jobs on input.daemon_name until a shutdown request.
+[[nodiscard]] sccl_exit_code run_daemon(const inputs &) noexcept;
+// Sends the job file to a daemon and prints its results like run_job.
+[[nodiscard]] sccl_exit_code run_client(const inputs &) noexcept;
+
+#endif  // SLOPECRAFT_SCCL_INTERNAL_H
@@ -0,0 +1,282 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "sccl_internal.h"
+#include <algorithm>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <json.hpp>
+#include <magic_enum/magic_enum.hpp>
+#include <set>
+
+namespace {
+using njson = nlohmann::json;
+namespace stdfs = std::filesystem;
+
+template <class T>
+void parse_value(const njson &jo, const char *key, T &dest) noexcept(false) {
+  if (jo.contains(key)) {
+    dest = jo.at(key).get<T>();
+  }
+}
+
+template <class enum_t>
+void parse_enum(const njson &jo, const char *key,
+                enum_t &dest) noexcept(false) {
+  if (!jo.contains(key)) {
+    return;
+  }
+  const std::string str = jo.at(key);
+  auto val = magic_enum::enum_cast<enum_t>(str);
+  if (!val.has_value()) {
+    throw std::runtime_error{
+        fmt::format("Invalid value \"{}\" for \"{}\"", str, key)};
+  }
+  dest = val.value();
+}
+
+std::string resolve_path(const stdfs::path &dir, const std::string &path) {
+  const stdfs::path p{path};
+  if (p.is_relative()) {
+    return (dir / p).string();
+  }
+  return path;
+}
+
+// The same format as presets of SlopeCraft
+std::vector<std::pair<bool, std::string>> parse_preset(
+    const njson &jo) noexcept(false) {
+  std::vector<std::pair<bool, std::string>> ret;
+  ret.resize(jo.size());
+  std::vector<bool> is_defined(jo.size(), false);
+  for (const njson &opt : jo) {
+    const size_t basecolor = opt.at("baseColor");
+    if (basecolor >= ret.size()) {
+      throw std::runtime_error{
+          fmt::format("Base color {} is out of range", basecolor)};
+    }
+    if (is_defined[basecolor]) {
+      throw std::runtime_error{
+          fmt::format("Preset of base color {} is defined twice", basecolor)};
+    }
+    is_defined[basecolor] = true;
+    ret[basecolor] = {opt.at("enabled").get<bool>(),
+                      opt.at("blockId").get<std::string>()};
+  }
+  return ret;
+}
+
+color_table_info parse_color_table(const std::string &name, const njson &jo,
+                                   const stdfs::path &dir) noexcept(false) {
+  color_table_info ret;
+  ret.name = name;
+  parse_enum(jo, "map_type", ret.map_type);
+
+  const int ver = jo.at("mc_version");
+  if (ver < int(SCL_gameVersion::MC12) ||
+      ver > int(SlopeCraft::SCL_maxAvailableVersion())) {
+    throw std::runtime_error{fmt::format("Invalid mc_version {}", ver)};
+  }
+  ret.mc_version = SCL_gameVersion(ver);
+
+  const njson &preset = jo.at("preset");
+  if (preset.is_string()) {
+    const std::string filename =
+        resolve_path(dir, preset.get<std::string>());
+    std::ifstream ifs{filename};
+    if (!ifs) {
+      throw std::runtime_error{
+          fmt::format("Failed to open preset \"{}\"", filename)};
+    }
+    ret.preset = parse_preset(njson::parse(ifs, nullptr, true, true));
+  } else {
+    ret.preset = parse_preset(preset);
+  }
+  return ret;
+}
+
+SlopeCraft::convert_option parse_convert_option(
+    const njson &jo, SlopeCraft::convert_option opt) noexcept(false) {
+  parse_enum(jo, "algo", opt.algo);
+  parse_value(jo, "dither", opt.dither);
+  if (jo.contains("ai_cvter")) {
+    const njson &ga = jo.at("ai_cvter");
+    auto &dst = opt.ai_cvter_opt;
+    parse_value(ga, "population", dst.popSize);
+    parse_value(ga, "max_generation", dst.maxGeneration);
+    parse_value(ga, "max_fail_times", dst.maxFailTimes);
+    parse_value(ga, "crossover_prob", dst.crossoverProb);
+    parse_value(ga, "mutation_prob", dst.mutationProb);
+  }
+  return opt;
+}
+
+SlopeCraft::build_options parse_build_option(
+    const njson &jo, SlopeCraft::build_options opt) noexcept(false) {
+  parse_value(jo, "max_height", opt.max_allowed_height);
+  parse_value(jo, "bridge_interval", opt.bridge_interval);
+  parse_enum(jo, "compress", opt.compress_method);
+  parse_enum(jo, "glass_bridge", opt.glass_method);
+  parse_value(jo, "fire_proof", opt.fire_proof);
+  parse_value(jo, "enderman_proof", opt.enderman_proof);
+  parse_value(jo, "connect_mushrooms", opt.connect_mushrooms);
+  return opt;
+}
+
+export_formats parse_exports(const njson &jo) noexcept(false) {
+  export_formats ret;
+  for (const njson &val : jo) {
+    const std::string str = val;
+    if (str == "converted_image") {
+      ret.converted_image = true;
+    } else if (str == "map_data") {
+      ret.map_data = true;
+    } else if (str == "litematic") {
+      ret.litematic = true;
+    } else if (str == "structure") {
+      ret.structure = true;
+    } else if (str == "schem") {
+      ret.schem = true;
+    } else if (str == "flat_diagram") {
+      ret.flat_diagram = true;
+    } else {
+      throw std::runtime_error{
+          fmt::format("Unknown export format \"{}\"", str)};
+    }
+  }
+  return ret;
+}
+
+job parse_job(const njson &jo, const stdfs::path &dir) noexcept(false) {
+  job ret;
+  for (const njson &bl : jo.at("block_lists")) {
+    ret.block_lists.emplace_back(resolve_path(dir, bl.get<std::string>()));
+  }
+
+  for (const auto &[name, table] : jo.at("color_tables").items()) {
+    ret.color_tables.emplace_back(parse_color_table(name, table, dir));
+  }
+  if (ret.color_tables.empty()) {
+    throw std::runtime_error{"No color table"};
+  }
+
+  if (jo.contains("prefix")) {
+    ret.prefix = resolve_path(dir, jo.at("prefix").get<std::string>());
+  }
+  if (jo.contains("cache_dir")) {
+    ret.cache_dir = resolve_path(dir, jo.at("cache_dir").get<std::string>());
+  }
+  parse_value(jo, "flat_diagram_split_line", ret.flat_diagram_split_line);
+
+  // defaults of tasks
+  SlopeCraft::convert_option convert_opt{};
+  SlopeCraft::build_options build_opt{};
+  export_formats exports{};
+  double timeout{0};
+  parse_value(jo, "timeout", timeout);
+  if (jo.contains("convert")) {
+    convert_opt = parse_convert_option(jo.at("convert"), convert_opt);
+  }
+  if (jo.contains("build")) {
+    build_opt = parse_build_option(jo.at("build"), build_opt);
+  }
+  if (jo.contains("exports")) {
+    exports = parse_exports(jo.at("exports"));
+  }
+
+  std::set<std::string> names;
+  for (const njson &t : jo.at("tasks")) {
+    task_info task;
+    task.image = resolve_path(dir, t.at("image").get<std::string>());
+    task.name = stdfs::path{task.image}.stem().string();
+    parse_value(t, "name", task.name);
+    if (!names.emplace(task.name).second) {
+      throw std::runtime_error{fmt::format(
+          "Task name \"{}\" is used twice, outputs will overwrite each other",
+          task.name)};
+    }
+
+    if (t.contains("color_table")) {
+      const std::string table = t.at("color_table");
+      auto it = std::find_if(
+          ret.color_tables.begin(), ret.color_tables.end(),
+          [&table](const color_table_info &c) { return c.name == table; });
+      if (it == ret.color_tables.end()) {
+        throw std::runtime_error{
+            fmt::format("Task \"{}\" uses undefined color table \"{}\"",
+                        task.name, table)};
+      }
+      task.color_table = it - ret.color_tables.begin();
+    } else if (ret.color_tables.size() > 1) {
+      throw std::runtime_error{fmt::format(
+          "Task \"{}\" must assign color table, since there are {}", task.name,
+          ret.color_tables.size())};
+    }
+
+    task.convert = convert_opt;
+    task.build = build_opt;
+    task.exports = exports;
+    task.timeout = timeout;
+    parse_value(t, "timeout", task.timeout);
+    if (t.contains("convert")) {
+      task.convert = parse_convert_option(t.at("convert"), task.convert);
+    }
+    if (t.contains("build")) {
+      task.build = parse_build_option(t.at("build"), task.build);
+    }
+    if (t.contains("exports")) {
+      task.exports = parse_exports(t.at("exports"));
+    }
+    parse_value(t, "map_begin_index", task.map_begin_index);
+    ret.tasks.emplace_back(std::move(task));
+  }
+  return ret;
+}
+}  // namespace
+
+tl::expected<job, std::string> load_job(const std::string &filename) noexcept {
+  try {
+    std::ifstream ifs{filename};
+    if (!ifs) {
+      return tl::make_unexpected(
+          fmt::format("Failed to open job file \"{}\"", filename));
+    }
+    const njson jo = njson::parse(ifs, nullptr, true, true);
+    return parse_job(jo, stdfs::path{filename}.parent_path());
+  } catch (const std::exception &e) {
+    return tl::make_unexpected(
+        fmt::format("Failed to parse job file \"{}\", detail: {}", filename,
+                    e.what()));
+  }
+}
+
+tl::expected<job, std::string> load_job_from_string(
+    std::string_view json, const std::string &base_dir) noexcept {
+  try {
+    const njson jo = njson::parse(json, nullptr, true, true);
+    return parse_job(jo, stdfs::path{base_dir});
+  } catch (const std::exception &e) {
+    return tl::make_unexpected(
+        fmt::format("Failed to parse job, detail: {}", e.what()));
+  }
+}
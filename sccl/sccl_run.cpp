@@ -0,0 +1,545 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "sccl_internal.h"
+#include <QImage>
+#include <QString>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fmt/format.h>
+#include <json.hpp>
+#include <memory>
+#include <mutex>
+#include <omp.h>
+#include <thread>
+
+namespace {
+using njson = nlohmann::json;
+template <class T>
+using unique_ptr_t = std::unique_ptr<T, SlopeCraft::deleter>;
+
+// Collects errors reported by SlopeCraftL through ui_callbacks
+struct error_collector {
+  std::string message;
+  SlopeCraft::cancel_token token;
+
+  explicit error_collector(double timeout = 0) noexcept {
+    if (timeout > 0) {
+      using std::chrono::duration, std::chrono::nanoseconds;
+      this->token.set_timeout(
+          std::chrono::duration_cast<nanoseconds>(duration<double>{timeout}));
+    }
+  }
+
+  [[nodiscard]] SlopeCraft::ui_callbacks callbacks() noexcept {
+    SlopeCraft::ui_callbacks ret;
+    ret.wind = this;
+    ret.cancel = &this->token;
+    ret.cb_report_error = [](void *p, SCL_errorFlag, const char *msg) {
+      std::string &str = static_cast<error_collector *>(p)->message;
+      if (!str.empty()) {
+        str.append("; ");
+      }
+      str.append(msg);
+    };
+    return ret;
+  }
+
+  // returns message if it's not empty, otherwise what
+  [[nodiscard]] std::string error_or(std::string_view what) const noexcept {
+    if (this->message.empty()) {
+      return std::string{what};
+    }
+    return this->message;
+  }
+};
+
+// Changes when the file is modified
+std::string block_list_key(const std::string &filename) noexcept {
+  std::error_code err;
+  const auto time = std::filesystem::last_write_time(filename, err);
+  return fmt::format("{}|{}", filename,
+                     err ? 0 : time.time_since_epoch().count());
+}
+
+std::string color_table_key(const std::vector<std::string> &block_list_keys,
+                            const color_table_info &info) noexcept {
+  std::string ret =
+      fmt::format("{}|{}|", int(info.map_type), int(info.mc_version));
+  for (const std::string &key : block_list_keys) {
+    ret.append(key);
+    ret.push_back(';');
+  }
+  for (const auto &[enabled, id] : info.preset) {
+    ret.push_back(enabled ? '+' : '-');
+    ret.append(id);
+    ret.push_back(';');
+  }
+  return ret;
+}
+}  // namespace
+
+tl::expected<std::vector<const SlopeCraft::color_table *>, std::string>
+resource_cache::color_tables_of(const job &j) noexcept {
+  const uint64_t now = ++this->clock_;
+  std::vector<std::string> block_list_keys;
+  // block and its base color
+  std::vector<std::pair<const SlopeCraft::mc_block_interface *, uint8_t>>
+      blocks;
+  for (const std::string &filename : j.block_lists) {
+    const std::string key = block_list_key(filename);
+    auto it = this->block_lists_.find(key);
+    if (it == this->block_lists_.end()) {
+      std::string err;
+      err.resize(8192);
+      auto sd_err = SlopeCraft::string_deliver::from_string(err);
+      SlopeCraft::block_list_create_info option{SC_VERSION_U64, nullptr,
+                                                &sd_err};
+      unique_ptr_t<SlopeCraft::block_list_interface> bl{
+          SlopeCraft::SCL_create_block_list(filename.c_str(), option)};
+      if (bl == nullptr) {
+        err.resize(sd_err.size);
+        return tl::make_unexpected(fmt::format(
+            "Failed to load block list \"{}\": {}", filename, err));
+      }
+      // drop the outdated one and color tables made from it. Color tables
+      // copy blocks, so the returned ones are not affected.
+      std::erase_if(this->block_lists_, [this, &filename](const auto &pair) {
+        if (!pair.first.starts_with(filename + '|')) {
+          return false;
+        }
+        const std::string outdated = pair.first + ';';
+        std::erase_if(this->color_tables_, [&outdated](const auto &table) {
+          return table.first.find(outdated) != std::string::npos;
+        });
+        return true;
+      });
+      it = this->block_lists_.emplace(key, std::move(bl)).first;
+    }
+    block_list_keys.emplace_back(key);
+
+    const SlopeCraft::block_list_interface &bl = *it->second;
+    const size_t offset = blocks.size();
+    std::vector<const SlopeCraft::mc_block_interface *> ptrs(bl.size());
+    std::vector<uint8_t> basecolors(bl.size());
+    const size_t num =
+        bl.get_blocks(ptrs.data(), basecolors.data(), ptrs.size());
+    blocks.resize(offset + num);
+    for (size_t i = 0; i < num; i++) {
+      blocks[offset + i] = {ptrs[i], basecolors[i]};
+    }
+  }
+
+  std::vector<const SlopeCraft::color_table *> ret;
+  for (const color_table_info &info : j.color_tables) {
+    const std::string key = color_table_key(block_list_keys, info);
+    if (auto it = this->color_tables_.find(key);
+        it != this->color_tables_.end()) {
+      it->second.last_used = now;
+      ret.emplace_back(it->second.table.get());
+      continue;
+    }
+
+    error_collector ec;
+    SlopeCraft::color_table_create_info ci{};
+    ci.map_type = info.map_type;
+    ci.mc_version = info.mc_version;
+    ci.ui = ec.callbacks();
+    for (size_t bc = 0; bc < 64; bc++) {
+      ci.basecolor_allow_LUT[bc] = false;
+      ci.blocks[bc] = nullptr;
+      if (bc >= info.preset.size()) {
+        continue;
+      }
+      const auto &[enabled, id] = info.preset[bc];
+      auto it = std::find_if(blocks.begin(), blocks.end(), [&](auto &b) {
+        return b.second == bc && id == b.first->getId();
+      });
+      if (it != blocks.end()) {
+        ci.blocks[bc] = it->first;
+      } else if (enabled) {
+        return tl::make_unexpected(fmt::format(
+            "Color table \"{}\": block \"{}\" of base color {} is not found "
+            "in block lists",
+            info.name, id, bc));
+      }
+      ci.basecolor_allow_LUT[bc] = enabled;
+    }
+
+    unique_ptr_t<SlopeCraft::color_table> table{
+        SlopeCraft::SCL_create_color_table(ci)};
+    if (table == nullptr) {
+      return tl::make_unexpected(
+          fmt::format("Failed to create color table \"{}\": {}", info.name,
+                      ec.error_or("unknown error")));
+    }
+    ret.emplace_back(table.get());
+    this->color_tables_.emplace(key, cached_table{std::move(table), now});
+  }
+
+  // tables used by this job are never evicted
+  while (this->color_tables_.size() > max_color_tables) {
+    auto lru = std::min_element(
+        this->color_tables_.begin(), this->color_tables_.end(),
+        [](const auto &a, const auto &b) {
+          return a.second.last_used < b.second.last_used;
+        });
+    if (lru->second.last_used == now) {
+      break;
+    }
+    this->color_tables_.erase(lru);
+  }
+  this->update_sizes();
+  return ret;
+}
+
+namespace {
+
+bool is_same_convert(const SlopeCraft::convert_option &a,
+                     const SlopeCraft::convert_option &b) noexcept {
+  if (a.algo != b.algo || a.dither != b.dither) {
+    return false;
+  }
+  if (a.algo != SCL_convertAlgo::gaCvter) {
+    return true;
+  }
+  const auto &ga = a.ai_cvter_opt, &gb = b.ai_cvter_opt;
+  return ga.popSize == gb.popSize && ga.maxGeneration == gb.maxGeneration &&
+         ga.maxFailTimes == gb.maxFailTimes &&
+         ga.crossoverProb == gb.crossoverProb &&
+         ga.mutationProb == gb.mutationProb;
+}
+
+// Tasks that convert the same image with the same color table and option
+struct convert_unit {
+  const task_info *first;
+  std::vector<const task_info *> tasks;
+};
+
+std::vector<convert_unit> make_units(const job &j) noexcept {
+  std::vector<convert_unit> ret;
+  for (const task_info &task : j.tasks) {
+    auto it = std::find_if(ret.begin(), ret.end(), [&task](auto &u) {
+      return u.first->image == task.image &&
+             u.first->color_table == task.color_table &&
+             is_same_convert(u.first->convert, task.convert);
+    });
+    if (it == ret.end()) {
+      ret.emplace_back(convert_unit{&task, {}});
+      it = ret.end() - 1;
+    }
+    it->tasks.emplace_back(&task);
+  }
+  return ret;
+}
+
+struct task_result {
+  std::string error;
+  // seconds
+  double load{0};
+  double convert{0};
+  double build{0};
+  double exports{0};
+  bool convert_cache_hit{false};
+  bool convert_shared{false};
+  // exported files and directories
+  std::vector<std::string> files;
+};
+
+tl::expected<QImage, std::string> load_image(
+    const std::string &filename) noexcept {
+  QImage img{QString::fromLocal8Bit(filename.c_str())};
+  if (img.isNull()) {
+    return tl::make_unexpected(
+        fmt::format("Failed to open image \"{}\"", filename));
+  }
+  img = img.convertToFormat(QImage::Format_ARGB32);
+  auto *data = reinterpret_cast<uint32_t *>(img.scanLine(0));
+  const uint64_t size = uint64_t(img.height()) * img.width();
+  if (SlopeCraft::SCL_haveTransparentPixel(data, size)) {
+    SlopeCraft::SCL_preprocessImage(data, size);
+  }
+  return img;
+}
+
+class job_runner {
+ public:
+  job_runner(const job &j,
+             const std::vector<const SlopeCraft::color_table *> &tables,
+             const std::function<void(std::string_view)> &report)
+      : job_{j}, tables_{tables}, report_{report} {}
+
+  // returns the number of failed tasks
+  size_t run(int num_workers, int threads_per_worker) noexcept {
+    const auto units = make_units(this->job_);
+    num_workers =
+        std::clamp<int>(num_workers, 1, std::max<size_t>(1, units.size()));
+
+    std::atomic<size_t> next_unit{0};
+    auto worker = [&]() {
+      omp_set_num_threads(threads_per_worker);
+      for (size_t i = next_unit++; i < units.size(); i = next_unit++) {
+        this->run_unit(units[i]);
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_workers; i++) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+      t.join();
+    }
+    return this->num_failed_;
+  }
+
+ private:
+  const job &job_;
+  const std::vector<const SlopeCraft::color_table *> &tables_;
+  const std::function<void(std::string_view)> &report_;
+  std::mutex output_lock_;
+  size_t num_failed_{0};
+
+  void run_unit(const convert_unit &unit) noexcept;
+  void run_task(const task_info &task, const SlopeCraft::converted_image &,
+                task_result &) const noexcept;
+  void report(const task_info &task, const task_result &) noexcept;
+};
+
+void job_runner::run_unit(const convert_unit &unit) noexcept {
+  const task_info &first = *unit.first;
+  const auto &table = *this->tables_[first.color_table];
+  task_result result;
+
+  double wt = omp_get_wtime();
+  auto img = load_image(first.image);
+  result.load = omp_get_wtime() - wt;
+
+  unique_ptr_t<SlopeCraft::converted_image> cvted{nullptr};
+  if (img) {
+    wt = omp_get_wtime();
+    const SlopeCraft::const_image_reference ref{
+        .data = reinterpret_cast<const uint32_t *>(img->constScanLine(0)),
+        .rows = static_cast<size_t>(img->height()),
+        .cols = static_cast<size_t>(img->width()),
+    };
+    // the timeout of a shared conversion is the first task's
+    error_collector ec{first.timeout};
+    SlopeCraft::convert_option option = first.convert;
+    option.ui = ec.callbacks();
+
+    const char *cache_dir = this->job_.cache_dir.c_str();
+    const bool use_cache = !this->job_.cache_dir.empty();
+    if (use_cache && table.has_convert_cache(ref, option, cache_dir)) {
+      cvted.reset(table.load_convert_cache(ref, option, cache_dir, nullptr));
+      result.convert_cache_hit = (cvted != nullptr);
+    }
+    if (cvted == nullptr) {
+      cvted.reset(table.convert_image(ref, option));
+      // A failed cache doesn't fail the task
+      if (cvted != nullptr && use_cache) {
+        [[maybe_unused]] const bool ok =
+            table.save_convert_cache(ref, option, *cvted, cache_dir, nullptr);
+      }
+    }
+    result.convert = omp_get_wtime() - wt;
+    if (cvted == nullptr) {
+      result.error = ec.error_or("Failed to convert image");
+    }
+  } else {
+    result.error = img.error();
+  }
+
+  for (size_t i = 0; i < unit.tasks.size(); i++) {
+    task_result r = result;
+    // only the first task pays for loading and converting
+    if (i > 0) {
+      r.load = r.convert = 0;
+      r.convert_shared = true;
+    }
+    if (cvted != nullptr) {
+      this->run_task(*unit.tasks[i], *cvted, r);
+    }
+    this->report(*unit.tasks[i], r);
+  }
+}
+
+void job_runner::run_task(const task_info &task,
+                          const SlopeCraft::converted_image &cvted,
+                          task_result &result) const noexcept {
+  const auto &table = *this->tables_[task.color_table];
+  const std::string prefix = this->job_.prefix + task.name;
+  error_collector ec{task.timeout};
+  auto fail = [&ec, &result](std::string_view what) {
+    result.error = ec.error_or(what);
+  };
+
+  double wt = omp_get_wtime();
+  if (task.exports.converted_image) {
+    QImage img{QSize{static_cast<int>(cvted.cols()),
+                     static_cast<int>(cvted.rows())},
+               QImage::Format_ARGB32};
+    cvted.get_converted_image(reinterpret_cast<uint32_t *>(img.scanLine(0)));
+    const std::string filename = prefix + ".png";
+    if (!img.save(QString::fromLocal8Bit(filename.c_str()))) {
+      return fail(fmt::format("Failed to save \"{}\"", filename));
+    }
+    result.files.emplace_back(filename);
+  }
+  if (task.exports.map_data) {
+    const std::string dir = prefix + "_map_data";
+    std::error_code err;
+    std::filesystem::create_directories(dir, err);
+    SlopeCraft::map_data_file_options option;
+    option.folder_path = dir.c_str();
+    option.begin_index = task.map_begin_index;
+    option.ui = ec.callbacks();
+    if (err || !cvted.export_map_data(option)) {
+      return fail(fmt::format("Failed to export map data to \"{}\"", dir));
+    }
+    result.files.emplace_back(dir);
+  }
+  result.exports = omp_get_wtime() - wt;
+
+  if (!task.exports.need_build()) {
+    return;
+  }
+  if (!table.is_vanilla()) {
+    return fail("Map data only color table can't build 3D structure");
+  }
+
+  wt = omp_get_wtime();
+  SlopeCraft::build_options build_opt = task.build;
+  build_opt.ui = ec.callbacks();
+  unique_ptr_t<SlopeCraft::structure_3D> structure{
+      table.build(cvted, build_opt)};
+  result.build = omp_get_wtime() - wt;
+  if (structure == nullptr) {
+    return fail("Failed to build 3D structure");
+  }
+
+  wt = omp_get_wtime();
+  if (task.exports.litematic) {
+    SlopeCraft::litematic_options option;
+    option.litename_utf8 = task.name.c_str();
+    option.region_name_utf8 = task.name.c_str();
+    option.ui = ec.callbacks();
+    const std::string filename = prefix + ".litematic";
+    if (!structure->export_litematica(filename.c_str(), option)) {
+      return fail(fmt::format("Failed to export \"{}\"", filename));
+    }
+    result.files.emplace_back(filename);
+  }
+  if (task.exports.structure) {
+    SlopeCraft::vanilla_structure_options option;
+    option.ui = ec.callbacks();
+    const std::string filename = prefix + ".nbt";
+    if (!structure->export_vanilla_structure(filename.c_str(), option)) {
+      return fail(fmt::format("Failed to export \"{}\"", filename));
+    }
+    result.files.emplace_back(filename);
+  }
+  if (task.exports.schem) {
+    SlopeCraft::WE_schem_options option;
+    option.ui = ec.callbacks();
+    const std::string filename = prefix + ".schem";
+    if (!structure->export_WE_schem(filename.c_str(), option)) {
+      return fail(fmt::format("Failed to export \"{}\"", filename));
+    }
+    result.files.emplace_back(filename);
+  }
+  if (task.exports.flat_diagram) {
+    SlopeCraft::flag_diagram_options option;
+    option.split_line_row_margin = this->job_.flat_diagram_split_line;
+    option.split_line_col_margin = this->job_.flat_diagram_split_line;
+    option.ui = ec.callbacks();
+    const std::string filename = prefix + "_flat_diagram.png";
+    if (!structure->export_flat_diagram(filename.c_str(), table, option)) {
+      return fail(fmt::format("Failed to export \"{}\"", filename));
+    }
+    result.files.emplace_back(filename);
+  }
+  result.exports += omp_get_wtime() - wt;
+}
+
+void job_runner::report(const task_info &task,
+                        const task_result &r) noexcept {
+  njson jo;
+  jo["type"] = "task";
+  jo["name"] = task.name;
+  jo["success"] = r.error.empty();
+  if (!r.error.empty()) {
+    jo["error"] = r.error;
+  }
+  jo["seconds"] = {{"load", r.load},
+                   {"convert", r.convert},
+                   {"build", r.build},
+                   {"export", r.exports}};
+  jo["convert_cache_hit"] = r.convert_cache_hit;
+  jo["convert_shared"] = r.convert_shared;
+  jo["files"] = r.files;
+  const std::string line = jo.dump();
+
+  std::lock_guard<std::mutex> lk{this->output_lock_};
+  if (!r.error.empty()) {
+    this->num_failed_++;
+  }
+  this->report_(line);
+}
+}  // namespace
+
+sccl_exit_code run_job(
+    const job &j, const inputs &input, resource_cache &cache,
+    const std::function<void(std::string_view)> &report) noexcept {
+  const double wt = omp_get_wtime();
+  auto tables = cache.color_tables_of(j);
+  if (!tables) {
+    njson jo;
+    jo["type"] = "error";
+    jo["error"] = tables.error();
+    report(jo.dump());
+    return sccl_exit_code::resource_error;
+  }
+
+  int num_workers = input.num_workers;
+  if (num_workers <= 0) {
+    // conversion and building of each task are already parallel, a few
+    // workers are enough to overlap their serial parts and file io.
+    num_workers = std::clamp(input.num_threads / 4, 1, 4);
+  }
+  const int threads_per_worker = std::max(1, input.num_threads / num_workers);
+
+  job_runner runner{j, tables.value(), report};
+  const size_t num_failed = runner.run(num_workers, threads_per_worker);
+
+  njson jo;
+  jo["type"] = "summary";
+  jo["tasks"] = j.tasks.size();
+  jo["failed"] = num_failed;
+  jo["seconds"] = omp_get_wtime() - wt;
+  report(jo.dump());
+
+  return num_failed > 0 ? sccl_exit_code::task_failed
+                        : sccl_exit_code::success;
+}
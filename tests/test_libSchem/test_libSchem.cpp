@@ -100,6 +100,15 @@ int main() {
     return 1;
   }
 
+  info.region_count_x = 2;
+  info.region_count_z = 3;
+  if (!schem.export_litematic("test12-regions.litematic", info, nullptr,
+                              &error_str)) {
+    cout << "Failed to export file " << "test12-regions.litematic" << endl;
+    cout << "Error info = " << error_str << endl;
+    return 1;
+  }
+
   if (!schem.export_structure("test12.nbt", true, nullptr, &error_str)) {
     cout << "Failed to export file " << "test12.nbt" << endl;
     cout << "Error info = " << error_str << endl;
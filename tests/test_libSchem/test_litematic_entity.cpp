@@ -0,0 +1,266 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+// Exports an item frame into litematics with one and several regions, then
+// reads them back to check its position and facing.
+
+#include <Schem/Schem.h>
+#include <zlib.h>
+
+#include <array>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::cout, std::endl;
+
+constexpr std::array<int, 3> frame_pos{5, 3, 7};
+constexpr auto frame_facing = libSchem::hangable_facing_direction::east;
+
+/// Integer tags of a nbt file, keyed by their path like
+/// "/Regions/name/Position/x". Elements of a list share the path of the list.
+using int_tags_t = std::multimap<std::string, int64_t>;
+
+class nbt_reader {
+ public:
+  explicit nbt_reader(std::vector<uint8_t> &&data) : data_{std::move(data)} {}
+
+  bool read(int_tags_t &tags) noexcept {
+    const int type = this->u8();
+    if (type != 10) {
+      return false;
+    }
+    const std::string name = this->str();
+    return this->payload(type, name, tags) && this->ok_;
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+  size_t pos_{0};
+  bool ok_{true};
+
+  uint64_t be(size_t bytes) noexcept {
+    if (this->pos_ + bytes > this->data_.size()) {
+      this->ok_ = false;
+      return 0;
+    }
+    uint64_t val = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      val = (val << 8) | this->data_[this->pos_ + i];
+    }
+    this->pos_ += bytes;
+    return val;
+  }
+  int u8() noexcept { return int(this->be(1)); }
+  std::string str() noexcept {
+    const size_t len = this->be(2);
+    if (!this->ok_ || this->pos_ + len > this->data_.size()) {
+      this->ok_ = false;
+      return {};
+    }
+    std::string ret{reinterpret_cast<const char *>(&this->data_[this->pos_]),
+                    len};
+    this->pos_ += len;
+    return ret;
+  }
+
+  bool payload(int type, const std::string &path, int_tags_t &tags) noexcept {
+    switch (type) {
+      case 1:
+        tags.emplace(path, int8_t(this->be(1)));
+        return this->ok_;
+      case 2:
+        tags.emplace(path, int16_t(this->be(2)));
+        return this->ok_;
+      case 3:
+        tags.emplace(path, int32_t(this->be(4)));
+        return this->ok_;
+      case 4:
+        this->be(8);
+        return this->ok_;
+      case 5:
+        this->be(4);
+        return this->ok_;
+      case 6:
+        this->be(8);
+        return this->ok_;
+      case 8:
+        this->str();
+        return this->ok_;
+      case 7:
+      case 11:
+      case 12: {
+        const size_t elem_bytes = (type == 7) ? 1 : ((type == 11) ? 4 : 8);
+        const size_t len = uint32_t(this->be(4));
+        for (size_t i = 0; i < len && this->ok_; i++) {
+          this->be(elem_bytes);
+        }
+        return this->ok_;
+      }
+      case 9: {
+        const int elem_type = this->u8();
+        const size_t len = uint32_t(this->be(4));
+        for (size_t i = 0; i < len && this->ok_; i++) {
+          if (!this->payload(elem_type, path, tags)) {
+            return false;
+          }
+        }
+        return this->ok_;
+      }
+      case 10:
+        while (this->ok_) {
+          const int child_type = this->u8();
+          if (child_type == 0) {
+            return this->ok_;
+          }
+          const std::string name = this->str();
+          if (!this->payload(child_type, path + "/" + name, tags)) {
+            return false;
+          }
+        }
+        return false;
+      default:
+        return false;
+    }
+  }
+};
+
+bool read_litematic(const char *filename, int_tags_t &tags) noexcept {
+  gzFile file = gzopen(filename, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  std::array<uint8_t, 4096> buf;
+  int bytes = 0;
+  while ((bytes = gzread(file, buf.data(), buf.size())) > 0) {
+    data.insert(data.end(), buf.begin(), buf.begin() + bytes);
+  }
+  gzclose(file);
+  if (bytes < 0) {
+    return false;
+  }
+  return nbt_reader{std::move(data)}.read(tags);
+}
+
+/// Checks every frame in the file, and returns how many are found.
+int check_frames(const int_tags_t &tags, int &failed) noexcept {
+  constexpr std::array<const char *, 3> keys{"TileX", "TileY", "TileZ"};
+  constexpr std::array<const char *, 3> offset_keys{"x", "y", "z"};
+  int found = 0;
+  for (const auto &[path, facing] : tags) {
+    if (!path.ends_with("/Entities/Facing")) {
+      continue;
+    }
+    found++;
+    const std::string entities = path.substr(0, path.size() - 6);
+    const std::string region = path.substr(0, path.size() - 16);
+    if (facing != int64_t(frame_facing)) {
+      cout << path << " is " << facing << ", expected "
+           << int(frame_facing) << endl;
+      failed++;
+    }
+    for (size_t dim = 0; dim < 3; dim++) {
+      const auto tile = tags.find(entities + keys[dim]);
+      const auto offset = tags.find(region + "/Position/" + offset_keys[dim]);
+      if (tile == tags.end() || offset == tags.end()) {
+        cout << "Missing " << keys[dim] << " or region position of " << path
+             << endl;
+        failed++;
+        continue;
+      }
+      if (tile->second + offset->second != frame_pos[dim]) {
+        cout << entities << keys[dim] << " is " << tile->second
+             << " in region at " << offset->second << ", expected "
+             << frame_pos[dim] << " in the schematic" << endl;
+        failed++;
+      }
+    }
+  }
+  return found;
+}
+
+int main() {
+  libSchem::Schem schem;
+  schem.set_MC_major_version_number(SCL_gameVersion::MC21);
+  schem.set_MC_version_number(MCDataVersion::MCDataVersion_t::Java_1_21_1);
+  schem.resize(12, 9, 12);
+  const char *ids[] = {"minecraft:air"};
+  schem.set_block_id(ids, 1);
+  for (int idx = 0; idx < schem.size(); idx++) {
+    schem(idx) = 0;
+  }
+
+  {
+    auto frame = std::make_unique<libSchem::item_frame>();
+    frame->tile_position_ = frame_pos;
+    frame->direction_ = frame_facing;
+    frame->item_ = std::make_unique<libSchem::filled_map>();
+    schem.entity_list().emplace_back(std::move(frame));
+  }
+
+  int failed = 0;
+  {
+    // clones must keep position and facing of the hangable base
+    const auto clone = schem.entity_list().front()->clone();
+    if (clone->position() != std::array<double, 3>{5, 3, 7} ||
+        clone->rotation() != schem.entity_list().front()->rotation()) {
+      cout << "The cloned item frame is moved or turned." << endl;
+      failed++;
+    }
+  }
+
+  libSchem::litematic_info info;
+  for (auto [count_x, count_z] : {std::pair{1, 1}, std::pair{2, 3}}) {
+    info.region_count_x = count_x;
+    info.region_count_z = count_z;
+    const std::string filename =
+        "test_litematic_entity-" + std::to_string(count_x * count_z) +
+        ".litematic";
+    auto res = schem.export_litematic(filename, info);
+    if (!res) {
+      cout << "Failed to export " << filename << ": " << res.error().second
+           << endl;
+      return 1;
+    }
+    int_tags_t tags;
+    if (!read_litematic(filename.c_str(), tags)) {
+      cout << "Failed to read " << filename << endl;
+      return 1;
+    }
+    const int found = check_frames(tags, failed);
+    if (found != 1) {
+      cout << filename << " has " << found << " item frames, expected 1"
+           << endl;
+      failed++;
+    }
+  }
+
+  if (failed > 0) {
+    cout << failed << " checks failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
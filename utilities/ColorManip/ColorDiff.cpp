@@ -21,6 +21,7 @@ This file is part of SlopeCraft.
 */
 
 #include "ColorManip.h"
+#include <algorithm>
 #include <cmath>
 #include <xsimd/xsimd.hpp>
 #include "newTokiColor.hpp"
@@ -94,38 +95,128 @@ float color_diff_HSV(float h1, float s1, float v1, float h2, float s2,
 // using selected_arch = xsimd::default_arch;
 using batch_t = xsimd::batch<float>;
 constexpr size_t batch_size = batch_t::size;
-void colordiff_RGB_batch(std::span<const float> r1p, std::span<const float> g1p,
-                         std::span<const float> b1p,
-                         std::span<const float, 3> rgb2,
-                         std::span<float> dest) noexcept {
-  assert(r1p.size() == g1p.size());
-  assert(g1p.size() == b1p.size());
-  assert(b1p.size() == dest.size());
 
-  const size_t color_count = r1p.size();
+// Colors that don't fill a whole batch are padded to one, so that every color
+// goes through the same simd code and gets the same diff wherever it sits in
+// the colorset. Matching breaks ties by color index, which relies on this.
+struct tail_batch {
+  alignas(64) std::array<std::array<float, batch_size>, 3> channels;
+  size_t size;
+
+  tail_batch(std::span<const float> c1, std::span<const float> c2,
+             std::span<const float> c3, size_t begin) noexcept
+      : size{c1.size() - begin} {
+    assert(size > 0 && size < batch_size);
+    for (size_t k = 0; k < batch_size; k++) {
+      // pads with a real color, so that no lane produces nan
+      const size_t src = begin + std::min(k, size - 1);
+      channels[0][k] = c1[src];
+      channels[1][k] = c2[src];
+      channels[2][k] = c3[src];
+    }
+  }
 
+  batch_t load(int ch) const noexcept {
+    return batch_t::load_aligned(channels[ch].data());
+  }
+
+  void store(batch_t diff, float *dest) const noexcept {
+    alignas(64) std::array<float, batch_size> temp;
+    diff.store_aligned(temp.data());
+    std::copy_n(temp.data(), size, dest);
+  }
+};
+
+// Writes fun(c1, c2, c3) of every color to dest, a batch at a time.
+template <class fun_t>
+void for_each_batch(std::span<const float> c1p, std::span<const float> c2p,
+                    std::span<const float> c3p, std::span<float> dest,
+                    const fun_t &fun) noexcept {
+  assert(c1p.size() == c2p.size());
+  assert(c2p.size() == c3p.size());
+  assert(c3p.size() == dest.size());
+
+  const size_t color_count = c1p.size();
   const size_t vec_size = color_count - color_count % batch_size;
+  for (size_t idx = 0; idx < vec_size; idx += batch_size) {
+    const batch_t diff = fun(batch_t::load_aligned(c1p.data() + idx),
+                             batch_t::load_aligned(c2p.data() + idx),
+                             batch_t::load_aligned(c3p.data() + idx));
+    diff.store_aligned(dest.data() + idx);
+  }
+  if (vec_size < color_count) {
+    const tail_batch tail{c1p, c2p, c3p, vec_size};
+    tail.store(fun(tail.load(0), tail.load(1), tail.load(2)),
+               dest.data() + vec_size);
+  }
+}
 
+void colordiff_RGB_batch(std::span<const float> r1p, std::span<const float> g1p,
+                         std::span<const float> b1p,
+                         std::span<const float, 3> rgb2,
+                         std::span<float> dest) noexcept {
   const float r2{rgb2[0]}, g2{rgb2[1]}, b2{rgb2[2]};
 
-  for (size_t idx = 0; idx < vec_size; idx += batch_size) {
-    batch_t r1{batch_t ::load_aligned(r1p.data() + idx)};
-    batch_t g1{batch_t ::load_aligned(g1p.data() + idx)};
-    batch_t b1{batch_t ::load_aligned(b1p.data() + idx)};
-
+  for_each_batch(r1p, g1p, b1p, dest, [=](batch_t r1, batch_t g1, batch_t b1) {
     auto dr = r1 - r2;
     auto dg = g1 - g2;
     auto db = b1 - b2;
-    batch_t diff = dr * dr + dg * dg + db * db;
-    diff.store_aligned(dest.data() + idx);
+    return batch_t{dr * dr + dg * dg + db * db};
+  });
+}
+
+void colordiff_RGB_block(std::span<const float> r1p, std::span<const float> g1p,
+                         std::span<const float> b1p,
+                         std::span<const std::array<float, 3>> rgb2,
+                         float *dest, size_t dest_stride) noexcept {
+  assert(r1p.size() == g1p.size());
+  assert(g1p.size() == b1p.size());
+
+  const size_t color_count = r1p.size();
+  const size_t vec_size = color_count - color_count % batch_size;
+  // Colors of a tile stay in registers, so that each loaded color in colorset
+  // is compared with all of them.
+  constexpr size_t tile = 4;
+
+  size_t j = 0;
+  for (; j + tile <= rgb2.size(); j += tile) {
+    std::array<batch_t, tile> r2, g2, b2;
+    for (size_t k = 0; k < tile; k++) {
+      r2[k] = batch_t(rgb2[j + k][0]);
+      g2[k] = batch_t(rgb2[j + k][1]);
+      b2[k] = batch_t(rgb2[j + k][2]);
+    }
+    float *const dst = dest + j * dest_stride;
+
+    for (size_t idx = 0; idx < vec_size; idx += batch_size) {
+      batch_t r1{batch_t ::load_aligned(r1p.data() + idx)};
+      batch_t g1{batch_t ::load_aligned(g1p.data() + idx)};
+      batch_t b1{batch_t ::load_aligned(b1p.data() + idx)};
+
+      for (size_t k = 0; k < tile; k++) {
+        auto dr = r1 - r2[k];
+        auto dg = g1 - g2[k];
+        auto db = b1 - b2[k];
+        batch_t diff = dr * dr + dg * dg + db * db;
+        diff.store_unaligned(dst + k * dest_stride + idx);
+      }
+    }
+    if (vec_size < color_count) {
+      const tail_batch tail{r1p, g1p, b1p, vec_size};
+      const batch_t r1 = tail.load(0), g1 = tail.load(1), b1 = tail.load(2);
+      for (size_t k = 0; k < tile; k++) {
+        auto dr = r1 - r2[k];
+        auto dg = g1 - g2[k];
+        auto db = b1 - b2[k];
+        tail.store(dr * dr + dg * dg + db * db,
+                   dst + k * dest_stride + vec_size);
+      }
+    }
   }
-  for (size_t idx = vec_size; idx < color_count; idx++) {
-    const float r1 = r1p[idx], g1 = g1p[idx], b1 = b1p[idx];
-    const float dr = r1 - r2;
-    const float dg = g1 - g2;
-    const float db = b1 - b2;
-    auto diff = dr * dr + dg * dg + db * db;
-    dest[idx] = diff;
+
+  for (; j < rgb2.size(); j++) {
+    colordiff_RGB_batch(r1p, g1p, b1p, rgb2[j],
+                        {dest + j * dest_stride, color_count});
   }
 }
 
@@ -140,14 +231,8 @@ void colordiff_RGBplus_batch(std::span<const float> r1p,
                              std::span<const float> b1p,
                              std::span<const float, 3> c3,
                              std::span<float> dest) noexcept {
-  assert(r1p.size() == g1p.size());
-  assert(g1p.size() == b1p.size());
-  assert(b1p.size() == dest.size());
-
   std::fill(dest.begin(), dest.end(), NAN);
 
-  const size_t color_count = r1p.size();
-  const size_t vec_size = color_count - color_count % batch_size;
   const float r2 = c3[0], g2 = c3[1], b2 = c3[2];
 
   // const batch_t r2{_r2}, g2{_g2}, b2{_b2};
@@ -157,11 +242,7 @@ void colordiff_RGBplus_batch(std::span<const float> r1p,
   const float rr_plus_gg_plus_bb_2 = (r2 * r2 + g2 * g2 + b2 * b2);
   constexpr float w_r = 1.0f, w_g = 2.0f, w_b = 1.0f;
 
-  for (size_t i = 0; i < vec_size; i += batch_size) {
-    batch_t r1{batch_t ::load_aligned(r1p.data() + i)};
-    batch_t g1{batch_t ::load_aligned(g1p.data() + i)};
-    batch_t b1{batch_t ::load_aligned(b1p.data() + i)};
-
+  auto fun = [=](batch_t r1, batch_t g1, batch_t b1) {
     auto deltaR = r1 - r2;
     auto deltaG = g1 - g2;
     auto deltaB = b1 - b2;
@@ -243,33 +324,20 @@ void colordiff_RGBplus_batch(std::span<const float> r1p,
 
       diff = temp_X + temp_Y;
     }
-    diff.store_aligned(dest.data() + i);
-  }
-
-  for (size_t i = vec_size; i < color_count; i++) {
-    dest[i] = color_diff_RGB_plus(r1p[i], g1p[i], b1p[i], r2, g2, b2);
-  }
+    return diff;
+  };
+  for_each_batch(r1p, g1p, b1p, dest, fun);
 }
 
 void colordiff_HSV_batch(std::span<const float> h1p, std::span<const float> s1p,
                          std::span<const float> v1p,
                          std::span<const float, 3> hsv2,
                          std::span<float> dest) noexcept {
-  assert(h1p.size() == s1p.size());
-  assert(s1p.size() == v1p.size());
-  assert(v1p.size() == dest.size());
-
-  const size_t color_count = h1p.size();
-  const size_t vec_size = color_count - color_count % batch_size;
-
   const float h2 = hsv2[0];
   const float s2 = hsv2[1];
   const float v2 = hsv2[2];
 
-  for (size_t idx = 0; idx < vec_size; idx += batch_size) {
-    const batch_t h1 = batch_t::load_aligned(h1p.data() + idx);
-    const batch_t s1 = batch_t::load_aligned(s1p.data() + idx);
-    const batch_t v1 = batch_t::load_aligned(v1p.data() + idx);
+  auto fun = [=](batch_t h1, batch_t s1, batch_t v1) {
     auto sv_1 = s1 * v1;
     auto sv_2 = s2 * v2;
 
@@ -277,15 +345,9 @@ void colordiff_HSV_batch(std::span<const float> h1p, std::span<const float> s1p,
     const auto dY = 50.0f * (sin(h1) * sv_1 - std::sin(h2) * sv_2);
     const auto dZ = 50.0f * (v1 - v2);
 
-    const auto diff = dX * dX + dY * dY + dZ * dZ;
-    diff.store_aligned(dest.data() + idx);
-  }
-
-  for (size_t idx = vec_size; idx < color_count; idx++) {
-    const float diff =
-        color_diff_HSV(hsv2[0], hsv2[1], hsv2[2], h1p[idx], s1p[idx], v1p[idx]);
-    dest[idx] = diff;
-  }
+    return batch_t{dX * dX + dY * dY + dZ * dZ};
+  };
+  for_each_batch(h1p, s1p, v1p, dest, fun);
 }
 
 void colordiff_Lab94_batch(std::span<const float> l1p,
@@ -295,13 +357,6 @@ void colordiff_Lab94_batch(std::span<const float> l1p,
                            std::span<float> dest) noexcept {
   const auto &c3 = lab2;
 
-  assert(l1p.size() == a1p.size());
-  assert(a1p.size() == b1p.size());
-  assert(b1p.size() == dest.size());
-
-  const size_t color_count = l1p.size();
-  const size_t vec_size = color_count - color_count % batch_size;
-
   const float L2 = c3[0];
   const float a2 = c3[1];
   const float b2 = c3[2];
@@ -309,11 +364,7 @@ void colordiff_Lab94_batch(std::span<const float> l1p,
   const float sqrt_C1_2 = sqrt(a2 * a2 + b2 * b2);
   const float SC_2 = square(sqrt_C1_2 * 0.045f + 1.0f);
 
-  for (size_t i = 0; i < vec_size; i += batch_size) {
-    batch_t L1 = batch_t::load_aligned(l1p.data() + i);
-    batch_t a1 = batch_t::load_aligned(a1p.data() + i);
-    batch_t b1 = batch_t::load_aligned(b1p.data() + i);
-
+  auto fun = [=](batch_t L1, batch_t a1, batch_t b1) {
     batch_t deltaL_2;
     {
       batch_t Ldiff = L1 - L2;
@@ -354,44 +405,7 @@ void colordiff_Lab94_batch(std::span<const float> l1p,
       batch_t temp_H = (deltaHab_2 / SH_2);
       diff = (deltaL_2 + (temp_C + temp_H));
     }
-
-    diff.store_aligned(dest.data() + i);
-  }
-
-  {
-    const float L = c3[0];
-    const float a = c3[1];
-    const float b = c3[2];
-    const float _C1_2 = a * a + b * b;
-    const float _SC_2 =
-        (sqrt(_C1_2) * 0.045f + 1.0f) * (sqrt(_C1_2) * 0.045f + 1.0f);
-
-    for (size_t i = vec_size; i < color_count; i++) {
-      // auto deltaL_2 = (Allowed->lab(0) - L).square();
-
-      const float deltaL_2 = (l1p[i] - L) * (l1p[i] - L);
-
-      const float C2_2 = a1p[i] * a1p[i] + b1p[i] * b1p[i];
-      float deltaCab_2;
-      {
-        float temp = sqrt(_C1_2) - sqrt(C2_2);
-        deltaCab_2 = temp * temp;
-      }
-
-      float deltaHab_2;
-      {
-        float diff_a = a1p[i] - a;
-        float diff_b = b1p[i] - b;
-        deltaHab_2 = diff_a * diff_a + diff_b * diff_b;
-      }
-
-      float SH_2;
-      {
-        float temp = sqrt(C2_2) * 0.015f + 1.0f;
-        SH_2 = temp * temp;
-      }
-      // delete &SH_2;
-      dest[i] = deltaL_2 + deltaCab_2 / _SC_2 + deltaHab_2 / SH_2;
-    }
-  }
+    return diff;
+  };
+  for_each_batch(l1p, a1p, b1p, dest, fun);
 }
\ No newline at end of file
@@ -52,6 +52,21 @@ ARGB ComposeColor(const ARGB front,
 ARGB ComposeColor_background_half_transparent(
     const ARGB front, const ARGB background_can_be_transparent) noexcept;
 
+// Batch versions of the functions above, computing dest[i] from front[i] and
+// background[i]. All spans must have the same size. Results are the same as
+// the scalar functions.
+void ComposeColor_batch(std::span<const ARGB> front,
+                        std::span<const ARGB> background_not_transparent,
+                        std::span<ARGB> dest) noexcept;
+void ComposeColor_background_half_transparent_batch(
+    std::span<const ARGB> front,
+    std::span<const ARGB> background_can_be_transparent,
+    std::span<ARGB> dest) noexcept;
+// Sum of r, g and b of composed colors, without storing them.
+std::array<uint64_t, 3> ComposeColor_sum_batch(
+    std::span<const ARGB> front,
+    std::span<const ARGB> background_not_transparent) noexcept;
+
 constexpr inline ARGB ARGB32(uint32_t r, uint32_t g, uint32_t b,
                              uint32_t a = 255) noexcept {
   return ((r & 0xFF) << 16) | ((g & 0xFF) << 8) | ((b & 0xFF)) | (a << 24);
@@ -78,6 +93,14 @@ void colordiff_RGB_batch(std::span<const float> r1, std::span<const float> g1,
                          std::span<const float, 3> rgb2,
                          std::span<float> dest) noexcept;
 
+// Like colordiff_RGB_batch, but for several colors at once. Diffs of rgb2[j]
+// are written to dest + j * dest_stride, which must be aligned like dest of
+// colordiff_RGB_batch.
+void colordiff_RGB_block(std::span<const float> r1, std::span<const float> g1,
+                         std::span<const float> b1,
+                         std::span<const std::array<float, 3>> rgb2,
+                         float *dest, size_t dest_stride) noexcept;
+
 void colordiff_RGBplus_batch(std::span<const float> r1,
                              std::span<const float> g1,
                              std::span<const float> b1,
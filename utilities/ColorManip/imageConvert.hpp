@@ -28,8 +28,11 @@ This file is part of SlopeCraft.
 
 #include <Eigen/Dense>
 #include <GPU_interface.h>
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <optional>
+#include <span>
 #include <thread>
 #include <type_traits>
 #include <unordered_map>
@@ -66,11 +69,36 @@ struct GPU_wrapper_wrapper<false> {
  protected:
   gpu_wrapper::gpu_interface *gpu{nullptr};
 
+  static constexpr double initial_gpu_share = 0.75;
+  // Fraction of colors in each chunk matched by gpu, the rest are matched by
+  // cpu threads at the same time.
+  double gpu_share{initial_gpu_share};
+
+  /// If gpu was waited for, it was slower than cpu, and colors are split by
+  /// the throughput of both. Otherwise gpu was idle, and it gets more colors.
+  void adapt_gpu_share(size_t gpu_count, double gpu_seconds, size_t cpu_count,
+                       double cpu_seconds, double wait_seconds) noexcept {
+    // both sides keep some colors, so that their throughput is still measured
+    constexpr double min_share = 1.0 / 64;
+    if (gpu_count <= 0 || cpu_count <= 0) {
+      return;
+    }
+    if (wait_seconds > 0.01 * gpu_seconds && cpu_seconds > 0) {
+      const double gpu_rate = gpu_count / gpu_seconds;
+      const double cpu_rate = cpu_count / cpu_seconds;
+      this->gpu_share = gpu_rate / (gpu_rate + cpu_rate);
+    } else {
+      this->gpu_share = (this->gpu_share + 1) / 2;
+    }
+    this->gpu_share = std::clamp(this->gpu_share, min_share, 1 - min_share);
+  }
+
  public:
   bool have_gpu_resource() const noexcept { return this->gpu != nullptr; }
 
   void set_gpu_resource(gpu_wrapper::gpu_interface *gi) noexcept {
     this->gpu = gi;
+    this->gpu_share = initial_gpu_share;
   }
 
   inline gpu_wrapper::gpu_interface *gpu_resource() noexcept {
@@ -126,6 +154,103 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
   /// Call this function when the color set is changed.
   inline void clear_color_hash() noexcept { this->color_hash_.clear(); }
 
+  /// Takes colors matched by src, whose allowed colors may be different.
+  /// Results using removed colors and those beaten by added colors are
+  /// cleared, so converting again only matches colors affected by the change.
+  template <typename = void>
+  void reuse_matched_colors(const ImageCvter &src) noexcept {
+    static_assert(is_not_optical,
+                  "reuse_matched_colors is only avaliable for maptical "
+                  "colors.");
+    const allowed_colorset_t &old_allowed = src.allowed_colorset;
+    const allowed_colorset_t &new_allowed = this->allowed_colorset;
+    if (old_allowed.need_find_side != new_allowed.need_find_side) {
+      this->clear_color_hash();
+      return;
+    }
+    if (&src != this) {
+      this->color_hash_ = src.color_hash_;
+    }
+
+    std::array<bool, 256> was_allowed{}, is_allowed{}, removed{};
+    for (int i = 0; i < old_allowed.color_count(); i++) {
+      was_allowed[old_allowed.Map(i)] = true;
+    }
+    for (int i = 0; i < new_allowed.color_count(); i++) {
+      is_allowed[new_allowed.Map(i)] = true;
+    }
+    for (int id = 0; id < 256; id++) {
+      removed[id] = was_allowed[id] && !is_allowed[id];
+    }
+
+    // Allowed colors are ordered by color index, so are added colors.
+    std::vector<uint8_t> added_ids;
+    std::vector<int> added_indices;
+    for (int i = 0; i < new_allowed.color_count(); i++) {
+      if (!was_allowed[new_allowed.Map(i)]) {
+        added_ids.emplace_back(new_allowed.Map(i));
+        added_indices.emplace_back(i);
+      }
+    }
+    // Channels of added colors in rgb, hsv, lab and xyz. Columns are padded
+    // to keep them aligned for batch diff functions.
+    const size_t added_count = added_ids.size();
+    Eigen::ArrayXXf added(std::max<size_t>(16, (added_count + 15) / 16 * 16),
+                          12);
+    for (size_t j = 0; j < added_count; j++) {
+      const int i = added_indices[j];
+      for (int c = 0; c < 3; c++) {
+        added(j, c) = new_allowed.RGB(i, c);
+        added(j, 3 + c) = new_allowed.HSV(i, c);
+        added(j, 6 + c) = new_allowed.Lab(i, c);
+        added(j, 9 + c) = new_allowed.XYZ(i, c);
+      }
+    }
+    auto added_colors_of = [&added, added_count](::SCL_convertAlgo a) {
+      int col = 0;
+      switch (a) {
+        case ::SCL_convertAlgo::HSV:
+          col = 3;
+          break;
+        case ::SCL_convertAlgo::Lab94:
+        case ::SCL_convertAlgo::Lab00:
+          col = 6;
+          break;
+        case ::SCL_convertAlgo::XYZ:
+          col = 9;
+          break;
+        default:
+          break;
+      }
+      return std::array<std::span<const float>, 3>{
+          std::span<const float>{&added(0, col), added_count},
+          std::span<const float>{&added(0, col + 1), added_count},
+          std::span<const float>{&added(0, col + 2), added_count}};
+    };
+
+    std::vector<task_t *> tasks;
+    tasks.reserve(this->color_hash_.size());
+    for (auto &pair : this->color_hash_) {
+      if (pair.second.is_result_computed()) tasks.emplace_back(&pair);
+    }
+
+#pragma omp parallel
+    {
+      Eigen::ArrayXf diff_buffer(added.rows());
+#pragma omp for schedule(static)
+      for (int64_t t = 0; t < int64_t(tasks.size()); t++) {
+        const convert_unit cu = tasks[t]->first;
+        TokiColor_t &tc = tasks[t]->second;
+        if (!tc.update_on_colorset_changed(
+                cu, removed, added_ids, added_colors_of(cu.algo),
+                new_allowed.need_find_side,
+                {diff_buffer.data(), size_t(diff_buffer.size())})) {
+          tc = TokiColor_t();
+        }
+      }
+    }
+  }
+
   inline ::SCL_convertAlgo convert_algo() const noexcept { return this->algo; }
 
   inline bool is_dither() const noexcept { return this->dither; }
@@ -177,7 +302,7 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
     this->algo = algo_;
     this->add_colors_to_hash();
     ui.rangeSet(0, 100, 25);
-    if (!this->match_all_TokiColors(try_gpu)) {
+    if (!this->match_all_TokiColors(try_gpu) || ui.is_cancelled()) {
       return false;
     }
     ui.rangeSet(0, 100, 50);
@@ -218,6 +343,10 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
     } else {
       this->dithered_image_ = this->raw_image_;
     }
+    // the dithered image is incomplete
+    if (ui.is_cancelled()) {
+      return false;
+    }
 
     //    for (int64_t idx = 0; idx < this->_dithered_image.size(); idx++) {
     //      const auto current_color{this->_dithered_image(idx)};
@@ -319,29 +448,8 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
           //          const int64_t idx =
           //              (is_dest_col_major) ? (r * cols() + c) : (c * rows() +
           //              r);
-          ARGB argb = this->dithered_image_(r, c);
-          // process full-transparent image
-          if (::getA(argb) <= 0) {
-            argb = ARGB32(0, 0, 0, 0);
-          }
-          auto it = this->color_hash_.find(convert_unit{argb, this->algo});
-          if (it == this->color_hash_.end()) {
-            // logical impossible
-            abort();
-          }
-
-          const auto color_id = it->second.color_id();
-          const auto color_index =
-              basic_colorset.colorindex_of_colorid(color_id);
-          ARGB color;
-          if (color_index != allowed_colorset_t::invalid_color_id) {
-            color = RGB2ARGB(basic_colorset.RGB(color_index, 0),
-                             basic_colorset.RGB(color_index, 1),
-                             basic_colorset.RGB(color_index, 2));
-          } else {
-            color = 0x00'00'00'00;
-          }
-          dest(r, c) = color;
+          dest(r, c) =
+              this->matched_color(this->dithered_image_(r, c), this->algo);
         }
       }
       if (is_dest_col_major) {
@@ -350,7 +458,73 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
     }
   }
 
+  /// A preview takes one pixel in every step*step block of the raw image.
+  static int64_t preview_step(int64_t rows, int64_t cols,
+                              int64_t max_side) noexcept {
+    max_side = std::max<int64_t>(max_side, 1);
+    return std::max<int64_t>(1,
+                             (std::max(rows, cols) + max_side - 1) / max_side);
+  }
+
+  /// Converts a downsampled copy of the raw image without dithering, so that a
+  /// preview can be shown long before convert_image finishes. The longer side
+  /// of the result is at most max_side. Colors matched here stay in the color
+  /// hash and are reused by convert_image.
+  Eigen::ArrayXX<ARGB> preview(::SCL_convertAlgo algo_,
+                               int64_t max_side) noexcept {
+    if (algo_ == ::SCL_convertAlgo::gaCvter) {
+      algo_ = ::SCL_convertAlgo::RGB_Better;
+    }
+    const int64_t step = preview_step(this->rows(), this->cols(), max_side);
+    const int64_t p_rows = (this->rows() + step - 1) / step;
+    const int64_t p_cols = (this->cols() + step - 1) / step;
+
+    // sample the center of each step*step block
+    Eigen::ArrayXX<ARGB> result(p_rows, p_cols);
+    for (int64_t c = 0; c < p_cols; c++) {
+      for (int64_t r = 0; r < p_rows; r++) {
+        ARGB argb =
+            this->raw_image_(std::min(r * step + step / 2, this->rows() - 1),
+                             std::min(c * step + step / 2, this->cols() - 1));
+        if (::getA(argb) <= 0) {
+          argb = ARGB32(0, 0, 0, 0);
+        }
+        result(r, c) = argb;
+        this->color_hash_.try_emplace(convert_unit{argb, algo_});
+      }
+    }
+
+    this->match_all_TokiColors_cpu();
+
+    for (ARGB &argb : result.reshaped()) {
+      argb = this->matched_color(argb, algo_);
+    }
+    return result;
+  }
+
  private:
+  /// The color that argb is converted to. It must have been matched.
+  ARGB matched_color(ARGB argb, ::SCL_convertAlgo a) const noexcept {
+    // process full-transparent image
+    if (::getA(argb) <= 0) {
+      argb = ARGB32(0, 0, 0, 0);
+    }
+    auto it = this->color_hash_.find(convert_unit{argb, a});
+    if (it == this->color_hash_.end()) {
+      // logical impossible
+      abort();
+    }
+
+    const auto color_index =
+        basic_colorset.colorindex_of_colorid(it->second.color_id());
+    if (color_index == allowed_colorset_t::invalid_color_id) {
+      return 0x00'00'00'00;
+    }
+    return RGB2ARGB(basic_colorset.RGB(color_index, 0),
+                    basic_colorset.RGB(color_index, 1),
+                    basic_colorset.RGB(color_index, 2));
+  }
+
   void add_colors_to_hash() noexcept {
     // this->_color_hash.clear();
 
@@ -364,12 +538,28 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
     }
   }
 
+  using task_t = typename TokiColor_t::task_t;
+
+  /// Match colors by cpu threads, each takes a slice of colors and matches
+  /// them block by block.
+  void match_TokiColors_cpu(std::span<task_t *const> tasks) noexcept {
+    constexpr size_t slice_size = 1024;
+    const int64_t num_slices =
+        int64_t(tasks.size() + slice_size - 1) / slice_size;
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t slice = 0; slice < num_slices; slice++) {
+      const size_t begin = slice * slice_size;
+      TokiColor_t::compute_batch(
+          tasks.subspan(begin, std::min(slice_size, tasks.size() - begin)),
+          this->allowed_colorset);
+    }
+  }
+
   bool match_all_TokiColors(bool try_gpu) noexcept {
     if constexpr (is_not_optical) {
-      this->match_all_TokiColors_cpu();
-      return true;
+      return this->match_all_TokiColors_cpu();
     } else {
-      if constexpr (gpu_wrapper::have_api) {
+      if constexpr (gpu_wrapper::have_backend) {
         // If converter have gpu resources, compute by gpu
         if (try_gpu && this->have_gpu_resource()) {
           const bool ok = this->match_all_TokiColors_gpu();
@@ -378,15 +568,15 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
         }
       }
       // otherwise compute by cpu
-      this->match_all_TokiColors_cpu();
-      return true;
+      return this->match_all_TokiColors_cpu();
     }
   }
 
-  void match_all_TokiColors_cpu() noexcept {
+  /// Returns false if cancelled.
+  bool match_all_TokiColors_cpu() noexcept {
     // const int threadCount = omp_get_num_threads();
 
-    std::vector<std::pair<const convert_unit, TokiColor_t> *> tasks;
+    std::vector<task_t *> tasks;
     tasks.reserve(color_hash_.size());
     tasks.clear();
 
@@ -394,11 +584,15 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
       if (!pair.second.is_result_computed()) tasks.emplace_back(&pair);
     }
     const size_t taskCount = tasks.size();
+    // matched in chunks to check for cancellation in between
+    constexpr size_t chunk_size = 16384;
 
-#pragma omp parallel for schedule(dynamic)
-    for (int taskIdx = 0; taskIdx < (int)taskCount; taskIdx++) {
-      tasks[taskIdx]->second.compute(tasks[taskIdx]->first,
-                                     this->allowed_colorset);
+    for (size_t begin = 0; begin < taskCount; begin += chunk_size) {
+      if (this->ui.is_cancelled()) {
+        return false;
+      }
+      this->match_TokiColors_cpu(std::span{tasks}.subspan(
+          begin, std::min(chunk_size, taskCount - begin)));
     }
     // #warning we should parallelize here
     /*
@@ -410,6 +604,7 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
       }
     }
   */
+    return true;
   }
 
   /// fill a colorid matrix according to raw image and colorhash
@@ -444,7 +639,7 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
       return false;
     }
 
-    std::vector<std::pair<const convert_unit, TokiColor_t> *> tasks;
+    std::vector<task_t *> tasks;
     tasks.reserve(color_hash_.size());
     tasks.clear();
 
@@ -458,40 +653,34 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
       }
     }
 
-    if (tasks.size() <= 0) {
-      return true;
-    }
-
-    const SCL_convertAlgo algo = tasks[0]->first.algo;
-
-    const uint64_t taskCount = tasks.size();
+    // colors of each algo are matched separately
+    std::ranges::stable_sort(
+        tasks, {}, [](const task_t *t) { return t->first.algo; });
 
-    const uint64_t gpu_task_count =
-        taskCount - taskCount % this->gpu->local_work_group_size_v();
-    const uint64_t cpu_task_count = taskCount - gpu_task_count;
-
-    if (gpu_task_count > 0) {
-      std::vector<std::array<float, 3>> task_colors(gpu_task_count);
-      for (size_t tid = 0; tid < gpu_task_count; tid++) {
-        if (tasks[tid]->first.algo != algo) {
-          return false;
-        }
-
-        const Eigen::Array3f c3_eig = tasks[tid]->first.to_c3();
-        for (size_t channel = 0; channel < 3; channel++) {
-          task_colors[tid][channel] = c3_eig[channel];
-        }
+    for (size_t begin = 0; begin < tasks.size();) {
+      const SCL_convertAlgo algo = tasks[begin]->first.algo;
+      size_t end = begin;
+      while (end < tasks.size() && tasks[end]->first.algo == algo) {
+        end++;
       }
-
-      //  set task
-      this->gpu->set_task_v(task_colors.size(), task_colors.data());
-      if (!this->gpu->ok_v()) {
+      if (!this->match_TokiColors_gpu(
+              std::span{tasks}.subspan(begin, end - begin), algo)) {
         return false;
       }
+      begin = end;
     }
 
-    // set colorset to device
+    return true;
+  }
 
+  /// Match colors of the same algo in chunks. The first part of a chunk is
+  /// matched by gpu while cpu threads match the rest and prepare the next
+  /// chunk, and results are written back after each chunk. How many colors
+  /// gpu gets is adapted by measured throughput. The CPU backend isn't split
+  /// with cpu threads.
+  template <typename = void>
+  bool match_TokiColors_gpu(std::span<task_t *> tasks,
+                            SCL_convertAlgo algo) noexcept {
     std::array<const float *, 3> colorset_ptrs{nullptr, nullptr, nullptr};
     switch (algo) {
       case SCL_convertAlgo::RGB:
@@ -520,45 +709,97 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
         abort();
     }
 
-    if (gpu_task_count > 0) {
-      // set colorset for ocl
-      this->gpu->set_colorset_v(this->allowed_colorset.color_count(),
-                                colorset_ptrs);
-      if (!this->gpu->ok_v()) {
-        return false;
-      }
+    // set colorset to device
+    this->gpu->set_colorset_v(this->allowed_colorset.color_count(),
+                              colorset_ptrs);
+    if (!this->gpu->ok_v()) {
+      return false;
+    }
 
-      this->gpu->execute_v(algo, false);
-      if (!this->gpu->ok_v()) {
-        return false;
+    static constexpr size_t chunk_size = 65536;
+    const size_t group_size = this->gpu->local_work_group_size_v();
+    const size_t num_chunks = (tasks.size() + chunk_size - 1) / chunk_size;
+
+    // Two buffers, as the device may still read colors of the current chunk
+    // while those of the next one are being prepared.
+    std::array<std::vector<std::array<float, 3>>, 2> staged;
+    auto stage = [&tasks, &staged](size_t chunk) {
+      const size_t begin = chunk * chunk_size;
+      auto &dst = staged[chunk % 2];
+      dst.resize(std::min(tasks.size() - begin, chunk_size));
+#pragma omp parallel for
+      for (int64_t i = 0; i < int64_t(dst.size()); i++) {
+        const Eigen::Array3f c3_eig = tasks[begin + i]->first.to_c3();
+        dst[i] = {c3_eig[0], c3_eig[1], c3_eig[2]};
       }
-    }
-    // compute rest tasks on cpu
-    for (uint64_t ctid = 0; ctid < cpu_task_count; ctid++) {
-      const uint64_t tid = gpu_task_count + ctid;
-      tasks[tid]->second.compute(tasks[tid]->first, this->allowed_colorset);
+    };
+    if (num_chunks > 0) {
+      stage(0);
     }
 
-    if (gpu_task_count > 0) {
-      this->gpu->wait_v();
-      if (!this->gpu->ok_v()) {
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+      if (this->ui.is_cancelled()) {
         return false;
       }
-    }
+      const size_t begin = chunk * chunk_size;
+      const auto &colors = staged[chunk % 2];
+      const size_t count = colors.size();
+      // The CPU backend runs on the same threads as the cpu side, so
+      // splitting would only make them compete. It takes all colors.
+      size_t gpu_count = gpu_wrapper::is_cpu_backend
+                             ? count
+                             : size_t(this->gpu_share * count);
+      gpu_count -= gpu_count % group_size;
+
+      const double gpu_begin = omp_get_wtime();
+      if (gpu_count > 0) {
+        this->gpu->set_task_v(gpu_count, colors.data());
+        if (!this->gpu->ok_v()) {
+          return false;
+        }
+        this->gpu->execute_v(algo, false);
+        if (!this->gpu->ok_v()) {
+          return false;
+        }
+      }
+
+      // compute rest tasks on cpu
+      const double cpu_begin = omp_get_wtime();
+      if (gpu_count < count) {
+        this->match_TokiColors_cpu(
+            tasks.subspan(begin + gpu_count, count - gpu_count));
+      }
+      const double cpu_seconds = omp_get_wtime() - cpu_begin;
+
+      if (chunk + 1 < num_chunks) {
+        stage(chunk + 1);
+      }
 
-    if (gpu_task_count > 0)
-      for (size_t tid = 0; tid < gpu_task_count; tid++) {
-        TokiColor_t &tc = tasks[tid]->second;
+      const double wait_begin = omp_get_wtime();
+      if (gpu_count > 0) {
+        this->gpu->wait_v();
+        if (!this->gpu->ok_v()) {
+          return false;
+        }
+      }
+      const double gpu_end = omp_get_wtime();
+
+      for (size_t i = 0; i < gpu_count; i++) {
+        TokiColor_t &tc = tasks[begin + i]->second;
 
-        const uint16_t tempidx = this->gpu->result_idx_v()[tid];
+        const uint16_t tempidx = this->gpu->result_idx_v()[i];
         if (tempidx >= this->allowed_colorset.color_count()) {
           abort();
         }
 
         tc.set_gpu_result(this->allowed_colorset.color_id(tempidx),
-                          this->gpu->result_diff_v()[tid]);
+                          this->gpu->result_diff_v()[i]);
       }
 
+      this->adapt_gpu_share(gpu_count, gpu_end - gpu_begin, count - gpu_count,
+                            cpu_seconds, gpu_end - wait_begin);
+    }
+
     return true;
   }
 
@@ -618,6 +859,9 @@ class ImageCvter : public GPU_wrapper_wrapper<is_not_optical> {
     // int64_t inserted_count = 0;
     bool is_dir_LR = true;
     for (int64_t row = 0; row < this->rows(); row++) {
+      if (this->ui.is_cancelled()) {
+        return;
+      }
       if (is_dir_LR)
         for (int64_t col = 0; col < this->cols(); col++) {
           if (::getA(this->raw_image_(row, col)) <= 0) {
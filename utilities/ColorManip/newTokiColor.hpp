@@ -186,8 +186,190 @@ class newTokiColor
     }
   }
 
+  using task_t = std::pair<const convert_unit, newTokiColor>;
+  // colors matched together by compute_batch
+  static constexpr size_t batch_size = 16;
+
+  /// Same results as compute, but colors are matched in blocks. Diffs of a
+  /// block go to columns of one matrix, from which results and side results
+  /// are found. Transparent colors, computed ones and those with a different
+  /// algo from the first in block are computed one by one.
+  static void compute_batch(std::span<task_t *const> tasks,
+                            const allowed_t &allowed) noexcept {
+    // Columns are padded to keep them aligned for batch diff functions.
+    const Eigen::Index color_count = allowed.color_count();
+    Eigen::ArrayXXf diffs((color_count + 15) / 16 * 16, batch_size);
+    std::array<std::array<float, 3>, batch_size> c3s;
+    std::array<newTokiColor *, batch_size> results;
+
+    for (size_t begin = 0; begin < tasks.size(); begin += batch_size) {
+      const size_t end = std::min(tasks.size(), begin + batch_size);
+      const ::SCL_convertAlgo algo = tasks[begin]->first.algo;
+      size_t count = 0;
+      for (size_t t = begin; t < end; t++) {
+        const convert_unit cu = tasks[t]->first;
+        newTokiColor &tc = tasks[t]->second;
+        if (getA(cu.ARGB_) == 0 || tc.is_result_computed() ||
+            cu.algo != algo) {
+          tc.compute(cu, allowed);
+          continue;
+        }
+        const Eigen::Array3f c3 = cu.to_c3();
+        c3s[count] = {c3[0], c3[1], c3[2]};
+        results[count] = &tc;
+        count++;
+      }
+
+      fill_diffs(algo, std::span{c3s}.first(count), allowed, diffs);
+      for (size_t j = 0; j < count; j++) {
+        results[j]->find_result(diffs.col(j).head(color_count), allowed);
+      }
+    }
+  }
+
+  /// Keeps a computed result after the allowed colors changed, if it's still
+  /// what compute would give. removed is indexed by color id. added_ids are
+  /// the added colors in the order of color index, and added_colors are their
+  /// channels in the colorspace of cu.algo. Side results are updated with
+  /// added colors. Returns false if the color must be computed again.
+  template <typename = void>
+  bool update_on_colorset_changed(
+      convert_unit cu, std::span<const bool, 256> removed,
+      std::span<const uint8_t> added_ids,
+      const std::array<std::span<const float>, 3> &added_colors,
+      bool need_find_side, std::span<float> diff_buffer) noexcept {
+    static_assert(is_not_optical,
+                  "update_on_colorset_changed is only avaliable for maptical "
+                  "colors.");
+    if (!this->is_result_computed() || removed[this->Result]) {
+      return false;
+    }
+    if (need_find_side &&
+        (removed[this->sideResult[0]] || removed[this->sideResult[1]])) {
+      return false;
+    }
+    if (added_ids.empty()) {
+      return true;
+    }
+
+    const Eigen::Array3f c3 = cu.to_c3();
+    std::span<float> diff = diff_buffer.first(added_ids.size());
+    fill_diff(cu.algo, std::span<const float, 3>{c3.data(), 3}, added_colors,
+              diff);
+
+    // compute takes the first minimum, which has the least color index
+    auto is_better = [](float d, uint8_t id, float old_d, uint8_t old_id) {
+      if (d != old_d) {
+        return d < old_d;
+      }
+      return basic_t::colorindex_of_colorid(id) <
+             basic_t::colorindex_of_colorid(old_id);
+    };
+    for (size_t j = 0; j < added_ids.size(); j++) {
+      if (is_better(diff[j], added_ids[j], this->ResultDiff, this->Result)) {
+        return false;
+      }
+    }
+
+    const int result_depth = this->Result & 0b11;
+    if (!need_find_side || result_depth == 3) {
+      return true;
+    }
+    for (size_t j = 0; j < added_ids.size(); j++) {
+      const int depth = added_ids[j] & 0b11;
+      if (depth == 3 || depth == result_depth) {
+        continue;
+      }
+      // sides are the other two depths among 0, 1 and 2, in ascending order
+      const int side = (depth < result_depth) ? depth : depth - 1;
+      if (is_better(diff[j], added_ids[j], this->sideSelectivity[side],
+                    this->sideResult[side])) {
+        this->sideSelectivity[side] = diff[j];
+        this->sideResult[side] = added_ids[j];
+      }
+    }
+    return true;
+  }
+
  private:
-  auto find_result(const TempVectorXf_t &diff,
+  /// Diffs between allowed colors and each of c3s, one column for each.
+  static void fill_diffs(::SCL_convertAlgo algo,
+                         std::span<const std::array<float, 3>> c3s,
+                         const allowed_t &allowed,
+                         Eigen::ArrayXXf &diffs) noexcept {
+    const size_t color_count = allowed.color_count();
+    switch (algo) {
+      case ::SCL_convertAlgo::RGB:
+        colordiff_RGB_block(allowed.rgb_data_span(0), allowed.rgb_data_span(1),
+                            allowed.rgb_data_span(2), c3s, diffs.data(),
+                            diffs.rows());
+        return;
+      case ::SCL_convertAlgo::XYZ:
+        colordiff_RGB_block(allowed.xyz_data_span(0), allowed.xyz_data_span(1),
+                            allowed.xyz_data_span(2), c3s, diffs.data(),
+                            diffs.rows());
+        return;
+      default:
+        break;
+    }
+
+    const auto colors = channels_of(algo, allowed);
+    for (size_t j = 0; j < c3s.size(); j++) {
+      fill_diff(algo, c3s[j], colors, {&diffs(0, j), color_count});
+    }
+  }
+
+  static std::array<std::span<const float>, 3> channels_of(
+      ::SCL_convertAlgo algo, const allowed_t &allowed) noexcept {
+    switch (algo) {
+      case ::SCL_convertAlgo::HSV:
+        return {allowed.hsv_data_span(0), allowed.hsv_data_span(1),
+                allowed.hsv_data_span(2)};
+      case ::SCL_convertAlgo::Lab94:
+      case ::SCL_convertAlgo::Lab00:
+        return {allowed.lab_data_span(0), allowed.lab_data_span(1),
+                allowed.lab_data_span(2)};
+      case ::SCL_convertAlgo::XYZ:
+        return {allowed.xyz_data_span(0), allowed.xyz_data_span(1),
+                allowed.xyz_data_span(2)};
+      default:
+        return {allowed.rgb_data_span(0), allowed.rgb_data_span(1),
+                allowed.rgb_data_span(2)};
+    }
+  }
+
+  /// Diffs between c3 and colors, whose channels are in the colorspace of
+  /// algo. Channels and diff must be aligned like colorset tables.
+  static void fill_diff(::SCL_convertAlgo algo, std::span<const float, 3> c3,
+                        const std::array<std::span<const float>, 3> &colors,
+                        std::span<float> diff) noexcept {
+    switch (algo) {
+      case ::SCL_convertAlgo::RGB:
+      case ::SCL_convertAlgo::XYZ:
+        colordiff_RGB_batch(colors[0], colors[1], colors[2], c3, diff);
+        break;
+      case ::SCL_convertAlgo::RGB_Better:
+        colordiff_RGBplus_batch(colors[0], colors[1], colors[2], c3, diff);
+        break;
+      case ::SCL_convertAlgo::HSV:
+        colordiff_HSV_batch(colors[0], colors[1], colors[2], c3, diff);
+        break;
+      case ::SCL_convertAlgo::Lab94:
+        colordiff_Lab94_batch(colors[0], colors[1], colors[2], c3, diff);
+        break;
+      case ::SCL_convertAlgo::Lab00:
+        for (size_t i = 0; i < diff.size(); i++) {
+          diff[i] = Lab00_diff(c3[0], c3[1], c3[2], colors[0][i], colors[1][i],
+                               colors[2][i]);
+        }
+        break;
+      default:
+        abort();
+    }
+  }
+
+  template <class diff_t>
+  auto find_result(const Eigen::ArrayBase<diff_t> &diff,
                    const allowed_t &allowed_colorset) noexcept {
     if (diff.isNaN().any()) {
       for (int idx = 0; idx < diff.size(); idx++) {
@@ -234,8 +416,9 @@ class newTokiColor
     }
   }
 
-  template <typename = void>
-  void doSide(const TempVectorXf_t &Diff, const allowed_t &allowed_colorset) {
+  template <class diff_t>
+  void doSide(const Eigen::ArrayBase<diff_t> &Diff,
+              const allowed_t &allowed_colorset) {
     static_assert(is_not_optical);
 
     int tempIndex = 0;
@@ -0,0 +1,92 @@
+// The batched color diff functions compute colors a simd batch at a time,
+// padding the remaining ones. A color must get exactly the same diff wherever
+// it sits in the color table, or ties between equal colors are broken
+// differently.
+
+#include <ColorManip.h>
+
+#include <Eigen/Dense>
+#include <array>
+#include <iostream>
+#include <string_view>
+
+using std::cout, std::endl;
+
+using batch_fun_t = void (*)(std::span<const float>, std::span<const float>,
+                             std::span<const float>, std::span<const float, 3>,
+                             std::span<float>) noexcept;
+
+struct case_t {
+  std::string_view name;
+  batch_fun_t fun;
+  // channels are scaled from [0,1] to these ranges
+  std::array<float, 3> min;
+  std::array<float, 3> max;
+};
+
+const std::array<case_t, 4> cases{{
+    {"RGB", colordiff_RGB_batch, {0, 0, 0}, {1, 1, 1}},
+    {"RGBplus", colordiff_RGBplus_batch, {0, 0, 0}, {1, 1, 1}},
+    {"HSV", colordiff_HSV_batch, {0, 0, 0}, {6.2831853f, 1, 1}},
+    {"Lab94", colordiff_Lab94_batch, {0, -100, -100}, {100, 100, 100}},
+}};
+
+int check(const case_t &c) noexcept {
+  int failed = 0;
+  // each count leaves a few colors in the padded last batch, but the diff of
+  // a color must not depend on its position
+  for (int color_count : {1, 3, 17, 31, 67}) {
+    // channels are loaded aligned, so each one has its own array
+    using table_t = std::array<Eigen::ArrayXf, 3>;
+    table_t colors, reversed;
+    for (int ch = 0; ch < 3; ch++) {
+      colors[ch] = (Eigen::ArrayXf::Random(color_count) + 1) / 2 *
+                       (c.max[ch] - c.min[ch]) +
+                   c.min[ch];
+      // the reversed table moves tail colors into full batches
+      reversed[ch] = colors[ch].reverse();
+    }
+
+    for (int t = 0; t < 16; t++) {
+      Eigen::Array3f c2 = (Eigen::Array3f::Random() + 1) / 2;
+      for (int ch = 0; ch < 3; ch++) {
+        c2[ch] = c2[ch] * (c.max[ch] - c.min[ch]) + c.min[ch];
+      }
+      Eigen::ArrayXf diff(color_count), diff_rev(color_count);
+      auto run = [&](const table_t &table, Eigen::ArrayXf &dest) {
+        c.fun({table[0].data(), size_t(color_count)},
+              {table[1].data(), size_t(color_count)},
+              {table[2].data(), size_t(color_count)},
+              std::span<const float, 3>{c2.data(), 3},
+              {dest.data(), size_t(color_count)});
+      };
+      run(colors, diff);
+      run(reversed, diff_rev);
+      diff_rev.reverseInPlace();
+
+      for (int i = 0; i < color_count; i++) {
+        if (diff[i] != diff_rev[i]) {
+          cout << c.name << ": color " << i << " of " << color_count
+               << " gets " << diff[i] << " and " << diff_rev[i]
+               << " when reversed" << endl;
+          failed++;
+          break;
+        }
+      }
+    }
+  }
+  return failed;
+}
+
+int main() {
+  int failed = 0;
+  for (const auto &c : cases) {
+    failed += check(c);
+  }
+  if (failed > 0) {
+    cout << failed << " checks failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
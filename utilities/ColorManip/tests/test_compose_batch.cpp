@@ -0,0 +1,98 @@
+// The batched compose functions must give exactly the same colors as the
+// scalar ones, including the sizes that don't fill a whole simd batch, and
+// ComposeColor_sum_batch must not overflow on images of more than 2^24 pixels.
+
+#include <ColorManip.h>
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout, std::endl;
+
+// Fully transparent and opaque colors are taken by other branches of the
+// scalar functions, so they are generated more often.
+ARGB random_color(std::mt19937 &mt) noexcept {
+  const ARGB rgb = mt() & 0xFFFFFF;
+  switch (mt() % 4) {
+    case 0:
+      return rgb;
+    case 1:
+      return rgb | 0xFF000000U;
+    default:
+      return rgb | (mt() << 24);
+  }
+}
+
+int main() {
+  std::mt19937 mt{114514};
+  int failed = 0;
+
+  for (size_t size : {0, 1, 3, 7, 8, 9, 15, 17, 31, 33, 63, 65, 1000, 4099}) {
+    std::vector<ARGB> front(size), back(size), back_opaque(size);
+    for (size_t i = 0; i < size; i++) {
+      front[i] = random_color(mt);
+      back[i] = random_color(mt);
+      back_opaque[i] = back[i] | 0xFF000000U;
+    }
+
+    std::vector<ARGB> dest(size);
+    ComposeColor_batch(front, back_opaque, dest);
+    std::array<uint64_t, 3> expected_sum{0, 0, 0};
+    for (size_t i = 0; i < size; i++) {
+      const ARGB expected = ComposeColor(front[i], back_opaque[i]);
+      expected_sum[0] += getR(expected);
+      expected_sum[1] += getG(expected);
+      expected_sum[2] += getB(expected);
+      if (dest[i] != expected) {
+        cout << "ComposeColor_batch of size " << size << " gives " << std::hex
+             << dest[i] << " at " << std::dec << i << ", expected " << std::hex
+             << expected << std::dec << endl;
+        failed++;
+        break;
+      }
+    }
+    if (ComposeColor_sum_batch(front, back_opaque) != expected_sum) {
+      cout << "ComposeColor_sum_batch of size " << size << " is wrong" << endl;
+      failed++;
+    }
+
+    ComposeColor_background_half_transparent_batch(front, back, dest);
+    for (size_t i = 0; i < size; i++) {
+      const ARGB expected =
+          ComposeColor_background_half_transparent(front[i], back[i]);
+      if (dest[i] != expected) {
+        cout << "ComposeColor_background_half_transparent_batch of size "
+             << size << " gives " << std::hex << dest[i] << " at " << std::dec
+             << i << ", expected " << std::hex << expected << std::dec << endl;
+        failed++;
+        break;
+      }
+    }
+  }
+
+  {
+    // the sum of white pixels overflows 32 bits if not summed in chunks
+    constexpr size_t size = (size_t(1) << 24) + (size_t(1) << 17) + 37;
+    static_assert(uint64_t(255) * size > UINT32_MAX);
+    const std::vector<ARGB> front(size, 0x00000000U), back(size, 0xFFFFFFFFU);
+    const auto sum = ComposeColor_sum_batch(front, back);
+    for (uint64_t s : sum) {
+      if (s != uint64_t(255) * size) {
+        cout << "ComposeColor_sum_batch of " << size << " white pixels is "
+             << s << ", expected " << uint64_t(255) * size << endl;
+        failed++;
+        break;
+      }
+    }
+  }
+
+  if (failed > 0) {
+    cout << failed << " checks failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
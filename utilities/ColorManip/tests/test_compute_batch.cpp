@@ -0,0 +1,176 @@
+// compute_batch and colordiff_RGB_block must give exactly what the scalar
+// code gives, for task and color counts that are not multiples of block sizes.
+
+#include <ColorManip.h>
+#include <newColorSet.hpp>
+#include <newTokiColor.hpp>
+
+#include <Eigen/Dense>
+#include <array>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "test_fixture.hpp"
+
+using std::cout, std::endl;
+using test_fixture::algos;
+
+// not multiples of newTokiColor::batch_size, nor the tile of
+// colordiff_RGB_block
+constexpr std::array<size_t, 6> task_counts{1, 3, 15, 17, 33, 1001};
+
+std::mt19937 mt = test_fixture::make_rng();
+
+template <class tc_t>
+bool same_result(const tc_t &a, const tc_t &b, bool transparent) noexcept {
+  if constexpr (!requires { a.Result; }) {
+    return a.color_id() == b.color_id() &&
+           (transparent || a.ResultDiff == b.ResultDiff);
+  } else {
+    if (transparent) {
+      return a.Result == b.Result;
+    }
+    return a.Result == b.Result && a.ResultDiff == b.ResultDiff &&
+           a.sideResult == b.sideResult &&
+           a.sideSelectivity == b.sideSelectivity;
+  }
+}
+
+template <class tc_t, class allowed_t>
+int check_compute_batch(const allowed_t &allowed,
+                        std::string_view name) noexcept {
+  using task_t = typename tc_t::task_t;
+  int failed = 0;
+  for (SCL_convertAlgo algo : algos) {
+    for (size_t count : task_counts) {
+      std::vector<task_t> scalar, batch;
+      for (size_t i = 0; i < count; i++) {
+        ARGB argb = 0xFF000000U | (mt() & 0xFFFFFF);
+        if (i % 7 == 5) {
+          // transparent colors are computed one by one
+          argb = 0;
+        }
+        scalar.emplace_back(convert_unit{argb, algo}, tc_t{});
+        batch.emplace_back(convert_unit{argb, algo}, tc_t{});
+      }
+      std::vector<task_t *> ptrs;
+      for (auto &task : batch) {
+        ptrs.emplace_back(&task);
+      }
+
+      for (auto &[cu, tc] : scalar) {
+        tc.compute(cu, allowed);
+      }
+      tc_t::compute_batch(ptrs, allowed);
+
+      for (size_t i = 0; i < count; i++) {
+        const bool transparent = getA(scalar[i].first.ARGB_) == 0;
+        if (!same_result(scalar[i].second, batch[i].second, transparent)) {
+          cout << name << ": compute_batch differs from compute with algo "
+               << char(algo) << ", " << count << " tasks, at task " << i
+               << endl;
+          failed++;
+          break;
+        }
+      }
+    }
+  }
+  return failed;
+}
+
+int check_RGB_block() noexcept {
+  int failed = 0;
+  for (int color_count : {1, 15, 16, 61, 256}) {
+    std::array<Eigen::ArrayXf, 3> colors;
+    for (auto &ch : colors) {
+      ch = (Eigen::ArrayXf::Random(color_count) + 1) / 2;
+    }
+    for (size_t count : task_counts) {
+      std::vector<std::array<float, 3>> rgb2(count);
+      for (auto &c : rgb2) {
+        c = {float(mt() % 256) / 255, float(mt() % 256) / 255,
+             float(mt() % 256) / 255};
+      }
+      // columns are padded to keep them aligned, like in compute_batch
+      const int stride = (color_count + 15) / 16 * 16;
+      Eigen::ArrayXXf block(stride, count);
+      colordiff_RGB_block({colors[0].data(), size_t(color_count)},
+                          {colors[1].data(), size_t(color_count)},
+                          {colors[2].data(), size_t(color_count)}, rgb2,
+                          block.data(), stride);
+
+      Eigen::ArrayXf expected(color_count);
+      for (size_t j = 0; j < count; j++) {
+        colordiff_RGB_batch({colors[0].data(), size_t(color_count)},
+                            {colors[1].data(), size_t(color_count)},
+                            {colors[2].data(), size_t(color_count)},
+                            std::span<const float, 3>{rgb2[j]},
+                            {expected.data(), size_t(color_count)});
+        if ((block.col(j).head(color_count) != expected).any()) {
+          cout << "colordiff_RGB_block differs from colordiff_RGB_batch with "
+               << color_count << " colors, " << count << " tasks, at task "
+               << j << endl;
+          failed++;
+          break;
+        }
+      }
+    }
+  }
+  return failed;
+}
+
+int main() {
+  int failed = check_RGB_block();
+
+  {
+    using basic_t = colorset_new<true, true>;
+    using allowed_t = colorset_new<false, true>;
+    using tc_t = newTokiColor<true, basic_t, allowed_t>;
+    const std::vector<float> rgb = test_fixture::random_basic_rgb(mt);
+    const basic_t basic{rgb.data()};
+    std::array<bool, 256> allow;
+    for (size_t i = 0; i < allow.size(); i++) {
+      // leaves some base colors with a few depths, so side results vary
+      allow[i] = (i >= 4) && (i % 4 != 3) && (mt() % 10 < 7);
+    }
+    allowed_t allowed;
+    allowed.need_find_side = true;
+    if (!allowed.apply_allowed(basic, allow)) {
+      cout << "Failed to set maptical colorset." << endl;
+      return 1;
+    }
+    failed += check_compute_batch<tc_t>(allowed, "maptical");
+  }
+  {
+    using basic_t = colorset_new<true, false>;
+    using allowed_t = colorset_new<false, false>;
+    using tc_t = newTokiColor<false, basic_t, allowed_t>;
+    constexpr int color_count = 1003;
+    const Eigen::ArrayXXf rgb =
+        (Eigen::ArrayXXf::Random(color_count, 3) + 1) / 2;
+    basic_t basic;
+    if (!basic.set_colors(rgb.data(), color_count)) {
+      cout << "Failed to set optical colorset." << endl;
+      return 1;
+    }
+    std::vector<uint8_t> allow(color_count);
+    for (auto &val : allow) {
+      val = (mt() % 10 < 9);
+    }
+    allowed_t allowed;
+    if (!allowed.apply_allowed(basic,
+                               reinterpret_cast<const bool *>(allow.data()))) {
+      cout << "Failed to set optical colorset." << endl;
+      return 1;
+    }
+    failed += check_compute_batch<tc_t>(allowed, "optical");
+  }
+
+  if (failed > 0) {
+    cout << failed << " checks failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
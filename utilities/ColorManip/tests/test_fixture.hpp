@@ -0,0 +1,35 @@
+// Setup shared by tests that match colors: every algorithm, a fixed random
+// seed, and a random basic colorset of 256 colors.
+
+#ifndef COLORMANIP_TESTS_TEST_FIXTURE_HPP
+#define COLORMANIP_TESTS_TEST_FIXTURE_HPP
+
+#include <SC_GlobalEnums.h>
+
+#include <array>
+#include <random>
+#include <vector>
+
+namespace test_fixture {
+
+constexpr std::array<SCL_convertAlgo, 6> algos{
+    SCL_convertAlgo::RGB,   SCL_convertAlgo::RGB_Better,
+    SCL_convertAlgo::HSV,   SCL_convertAlgo::Lab94,
+    SCL_convertAlgo::Lab00, SCL_convertAlgo::XYZ};
+
+// A fixed seed, so that failures can be reproduced.
+inline std::mt19937 make_rng() noexcept { return std::mt19937{114514}; }
+
+// rgb_table of 256 colors, column major as colorset_new<true, true> takes it.
+inline std::vector<float> random_basic_rgb(std::mt19937 &mt) noexcept {
+  std::uniform_real_distribution<float> rand_f32{0, 1};
+  std::vector<float> rgb(256 * 3);
+  for (float &val : rgb) {
+    val = rand_f32(mt);
+  }
+  return rgb;
+}
+
+}  // namespace test_fixture
+
+#endif  // COLORMANIP_TESTS_TEST_FIXTURE_HPP
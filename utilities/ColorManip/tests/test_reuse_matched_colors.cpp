@@ -0,0 +1,101 @@
+// Converting after reuse_matched_colors must match converting from scratch
+// with the new allowed colors, including ties broken by color index.
+
+#include <imageConvert.hpp>
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "test_fixture.hpp"
+
+using std::cout, std::endl;
+using test_fixture::algos;
+
+using cvt_t = libImageCvt::ImageCvter<true>;
+
+constexpr int64_t rows = 300, cols = 200;
+
+bool near(float a, float b) noexcept {
+  return std::abs(a - b) <= 1e-5f * std::max(std::abs(a), std::abs(b));
+}
+
+int main() {
+  std::mt19937 mt = test_fixture::make_rng();
+  std::uniform_real_distribution<float> rand_f32{0, 1};
+
+  std::vector<float> rgb = test_fixture::random_basic_rgb(mt);
+  // colors of 128 to 191 duplicate those of 64 to 127, so they always tie
+  for (int ch = 0; ch < 3; ch++) {
+    for (int id = 128; id < 192; id++) {
+      rgb[ch * 256 + id] = rgb[ch * 256 + id - 64];
+    }
+  }
+  const cvt_t::basic_colorset_t basic{rgb.data()};
+
+  std::vector<ARGB> img(rows * cols);
+  for (auto &argb : img) {
+    argb = 0xFF000000U | (mt() & 0xFFFFFF);
+  }
+  img[5] = 0;
+
+  int failed = 0;
+  for (bool find_side : {false, true}) {
+    for (SCL_convertAlgo algo : algos) {
+      std::array<bool, 256> allow_old, allow_new;
+      for (size_t i = 0; i < 256; i++) {
+        allow_old[i] = rand_f32(mt) < 0.6f;
+        // toggles about 10% of colors
+        allow_new[i] = (rand_f32(mt) < 0.1f) ? !allow_old[i] : allow_old[i];
+      }
+      cvt_t::allowed_colorset_t old_allowed, new_allowed;
+      if (!old_allowed.apply_allowed(basic, allow_old) ||
+          !new_allowed.apply_allowed(basic, allow_new)) {
+        cout << "Failed to set allowed colors." << endl;
+        return 1;
+      }
+      old_allowed.need_find_side = find_side;
+      new_allowed.need_find_side = find_side;
+
+      cvt_t old_cvt{basic, old_allowed}, reused{basic, new_allowed},
+          fresh{basic, new_allowed};
+      for (cvt_t *cvt : {&old_cvt, &reused, &fresh}) {
+        cvt->set_raw_image(img.data(), rows, cols);
+      }
+      old_cvt.convert_image(algo, false);
+      reused.reuse_matched_colors(old_cvt);
+      reused.convert_image(algo, false);
+      fresh.convert_image(algo, false);
+
+      for (const auto &[cu, expected] : fresh.color_hash()) {
+        if (getA(cu.ARGB_) == 0) {
+          continue;
+        }
+        const auto &tc = reused.color_hash().at(cu);
+        bool ok = tc.Result == expected.Result &&
+                  near(tc.ResultDiff, expected.ResultDiff);
+        if (find_side) {
+          ok = ok && tc.sideResult == expected.sideResult &&
+               near(tc.sideSelectivity[0], expected.sideSelectivity[0]) &&
+               near(tc.sideSelectivity[1], expected.sideSelectivity[1]);
+        }
+        if (!ok) {
+          cout << "Reused result of " << std::hex << cu.ARGB_ << std::dec
+               << " differs from the fresh one with algo " << char(algo)
+               << ", find_side = " << find_side << endl;
+          failed++;
+          break;
+        }
+      }
+    }
+  }
+
+  if (failed > 0) {
+    cout << failed << " checks failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
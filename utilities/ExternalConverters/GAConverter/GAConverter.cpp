@@ -22,6 +22,7 @@ This file is part of SlopeCraft.
 
 #include "GAConverter.h"
 
+#include <algorithm>
 #include <mutex>
 
 using namespace GACvter;
@@ -50,6 +51,102 @@ inline ARGB mapColor2ARGB32(const mapColor_t mC) noexcept {
   return ARGB32(rgb(0), rgb(1), rgb(2), (mC < 4) ? 0 : 255);
 }
 
+// The edge map is 6 pixels smaller than the image after a 5x5 gaussian and a
+// 3x3 sobel filter, and each edge pixel depends on 7x7 pixels.
+constexpr int edge_padding = 6;
+
+/// Computes edge_diff of v in a rectangle of the edge map, the same as
+/// applyGaussian and applySobel do. gray and blurred are scratch buffers.
+void evaluate_edges(const Var_t &v, const CvterInfo &arg, int r0, int c0,
+                    int rows, int cols, GrayImage &gray,
+                    GrayImage &blurred) noexcept {
+  static const int gaussian_sum = Gaussian.sum();
+  const int64_t img_rows = arg.rawImageCache.rows();
+
+  gray.resize(rows + edge_padding, cols + edge_padding);
+  for (int c = 0; c < gray.cols(); c++) {
+    for (int r = 0; r < gray.rows(); r++) {
+      const int64_t idx = (c0 + c) * img_rows + (r0 + r);
+      gray(r, c) = arg.mapColor2Gray[arg.colorMap(idx).mapColor(v.order(idx))];
+    }
+  }
+
+  blurred.resize(rows + 2, cols + 2);
+  for (int c = 0; c < blurred.cols(); c++) {
+    for (int r = 0; r < blurred.rows(); r++) {
+      blurred(r, c) = (gray.block<5, 5>(r, c) * Gaussian).sum() / gaussian_sum;
+    }
+  }
+
+  for (int c = 0; c < cols; c++) {
+    for (int r = 0; r < rows; r++) {
+      const gray_t x = (SobelX * blurred.block<3, 3>(r, c)).sum();
+      const gray_t y = (SobelY * blurred.block<3, 3>(r, c)).sum();
+      const gray_t edge = gray_t(std::sqrt(x * x + y * y));
+      v.edge_diff(r0 + r, c0 + c) =
+          std::abs(edge - arg.edgeFeatureMap(r0 + r, c0 + c));
+    }
+  }
+}
+
+/// Brings edge_diff and edge_score of v up to date, by computing the dirty
+/// rectangles only.
+void update_edges(const Var_t &v, const CvterInfo &arg, GrayImage &gray,
+                  GrayImage &blurred) noexcept {
+  const int rows = arg.edgeFeatureMap.rows();
+  const int cols = arg.edgeFeatureMap.cols();
+  if (v.is_all_dirty || v.edge_diff.rows() != rows ||
+      v.edge_diff.cols() != cols) {
+    v.edge_diff.resize(rows, cols);
+    if (rows > 0 && cols > 0) {
+      evaluate_edges(v, arg, 0, 0, rows, cols, gray, blurred);
+    }
+    v.is_score_valid = false;
+  } else {
+    for (const auto &[r, c, h, w] : v.dirty) {
+      if (!v.is_score_valid) {
+        evaluate_edges(v, arg, r, c, h, w, gray, blurred);
+        continue;
+      }
+      v.edge_score -= v.edge_diff.block(r, c, h, w).cast<int64_t>().sum();
+      evaluate_edges(v, arg, r, c, h, w, gray, blurred);
+      v.edge_score += v.edge_diff.block(r, c, h, w).cast<int64_t>().sum();
+    }
+  }
+
+  if (!v.is_score_valid) {
+    v.edge_score = v.edge_diff.cast<int64_t>().sum();
+  }
+  v.dirty.clear();
+  v.is_all_dirty = false;
+  v.is_score_valid = true;
+}
+
+/// Marks edge pixels whose 7x7 neighborhood overlaps rows [r0, r1) and cols
+/// [c0, c1) of the image. If r0 == r1, those crossing the border between row
+/// r0 - 1 and r0 are marked, and the same for cols.
+void mark_dirty(Var_t &v, const CvterInfo &arg, int r0, int c0, int r1,
+                int c1) noexcept {
+  // computing everything is cheaper than too many small rectangles
+  constexpr size_t max_dirty_rects = 64;
+  if (v.is_all_dirty) {
+    return;
+  }
+  const int er0 = std::max(0, r0 - edge_padding);
+  const int ec0 = std::max(0, c0 - edge_padding);
+  const int er1 = std::min<int>(arg.edgeFeatureMap.rows(), r1);
+  const int ec1 = std::min<int>(arg.edgeFeatureMap.cols(), c1);
+  if (er0 >= er1 || ec0 >= ec1) {
+    return;
+  }
+  if (v.dirty.size() >= max_dirty_rects) {
+    v.dirty.clear();
+    v.is_all_dirty = true;
+    return;
+  }
+  v.dirty.push_back({er0, ec0, er1 - er0, ec1 - ec0});
+}
+
 }  // namespace GACvter
 
 GAConverter::GAConverter() { this->setTournamentSize(3); }
@@ -71,29 +168,34 @@ template <bool strong>
 void privateMutateFun(const Var_t *parent, Var_t *child,
                       const CvterInfo *arg) noexcept {
   constexpr float ratio = 0.01;
-  constexpr float Threshold = ratio * 2 - 1;
   *child = *parent;
+  const int64_t size = parent->order.size();
   if constexpr (strong  //&& false
   ) {                   //  strong mutation
-    static Eigen::ArrayXXf randMat(arg->rawImageCache.rows(),
-                                   arg->rawImageCache.cols());
-    randMat.setRandom();
-
-    for (int idx = 0; idx < arg->rawImageCache.size(); idx++) {
-      if (randMat(idx) <= Threshold) {
-        child->operator()(idx) =
-            mutateMap(parent->operator()(idx), heu::randIdx(OrderMax - 1));
+    // each pixel mutates by the probability of ratio, too many to update
+    // edges around each
+    for (int64_t idx = 0; idx < size; idx++) {
+      if (heu::randD() < ratio) {
+        child->order(idx) =
+            mutateMap(parent->order(idx), heu::randIdx(OrderMax - 1));
       }
     }
+    child->dirty.clear();
+    child->is_all_dirty = true;
   } else {  //  weak mutation
-    const int idx = heu::randIdx(parent->size());
-    child->operator()(idx) =
-        mutateMap(parent->operator()(idx), heu::randIdx(OrderMax - 1));
+    const int idx = heu::randIdx(size);
+    child->order(idx) =
+        mutateMap(parent->order(idx), heu::randIdx(OrderMax - 1));
+    const int r = idx % parent->order.rows();
+    const int c = idx / parent->order.rows();
+    mark_dirty(*child, *arg, r, c, r + 1, c + 1);
   }
 }
 
 void GACvter::iFun(Var_t *v, const CvterInfo *arg) noexcept {
-  v->setZero(arg->rawImageCache.rows(), arg->rawImageCache.cols());
+  v->order.setZero(arg->rawImageCache.rows(), arg->rawImageCache.cols());
+  v->dirty.clear();
+  v->is_all_dirty = true;
 
   if (heu::randD() < 1.0 / 3) {  //  generate by random
 
@@ -103,7 +205,7 @@ void GACvter::iFun(Var_t *v, const CvterInfo *arg) noexcept {
     }
 
     for (int64_t i = 0; i < arg->rawImageCache.size(); i++) {
-      v->operator()(i) = iniToolCpy[arg->rawImageCache(i)];
+      v->order(i) = iniToolCpy[arg->rawImageCache(i)];
     }
 
   } else {  //  generate by seed and mutation
@@ -122,16 +224,11 @@ void GACvter::iFun(Var_t *v, const CvterInfo *arg) noexcept {
 }
 
 void GACvter::fFun(const Var_t *v, const CvterInfo *arg, double *f) noexcept {
-  GrayImage gray(arg->rawImageCache.rows(), arg->rawImageCache.cols()), edged;
-  for (int64_t i = 0; i < arg->rawImageCache.size(); i++) {
-    gray(i) = arg->mapColor2Gray[arg->colorMap(i).mapColor(v->operator()(i))];
-  }
-
-  applyGaussian(gray, &edged, Gaussian);
-  applySobel(edged, &gray);
-  // applyGaussian(gray,&edged,Gaussian);
+  // individuals are evaluated in parallel
+  thread_local GrayImage gray, blurred;
+  update_edges(*v, *arg, gray, blurred);
 
-  double edgeScore = double((gray - arg->edgeFeatureMap).abs().sum());
+  double edgeScore = double(v->edge_score);
   edgeScore /= arg->rawImageCache.size();
   *f = std::log10(edgeScore);
 }
@@ -146,20 +243,47 @@ void GACvter::cFun(const Var_t *p1, const Var_t *p2, Var_t *c1, Var_t *c2,
   const Var_t *src[2] = {p1, p2};
   Var_t *dst[2] = {c1, c2};
 
+  const uint32_t edge_rows = arg->edgeFeatureMap.rows();
+  const uint32_t edge_cols = arg->edgeFeatureMap.cols();
+  const uint32_t eS_r = std::min(rS, edge_rows);
+  const uint32_t eS_c = std::min(cS, edge_cols);
+
   for (uint8_t i = 0; i < 2; i++) {
-    uint8_t srcIdx;
-    dst[i]->resize(rows, cols);
-    srcIdx = heu::randD() < 0.5;
-    dst[i]->block(0, 0, rS, cS) = src[srcIdx]->block(0, 0, rS, cS);
-    srcIdx = heu::randD() < 0.5;
-    dst[i]->block(rS, 0, rows - rS, cS) =
-        src[srcIdx]->block(rS, 0, rows - rS, cS);
-    srcIdx = heu::randD() < 0.5;
-    dst[i]->block(0, cS, rS, cols - cS) =
-        src[srcIdx]->block(0, cS, rS, cols - cS);
-    srcIdx = heu::randD() < 0.5;
-    dst[i]->block(rS, cS, rows - rS, cols - cS) =
-        src[srcIdx]->block(rS, cS, rows - rS, cols - cS);
+    // sources of the top left, bottom left, top right and bottom right
+    std::array<const Var_t *, 4> q;
+    for (auto &ptr : q) {
+      ptr = src[heu::randD() < 0.5];
+    }
+    Var_t &d = *dst[i];
+    d.order.resize(rows, cols);
+    d.order.block(0, 0, rS, cS) = q[0]->order.block(0, 0, rS, cS);
+    d.order.block(rS, 0, rows - rS, cS) =
+        q[1]->order.block(rS, 0, rows - rS, cS);
+    d.order.block(0, cS, rS, cols - cS) =
+        q[2]->order.block(0, cS, rS, cols - cS);
+    d.order.block(rS, cS, rows - rS, cols - cS) =
+        q[3]->order.block(rS, cS, rows - rS, cols - cS);
+
+    d.dirty.clear();
+    d.is_all_dirty = !std::ranges::all_of(
+        q, [](const Var_t *p) { return p->is_evaluated(); });
+    if (d.is_all_dirty) {
+      continue;
+    }
+    // Edges inside each quadrant are the same as its source, only those
+    // crossing borders are computed again.
+    d.edge_diff.resize(edge_rows, edge_cols);
+    d.edge_diff.block(0, 0, eS_r, eS_c) =
+        q[0]->edge_diff.block(0, 0, eS_r, eS_c);
+    d.edge_diff.block(eS_r, 0, edge_rows - eS_r, eS_c) =
+        q[1]->edge_diff.block(eS_r, 0, edge_rows - eS_r, eS_c);
+    d.edge_diff.block(0, eS_c, eS_r, edge_cols - eS_c) =
+        q[2]->edge_diff.block(0, eS_c, eS_r, edge_cols - eS_c);
+    d.edge_diff.block(eS_r, eS_c, edge_rows - eS_r, edge_cols - eS_c) =
+        q[3]->edge_diff.block(eS_r, eS_c, edge_rows - eS_r, edge_cols - eS_c);
+    d.is_score_valid = false;
+    mark_dirty(d, *arg, rS, 0, rS, cols);
+    mark_dirty(d, *arg, 0, cS, rows, cS);
   }
 }
 
@@ -217,40 +341,48 @@ void GACvter::GAConverter::setSeeds(
   const int Rows = this->_args.rawImageCache.rows(),
             Cols = this->_args.rawImageCache.cols();
   for (size_t idx = 0; idx < mapColorMats.size(); idx++) {
-    this->_args.seeds[idx].setZero(Rows, Cols);
+    this->_args.seeds[idx].order.setZero(Rows, Cols);
     // convert mapColor_t to order_t
 
     for (int64_t pixIdx = 0; pixIdx < Rows * Cols; pixIdx++) {
-      this->_args.seeds[idx](pixIdx) = 0;
+      this->_args.seeds[idx].order(pixIdx) = 0;
 
       for (order_t o = 0; o < OrderMax; o++) {
         //  go through the 4 colors to find if there is a color same as that in
         //  seed.
         if (mapColorMats[idx]->operator()(pixIdx) ==
             this->_args.colorMap(pixIdx).mapColor(o)) {
-          this->_args.seeds[idx](pixIdx) = o;
+          this->_args.seeds[idx].order(pixIdx) = o;
           break;
         }
       }
     }
   }
+
+  // offsprings of seeds inherit their edges
+#pragma omp parallel for schedule(dynamic)
+  for (int idx = 0; idx < int(this->_args.seeds.size()); idx++) {
+    GrayImage gray, blurred;
+    update_edges(this->_args.seeds[idx], this->_args, gray, blurred);
+  }
 }
 
-void GACvter::GAConverter::run() {
+bool GACvter::GAConverter::run() {
   this->_args.prevClock = std::clock();
   this->_args.strongMutation = true;
 
   this->initializePop();
 
   this->template __impl_run<GACvter::GAConverter>();
+  return !this->_args.ui.is_cancelled();
 }
 
 void GACvter::GAConverter::resultImage(EImage *dst) {
   const Var_t &res = this->result();
-  dst->resize(res.rows(), res.cols());
+  dst->resize(res.order.rows(), res.order.cols());
 
-  for (int64_t pixIdx = 0; pixIdx < res.size(); pixIdx++) {
-    const order_t o = res(pixIdx);
+  for (int64_t pixIdx = 0; pixIdx < res.order.size(); pixIdx++) {
+    const order_t o = res.order(pixIdx);
     const mapColor_t mC = this->_args.colorMap(pixIdx).mapColor(o);
     const ARGB pixColor = mapColor2ARGB32(mC);
     dst->operator()(pixIdx) = pixColor;
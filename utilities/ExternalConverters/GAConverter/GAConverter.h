@@ -73,7 +73,8 @@ class GAConverter
   using Base_t::option;
   using Base_t::setOption;
 
-  void run();
+  /// Returns false if cancelled by the ui pack.
+  bool run();
 
   void resultImage(EImage *);
 
@@ -106,6 +107,12 @@ class GAConverter
         this->_args.prevClock = curT;
       }
     }
+    // the run ends after this generation
+    if (args().ui.is_cancelled()) {
+      heu::GAOption opt = option();
+      opt.maxGenerations = 0;
+      this->setOption(opt);
+    }
   }
 };
 
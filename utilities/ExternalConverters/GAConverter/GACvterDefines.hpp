@@ -27,7 +27,9 @@ This file is part of SlopeCraft.
 #define _USE_MATH_DEFINES
 #endif
 
+#include <array>
 #include <complex>
+#include <vector>
 #include <Eigen/Dense>
 #include <HeuristicFlow/Genetic>
 #include <HeuristicFlow/Global>
@@ -55,7 +57,25 @@ using mapColorSrc_t = MapList;
 using mapColor2Gray_LUT_t = std::array<gray_t, 256>;
 using mapColor2ARGB_LUT_t = std::array<ARGB, 256>;
 
-using Var_t = Eigen::ArrayXX<order_t>;
+/// Orders of colors of each pixel, with the edge diffs they were evaluated
+/// with. Offsprings inherit them, so fitness is computed again only where
+/// orders changed.
+struct Var_t {
+  Eigen::ArrayXX<order_t> order;
+  // |edge - edgeFeatureMap| of each pixel in the edge map
+  mutable Eigen::ArrayXX<uint16_t> edge_diff;
+  // Rectangles (row, col, rows, cols) of the edge map changed since edge_diff
+  // was computed
+  mutable std::vector<std::array<int, 4>> dirty;
+  // sum of edge_diff
+  mutable int64_t edge_score{0};
+  mutable bool is_score_valid{false};
+  mutable bool is_all_dirty{true};
+
+  inline bool is_evaluated() const noexcept {
+    return !this->is_all_dirty && this->dirty.empty() && this->is_score_valid;
+  }
+};
 
 const Eigen::Array33i SobelX = {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}};
 const Eigen::Array33i SobelY = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
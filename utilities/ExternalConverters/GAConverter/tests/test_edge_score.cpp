@@ -0,0 +1,125 @@
+// Fitness of offsprings is computed only where their orders changed. After any
+// mutations and crossovers, edge_score must equal a full computation with
+// applyGaussian and applySobel.
+
+#include <ColorManip/tests/test_fixture.hpp>
+#include <ExternalConverters/GAConverter/GAConverter.h>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout, std::endl;
+using namespace GACvter;
+
+std::vector<float> basic_rgb;
+
+Eigen::Map<const Eigen::ArrayXf> SlopeCraft::BasicRGB4External(int channel) {
+  return {basic_rgb.data() + 256 * channel, 256};
+}
+int SlopeCraft::colorCount4External() { return 256; }
+
+int64_t full_edge_score(const Var_t &v, const CvterInfo &arg) noexcept {
+  GrayImage gray(arg.rawImageCache.rows(), arg.rawImageCache.cols()), blurred,
+      edge;
+  for (int64_t i = 0; i < gray.size(); i++) {
+    gray(i) = arg.mapColor2Gray[arg.colorMap(i).mapColor(v.order(i))];
+  }
+  applyGaussian(gray, &blurred, Gaussian);
+  applySobel(blurred, &edge);
+  return (edge - arg.edgeFeatureMap).abs().cast<int64_t>().sum();
+}
+
+int main() {
+  std::mt19937 mt = test_fixture::make_rng();
+  std::uniform_real_distribution<float> rand_f32{0, 1};
+  basic_rgb = test_fixture::random_basic_rgb(mt);
+  const colorset_new<true, true> basic{basic_rgb.data()};
+  std::array<bool, 256> allow;
+  for (bool &a : allow) {
+    a = rand_f32(mt) < 0.6f;
+  }
+  colorset_allowed_t allowed;
+  if (!allowed.apply_allowed(basic, allow)) {
+    cout << "Failed to set allowed colors." << endl;
+    return 1;
+  }
+
+  // not multiples of anything, and the edge map is 6 pixels smaller
+  constexpr int rows = 61, cols = 47;
+  CvterInfo arg;
+  arg.allowed_colorset = &allowed;
+  arg.rawImageCache.resize(rows, cols);
+  for (auto &argb : arg.rawImageCache.reshaped()) {
+    argb = 0xFF000000U | (mt() & 0xFFFFFF);
+  }
+  {
+    GrayImage gray, blurred;
+    EImg2GrayImg<0, 0>(arg.rawImageCache, &gray);
+    applyGaussian(gray, &blurred, Gaussian);
+    applySobel(blurred, &arg.edgeFeatureMap);
+  }
+  arg.colorMap.resize(rows, cols);
+  for (int64_t i = 0; i < arg.rawImageCache.size(); i++) {
+    arg.colorMap(i).calculate(arg.rawImageCache(i), allowed);
+    arg.iniTool[arg.rawImageCache(i)] = 0;
+  }
+  arg.mapColor2Gray = updateMapColor2GrayLUT();
+  arg.seeds.resize(1);
+  arg.seeds[0].order.resize(rows, cols);
+  for (auto &o : arg.seeds[0].order.reshaped()) {
+    o = mt() % OrderMax;
+  }
+
+  int checks = 0, failed = 0;
+  auto check = [&](const Var_t &v) {
+    double f;
+    fFun(&v, &arg, &f);
+    checks++;
+    const int64_t expected = full_edge_score(v, arg);
+    if (v.edge_score != expected) {
+      cout << "edge_score is " << v.edge_score << " but " << expected
+           << " is expected, at check " << checks << endl;
+      failed++;
+    }
+  };
+
+  std::vector<Var_t> pool(8);
+  for (auto &v : pool) {
+    iFun(&v, &arg);
+    check(v);
+  }
+  for (int it = 0; it < 3000; it++) {
+    const Var_t &p1 = pool[mt() % pool.size()];
+    const Var_t &p2 = pool[mt() % pool.size()];
+    Var_t child, child2;
+    switch (mt() % 4) {
+      case 0:
+        arg.strongMutation = false;
+        mFun(&p1, &child, &arg);
+        break;
+      case 1:
+        arg.strongMutation = true;
+        mFun(&p1, &child, &arg);
+        break;
+      default:
+        cFun(&p1, &p2, &child, &child2, &arg);
+        break;
+    }
+    // some offsprings are changed again before they are evaluated
+    if (mt() % 3 != 0) {
+      check(child);
+    }
+    pool[mt() % pool.size()] = std::move(child);
+  }
+  for (const auto &v : pool) {
+    check(v);
+  }
+
+  if (failed > 0) {
+    cout << failed << " of " << checks << " checks failed." << endl;
+    return 1;
+  }
+  cout << "Pass." << endl;
+  return 0;
+}
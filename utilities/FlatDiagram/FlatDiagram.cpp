@@ -24,14 +24,15 @@ void libFlatDiagram::ARGB_to_AGBR(uint32_t *ptr, size_t num_pixels) noexcept {
 void libFlatDiagram::draw_flat_diagram_to_memory(
     Eigen::Map<EImgRowMajor_t> buffer, const fd_option &opt,
     const get_blk_image_callback_t &blk_image_at) {
-  assert(buffer.cols() == opt.cols * 16);
-  assert(buffer.rows() >= (opt.row_end - opt.row_start) * 16);
+  const int res = opt.block_resolution;
+  assert(buffer.cols() == opt.cols * res);
+  assert(buffer.rows() >= (opt.row_end - opt.row_start) * res);
 
   // copy block images
   for (int64_t r = opt.row_start; r < opt.row_end; r++) {
-    const int r_pixel_beg = (r - opt.row_start) * 16;
+    const int r_pixel_beg = (r - opt.row_start) * res;
     for (int64_t c = 0; c < opt.cols; c++) {
-      const int c_pixel_beg = c * 16;
+      const int c_pixel_beg = c * res;
       /*
       const bool is_src_aligned =
           (reinterpret_cast<size_t>(
@@ -40,14 +41,16 @@ void libFlatDiagram::draw_flat_diagram_to_memory(
       const bool is_aligned = is_dst_aligned && is_src_aligned;
       */
 
-      buffer.block<16, 16>(r_pixel_beg, c_pixel_beg) = blk_image_at(r, c);
+      const block_img_ref_t img = blk_image_at(r, c);
+      assert(img.rows() == res && img.cols() == res);
+      buffer.block(r_pixel_beg, c_pixel_beg, res, res) = img;
     }
   }
 
   for (int64_t br = opt.row_start; br < opt.row_end; br++) {
     if ((opt.split_line_row_margin > 0) &&
         (br % opt.split_line_row_margin == 0)) {
-      const int64_t pr = (br - opt.row_start) * 16;
+      const int64_t pr = (br - opt.row_start) * res;
 
       reverse_color(&buffer(pr, 0), buffer.cols());
     }
@@ -56,7 +59,7 @@ void libFlatDiagram::draw_flat_diagram_to_memory(
   for (int64_t bc = 0; bc < opt.cols; bc++) {
     if ((opt.split_line_col_margin > 0) &&
         (bc % opt.split_line_col_margin == 0)) {
-      const int64_t pc = bc * 16;
+      const int64_t pc = bc * res;
 
       for (int64_t pr = 0; pr < buffer.rows(); pr++) {
         buffer(pr, pc) = reverse_color(buffer(pr, pc));
@@ -71,7 +74,8 @@ std::string libFlatDiagram::export_flat_diagram(
     std::span<std::pair<std::string, std::string>> texts) noexcept {
   const int64_t rows_capacity_by_blocks = 16;
 
-  EImgRowMajor_t buffer(rows_capacity_by_blocks * 16, opt.cols * 16);
+  const int res = opt.block_resolution;
+  EImgRowMajor_t buffer(rows_capacity_by_blocks * res, opt.cols * res);
 
   FILE *fp = fopen(png_filename.data(), "wb");
 
@@ -104,9 +108,10 @@ std::string libFlatDiagram::export_flat_diagram(
 
   // png_set_text_compression_level(png, 8);
 
-  png_set_IHDR(png, png_info, opt.cols * 16, 16 * (opt.row_end - opt.row_start),
-               8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
-               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_set_IHDR(png, png_info, opt.cols * res,
+               res * (opt.row_end - opt.row_start), 8, PNG_COLOR_TYPE_RGB_ALPHA,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
   png_write_info(png, png_info);
 
   {
@@ -137,9 +142,9 @@ std::string libFlatDiagram::export_flat_diagram(
       draw_flat_diagram_to_memory({buffer.data(), buffer.rows(), buffer.cols()},
                                   opt_temp, blk_image_at);
 
-      ARGB_to_AGBR(buffer.data(), rows_this_time * 16 * opt.cols * 16);
+      ARGB_to_AGBR(buffer.data(), rows_this_time * res * opt.cols * res);
 
-      for (int64_t pix_r = 0; pix_r < rows_this_time * 16; pix_r++) {
+      for (int64_t pix_r = 0; pix_r < rows_this_time * res; pix_r++) {
         png_write_row(png,
                       reinterpret_cast<const uint8_t *>(&buffer(pix_r, 0)));
       }
@@ -40,10 +40,12 @@ struct fd_option {
   int32_t split_line_col_margin;  // 0 or negative number means no split lines
   int png_compress_level{9};
   int png_compress_memory_level{8};
+  // size of each block in pixels. Block images must be of this size.
+  int32_t block_resolution{16};
 };
 
-using block_img_ref_t =
-    Eigen::Map<const Eigen::Array<uint32_t, 16, 16, Eigen::RowMajor>>;
+using block_img_ref_t = Eigen::Map<const Eigen::Array<
+    uint32_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>;
 
 constexpr size_t ret_size = sizeof(block_img_ref_t);
 
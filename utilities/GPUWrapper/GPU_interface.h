@@ -37,6 +37,17 @@ static constexpr bool have_api = true;
 static constexpr bool have_api = false;
 #endif  // #ifdef SLOPECRAFT_GPU_API
 
+// Without a gpu api, colors can be matched in batches by CPU threads through
+// gpu_interface. It's not a gpu, so have_api is false.
+#ifdef SLOPECRAFT_GPU_CPU_BACKEND
+static constexpr bool is_cpu_backend = true;
+#else
+static constexpr bool is_cpu_backend = false;
+#endif  // #ifdef SLOPECRAFT_GPU_CPU_BACKEND
+
+// Whether gpu_interface can be created
+static constexpr bool have_backend = have_api || is_cpu_backend;
+
 const char *api_name() noexcept;
 
 size_t platform_num() noexcept;
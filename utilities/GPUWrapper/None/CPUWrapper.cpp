@@ -0,0 +1,369 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "CPUWrapper.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numbers>
+#include <span>
+#include <fmt/format.h>
+#include <omp.h>
+
+namespace {
+
+constexpr float pi_fp32 = std::numbers::pi_v<float>;
+
+inline float square(float v) noexcept { return v * v; }
+inline float radians(float deg) noexcept { return deg * (pi_fp32 / 180.0f); }
+
+// Functions below compute the same as color_diff_* in ColorDiff.cl. The first
+// color is from colorset, and the second is the unconverted one.
+
+#pragma omp declare simd
+float diff_RGB_XYZ(float r1, float g1, float b1, float r2, float g2,
+                   float b2) noexcept {
+  return square(r1 - r2) + square(g1 - g2) + square(b1 - b2);
+}
+
+#pragma omp declare simd
+float diff_RGB_Better(float r1, float g1, float b1, float r2, float g2,
+                      float b2) noexcept {
+  constexpr float w_r = 1.0f, w_g = 2.0f, w_b = 1.0f;
+  constexpr float thre = 1e-4f;
+
+  const float SqrModSquare =
+      (r1 * r1 + g1 * g1 + b1 * b1) * (r2 * r2 + g2 * g2 + b2 * b2);
+
+  const float dr = r1 - r2, dg = g1 - g2, db = b1 - b2;
+
+  const float SigmaRGB = (r1 + g1 + b1 + r2 + g2 + b2) / 3.0f;
+  const float S_r = std::min((r1 + r2) / (SigmaRGB + thre), 1.0f);
+  const float S_g = std::min((g1 + g2) / (SigmaRGB + thre), 1.0f);
+  const float S_b = std::min((b1 + b2) / (SigmaRGB + thre), 1.0f);
+
+  const float sumRGBSquare = r1 * r2 + g1 * g2 + b1 * b2;
+
+  const float theta =
+      2.0f / pi_fp32 *
+      std::acos(sumRGBSquare / std::sqrt(SqrModSquare + thre) / 1.01f);
+
+  const float OnedDelta_r = std::abs(dr) / (r1 + r2 + thre);
+  const float OnedDelta_g = std::abs(dg) / (g1 + g2 + thre);
+  const float OnedDelta_b = std::abs(db) / (b1 + b2 + thre);
+
+  const float sumOnedDelta = OnedDelta_r + OnedDelta_g + OnedDelta_b + thre;
+
+  const float S_theta = (OnedDelta_r * S_r * S_r + OnedDelta_g * S_g * S_g +
+                         OnedDelta_b * S_b * S_b) /
+                        sumOnedDelta;
+
+  const float S_ratio =
+      std::max({std::max(r1, r2), std::max(g1, g2), std::max(b1, b2)});
+
+  const float part1 = (S_r * S_r * dr * dr * w_r + S_g * S_g * dg * dg * w_g +
+                       S_b * S_b * db * db * w_b) /
+                      (w_r + w_g + w_b);
+
+  const float part2 = S_theta * S_ratio * theta * theta;
+
+  return part1 + part2;
+}
+
+// color_diff_HSV is the squared distance of hsv colors mapped into a cone, so
+// colors are mapped once by this function and compared with diff_RGB_XYZ.
+std::array<float, 3> hsv_to_cone(float h, float s, float v) noexcept {
+  const float sv = s * v;
+  return {50.0f * std::cos(h) * sv, 50.0f * std::sin(h) * sv, 50.0f * v};
+}
+
+#pragma omp declare simd
+float diff_Lab94(float L1, float a1, float b1, float L2, float a2,
+                 float b2) noexcept {
+  const float deltaL_2 = square(L1 - L2);
+  const float C1 = std::sqrt(a1 * a1 + b1 * b1);
+  const float C2 = std::sqrt(a2 * a2 + b2 * b2);
+
+  const float deltaCab_2 = square(C1 - C2);
+  const float deltaHab_2 = square(a2 - a1) + square(b2 - b1) - deltaCab_2;
+
+  const float SC_2 = square(C1 * 0.045f + 1.0f);
+  const float SH_2 = square(C2 * 0.015f + 1.0f);
+
+  return deltaL_2 + deltaCab_2 / SC_2 + deltaHab_2 / SH_2;
+}
+
+#pragma omp declare simd
+float diff_Lab00(float L1, float a1, float b1, float L2, float a2,
+                 float b2) noexcept {
+  constexpr float kL = 1.0f;
+  constexpr float kC = 1.0f;
+  constexpr float kH = 1.0f;
+  // pow(25,7)
+  constexpr float pow_25_7 = 6103515625.0f;
+
+  const float C1sab = std::sqrt(a1 * a1 + b1 * b1);
+  const float C2sab = std::sqrt(a2 * a2 + b2 * b2);
+  const float mCsab = (C1sab + C2sab) / 2;
+  const float pow_mCsab_7 = std::pow(mCsab, 7.0f);
+  const float G =
+      0.5f * (1 - std::sqrt(pow_mCsab_7 / (pow_mCsab_7 + pow_25_7)));
+  const float a1p = (1 + G) * a1;
+  const float a2p = (1 + G) * a2;
+  const float C1p = std::sqrt(a1p * a1p + b1 * b1);
+  const float C2p = std::sqrt(a2p * a2p + b2 * b2);
+
+  float h1p = (b1 == 0 && a1p == 0) ? 0 : std::atan2(b1, a1p);
+  if (h1p < 0) h1p += 2 * pi_fp32;
+  float h2p = (b2 == 0 && a2p == 0) ? 0 : std::atan2(b2, a2p);
+  if (h2p < 0) h2p += 2 * pi_fp32;
+
+  const float dLp = L2 - L1;
+  const float dCp = C2p - C1p;
+  float dhp;
+  if (C1p * C2p == 0) {
+    dhp = 0;
+  } else if (std::abs(h2p - h1p) <= radians(180.0f)) {
+    dhp = h2p - h1p;
+  } else if (h2p - h1p > radians(180.0f)) {
+    dhp = h2p - h1p - radians(360.0f);
+  } else {
+    dhp = h2p - h1p + radians(360.0f);
+  }
+
+  const float dHp = 2 * std::sqrt(C1p * C2p) * std::sin(dhp / 2.0f);
+
+  const float mLp = (L1 + L2) / 2;
+  const float mCp = (C1p + C2p) / 2;
+  float mhp;
+  if (C1p * C2p == 0) {
+    mhp = h1p + h2p;
+  } else if (std::abs(h2p - h1p) <= radians(180.0f)) {
+    mhp = (h1p + h2p) / 2;
+  } else if (h1p + h2p < radians(360.0f)) {
+    mhp = (h1p + h2p + radians(360.0f)) / 2;
+  } else {
+    mhp = (h1p + h2p - radians(360.0f)) / 2;
+  }
+
+  const float T = 1 - 0.17f * std::cos(mhp - radians(30.0f)) +
+                  0.24f * std::cos(2 * mhp) +
+                  0.32f * std::cos(3 * mhp + radians(6.0f)) -
+                  0.20f * std::cos(4 * mhp - radians(63.0f));
+
+  const float dTheta =
+      radians(30.0f) *
+      std::exp(-square((mhp - radians(275.0f)) / radians(25.0f)));
+
+  const float pow_mCp_7 = std::pow(mCp, 7.0f);
+  const float RC = 2 * std::sqrt(pow_mCp_7 / (pow_25_7 + pow_mCp_7));
+  const float square_mLp_minus_50 = square(mLp - 50);
+  const float SL =
+      1 + 0.015f * square_mLp_minus_50 / std::sqrt(20 + square_mLp_minus_50);
+
+  const float SC = 1 + 0.045f * mCp;
+  const float SH = 1 + 0.015f * mCp * T;
+
+  const float RT = -RC * std::sin(2 * dTheta);
+
+  return square(dLp / SL / kL) + square(dCp / SC / kC) +
+         square(dHp / SH / kH) + RT * (dCp / SC / kC) * (dHp / SH / kH);
+}
+
+using cpu_wrapper::cpu_resource;
+using diff_fun_t = float (*)(float, float, float, float, float,
+                             float) noexcept;
+
+// Each thread matches a tile of tasks against a tile of colors at a time, so
+// the colors stay in cache while they are compared with all tasks of the tile.
+template <diff_fun_t diff_fun>
+void match_tiles(const cpu_resource::colorset_rcs &colorset,
+                 std::span<const std::array<float, 3>> tasks,
+                 uint16_t *result_idx, float *result_diff,
+                 int num_threads) noexcept {
+  constexpr size_t task_tile_size = cpu_resource::task_tile_size;
+  constexpr size_t color_tile_size = cpu_resource::color_tile_size;
+  const float *const ch0 = colorset.channels[0].data();
+  const float *const ch1 = colorset.channels[1].data();
+  const float *const ch2 = colorset.channels[2].data();
+  const size_t color_num = colorset.color_num;
+
+  const int64_t num_tiles =
+      int64_t(tasks.size() + task_tile_size - 1) / task_tile_size;
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+  for (int64_t tile = 0; tile < num_tiles; tile++) {
+    const size_t t_begin = tile * task_tile_size;
+    const size_t t_end = std::min(tasks.size(), t_begin + task_tile_size);
+    std::array<float, color_tile_size> diffs;
+
+    for (size_t t = t_begin; t < t_end; t++) {
+      result_idx[t] = UINT16_MAX - 1;
+      result_diff[t] = FLT_MAX / 2;
+    }
+
+    for (size_t c_begin = 0; c_begin < color_num; c_begin += color_tile_size) {
+      const size_t c_num = std::min(color_tile_size, color_num - c_begin);
+      const float *const x = ch0 + c_begin;
+      const float *const y = ch1 + c_begin;
+      const float *const z = ch2 + c_begin;
+
+      for (size_t t = t_begin; t < t_end; t++) {
+        const float u0 = tasks[t][0], u1 = tasks[t][1], u2 = tasks[t][2];
+#pragma omp simd
+        for (size_t c = 0; c < c_num; c++) {
+          diffs[c] = diff_fun(x[c], y[c], z[c], u0, u1, u2);
+        }
+        // take the first minimum like ColorDiff.cl
+        uint16_t idx = result_idx[t];
+        float diff = result_diff[t];
+        for (size_t c = 0; c < c_num; c++) {
+          if (diff > diffs[c]) {
+            idx = uint16_t(c_begin + c);
+            diff = diffs[c];
+          }
+        }
+        result_idx[t] = idx;
+        result_diff[t] = diff;
+      }
+    }
+  }
+}
+
+using match_fun_t = void (*)(const cpu_resource::colorset_rcs &,
+                             std::span<const std::array<float, 3>>,
+                             uint16_t *, float *, int) noexcept;
+
+}  // namespace
+
+void cpu_wrapper::cpu_resource::set_colorset(
+    size_t color_num, const std::array<const float *, 3> &color_ptrs) noexcept {
+  this->wait();
+  // the same limit as ushort in ColorDiff.cl
+  if (color_num >= UINT16_MAX) {
+    this->error = 1;
+    this->err_msg = fmt::format(
+        "Too many colors in colorset : {}, at most {} colors are supported.",
+        color_num, UINT16_MAX - 1);
+    return;
+  }
+  this->error = 0;
+  this->err_msg.clear();
+
+  for (size_t ch = 0; ch < 3; ch++) {
+    this->colorset.channels[ch].assign(color_ptrs[ch],
+                                       color_ptrs[ch] + color_num);
+  }
+  this->colorset.color_num = color_num;
+}
+
+void cpu_wrapper::cpu_resource::set_task(
+    size_t task_num, const std::array<float, 3> *data) noexcept {
+  this->wait();
+  this->task.colors.assign(data, data + task_num);
+  this->task.result_idx.assign(task_num, UINT16_MAX);
+  this->task.result_diff.assign(task_num, NAN);
+}
+
+void cpu_wrapper::cpu_resource::execute(::SCL_convertAlgo algo,
+                                        bool wait) noexcept {
+  this->wait();
+
+  match_fun_t match{nullptr};
+  switch (algo) {
+    case SCL_convertAlgo::RGB:
+    case SCL_convertAlgo::XYZ:
+    case SCL_convertAlgo::HSV:
+      match = match_tiles<diff_RGB_XYZ>;
+      break;
+    case SCL_convertAlgo::RGB_Better:
+      match = match_tiles<diff_RGB_Better>;
+      break;
+    case SCL_convertAlgo::Lab94:
+      match = match_tiles<diff_Lab94>;
+      break;
+    case SCL_convertAlgo::Lab00:
+      match = match_tiles<diff_Lab00>;
+      break;
+    default:
+      this->error = 2;
+      this->err_msg =
+          fmt::format("Unsupported convert algorithm : {}", char(algo));
+      return;
+  }
+  this->error = 0;
+  this->err_msg.clear();
+
+  // The job may run in another thread, where omp_set_num_threads of the
+  // caller doesn't apply.
+  const int num_threads = omp_get_max_threads();
+  auto job = [this, algo, match, num_threads]() {
+    uint16_t *const idx = this->task.result_idx.data();
+    float *const diff = this->task.result_diff.data();
+    if (algo != SCL_convertAlgo::HSV) {
+      match(this->colorset, this->task.colors, idx, diff, num_threads);
+      return;
+    }
+
+    colorset_rcs cone_colorset;
+    cone_colorset.color_num = this->colorset.color_num;
+    for (auto &ch : cone_colorset.channels) {
+      ch.resize(this->colorset.color_num);
+    }
+    for (size_t c = 0; c < this->colorset.color_num; c++) {
+      const auto cone = hsv_to_cone(this->colorset.channels[0][c],
+                                    this->colorset.channels[1][c],
+                                    this->colorset.channels[2][c]);
+      for (size_t ch = 0; ch < 3; ch++) {
+        cone_colorset.channels[ch][c] = cone[ch];
+      }
+    }
+
+    std::vector<std::array<float, 3>> cone_tasks(this->task_count());
+#pragma omp parallel for num_threads(num_threads)
+    for (int64_t t = 0; t < int64_t(cone_tasks.size()); t++) {
+      const auto &hsv = this->task.colors[t];
+      cone_tasks[t] = hsv_to_cone(hsv[0], hsv[1], hsv[2]);
+    }
+    match(cone_colorset, cone_tasks, idx, diff, num_threads);
+  };
+
+  if (wait) {
+    job();
+    return;
+  }
+  // errors are only set above, so ok_v is safe to call while matching
+  try {
+    this->running = std::async(std::launch::async, job);
+  } catch (const std::exception &) {
+    // no thread available, match in this thread
+    job();
+  }
+}
+
+void cpu_wrapper::cpu_resource::wait() noexcept {
+  if (this->running.valid()) {
+    this->running.get();
+  }
+}
+
+cpu_wrapper::cpu_device::cpu_device()
+    : name{fmt::format("CPU ({} threads)", omp_get_num_procs())} {}
@@ -0,0 +1,157 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#ifndef SLOPECRAFT_UTILITIES_GPUWRAPPER_CPUWRAPPER_H
+#define SLOPECRAFT_UTILITIES_GPUWRAPPER_CPUWRAPPER_H
+
+#include "../GPU_interface.h"
+#include <array>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace cpu_wrapper {
+
+// Matches colors on CPU threads, computing the same color differences as
+// ColorDiff.cl. Tasks and colors are matched in tiles that fit in cache.
+class cpu_resource : public ::gpu_wrapper::gpu_interface {
+ public:
+  struct colorset_rcs {
+    // structure of arrays, so that each channel can be loaded as a vector
+    std::array<std::vector<float>, 3> channels;
+    size_t color_num{0};
+  };
+
+  struct task_rcs {
+    std::vector<std::array<float, 3>> colors;
+    std::vector<uint16_t> result_idx;
+    std::vector<float> result_diff;
+  };
+
+  // Tasks matched together share the colors loaded into cache.
+  static constexpr size_t task_tile_size = 64;
+  // 3 channels of 1024 colors take 12KB, fitting in L1 cache with the diffs.
+  static constexpr size_t color_tile_size = 1024;
+
+ private:
+  int error{0};
+  std::string err_msg{""};
+
+  task_rcs task;
+  colorset_rcs colorset;
+  // matching started by execute and not waited yet
+  std::future<void> running;
+
+ public:
+  inline int error_code() const noexcept { return this->error; }
+  inline bool ok() const noexcept { return this->error == 0; }
+
+  inline const std::string &error_detail() const noexcept {
+    return this->err_msg;
+  }
+
+  void set_colorset(size_t color_num,
+                    const std::array<const float *, 3> &color_ptrs) noexcept;
+
+  void set_task(size_t task_num, const std::array<float, 3> *data) noexcept;
+
+  ~cpu_resource() { this->wait(); }
+
+  // Like a gpu, tasks are matched in another thread unless wait is true.
+  void execute(::SCL_convertAlgo algo, bool wait) noexcept;
+
+  void wait() noexcept;
+
+  inline size_t task_count() const noexcept { return this->task.colors.size(); }
+
+  inline const auto &result_idx() const noexcept {
+    return this->task.result_idx;
+  }
+
+  inline const auto &result_diff() const noexcept {
+    return this->task.result_diff;
+  }
+
+ public:
+  // overrided functions
+
+  const char *api_v() const noexcept override { return "CPU"; }
+
+  int error_code_v() const noexcept override { return this->error_code(); }
+  bool ok_v() const noexcept override { return this->ok(); }
+
+  std::string error_detail_v() const noexcept override {
+    return this->error_detail();
+  }
+
+  void set_colorset_v(
+      size_t color_num,
+      const std::array<const float *, 3> &color_ptrs) noexcept override {
+    this->set_colorset(color_num, color_ptrs);
+  }
+
+  void set_task_v(size_t task_num,
+                  const std::array<float, 3> *data) noexcept override {
+    this->set_task(task_num, data);
+  }
+
+  void execute_v(::SCL_convertAlgo algo, bool wait) noexcept override {
+    this->execute(algo, wait);
+  }
+
+  void wait_v() noexcept override { this->wait(); }
+
+  size_t task_count_v() const noexcept override { return this->task_count(); }
+
+  std::string device_vendor_v() const noexcept override { return "CPU"; }
+
+  const uint16_t *result_idx_v() const noexcept override {
+    return this->result_idx().data();
+  }
+
+  const float *result_diff_v() const noexcept override {
+    return this->result_diff().data();
+  }
+
+  // Any task count is fine for CPU, no remainder has to be matched by caller.
+  size_t local_work_group_size_v() const noexcept override { return 1; }
+};
+
+// The only platform, with the only device.
+class cpu_platform : public ::gpu_wrapper::platform_wrapper {
+ public:
+  const char *name_v() const noexcept override { return "CPU"; }
+  size_t num_devices_v() const noexcept override { return 1; }
+};
+
+class cpu_device : public ::gpu_wrapper::device_wrapper {
+ public:
+  cpu_device();
+
+  std::string name;
+
+  const char *name_v() const noexcept override { return this->name.c_str(); }
+};
+
+}  // namespace cpu_wrapper
+
+#endif  // SLOPECRAFT_UTILITIES_GPUWRAPPER_CPUWRAPPER_H
@@ -1,38 +1,57 @@
 #include "../GPU_interface.h"
-#include <climits>
+#include "CPUWrapper.h"
+
+// Without any GPU api, colors are matched by the CPU as the only device.
 
 const char *gpu_wrapper::api_name() noexcept { return "None"; }
 
-size_t gpu_wrapper::platform_num() noexcept { return 0; }
+size_t gpu_wrapper::platform_num() noexcept { return 1; }
 
 gpu_wrapper::platform_wrapper *gpu_wrapper::platform_wrapper::create(
-    size_t, int *) noexcept {
-  return nullptr;
+    size_t idx, int *errorcode) noexcept {
+  if (errorcode != nullptr) {
+    *errorcode = (idx == 0) ? 0 : 1;
+  }
+  if (idx != 0) {
+    return nullptr;
+  }
+  return new cpu_wrapper::cpu_platform;
 }
 
 void gpu_wrapper::platform_wrapper::destroy(
-    gpu_wrapper::platform_wrapper *) noexcept {
-  return;
+    gpu_wrapper::platform_wrapper *pw) noexcept {
+  delete static_cast<cpu_wrapper::cpu_platform *>(pw);
 }
 
 gpu_wrapper::device_wrapper *gpu_wrapper::device_wrapper::create(
-    platform_wrapper *, size_t, int *) noexcept {
-  return nullptr;
+    platform_wrapper *, size_t idx, int *errorcode) noexcept {
+  if (errorcode != nullptr) {
+    *errorcode = (idx == 0) ? 0 : 1;
+  }
+  if (idx != 0) {
+    return nullptr;
+  }
+  return new cpu_wrapper::cpu_device;
 }
 
-void gpu_wrapper::device_wrapper::destroy(device_wrapper *) noexcept { return; }
+void gpu_wrapper::device_wrapper::destroy(device_wrapper *dw) noexcept {
+  delete static_cast<cpu_wrapper::cpu_device *>(dw);
+}
 
 gpu_wrapper::gpu_interface *gpu_wrapper::gpu_interface::create(
-    platform_wrapper *, device_wrapper *) noexcept {
-  return nullptr;
+    platform_wrapper *pw, device_wrapper *dw) noexcept {
+  std::pair<int, std::string> temp;
+  return create(pw, dw, temp);
 }
 
 gpu_wrapper::gpu_interface *gpu_wrapper::gpu_interface::create(
-    gpu_wrapper::platform_wrapper *pw, gpu_wrapper::device_wrapper *dw,
+    gpu_wrapper::platform_wrapper *, gpu_wrapper::device_wrapper *,
     std::pair<int, std::string> &err) noexcept {
-  err.first = INT_MAX;
-  err.second = "VisualCraft is built without any GPU api.";
-  return nullptr;
+  err.first = 0;
+  err.second.clear();
+  return new cpu_wrapper::cpu_resource;
 }
 
-void gpu_wrapper::gpu_interface::destroy(gpu_interface *) noexcept { return; }
+void gpu_wrapper::gpu_interface::destroy(gpu_interface *gi) noexcept {
+  delete static_cast<cpu_wrapper::cpu_resource *>(gi);
+}
@@ -0,0 +1,158 @@
+#include "LocalDaemon.h"
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <QPointer>
+#include <fmt/format.h>
+#include <memory>
+#include <optional>
+
+namespace local_daemon {
+namespace {
+QByteArray make_frame(std::string_view payload) noexcept {
+  const auto len = static_cast<uint32_t>(payload.size());
+  QByteArray ret;
+  ret.reserve(4 + payload.size());
+  for (int i = 0; i < 4; i++) {
+    ret.push_back(static_cast<char>((len >> (8 * i)) & 0xFF));
+  }
+  ret.append(payload.data(), static_cast<qsizetype>(payload.size()));
+  return ret;
+}
+
+// Length of payload, nullopt if the header is incomplete
+std::optional<uint32_t> frame_length(const QByteArray &buffer) noexcept {
+  if (buffer.size() < 4) {
+    return std::nullopt;
+  }
+  uint32_t len = 0;
+  for (int i = 0; i < 4; i++) {
+    len |= uint32_t(static_cast<uint8_t>(buffer[i])) << (8 * i);
+  }
+  return len;
+}
+}  // namespace
+
+struct server::connection {
+  QByteArray buffer;
+  // A request of this connection is being handled
+  bool busy{false};
+};
+
+server::server(handler_t handler) noexcept : handler_{std::move(handler)} {
+  QObject::connect(&this->server_, &QLocalServer::newConnection,
+                   [this]() { this->on_new_connection(); });
+}
+
+server::~server() { this->workers_.waitForDone(); }
+
+tl::expected<void, std::string> server::listen(
+    const std::string &name) noexcept {
+  const QString qname = QString::fromLocal8Bit(name.c_str());
+  {
+    // The socket is only stale if nobody answers on it.
+    QLocalSocket probe;
+    probe.connectToServer(qname);
+    if (probe.waitForConnected(500)) {
+      probe.disconnectFromServer();
+      return tl::make_unexpected(
+          fmt::format("Another daemon is serving on \"{}\"", name));
+    }
+  }
+  QLocalServer::removeServer(qname);
+  this->server_.setSocketOptions(QLocalServer::UserAccessOption);
+  if (!this->server_.listen(qname)) {
+    return tl::make_unexpected(
+        fmt::format("Failed to listen on \"{}\": {}", name,
+                    this->server_.errorString().toLocal8Bit().data()));
+  }
+  return {};
+}
+
+void server::on_new_connection() noexcept {
+  while (QLocalSocket *socket = this->server_.nextPendingConnection()) {
+    auto conn = std::make_shared<connection>();
+    QObject::connect(socket, &QLocalSocket::disconnected, socket,
+                     &QLocalSocket::deleteLater);
+    QObject::connect(socket, &QLocalSocket::readyRead, socket, [=, this]() {
+      conn->buffer.append(socket->readAll());
+      this->dispatch(socket, conn);
+    });
+  }
+}
+
+void server::dispatch(QLocalSocket *socket,
+                      const std::shared_ptr<connection> &conn) noexcept {
+  if (conn->busy) {
+    return;
+  }
+  const auto len = frame_length(conn->buffer);
+  if (!len) {
+    return;
+  }
+  if (len.value() > max_frame_bytes) {
+    socket->abort();
+    return;
+  }
+  if (conn->buffer.size() < qsizetype(4 + len.value())) {
+    return;
+  }
+  std::string request{conn->buffer.constData() + 4, len.value()};
+  conn->buffer.remove(0, 4 + len.value());
+  conn->busy = true;
+
+  // The socket may be deleted while the request is being handled.
+  QPointer<QLocalSocket> sock{socket};
+  this->workers_.start([this, sock, conn, request = std::move(request)]() {
+    bool stop = false;
+    std::string response = this->handler_(request, stop);
+    // Sockets must be used in the thread of event loop
+    QMetaObject::invokeMethod(
+        &this->server_,
+        [this, sock, conn, stop, response = std::move(response)]() {
+          conn->busy = false;
+          if (sock != nullptr) {
+            sock->write(make_frame(response));
+            sock->flush();
+          }
+          if (stop) {
+            if (sock != nullptr) {
+              sock->waitForBytesWritten(1000);
+            }
+            QCoreApplication::quit();
+            return;
+          }
+          if (sock != nullptr) {
+            this->dispatch(sock, conn);
+          }
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+tl::expected<std::string, std::string> send_request(
+    const std::string &name, std::string_view request,
+    int timeout_ms) noexcept {
+  QLocalSocket socket;
+  socket.connectToServer(QString::fromLocal8Bit(name.c_str()));
+  if (!socket.waitForConnected(timeout_ms)) {
+    return tl::make_unexpected(
+        fmt::format("Failed to connect to \"{}\": {}", name,
+                    socket.errorString().toLocal8Bit().data()));
+  }
+  socket.write(make_frame(request));
+
+  QByteArray buffer;
+  while (true) {
+    if (auto len = frame_length(buffer);
+        len && buffer.size() >= qsizetype(4 + len.value())) {
+      return std::string{buffer.constData() + 4, len.value()};
+    }
+    if (!socket.waitForReadyRead(timeout_ms)) {
+      return tl::make_unexpected(
+          fmt::format("Failed to receive response from \"{}\": {}", name,
+                      socket.errorString().toLocal8Bit().data()));
+    }
+    buffer.append(socket.readAll());
+  }
+}
+}  // namespace local_daemon
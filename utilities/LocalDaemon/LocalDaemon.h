@@ -0,0 +1,63 @@
+#ifndef SLOPECRAFT_UTILITIES_LOCALDAEMON_LOCALDAEMON_H
+#define SLOPECRAFT_UTILITIES_LOCALDAEMON_LOCALDAEMON_H
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThreadPool>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tl/expected.hpp>
+
+// A long running process that serves requests on a local socket (unix domain
+// socket on unix, named pipe on windows). Each message in both directions is a
+// frame: the length of payload as 4 byte little endian integer, followed by
+// the payload.
+namespace local_daemon {
+
+constexpr uint32_t max_frame_bytes = 256U << 20;
+
+// Returns the response of a request. Set stop to quit the event loop after
+// the response is sent. Handlers run in worker threads and may run
+// concurrently for different connections, so they must be thread-safe.
+using handler_t =
+    std::function<std::string(std::string_view request, bool &stop)>;
+
+// Requests are handled in a thread pool, so a long request doesn't block
+// others like ping or shutdown. Requests of one connection are handled in
+// order.
+class server {
+ public:
+  explicit server(handler_t handler) noexcept;
+  // Waits for running handlers.
+  ~server();
+
+  // Fails if another daemon is serving on the name, otherwise removes the
+  // socket left by a crashed daemon before listening.
+  [[nodiscard]] tl::expected<void, std::string> listen(
+      const std::string &name) noexcept;
+
+ private:
+  struct connection;
+
+  QLocalServer server_;
+  QThreadPool workers_;
+  handler_t handler_;
+
+  void on_new_connection() noexcept;
+  // Starts handling the next complete request if the connection is idle.
+  void dispatch(QLocalSocket *socket,
+                const std::shared_ptr<connection> &conn) noexcept;
+};
+
+// Sends a request and waits for its response. Negative timeout means waiting
+// forever.
+[[nodiscard]] tl::expected<std::string, std::string> send_request(
+    const std::string &name, std::string_view request,
+    int timeout_ms = -1) noexcept;
+
+}  // namespace local_daemon
+
+#endif  // SLOPECRAFT_UTILITIES_LOCALDAEMON_LOCALDAEMON_H
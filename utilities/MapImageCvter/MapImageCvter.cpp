@@ -36,12 +36,11 @@ libMapImageCvt::MapImageCvter::MapImageCvter(
     : libImageCvt::ImageCvter<true>{basic, allowed},
       gacvter(new GACvter::GAConverter) {}
 
-void libMapImageCvt::MapImageCvter::convert_image(
+bool libMapImageCvt::MapImageCvter::convert_image(
     const ::SCL_convertAlgo algo, bool dither,
     const heu::GAOption *const opt) noexcept {
   if (algo != ::SCL_convertAlgo::gaCvter) {
-    Base_t::convert_image(algo, dither);
-    return;
+    return Base_t::convert_image(algo, dither);
   }
   // dither = false;
   constexpr int seed_num = 5;
@@ -53,7 +52,9 @@ void libMapImageCvt::MapImageCvter::convert_image(
   std::vector<const Eigen::ArrayXX<uint8_t> *> seeds(seed_num);
 
   for (int a = 0; a < seed_num; a++) {
-    Base_t::convert_image(seed_algos[a], false);
+    if (!Base_t::convert_image(seed_algos[a], false)) {
+      return false;
+    }
     cvtedmap[a] = this->mapcolor_matrix();
     seeds[a] = &cvtedmap[a];
   }
@@ -64,15 +65,18 @@ void libMapImageCvt::MapImageCvter::convert_image(
 
   gacvter->setUiPack(this->ui);
 
-  gacvter->run();
+  if (!gacvter->run()) {
+    return false;
+  }
 
   Eigen::ArrayXX<ARGB> raw_image_cache = this->raw_image_;
 
   gacvter->resultImage(&this->raw_image_);
 
-  Base_t::convert_image(::SCL_convertAlgo::RGB_Better, dither);
+  const bool ok = Base_t::convert_image(::SCL_convertAlgo::RGB_Better, dither);
 
   this->raw_image_ = raw_image_cache;
+  return ok;
 }
 
 bool libMapImageCvt::MapImageCvter::save_cache(
@@ -135,7 +139,17 @@ bool libMapImageCvt::MapImageCvter::load_cache(
 }
 
 bool libMapImageCvt::MapImageCvter::load_cache(const char *filename) noexcept {
+  std::ifstream ifs{filename, std::ios::binary};
+  if (!ifs) {  // cache file not exist
+    return false;
+  }
   MapImageCvter temp{this->basic_colorset, this->allowed_colorset};
+  try {
+    cereal::BinaryInputArchive bia{ifs};
+    bia(temp);
+  } catch (...) {  // the cache is broken
+    return false;
+  }
 
   this->load_from_itermediate(std::move(temp));
 
@@ -62,8 +62,8 @@ class MapImageCvter : public ::libImageCvt::ImageCvter<true> {
 
   ~MapImageCvter() = default;
 
-  // override
-  void convert_image(const ::SCL_convertAlgo algo, bool dither,
+  // override. Returns false if cancelled by ui.
+  bool convert_image(const ::SCL_convertAlgo algo, bool dither,
                      const heu::GAOption *const opt) noexcept;
 
   inline Eigen::ArrayXX<uint8_t> mapcolor_matrix() const noexcept {
@@ -101,6 +101,7 @@ class MapImageCvter : public ::libImageCvt::ImageCvter<true> {
   void load_from_itermediate(MapImageCvter &&temp) noexcept {
     this->raw_image_ = std::move(temp.raw_image_);
     this->algo = temp.algo;
+    this->dither = temp.dither;
     this->dithered_image_ = std::move(temp.dithered_image_);
 
     assert(this->raw_image_.rows() == this->dithered_image_.rows());
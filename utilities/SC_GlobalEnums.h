@@ -171,6 +171,10 @@ enum class SCL_errorFlag : int {
   MEMORY_ALLOCATE_FAILED = 0x12,
 
   EXPORT_SCHEM_HAS_INVALID_ENTITY = 0x13,
+  /// added in v5.4. The task is stopped by SlopeCraft::cancel_token
+  TASK_CANCELLED = 0x14,
+  /// added in v5.4. The deadline of SlopeCraft::cancel_token is reached
+  TASK_TIMED_OUT = 0x15,
 };
 
 enum class SCL_workStatus : int {
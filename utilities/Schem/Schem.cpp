@@ -29,6 +29,7 @@ This file is part of SlopeCraft.
 #include <iostream>
 #include <fmt/format.h>
 #include <set>
+#include <algorithm>
 
 #include "Schem.h"
 
@@ -414,9 +415,94 @@ tl::expected<void, std::pair<SCL_errorFlag, std::string>> Schem::pre_check(
   return {};
 }
 
+namespace {
+bool should_cancel(const cancel_checker_t &is_cancelled) noexcept {
+  return is_cancelled && is_cancelled();
+}
+
+/// Closes and removes the incomplete file of a cancelled export.
+template <bool is_nbt_compressed>
+tl::unexpected<std::pair<SCL_errorFlag, std::string>> cancel_export(
+    NBT::NBTWriter<is_nbt_compressed> &file,
+    std::string_view filename) noexcept {
+  file.close_file();
+  std::error_code ec;
+  std::filesystem::remove(filename, ec);
+  return tl::make_unexpected(
+      std::make_pair(SCL_errorFlag::TASK_CANCELLED,
+                     fmt::format("Exporting {} is cancelled", filename)));
+}
+
+struct litematic_region {
+  std::array<int64_t, 3> offset;  // xyz
+  std::array<int64_t, 3> shape;   // xyz
+  /// Local id -> global id. Regions only store blocks they contain, so a
+  /// region with fewer block types needs fewer bits per element.
+  std::vector<Schem::ele_t> palette;
+  std::vector<uint64_t> block_states;
+  std::vector<const entity *> entities;
+};
+
+/// Split [0,length) into parts ranges with almost identical length.
+std::vector<std::pair<int64_t, int64_t>> split_evenly(int64_t length,
+                                                      uint32_t parts) noexcept {
+  const int64_t num =
+      std::clamp<int64_t>(parts, 1, std::max<int64_t>(length, 1));
+  std::vector<std::pair<int64_t, int64_t>> ret;
+  ret.reserve(num);
+  for (int64_t i = 0; i < num; i++) {
+    ret.emplace_back(length * i / num, length * (i + 1) / num);
+  }
+  return ret;
+}
+
+size_t find_range_index(std::span<const std::pair<int64_t, int64_t>> ranges,
+                        double pos) noexcept {
+  for (size_t idx = 0; idx < ranges.size(); idx++) {
+    if (pos < ranges[idx].second) {
+      return idx;
+    }
+  }
+  return ranges.size() - 1;
+}
+
+void fill_litematic_region(const Schem &schem,
+                           litematic_region &region) noexcept {
+  std::vector<Schem::ele_t> global_to_local;
+  global_to_local.resize(schem.palette_size(), Schem::invalid_ele_t);
+  region.palette.clear();
+  if (not global_to_local.empty()) {
+    // keep air at 0, it's the default state of litematica
+    global_to_local[0] = 0;
+    region.palette.emplace_back(0);
+  }
+
+  std::vector<Schem::ele_t> local_ids;
+  local_ids.reserve(region.shape[0] * region.shape[1] * region.shape[2]);
+  // litematica requires y-z-x order
+  for (int64_t y = 0; y < region.shape[1]; y++) {
+    for (int64_t z = 0; z < region.shape[2]; z++) {
+      for (int64_t x = 0; x < region.shape[0]; x++) {
+        const Schem::ele_t global_id = schem(
+            x + region.offset[0], y + region.offset[1], z + region.offset[2]);
+        Schem::ele_t &local_id = global_to_local[global_id];
+        if (local_id == Schem::invalid_ele_t) {
+          local_id = static_cast<Schem::ele_t>(region.palette.size());
+          region.palette.emplace_back(global_id);
+        }
+        local_ids.emplace_back(local_id);
+      }
+    }
+  }
+
+  shrink_bits(local_ids.data(), local_ids.size(), region.palette.size(),
+              &region.block_states);
+}
+}  // namespace
+
 tl::expected<void, std::pair<SCL_errorFlag, std::string>>
-Schem::export_litematic(std::string_view filename,
-                        const litematic_info &info) const noexcept {
+Schem::export_litematic(std::string_view filename, const litematic_info &info,
+                        const cancel_checker_t &is_cancelled) const noexcept {
   //
   {
     auto res = this->pre_check(filename, ".litematic");
@@ -424,6 +510,41 @@ Schem::export_litematic(std::string_view filename,
       return res;
     }
   }
+
+  const auto x_ranges = split_evenly(this->x_range(), info.region_count_x);
+  const auto z_ranges = split_evenly(this->z_range(), info.region_count_z);
+  // regions are stored in [x][z] row-major
+  std::vector<litematic_region> regions;
+  regions.resize(x_ranges.size() * z_ranges.size());
+  for (size_t rx = 0; rx < x_ranges.size(); rx++) {
+    for (size_t rz = 0; rz < z_ranges.size(); rz++) {
+      auto &region = regions[rx * z_ranges.size() + rz];
+      region.offset = {x_ranges[rx].first, 0, z_ranges[rz].first};
+      region.shape = {x_ranges[rx].second - x_ranges[rx].first,
+                      this->y_range(),
+                      z_ranges[rz].second - z_ranges[rz].first};
+    }
+  }
+
+#pragma omp parallel for schedule(dynamic)
+  for (int64_t idx = 0; idx < int64_t(regions.size()); idx++) {
+    fill_litematic_region(*this, regions[idx]);
+  }
+
+  if (should_cancel(is_cancelled)) {
+    return tl::make_unexpected(
+        std::make_pair(SCL_errorFlag::TASK_CANCELLED,
+                       fmt::format("Exporting {} is cancelled", filename)));
+  }
+
+  for (auto &entity : this->entities) {
+    assert(entity);
+    const auto pos = entity->position();
+    const size_t rx = find_range_index(x_ranges, pos[0]);
+    const size_t rz = find_range_index(z_ranges, pos[2]);
+    regions[rx * z_ranges.size() + rz].entities.emplace_back(entity.get());
+  }
+
   NBT::NBTWriter<true> lite;
 
   if (!lite.open(filename.data())) {
@@ -448,7 +569,7 @@ Schem::export_litematic(std::string_view filename,
 
     lite.writeString("Name", info.litename_utf8.data());
 
-    lite.writeInt("RegionCount", 1);
+    lite.writeInt("RegionCount", regions.size());
     lite.writeLong("TimeCreated", info.time_created);
     lite.writeLong("TimeModified", info.time_modified);
     lite.writeInt("TotalBlocks", this->non_zero_count());
@@ -458,91 +579,103 @@ Schem::export_litematic(std::string_view filename,
 
   // progressRangeSet(wind, 0, 100 + Build.size(), 50);
 
+  // parse block ids only once, they are shared by all regions
+  using block_properties_t = std::vector<std::pair<std::string, std::string>>;
+  std::vector<std::pair<std::string, block_properties_t>> parsed_block_ids;
+  parsed_block_ids.resize(this->palette_size());
+  for (size_t idx = 0; idx < this->palette_size(); idx++) {
+    process_block_id(this->block_id_list[idx], &parsed_block_ids[idx].first,
+                     &parsed_block_ids[idx].second);
+  }
+
   lite.writeCompound("Regions");
-  {
-    lite.writeCompound(info.regionname_utf8.data());
-    {
-      lite.writeCompound("Position");
-      {
-        lite.writeInt("x", 0);
-        lite.writeInt("y", 0);
-        lite.writeInt("z", 0);
+  for (size_t rx = 0; rx < x_ranges.size(); rx++) {
+    for (size_t rz = 0; rz < z_ranges.size(); rz++) {
+      if (should_cancel(is_cancelled)) {
+        return cancel_export(lite, filename);
       }
-      lite.endCompound();
-
-      lite.writeCompound("Size");
+      const auto &region = regions[rx * z_ranges.size() + rz];
+      const std::string region_name =
+          (regions.size() == 1)
+              ? info.regionname_utf8
+              : fmt::format("{}_x{}_z{}", info.regionname_utf8, rx, rz);
+      lite.writeCompound(region_name);
       {
-        lite.writeInt("x", this->x_range());
-        lite.writeInt("y", this->y_range());
-        lite.writeInt("z", this->z_range());
-      }
-      lite.endCompound();
+        lite.writeCompound("Position");
+        {
+          lite.writeInt("x", region.offset[0]);
+          lite.writeInt("y", region.offset[1]);
+          lite.writeInt("z", region.offset[2]);
+        }
+        lite.endCompound();
 
-      // progressRangeSet(wind, 0, 100 + Build.size(), 100);
+        lite.writeCompound("Size");
+        {
+          lite.writeInt("x", region.shape[0]);
+          lite.writeInt("y", region.shape[1]);
+          lite.writeInt("z", region.shape[2]);
+        }
+        lite.endCompound();
 
-      // reportWorkingStatue(wind, workStatus::writingBlockPalette);
-      // write block palette
-      lite.writeListHead("BlockStatePalette", NBT::Compound,
-                         this->palette_size());
-      {
-        std::string pure_block_id;
-        pure_block_id.reserve(1024);
-        std::vector<std::pair<std::string, std::string>> properties;
-        properties.reserve(64);
-
-        for (const auto &block_string : this->block_id_list) {
-          process_block_id(block_string, &pure_block_id, &properties);
-          // write a block
-          lite.writeCompound("ThisStringShouldNeverBeSeen");
-          {
-            lite.writeString("Name", pure_block_id.data());
-            if (properties.size()) {
-              lite.writeCompound("Properties");
-              {
-                for (const auto &prop : properties) {
-                  lite.writeString(prop.first.data(), prop.second.data());
+        // reportWorkingStatue(wind, workStatus::writingBlockPalette);
+        // write block palette
+        lite.writeListHead("BlockStatePalette", NBT::Compound,
+                           region.palette.size());
+        {
+          for (const ele_t global_id : region.palette) {
+            const auto &[pure_block_id, properties] =
+                parsed_block_ids[global_id];
+            // write a block
+            lite.writeCompound("ThisStringShouldNeverBeSeen");
+            {
+              lite.writeString("Name", pure_block_id.data());
+              if (properties.size()) {
+                lite.writeCompound("Properties");
+                {
+                  for (const auto &prop : properties) {
+                    lite.writeString(prop.first.data(), prop.second.data());
+                  }
                 }
+                lite.endCompound();
               }
-              lite.endCompound();
             }
+            lite.endCompound();
           }
-          lite.endCompound();
         }
-      }
-
-      lite.writeListHead("PendingBlockTicks", NBT::Compound, 0);
-      lite.writeListHead("PendingFluidTicks", NBT::Compound, 0);
 
-      // write 3D
-      std::vector<uint64_t> shrinked;
-      shrink_bits(this->xzy.data(), xzy.size(), this->palette_size(),
-                  &shrinked);
+        lite.writeListHead("PendingBlockTicks", NBT::Compound, 0);
+        lite.writeListHead("PendingFluidTicks", NBT::Compound, 0);
 
-      lite.writeLongArrayHead("BlockStates", shrinked.size());
-      {
-        for (int64_t idx = 0; idx < int64_t(shrinked.size()); idx++) {
-          lite.writeSingleTag<int64_t, true>(
-              NBT::Long, "id", reinterpret_cast<int64_t &>(shrinked[idx]));
+        // write 3D
+        lite.writeLongArrayHead("BlockStates", region.block_states.size());
+        {
+          for (uint64_t val : region.block_states) {
+            lite.writeSingleTag<int64_t, true>(
+                NBT::Long, "id", reinterpret_cast<int64_t &>(val));
+          }
         }
-      }
-      // progressAdd(wind, size3D[0]);
-
-      lite.writeListHead("Entities", NBT::tagType::Compound,
-                         this->entities.size());
-      for (auto &entity : this->entities) {
-        assert(entity);
-        lite.writeCompound();
-        auto res = entity->dump(lite, this->MC_data_ver);
-        if (not res) {
+        // progressAdd(wind, size3D[0]);
+
+        // entity positions are relative to the region
+        lite.writeListHead("Entities", NBT::tagType::Compound,
+                           region.entities.size());
+        for (const entity *src : region.entities) {
+          auto moved = src->clone();
+          moved->translate({-int(region.offset[0]), -int(region.offset[1]),
+                            -int(region.offset[2])});
+          lite.writeCompound();
+          auto res = moved->dump(lite, this->MC_data_ver);
+          if (not res) {
+            lite.endCompound();
+            return tl::make_unexpected(
+                std::make_pair(SCL_errorFlag::EXPORT_SCHEM_HAS_INVALID_ENTITY,
+                               std::move(res.error())));
+          }
           lite.endCompound();
-          return tl::make_unexpected(
-              std::make_pair(SCL_errorFlag::EXPORT_SCHEM_HAS_INVALID_ENTITY,
-                             std::move(res.error())));
         }
-        lite.endCompound();
       }
+      lite.endCompound();  // end current region
     }
-    lite.endCompound();  // end current region
   }
   lite.endCompound();  // end all regions
 
@@ -578,7 +711,8 @@ Schem::export_litematic(std::string_view filename,
 
 tl::expected<void, std::pair<SCL_errorFlag, std::string>>
 Schem::export_structure(std::string_view filename,
-                        const bool is_air_structure_void) const noexcept {
+                        const bool is_air_structure_void,
+                        const cancel_checker_t &is_cancelled) const noexcept {
   //
   {
     auto res = this->pre_check(filename, ".nbt");
@@ -669,6 +803,9 @@ Schem::export_structure(std::string_view filename,
   file.writeListHead("blocks", NBT::Compound, blocks_to_write);
   {
     for (int64_t y = 0; y < y_range(); y++) {
+      if (should_cancel(is_cancelled)) {
+        return cancel_export(file, filename);
+      }
       for (int64_t z = 0; z < z_range(); z++) {
         for (int64_t x = 0; x < x_range(); x++) {
           bool should_write = false;
@@ -763,7 +900,8 @@ Schem::export_structure(std::string_view filename,
 }
 
 tl::expected<void, std::pair<SCL_errorFlag, std::string>> Schem::export_WESchem(
-    std::string_view filename, const WorldEditSchem_info &info) const noexcept {
+    std::string_view filename, const WorldEditSchem_info &info,
+    const cancel_checker_t &is_cancelled) const noexcept {
   //
   {
     auto res = this->pre_check(filename, ".schem");
@@ -820,6 +958,9 @@ tl::expected<void, std::pair<SCL_errorFlag, std::string>> Schem::export_WESchem(
   ::shrink_bytes_weSchem(
       {this->xzy.data(), static_cast<size_t>(this->xzy.size())},
       block_id_list.size(), &blockdata);
+  if (should_cancel(is_cancelled)) {
+    return cancel_export(file, filename);
+  }
   auto write_blocks = [&](const char *key) {
     std::span<const int8_t> data{reinterpret_cast<int8_t *>(blockdata.data()),
                                  blockdata.size() * sizeof(uint8_t)};
@@ -37,6 +37,7 @@ This file is part of SlopeCraft.
 #include <cereal/types/vector.hpp>
 #include <exception>
 #include <concepts>
+#include <functional>
 
 #include <boost/multi_array.hpp>
 
@@ -46,6 +47,10 @@ This file is part of SlopeCraft.
 namespace libSchem {
 // template <int64_t max_block_count = 256>
 
+/// Exports call it at coarse granularity. Once it returns true, the export
+/// removes the incomplete file and fails with TASK_CANCELLED.
+using cancel_checker_t = std::function<bool()>;
+
 struct litematic_info {
   litematic_info();
   std::string litename_utf8{"Litematic generated by SlopeCraft."};
@@ -54,6 +59,11 @@ struct litematic_info {
   std::string destricption_utf8{"This litematic is generated by SlopeCraft."};
   uint64_t time_created;   //< Miliseconds since 1970
   uint64_t time_modified;  //< Miliseconds since 1970
+  /// The structure is split evenly into region_count_x * region_count_z
+  /// regions, each of them has its own palette. Values larger than the size
+  /// on that dim are clamped, and 0 is treated as 1.
+  uint32_t region_count_x{1};
+  uint32_t region_count_z{1};
 };
 
 struct WorldEditSchem_info {
@@ -301,15 +311,16 @@ class Schem {
     }
   }
   tl::expected<void, std::pair<SCL_errorFlag, std::string>> export_litematic(
-      std::string_view filename, const litematic_info &info) const noexcept;
+      std::string_view filename, const litematic_info &info,
+      const cancel_checker_t &is_cancelled = {}) const noexcept;
 
   tl::expected<void, std::pair<SCL_errorFlag, std::string>> export_structure(
-      std::string_view filename,
-      const bool is_air_structure_void) const noexcept;
+      std::string_view filename, const bool is_air_structure_void,
+      const cancel_checker_t &is_cancelled = {}) const noexcept;
 
   tl::expected<void, std::pair<SCL_errorFlag, std::string>> export_WESchem(
-      std::string_view filename,
-      const WorldEditSchem_info &info) const noexcept;
+      std::string_view filename, const WorldEditSchem_info &info,
+      const cancel_checker_t &is_cancelled = {}) const noexcept;
 
   [[deprecated]] bool export_litematic(
       std::string_view filename, const litematic_info &info,
@@ -34,6 +34,10 @@ class entity {
   /// west = [90,0], north(again) = [180,0].
   [[nodiscard]] virtual std::array<float, 2> rotation() const noexcept = 0;
 
+  /// Move the entity by offset (xyz), used when writing entities into a
+  /// region whose origin is not (0,0,0).
+  virtual void translate(const std::array<int, 3>& offset) noexcept = 0;
+
   virtual tl::expected<size_t, std::string> dump(
       NBT::NBTWriter<true>& destination,
       MCDataVersion::MCDataVersion_t data_version) const noexcept;
@@ -63,6 +67,12 @@ class hangable : public entity {
     return ret;
   }
 
+  void translate(const std::array<int, 3>& offset) noexcept override {
+    for (size_t i = 0; i < 3; i++) {
+      this->tile_position_[i] += offset[i];
+    }
+  }
+
   std::array<float, 2> rotation() const noexcept override {
     using hfd = hangable_facing_direction;
     switch (this->direction_) {
@@ -112,12 +122,13 @@ class item_frame : public hangable {
   explicit item_frame() = default;
 
   explicit item_frame(const item_frame& src)
-      : fixed_{src.fixed_},
+      : hangable{src},
+        fixed_{src.fixed_},
         invisible_{src.invisible_},
         item_rotation{src.item_rotation},
         item_drop_chance{src.item_drop_chance},
-        variant_{src.variant_},
-        item_{src.item_->clone()} {}
+        item_{src.item_ ? src.item_->clone() : nullptr},
+        variant_{src.variant_} {}
 
   std::string_view id() const noexcept override {
     switch (this->variant_) {
@@ -28,6 +28,9 @@ public:
   void *_uiPtr{nullptr};
   void (*progressRangeSet)(void *, int, int, int){nullptr};
   void (*progressAdd)(void *, int){nullptr};
+  /// returns true if the running task should stop, called with _cancelPtr
+  bool (*cancelRequested)(const void *){nullptr};
+  const void *_cancelPtr{nullptr};
 
 public:
   inline void rangeSet(int a, int b, int c) const noexcept {
@@ -38,6 +41,9 @@ public:
     if (progressAdd != nullptr)
       progressAdd(_uiPtr, d);
   }
+  inline bool is_cancelled() const noexcept {
+    return cancelRequested != nullptr && cancelRequested(_cancelPtr);
+  }
 };
 
 #endif // SCL_UIPACK_UIPACK_H
@@ -74,5 +74,21 @@ foreach (_layers RANGE 1 3 1)
     endforeach (_ver RANGE 12 21)
 endforeach (_layers RANGE 1 3 1)
 
+# without any GPU api, --gpu selects the CPU backend, the only platform
+if (${SlopeCraft_GPU_API} STREQUAL "None")
+    foreach (_layers RANGE 1 3 1)
+        foreach (_ver RANGE 12 21)
+            foreach (_algo "RGB" "RGB_Better" "HSV" "Lab94" "Lab00" "XYZ")
+                set(test_name ${temp_testname_prefix}cpu_backend_ver=${_ver}_layer=${_layers}_algo=${_algo}_)
+                add_test(NAME ${test_name}
+                    WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+                    COMMAND vccl --img ${test_source_images} --mcver ${_ver} --face up --layers ${_layers} --algo ${_algo} -j20 --out-image --benchmark --prefix ${test_name} --gpu --platform 0 --device 0
+                    COMMAND_EXPAND_LISTS
+                )
+            endforeach (_algo)
+        endforeach (_ver RANGE 12 21)
+    endforeach (_layers RANGE 1 3 1)
+endif ()
+
 
 cmake_policy(POP)
\ No newline at end of file
@@ -57,6 +57,9 @@ int main(int argc, char **argv) {
   app.add_option("--block-state-list,--bsl", input.jsons,
                  "Block state list json files")
       ->check(CLI::ExistingFile);
+  app.add_option("--snapshot-dir,--sdir", input.snapshot_dir,
+                 "Directory to cache parsed resource for faster startup")
+      ->default_val("");
 
   // colors
   int __version;
@@ -116,6 +119,11 @@ int main(int argc, char **argv) {
                  "Col margin of split line in flat diagram. Non negative "
                  "values indicates that no splitline is drawn.")
       ->default_val(16);
+  app.add_option("--flat-diagram-block-resolution,--fdbr",
+                 input.flat_diagram_block_resolution,
+                 "Size of each block in flat diagram in pixels.")
+      ->default_val(16)
+      ->check(CLI::Range(1, 1024));
 
   app.add_flag("--litematic,--lite", input.make_litematic,
                "Export .litematic files for litematica mod")
@@ -138,6 +146,11 @@ int main(int argc, char **argv) {
                  "CPU threads used to convert images")
       ->check(CLI::PositiveNumber)
       ->default_val(std::thread::hardware_concurrency());
+  app.add_option("--kernels", input.num_kernels,
+                 "Number of images processed at the same time. 0 means "
+                 "decided automatically.")
+      ->check(CLI::NonNegativeNumber)
+      ->default_val(0);
 
   // gpu
   app.add_flag("--gpu", input.prefer_gpu, "Use gpu as much as possible")
@@ -155,6 +168,11 @@ int main(int argc, char **argv) {
                "List all avaliable GPU platforms and devices and exit")
       ->default_val(false);
 
+  // daemon
+  app.add_option("--daemon", input.daemon_name,
+                 "Keep running and serve batches on this local socket, so "
+                 "that the resource pack is parsed only once");
+
   // others
   app.add_flag("--disable-config", input.disable_config,
                "Disable default option provided by vccl-config.json")
@@ -0,0 +1,423 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "vccl_internal.h"
+#include <QImage>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fmt/format.h>
+#include <mutex>
+#include <omp.h>
+#include <optional>
+#include <thread>
+
+namespace {
+
+// A queue with limited capacity. push blocks while the queue is full, so a
+// fast stage never gets far ahead of a slow one, and the number of images in
+// memory stays bounded.
+template <typename T>
+class bounded_queue {
+ public:
+  explicit bounded_queue(size_t capacity)
+      : capacity_{std::max<size_t>(capacity, 1)} {}
+
+  void push(T &&val) noexcept {
+    std::unique_lock<std::mutex> lk{this->lock_};
+    this->not_full_.wait(
+        lk, [this]() { return this->queue_.size() < this->capacity_; });
+    this->queue_.emplace_back(std::move(val));
+    this->not_empty_.notify_one();
+  }
+
+  // Returns nullopt if the queue is closed and empty.
+  std::optional<T> pop() noexcept {
+    std::unique_lock<std::mutex> lk{this->lock_};
+    this->not_empty_.wait(
+        lk, [this]() { return !this->queue_.empty() || this->closed_; });
+    if (this->queue_.empty()) {
+      return std::nullopt;
+    }
+    T val = std::move(this->queue_.front());
+    this->queue_.pop_front();
+    this->not_full_.notify_one();
+    return val;
+  }
+
+  // No more elements will be pushed.
+  void close() noexcept {
+    std::lock_guard<std::mutex> lk{this->lock_};
+    this->closed_ = true;
+    this->not_empty_.notify_all();
+  }
+
+ private:
+  const size_t capacity_;
+  std::mutex lock_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> queue_;
+  bool closed_{false};
+};
+
+struct job_t {
+  std::string filename;
+  // output filenames are prefix + name + suffix
+  std::string name;
+  QImage image;
+  VCL_Kernel *kernel{nullptr};
+};
+
+struct stage_timer {
+  std::atomic<int64_t> microseconds{0};
+  std::atomic<int64_t> count{0};
+
+  void add(double seconds) noexcept {
+    this->microseconds += int64_t(seconds * 1e6);
+    this->count++;
+  }
+
+  void print(std::string_view stage) const noexcept {
+    const double sec = this->microseconds / 1e6;
+    const int64_t num = this->count;
+    fmt::print("{:>8} : {} images, {:.3f} seconds in total, {:.3f} ms per "
+               "image.\n",
+               stage, num, sec, num > 0 ? sec * 1000 / num : 0.0);
+  }
+};
+
+class batch_executor {
+ public:
+  batch_executor(const inputs &input, std::span<VCL_Kernel *const> kernels,
+                 std::vector<std::string> *outputs)
+      : input_{input},
+        outputs_{outputs},
+        free_kernels_{kernels.size()},
+        decoded_{kernels.size()},
+        converted_{kernels.size()},
+        built_{kernels.size()} {
+    for (VCL_Kernel *kernel : kernels) {
+      this->free_kernels_.push(std::move(kernel));
+    }
+  }
+
+  int run() noexcept;
+
+ private:
+  const inputs &input_;
+  std::vector<std::string> *const outputs_;
+  std::mutex outputs_lock_;
+  // Each image in convert, build or export stage holds a kernel, so the
+  // number of kernels limits the images in flight.
+  bounded_queue<VCL_Kernel *> free_kernels_;
+  bounded_queue<job_t> decoded_;
+  bounded_queue<job_t> converted_;
+  bounded_queue<job_t> built_;
+
+  std::atomic<size_t> next_image_{0};
+  // line number of the first error, 0 if no error
+  std::atomic<int> error_line_{0};
+
+  stage_timer time_decode_;
+  stage_timer time_convert_;
+  stage_timer time_build_;
+  stage_timer time_export_;
+
+  void set_error(int line) noexcept {
+    int expected = 0;
+    this->error_line_.compare_exchange_strong(expected, line);
+  }
+
+  void add_output(const std::string &filename) noexcept {
+    if (this->outputs_ != nullptr) {
+      std::lock_guard<std::mutex> lk{this->outputs_lock_};
+      this->outputs_->emplace_back(filename);
+    }
+  }
+
+  void release_kernel(job_t &job) noexcept {
+    if (job.kernel != nullptr) {
+      this->free_kernels_.push(std::move(job.kernel));
+      job.kernel = nullptr;
+    }
+  }
+
+  // Run fun on num_threads threads, each of them uses omp_threads openmp
+  // threads. fun returns false if the stage fails and the image should be
+  // dropped. The last thread closes out.
+  template <typename fun_t>
+  void start_stage(std::vector<std::thread> &threads, int num_threads,
+                   int omp_threads, bounded_queue<job_t> *in,
+                   bounded_queue<job_t> *out, fun_t fun) noexcept;
+
+  void decode_loop() noexcept;
+  bool convert(job_t &) noexcept;
+  bool build(job_t &) noexcept;
+  bool export_all(job_t &) noexcept;
+};
+
+template <typename fun_t>
+void batch_executor::start_stage(std::vector<std::thread> &threads,
+                                 int num_threads, int omp_threads,
+                                 bounded_queue<job_t> *in,
+                                 bounded_queue<job_t> *out,
+                                 fun_t fun) noexcept {
+  auto running = std::make_shared<std::atomic<int>>(num_threads);
+  for (int t = 0; t < num_threads; t++) {
+    threads.emplace_back([this, in, out, fun, running, omp_threads]() {
+      omp_set_num_threads(omp_threads);
+      while (auto job = in->pop()) {
+        if (!fun(job.value())) {
+          this->release_kernel(job.value());
+          continue;
+        }
+        if (out != nullptr) {
+          out->push(std::move(job.value()));
+        } else {
+          this->release_kernel(job.value());
+        }
+      }
+      if (--*running == 0 && out != nullptr) {
+        out->close();
+      }
+    });
+  }
+}
+
+void batch_executor::decode_loop() noexcept {
+  while (true) {
+    const size_t idx = this->next_image_++;
+    if (idx >= this->input_.images.size()) {
+      return;
+    }
+    job_t job;
+    job.filename = this->input_.images[idx];
+    job.name = std::filesystem::path(job.filename)
+                   .filename()
+                   .replace_extension("")
+                   .string();
+
+    double wt = omp_get_wtime();
+    job.image = QImage(QString::fromLocal8Bit(job.filename.c_str()));
+    if (!job.image.isNull()) {
+      job.image = job.image.convertToFormat(QImage::Format::Format_ARGB32);
+    }
+    wt = omp_get_wtime() - wt;
+
+    if (job.image.isNull()) {
+      fmt::print("Failed to open image {}\n", job.filename);
+      this->set_error(__LINE__);
+      continue;
+    }
+    this->time_decode_.add(wt);
+    this->decoded_.push(std::move(job));
+  }
+}
+
+bool batch_executor::convert(job_t &job) noexcept {
+  // blocks until a kernel is free
+  job.kernel = this->free_kernels_.pop().value_or(nullptr);
+  if (job.kernel == nullptr) {
+    return false;
+  }
+
+  double wt = omp_get_wtime();
+  if (!job.kernel->set_image(job.image.height(), job.image.width(),
+                             (const uint32_t *)job.image.scanLine(0), true)) {
+    fmt::print("Failed to set raw image {} to kernel.\n", job.filename);
+    this->set_error(__LINE__);
+    return false;
+  }
+  if (!this->input_.make_converted_image) {
+    // the kernel keeps a copy
+    job.image = QImage{};
+  }
+
+  if (!job.kernel->convert(this->input_.algo, this->input_.dither)) {
+    fmt::print("Failed to convert image {}.\n", job.filename);
+    this->set_error(__LINE__);
+    return false;
+  }
+  this->time_convert_.add(omp_get_wtime() - wt);
+  return true;
+}
+
+bool batch_executor::build(job_t &job) noexcept {
+  if (!this->input_.need_to_build()) {
+    return true;
+  }
+  double wt = omp_get_wtime();
+  if (!job.kernel->build()) {
+    fmt::print("Failed to build {}.\n", job.filename);
+    this->set_error(__LINE__);
+    return false;
+  }
+  this->time_build_.add(omp_get_wtime() - wt);
+  return true;
+}
+
+bool batch_executor::export_all(job_t &job) noexcept {
+  const inputs &input = this->input_;
+  VCL_Kernel *const kernel = job.kernel;
+  const std::string prefix = input.prefix + job.name;
+  double wt = omp_get_wtime();
+
+  auto report_failure = [this](const std::string &filename, int line) {
+    fmt::println("Failed to export {}.", filename);
+    this->set_error(line);
+    return false;
+  };
+
+  if (input.make_converted_image) {
+    const std::string filename = prefix + "_converted.png";
+    memset(job.image.scanLine(0), 0,
+           job.image.height() * job.image.width() * sizeof(uint32_t));
+    kernel->converted_image((uint32_t *)job.image.scanLine(0), nullptr,
+                            nullptr, true);
+    if (!job.image.save(QString::fromLocal8Bit(filename.c_str()))) {
+      return report_failure(filename, __LINE__);
+    }
+    this->add_output(filename);
+  }
+
+  if (input.make_flat_diagram) {
+    for (uint8_t layer = 0; layer < input.layers; layer++) {
+      const std::string filename =
+          fmt::format("{}_flagdiagram_layer={}.png", prefix, layer);
+
+      VCL_Kernel::flag_diagram_option option;
+      option.row_start = 0;
+      option.row_end = kernel->rows();
+      option.split_line_row_margin = input.flat_diagram_splitline_margin_row;
+      option.split_line_col_margin = input.flat_diagram_splitline_margin_col;
+      option.block_resolution = input.flat_diagram_block_resolution;
+      if (!kernel->export_flag_diagram(filename.c_str(), option, layer)) {
+        return report_failure(filename, __LINE__);
+      }
+      this->add_output(filename);
+    }
+  }
+
+  if (input.make_litematic) {
+    const std::string filename = prefix + ".litematic";
+    if (!kernel->export_litematic(filename.c_str(), "Genereated by VCCL",
+                                  "VCCL is part of SlopeCraft")) {
+      return report_failure(filename, __LINE__);
+    }
+    this->add_output(filename);
+  }
+
+  if (input.make_schematic) {
+    const std::string filename = prefix + ".schem";
+    if (!kernel->export_WESchem(filename.data(), {0, 0, 0}, {0, 0, 0},
+                                "Genereated by VCCL")) {
+      return report_failure(filename, __LINE__);
+    }
+    this->add_output(filename);
+  }
+
+  if (input.make_structure) {
+    const std::string filename = prefix + ".nbt";
+    if (!kernel->export_structure(filename.c_str(),
+                                  input.structure_is_air_void)) {
+      return report_failure(filename, __LINE__);
+    }
+    this->add_output(filename);
+  }
+
+  this->time_export_.add(omp_get_wtime() - wt);
+  return true;
+}
+
+int batch_executor::run() noexcept {
+  const size_t num_images = this->input_.images.size();
+  const int num_kernels = this->input_.num_kernels;
+  const int num_threads = std::max<int>(this->input_.num_threads, 1);
+  // Decoding is single threaded. Other stages use openmp, and each image in
+  // them holds a kernel, so they run up to num_kernels images at a time and
+  // share the threads among them.
+  const int num_decoders = std::clamp<int>(num_threads / 4, 1, num_kernels);
+  const int num_exporters = num_kernels;
+  const int num_workers = std::clamp<int>(num_threads, 1, num_kernels);
+  const int omp_threads_per_worker = std::max(num_threads / num_workers, 1);
+
+  const double wt = omp_get_wtime();
+  std::vector<std::thread> threads;
+  {
+    auto running = std::make_shared<std::atomic<int>>(num_decoders);
+    for (int t = 0; t < num_decoders; t++) {
+      threads.emplace_back([this, running]() {
+        this->decode_loop();
+        if (--*running == 0) {
+          this->decoded_.close();
+        }
+      });
+    }
+  }
+  this->start_stage(threads, num_workers, omp_threads_per_worker,
+                    &this->decoded_, &this->converted_,
+                    [this](job_t &job) { return this->convert(job); });
+  this->start_stage(threads, num_workers, omp_threads_per_worker,
+                    &this->converted_, &this->built_,
+                    [this](job_t &job) { return this->build(job); });
+  this->start_stage(threads, num_exporters, omp_threads_per_worker,
+                    &this->built_, nullptr,
+                    [this](job_t &job) { return this->export_all(job); });
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (this->input_.benchmark) {
+    fmt::print("Processed {} images with {} kernels in {} seconds.\n",
+               num_images, num_kernels, omp_get_wtime() - wt);
+    this->time_decode_.print("decode");
+    this->time_convert_.print("convert");
+    if (this->input_.need_to_build()) {
+      this->time_build_.print("build");
+    }
+    this->time_export_.print("export");
+  }
+  return this->error_line_;
+}
+}  // namespace
+
+int run_batch(const inputs &input, std::span<VCL_Kernel *const> kernels,
+              std::vector<std::string> *outputs) noexcept {
+  if (kernels.empty() || input.images.empty()) {
+    return 0;
+  }
+  if (!input.need_to_read()) {
+    // nothing is produced from images, so don't decode them
+    fmt::print("No output is required, {} images are skipped.\n",
+               input.images.size());
+    return 0;
+  }
+  inputs input_copy = input;
+  input_copy.num_kernels = kernels.size();
+  batch_executor executor{input_copy, kernels, outputs};
+  return executor.run();
+}
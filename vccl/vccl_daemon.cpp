@@ -0,0 +1,258 @@
+/*
+ Copyright © 2021-2023  TokiNoBug
+This file is part of SlopeCraft.
+
+    SlopeCraft is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SlopeCraft is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SlopeCraft. If not, see <https://www.gnu.org/licenses/>.
+
+    Contact with me:
+    github:https://github.com/SlopeCraft/SlopeCraft
+    bilibili:https://space.bilibili.com/351429231
+*/
+
+#include "vccl_internal.h"
+#include <LocalDaemon.h>
+#include <QCoreApplication>
+#include <algorithm>
+#include <atomic>
+#include <fmt/format.h>
+#include <json.hpp>
+#include <magic_enum.hpp>
+#include <map>
+#include <mutex>
+
+using std::cout, std::endl;
+
+namespace {
+using njson = nlohmann::json;
+
+// Kernels created for a resource option that differs from the one at startup
+struct kernel_set {
+  std::vector<VCL_Kernel *> kernels;
+  uint64_t last_used{0};
+
+  kernel_set() = default;
+  kernel_set(const kernel_set &) = delete;
+  kernel_set(kernel_set &&) = default;
+  ~kernel_set() {
+    for (VCL_Kernel *k : this->kernels) {
+      VCL_destroy_kernel(k);
+    }
+  }
+};
+
+class daemon_state {
+ public:
+  daemon_state(const inputs &input, std::span<VCL_Kernel *const> kernels)
+      : input_{input}, default_kernels_{kernels} {}
+
+  std::string handle_request(std::string_view request, bool &stop) noexcept;
+
+ private:
+  // Kernels of other options use resource contexts, and the least recently
+  // used ones are destroyed beyond this number.
+  static constexpr size_t max_cached_sets = 4;
+
+  const inputs &input_;
+  // Kernels of the startup option, they use the global resource.
+  const std::span<VCL_Kernel *const> default_kernels_;
+
+  // Runs share kernels, so they are serialized.
+  std::mutex run_lock_;
+  std::map<std::string, kernel_set> cached_sets_;
+  // size of cached_sets_, so that status doesn't wait for runs
+  std::atomic<size_t> num_cached_sets_{0};
+  uint64_t clock_{0};
+
+  std::string run_request(const njson &req) noexcept(false);
+  std::span<VCL_Kernel *const> kernels_of(const inputs &in) noexcept(false);
+};
+
+std::string resource_key(const inputs &in) noexcept {
+  return fmt::format("{}|{}|{}|{}", int(in.face), int(in.layers),
+                     int(in.biome), in.leaves_transparent);
+}
+
+std::span<VCL_Kernel *const> daemon_state::kernels_of(
+    const inputs &in) noexcept(false) {
+  const std::string key = resource_key(in);
+  if (key == resource_key(this->input_)) {
+    return this->default_kernels_;
+  }
+  this->clock_++;
+  if (auto it = this->cached_sets_.find(key); it != this->cached_sets_.end()) {
+    it->second.last_used = this->clock_;
+    return it->second.kernels;
+  }
+
+  const VCL_resource_pack *rp = VCL_get_resource_pack();
+  const VCL_block_state_list *bsl = VCL_get_block_state_list();
+  if (rp == nullptr || bsl == nullptr) {
+    throw std::runtime_error{
+        "The resource is loaded from a snapshot, so only the face, layers, "
+        "biome and leaves of startup are supported"};
+  }
+
+  VCL_set_resource_option option;
+  option.version = in.version;
+  option.max_block_layers = in.layers;
+  option.exposed_face = in.face;
+  option.biome = in.biome;
+  option.is_render_quality_fast = !in.leaves_transparent;
+
+  VCL_resource_context *base = VCL_create_resource_context(rp, bsl, option);
+  if (base == nullptr) {
+    throw std::runtime_error{"Failed to create resource context"};
+  }
+  std::vector<const VCL_block *> blocks;
+  const VCL_block_state_list *ctx_bsl =
+      VCL_resource_context_block_state_list(base);
+  blocks.resize(VCL_get_blocks_from_block_state_list_match_const(
+      ctx_bsl, in.version, in.face, nullptr, 0));
+  VCL_get_blocks_from_block_state_list_match_const(
+      ctx_bsl, in.version, in.face, blocks.data(), blocks.size());
+  VCL_resource_context *ctx = VCL_create_resource_context_with_allowed_blocks(
+      base, blocks.data(), blocks.size());
+  VCL_destroy_resource_context(base);
+  if (ctx == nullptr) {
+    throw std::runtime_error{"Failed to set allowed blocks"};
+  }
+
+  kernel_set set;
+  set.last_used = this->clock_;
+  // kernels keep the context alive
+  for (size_t i = 0; i < this->default_kernels_.size(); i++) {
+    VCL_Kernel *kernel = VCL_create_kernel_with_context(ctx);
+    if (kernel == nullptr || setup_kernel(kernel, in) != 0) {
+      if (kernel != nullptr) {
+        VCL_destroy_kernel(kernel);
+      }
+      VCL_destroy_resource_context(ctx);
+      throw std::runtime_error{"Failed to create kernel"};
+    }
+    set.kernels.emplace_back(kernel);
+  }
+  VCL_destroy_resource_context(ctx);
+
+  if (this->cached_sets_.size() >= max_cached_sets) {
+    auto lru = std::min_element(this->cached_sets_.begin(),
+                                this->cached_sets_.end(),
+                                [](const auto &a, const auto &b) {
+                                  return a.second.last_used <
+                                         b.second.last_used;
+                                });
+    this->cached_sets_.erase(lru);
+  }
+  auto it = this->cached_sets_.emplace(key, std::move(set)).first;
+  this->num_cached_sets_ = this->cached_sets_.size();
+  return it->second.kernels;
+}
+
+std::string daemon_state::run_request(const njson &req) noexcept(false) {
+  const inputs &input = this->input_;
+  inputs in = input;
+  in.images = req.at("images").get<std::vector<std::string>>();
+  in.prefix = req.value("prefix", input.prefix);
+  if (req.contains("algo")) {
+    bool ok = false;
+    in.algo = str_to_algo(req.at("algo").get<std::string>(), ok);
+    if (!ok) {
+      throw std::runtime_error{"Invalid algo"};
+    }
+  }
+  if (req.contains("face")) {
+    bool ok = false;
+    in.face = VCL_str_to_face_t(req.at("face").get<std::string>().c_str(), &ok);
+    if (!ok) {
+      throw std::runtime_error{"Invalid face"};
+    }
+  }
+  if (req.contains("biome")) {
+    auto biome =
+        magic_enum::enum_cast<VCL_biome_t>(req.at("biome").get<std::string>());
+    if (!biome) {
+      throw std::runtime_error{"Invalid biome"};
+    }
+    in.biome = biome.value();
+  }
+  in.layers = req.value("layers", input.layers);
+  if (in.layers < 1 || in.layers > 3) {
+    throw std::runtime_error{"Invalid layers"};
+  }
+  in.leaves_transparent =
+      req.value("leaves_transparent", input.leaves_transparent);
+  in.dither = req.value("dither", input.dither);
+  in.make_converted_image = req.value("out_image", input.make_converted_image);
+  in.make_flat_diagram = req.value("flat_diagram", input.make_flat_diagram);
+  in.make_litematic = req.value("litematic", input.make_litematic);
+  in.make_schematic = req.value("schematic", input.make_schematic);
+  in.make_structure = req.value("structure", input.make_structure);
+
+  std::vector<std::string> files;
+  int ret = 0;
+  {
+    std::lock_guard<std::mutex> lk{this->run_lock_};
+    ret = run_batch(in, this->kernels_of(in), &files);
+  }
+  njson jo;
+  jo["success"] = (ret == 0);
+  jo["exit_code"] = ret;
+  jo["files"] = files;
+  return jo.dump();
+}
+
+std::string daemon_state::handle_request(std::string_view request,
+                                         bool &stop) noexcept {
+  njson jo;
+  try {
+    const njson req = njson::parse(request);
+    const std::string type = req.at("type");
+    if (type == "run") {
+      return this->run_request(req);
+    }
+    if (type == "shutdown") {
+      stop = true;
+    } else if (type == "status") {
+      jo["kernels"] = this->default_kernels_.size();
+      jo["colors"] = VCL_get_allowed_colors(nullptr, 0);
+      jo["cached_resources"] = this->num_cached_sets_.load();
+    } else if (type != "ping") {
+      throw std::runtime_error{
+          fmt::format("Unknown request type \"{}\"", type)};
+    }
+    jo["success"] = true;
+    jo["exit_code"] = 0;
+  } catch (const std::exception &e) {
+    jo["success"] = false;
+    jo["exit_code"] = __LINE__;
+    jo["error"] = fmt::format("Invalid request: {}", e.what());
+  }
+  return jo.dump();
+}
+}  // namespace
+
+int run_daemon(const inputs &input,
+               std::span<VCL_Kernel *const> kernels) noexcept {
+  daemon_state state{input, kernels};
+  local_daemon::server server{
+      [&state](std::string_view request, bool &stop) {
+        return state.handle_request(request, stop);
+      }};
+  if (auto ret = server.listen(input.daemon_name); !ret) {
+    cout << ret.error() << endl;
+    return __LINE__;
+  }
+  cout << "vccl daemon is serving on \"" << input.daemon_name << '\"' << endl;
+  QCoreApplication::exec();
+  return 0;
+}
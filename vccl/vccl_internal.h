@@ -26,6 +26,7 @@ This file is part of SlopeCraft.
 #include <VisualCraftL.h>
 #include <iostream>
 #include <map>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -35,6 +36,7 @@ struct inputs {
   // resource
   std::vector<std::string> zips;
   std::vector<std::string> jsons;
+  std::string snapshot_dir{""};
 
   // colors
   SCL_gameVersion version;
@@ -54,12 +56,14 @@ struct inputs {
   bool make_flat_diagram{false};
   int flat_diagram_splitline_margin_row{16};
   int flat_diagram_splitline_margin_col{16};
+  int flat_diagram_block_resolution{16};
   bool make_litematic{false};
   bool make_schematic{false};
   bool make_structure{false};
   bool structure_is_air_void{true};
 
-  inline bool need_to_read() const noexcept { return true; }
+  // images are only used for converting
+  inline bool need_to_read() const noexcept { return this->need_to_convert(); }
 
   inline bool need_to_convert() const noexcept {
     return this->make_converted_image || this->make_flat_diagram ||
@@ -70,6 +74,8 @@ struct inputs {
   }
   // compute
   uint16_t num_threads;
+  // 0 means decided by the number of images and threads
+  uint16_t num_kernels{0};
   bool benchmark{false};
 
   // gpu
@@ -86,11 +92,25 @@ struct inputs {
   bool list_models{false};
   bool list_textures{false};
   bool export_test_lite{false};
+
+  // daemon
+  std::string daemon_name{""};
 };
 
 int run(const inputs &input) noexcept;
 int set_resource(VCL_Kernel *kernel, const inputs &input) noexcept;
 int set_allowed(VCL_block_state_list *bsl, const inputs &input) noexcept;
+// Sets gpu resource and ui callbacks of a new kernel.
+int setup_kernel(VCL_Kernel *kernel, const inputs &input) noexcept;
+// Convert, build and export images in a pipeline. Each kernel processes one
+// image at a time. Exported filenames are appended to outputs if it's not
+// nullptr.
+int run_batch(const inputs &input, std::span<VCL_Kernel *const> kernels,
+              std::vector<std::string> *outputs = nullptr) noexcept;
+// Keep the resource, allowed blocks and kernels, and serve batches on
+// input.daemon_name until a shutdown request.
+int run_daemon(const inputs &input,
+               std::span<VCL_Kernel *const> kernels) noexcept;
 
 SCL_convertAlgo str_to_algo(std::string_view str, bool &ok) noexcept;
 
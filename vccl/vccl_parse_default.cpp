@@ -21,9 +21,8 @@ This file is part of SlopeCraft.
 */
 
 #include "vccl_internal.h"
-#include <QImage>
 #include <QImageReader>
-#include <filesystem>
+#include <algorithm>
 #include <fmt/format.h>
 #include <fstream>
 #include <omp.h>
@@ -88,6 +87,26 @@ int set_resource(VCL_Kernel *kernel, const inputs &input) noexcept {
     json_filenames.emplace_back(str.c_str());
   }
 
+  VCL_set_resource_option option;
+  option.version = input.version;
+  option.max_block_layers = input.layers;
+  option.exposed_face = input.face;
+  option.biome = input.biome;
+  option.is_render_quality_fast = !input.leaves_transparent;
+
+  const bool list_resource =
+      input.list_blockstates || input.list_models || input.list_textures;
+  if (!input.snapshot_dir.empty() && !list_resource) {
+    if (!VCL_set_resource_with_snapshot(
+            zip_filenames.size(), zip_filenames.data(), json_filenames.size(),
+            json_filenames.data(), option, input.snapshot_dir.c_str())) {
+      cout << "Failed to set resource pack" << endl;
+      VCL_destroy_kernel(kernel);
+      return __LINE__;
+    }
+    return 0;
+  }
+
   VCL_block_state_list *bsl =
       VCL_create_block_state_list(json_filenames.size(), json_filenames.data());
 
@@ -107,18 +126,11 @@ int set_resource(VCL_Kernel *kernel, const inputs &input) noexcept {
     return __LINE__;
   }
 
-  if (input.list_blockstates || input.list_models || input.list_textures) {
+  if (list_resource) {
     VCL_display_resource_pack(rp, input.list_textures, input.list_blockstates,
                               input.list_models);
   }
 
-  VCL_set_resource_option option;
-  option.version = input.version;
-  option.max_block_layers = input.layers;
-  option.exposed_face = input.face;
-  option.biome = input.biome;
-  option.is_render_quality_fast = !input.leaves_transparent;
-
   if (!VCL_set_resource_move(&rp, &bsl, option)) {
     cout << "Failed to set resource pack" << endl;
     VCL_destroy_block_state_list(bsl);
@@ -162,22 +174,7 @@ void list_supported_formats() noexcept {
   cout << endl;
 }
 
-int run(const inputs &input) noexcept {
-  double wt = 0;
-
-  if (input.zips.size() <= 0 || input.jsons.size() <= 0) {
-    cout << "No zips or jsons provided. exit." << endl;
-    return __LINE__;
-  }
-
-  VCL_Kernel *kernel = VCL_create_kernel();
-  if (kernel == nullptr) {
-    cout << "Failed to create kernel." << endl;
-    return __LINE__;
-  }
-
-  // cout << "algo = " << (char)input.algo << endl;
-
+int setup_kernel(VCL_Kernel *kernel, const inputs &input) noexcept {
   kernel->set_prefer_gpu(input.prefer_gpu);
   if (input.prefer_gpu) {
     bool ok;
@@ -208,15 +205,51 @@ int run(const inputs &input) noexcept {
            << endl;
       return __LINE__;
     }
+  }
 
-    if (input.show_gpu) {
-      kernel->show_gpu_name();
-    }
+  kernel->set_ui(nullptr, cb_progress_range_set, cb_progress_add);
+  return 0;
+}
+
+namespace {
+int num_kernels_of(const inputs &input) noexcept {
+  if (input.num_kernels > 0) {
+    return input.num_kernels;
   }
+  // a daemon doesn't know the number of images in advance
+  if (!input.daemon_name.empty()) {
+    return 4;
+  }
+  // A few kernels are enough to keep every stage busy, while convert and
+  // build of each image are already parallel.
+  return std::clamp<int>(input.images.size(), 1, 4);
+}
+}  // namespace
 
-  omp_set_num_threads(input.num_threads);
+int run(const inputs &input) noexcept {
+  double wt = 0;
 
-  kernel->set_ui(nullptr, cb_progress_range_set, cb_progress_add);
+  if (input.zips.size() <= 0 || input.jsons.size() <= 0) {
+    cout << "No zips or jsons provided. exit." << endl;
+    return __LINE__;
+  }
+
+  VCL_Kernel *kernel = VCL_create_kernel();
+  if (kernel == nullptr) {
+    cout << "Failed to create kernel." << endl;
+    return __LINE__;
+  }
+
+  // cout << "algo = " << (char)input.algo << endl;
+
+  if (const int ret = setup_kernel(kernel, input); ret != 0) {
+    return ret;
+  }
+  if (input.prefer_gpu && input.show_gpu) {
+    kernel->show_gpu_name();
+  }
+
+  omp_set_num_threads(input.num_threads);
 
   {
     wt = omp_get_wtime();
@@ -261,178 +294,32 @@ int run(const inputs &input) noexcept {
     }
   }
 
-  for (const auto &img_filename : input.images) {
-    const std::string pure_filename_no_extension =
-        std::filesystem::path(img_filename)
-            .filename()
-            .replace_extension("")
-            .string();
-    if (!input.need_to_read()) {
-      continue;
-    }
-
-    QImage img(QString::fromLocal8Bit(img_filename.c_str()));
-
-    if (img.isNull()) {
-      fmt::print("Failed to open image {}\n", img_filename);
-      VCL_destroy_kernel(kernel);
-      return __LINE__;
-    }
-
-    img = img.convertToFormat(QImage::Format::Format_ARGB32);
-
-    if (img.isNull()) {
-      return __LINE__;
-    }
-    if (!kernel->set_image(img.height(), img.width(),
-                           (const uint32_t *)img.scanLine(0), true)) {
-      cout << "Failed to set raw image to kernel." << endl;
-      return __LINE__;
-    }
-
-    if (!input.need_to_convert()) {
-      continue;
-    }
-
-    wt = omp_get_wtime();
-    if (!kernel->convert(input.algo, input.dither)) {
-      cout << "Failed to convert image." << endl;
-      return __LINE__;
-    }
-    wt = omp_get_wtime() - wt;
-
-    if (input.benchmark) {
-      fmt::print("Converted {} pixels in {} seconds.\n",
-                 img.height() * img.width(), wt);
-    }
-
-    if (input.make_converted_image) {
-      std::string dst_name_str(input.prefix);
-      dst_name_str += pure_filename_no_extension + "_converted.png";
-
-      memset(img.scanLine(0), 0, img.height() * img.width() * sizeof(uint32_t));
-
-      kernel->converted_image((uint32_t *)img.scanLine(0), nullptr, nullptr,
-                              true);
-
-      const bool ok = img.save(QString::fromLocal8Bit(dst_name_str.c_str()));
-
-      if (!ok) {
-        fmt::print("Failed to save image {}\n", dst_name_str);
-        return __LINE__;
-      }
-      // cout << dst_path << endl;
-    }
-
-    if (input.make_flat_diagram) {
-      double wtime[3];
-      for (uint8_t layer = 0; layer < input.layers; layer++) {
-        std::string dst_name_str(input.prefix);
-        dst_name_str += pure_filename_no_extension;
-        dst_name_str += "_flagdiagram_layer=";
-        dst_name_str += std::to_string(layer);
-        dst_name_str += ".png";
-
-        VCL_Kernel::flag_diagram_option option;
-        option.row_start = 0;
-        option.row_end = kernel->rows();
-        option.split_line_row_margin = input.flat_diagram_splitline_margin_row;
-        option.split_line_col_margin = input.flat_diagram_splitline_margin_col;
-        wtime[layer] = omp_get_wtime();
-        if (!kernel->export_flag_diagram(dst_name_str.c_str(), option, layer)) {
-          fmt::print("Failed to export flat diagram {}\n", dst_name_str);
-          return __LINE__;
-        }
-        wtime[layer] = omp_get_wtime() - wtime[layer];
-      }
-
-      if (input.benchmark) {
-        fmt::print("Export flatdiagram containing {} images in ", input.layers);
-        for (int i = 0; i < input.layers; i++) {
-          cout << wtime[i] << ", ";
-        }
-        cout << " seconds.\n";
-      }
-    }
-
-    if (!input.need_to_build()) {
-      continue;
-    }
-
-    wt = omp_get_wtime();
-    if (!kernel->build()) {
-      cout << "Failed to build " << endl;
-      return __LINE__;
-    }
-    wt = omp_get_wtime() - wt;
-
-    if (input.benchmark) {
-      fmt::print("Built {} blocks in {} seconds.\n", kernel->xyz_size(), wt);
-    }
-
-    if (input.make_litematic) {
-      const std::string filename =
-          input.prefix + pure_filename_no_extension + ".litematic";
-
-      wt = omp_get_wtime();
-      const bool success = kernel->export_litematic(
-          filename.c_str(), "Genereated by VCCL", "VCCL is part of SlopeCraft");
-      wt = omp_get_wtime() - wt;
-
-      if (!success) {
-        fmt::println("Failed to export {}.", filename);
-        return __LINE__;
-      }
-
-      if (input.benchmark) {
-        fmt::println("Export litematic with {} blocks in {} seconds.",
-                     kernel->xyz_size(), wt);
-      }
-    }
-
-    if (input.make_schematic) {
-      const std::string filename =
-          input.prefix + pure_filename_no_extension + ".schem";
-
-      wt = omp_get_wtime();
-      const bool success = kernel->export_WESchem(
-          filename.data(), {0, 0, 0}, {0, 0, 0}, "Genereated by VCCL");
-      wt = omp_get_wtime() - wt;
-
-      if (!success) {
-        fmt::println("Failed to export {}.", filename);
-        return __LINE__;
-      }
-
-      if (input.benchmark) {
-        fmt::print("Export WE schem with {} blocks in {} seconds.\n",
-                   kernel->xyz_size(), wt);
-      }
+  std::vector<VCL_Kernel *> kernels{kernel};
+  const int num_kernels = num_kernels_of(input);
+  int ret = 0;
+  while (int(kernels.size()) < num_kernels && ret == 0) {
+    kernels.emplace_back(VCL_create_kernel());
+    if (kernels.back() == nullptr) {
+      kernels.pop_back();
+      cout << "Failed to create kernel." << endl;
+      ret = __LINE__;
+      break;
     }
+    ret = setup_kernel(kernels.back(), input);
+  }
 
-    if (input.make_structure) {
-      const std::string filename =
-          input.prefix + pure_filename_no_extension + ".nbt";
-
-      wt = omp_get_wtime();
-      const bool success = kernel->export_structure(
-          filename.c_str(), input.structure_is_air_void);
-      wt = omp_get_wtime() - wt;
-
-      if (!success) {
-        fmt::println("Failed to export {}.", filename);
-        return __LINE__;
-      }
+  if (ret == 0) {
+    ret = input.daemon_name.empty() ? run_batch(input, kernels)
+                                    : run_daemon(input, kernels);
+  }
 
-      if (input.benchmark) {
-        fmt::print(
-            "Export vanilla structure file with {} blocks in {} seconds.\n",
-            kernel->xyz_size(), wt);
-      }
-    }
+  for (VCL_Kernel *k : kernels) {
+    VCL_destroy_kernel(k);
+  }
+  if (ret != 0) {
+    return ret;
   }
-  VCL_destroy_kernel(kernel);
   cout << "success." << endl;
 
   return 0;
-}
\ No newline at end of file
+}